@@ -15,6 +15,30 @@
 
 namespace leveldb {
 
+// Start the sequence range and counts of *meta for a new table
+static void ResetFileStats(FileMetaData* meta) {
+  meta->smallest_seq = kMaxSequenceNumber;
+  meta->largest_seq = 0;
+  meta->num_entries = 0;
+  meta->num_deletions = 0;
+}
+
+// Widen [meta->smallest_seq, meta->largest_seq] to include "key", and
+// count it among the entries of the table
+static void UpdateFileStats(FileMetaData* meta, const Slice& key) {
+  const SequenceNumber seq = ExtractSequence(key);
+  if (seq < meta->smallest_seq) {
+    meta->smallest_seq = seq;
+  }
+  if (seq > meta->largest_seq) {
+    meta->largest_seq = seq;
+  }
+  meta->num_entries++;
+  if (ExtractValueType(key) == kTypeDeletion) {
+    meta->num_deletions++;
+  }
+}
+
 // Finish and check for file errors
 void FinishFileCompletion(Status s,
 		FileMetaData meta,
@@ -49,7 +73,7 @@ void AddFilterString(FileLevelFilterBuilder* file_level_filter_builder, int n,
 					 const FilterPolicy* filter_policy, uint64_t file_number) {
 #ifdef FILE_LEVEL_FILTER
 	if (filter_policy != NULL) {
-		std::string* filter_string = file_level_filter_builder->GenerateFilter();
+		std::string* filter_string = file_level_filter_builder->GenerateFilter(filter_policy);
 		filter_list->push_back(filter_string);
 		file_level_filter_builder->Clear();
 	}
@@ -79,7 +103,8 @@ Status BuildLevel0Tables(const std::string& dbname,
 	  FileMetaData meta;
 	  WritableFile* file;
 	  TableBuilder* builder;
-	  const FilterPolicy* filter_policy = options.filter_policy;
+	  // Level 0 may use its own file-level filter policy (Options::level_filter_policies)
+	  const FilterPolicy* filter_policy = versions_->FileLevelFilterPolicy(0);
 	  int index = 0;
 
 	  iter->SeekToFirst();
@@ -111,8 +136,10 @@ Status BuildLevel0Tables(const std::string& dbname,
 							}
 							builder = new TableBuilder(options, file);
 							meta.smallest.DecodeFrom(iter->key());
+							ResetFileStats(&meta);
 					  }
 					  builder->Add(iter->key(), iter->value());
+					  UpdateFileStats(&meta, iter->key());
 #ifdef FILE_LEVEL_FILTER
 					  file_level_filter_builder->AddKey(key);
 #endif
@@ -178,8 +205,10 @@ Status BuildLevel0Tables(const std::string& dbname,
 					}
 					builder = new TableBuilder(options, file);
 					meta.smallest.DecodeFrom(iter->key());
+					ResetFileStats(&meta);
 			  }
 			  builder->Add(iter->key(), iter->value());
+			  UpdateFileStats(&meta, iter->key());
 
 #ifdef FILE_LEVEL_FILTER
 			  file_level_filter_builder->AddKey(iter->key());
@@ -233,9 +262,11 @@ Status BuildTable(const std::string& dbname,
 
     TableBuilder* builder = new TableBuilder(options, file);
     meta->smallest.DecodeFrom(iter->key());
+    ResetFileStats(meta);
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
+      UpdateFileStats(meta, key);
       builder->Add(key, iter->value());
     }
 
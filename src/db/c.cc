@@ -37,6 +37,7 @@ using leveldb::Logger;
 using leveldb::NewBloomFilterPolicy;
 using leveldb::NewLRUCache;
 using leveldb::Options;
+using leveldb::PinnableSlice;
 using leveldb::RandomAccessFile;
 using leveldb::Range;
 using leveldb::ReadOptions;
@@ -57,6 +58,7 @@ struct leveldb_snapshot_t     { const Snapshot*   rep; };
 struct leveldb_readoptions_t  { ReadOptions       rep; };
 struct leveldb_writeoptions_t { WriteOptions      rep; };
 struct leveldb_options_t      { Options           rep; };
+struct leveldb_pinnableslice_t { PinnableSlice    rep; };
 struct leveldb_cache_t        { Cache*            rep; };
 struct leveldb_seqfile_t      { SequentialFile*   rep; };
 struct leveldb_randomfile_t   { RandomAccessFile* rep; };
@@ -222,6 +224,33 @@ char* leveldb_get(
   return result;
 }
 
+leveldb_pinnableslice_t* leveldb_get_pinned(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    const char* key, size_t keylen,
+    char** errptr) {
+  leveldb_pinnableslice_t* result = new leveldb_pinnableslice_t;
+  Status s = db->rep->Get(options->rep, Slice(key, keylen), &result->rep);
+  if (!s.ok()) {
+    delete result;
+    result = NULL;
+    if (!s.IsNotFound()) {
+      SaveError(errptr, s);
+    }
+  }
+  return result;
+}
+
+const char* leveldb_pinnableslice_value(
+    const leveldb_pinnableslice_t* v, size_t* vallen) {
+  *vallen = v->rep.size();
+  return v->rep.data();
+}
+
+void leveldb_pinnableslice_destroy(leveldb_pinnableslice_t* v) {
+  delete v;
+}
+
 leveldb_iterator_t* leveldb_create_iterator(
     leveldb_t* db,
     const leveldb_readoptions_t* options) {
@@ -448,6 +477,15 @@ void leveldb_options_set_cache(leveldb_options_t* opt, leveldb_cache_t* c) {
   opt->rep.block_cache = c->rep;
 }
 
+void leveldb_options_set_row_cache(leveldb_options_t* opt, leveldb_cache_t* c) {
+  opt->rep.row_cache = c->rep;
+}
+
+void leveldb_options_set_compressed_cache(leveldb_options_t* opt,
+                                          leveldb_cache_t* c) {
+  opt->rep.compressed_block_cache = c->rep;
+}
+
 void leveldb_options_set_block_size(leveldb_options_t* opt, size_t s) {
   opt->rep.block_size = s;
 }
@@ -456,6 +494,26 @@ void leveldb_options_set_block_restart_interval(leveldb_options_t* opt, int n) {
   opt->rep.block_restart_interval = n;
 }
 
+void leveldb_options_set_compaction_readahead_size(leveldb_options_t* opt,
+                                                  size_t s) {
+  opt->rep.compaction_readahead_size = s;
+}
+
+void leveldb_options_set_value_log_threshold(leveldb_options_t* opt,
+                                             size_t s) {
+  opt->rep.value_log_threshold = s;
+}
+
+void leveldb_options_set_value_log_file_size(leveldb_options_t* opt,
+                                             size_t s) {
+  opt->rep.value_log_file_size = s;
+}
+
+void leveldb_options_set_value_log_gc_ratio(leveldb_options_t* opt,
+                                            double r) {
+  opt->rep.value_log_gc_ratio = r;
+}
+
 void leveldb_options_set_compression(leveldb_options_t* opt, int t) {
   opt->rep.compression = static_cast<CompressionType>(t);
 }
@@ -554,6 +612,16 @@ void leveldb_readoptions_set_snapshot(
   opt->rep.snapshot = (snap ? snap->rep : NULL);
 }
 
+void leveldb_readoptions_set_readahead_size(
+    leveldb_readoptions_t* opt, size_t s) {
+  opt->rep.readahead_size = s;
+}
+
+void leveldb_readoptions_set_prefetch_next_guard(
+    leveldb_readoptions_t* opt, unsigned char v) {
+  opt->rep.prefetch_next_guard = v;
+}
+
 leveldb_writeoptions_t* leveldb_writeoptions_create() {
   return new leveldb_writeoptions_t;
 }
@@ -69,10 +69,21 @@ static void CheckGet(
   char* err = NULL;
   size_t val_len;
   char* val;
+  leveldb_pinnableslice_t* pinned;
   val = leveldb_get(db, options, key, strlen(key), &val_len, &err);
   CheckNoError(err);
   CheckEqual(expected, val, val_len);
   Free(&val);
+
+  pinned = leveldb_get_pinned(db, options, key, strlen(key), &err);
+  CheckNoError(err);
+  if (pinned == NULL) {
+    CheckEqual(expected, NULL, 0);
+  } else {
+    const char* pinned_val = leveldb_pinnableslice_value(pinned, &val_len);
+    CheckEqual(expected, pinned_val, val_len);
+    leveldb_pinnableslice_destroy(pinned);
+  }
 }
 
 static void CheckIter(leveldb_iterator_t* iter,
@@ -189,11 +200,17 @@ int main(int argc, char** argv) {
   leveldb_options_set_max_open_files(options, 10);
   leveldb_options_set_block_size(options, 1024);
   leveldb_options_set_block_restart_interval(options, 8);
+  leveldb_options_set_compaction_readahead_size(options, 64 << 10);
+  leveldb_options_set_value_log_threshold(options, 4);
+  leveldb_options_set_value_log_file_size(options, 64 << 10);
+  leveldb_options_set_value_log_gc_ratio(options, 0.5);
   leveldb_options_set_compression(options, leveldb_no_compression);
 
   roptions = leveldb_readoptions_create();
   leveldb_readoptions_set_verify_checksums(roptions, 1);
   leveldb_readoptions_set_fill_cache(roptions, 0);
+  leveldb_readoptions_set_readahead_size(roptions, 16 << 10);
+  leveldb_readoptions_set_prefetch_next_guard(roptions, 1);
 
   woptions = leveldb_writeoptions_create();
   leveldb_writeoptions_set_sync(woptions, 1);
@@ -23,8 +23,10 @@
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "pebblesdb/compaction_filter.h"
 #include "pebblesdb/db.h"
 #include "pebblesdb/env.h"
+#include "pebblesdb/merge_operator.h"
 #include "pebblesdb/replay_iterator.h"
 #include "pebblesdb/status.h"
 #include "pebblesdb/table.h"
@@ -120,12 +122,20 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // Every range tombstone older than this is in the compaction's version
+  // and drops what it covers from the outputs.
+  SequenceNumber tombstones_applied;
+
   // Files produced by compaction
   struct Output {
-    Output() : number(), file_size(), smallest(), largest() {}
+    Output() : number(), file_size(), smallest(), largest(),
+               smallest_seq(kMaxSequenceNumber), largest_seq(0),
+               num_entries(0), num_deletions(0) {}
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    SequenceNumber smallest_seq, largest_seq;
+    uint64_t num_entries, num_deletions;
   };
   std::vector<Output> outputs;
 
@@ -140,6 +150,7 @@ struct DBImpl::CompactionState {
   explicit CompactionState(Compaction* c)
       : compaction(c),
         smallest_snapshot(),
+        tombstones_applied(0),
         outputs(),
         outfile(NULL),
         builder(NULL),
@@ -166,6 +177,8 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.max_open_files,    64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
   ClipToRange(&result.block_size,        1<<10,                       4<<20);
+  ClipToRange(&result.level0_sentinel_compaction_trigger, 1,          1<<20);
+  ClipToRange(&result.level0_guard_compaction_trigger,    1,          1<<20);
   if (result.info_log == NULL) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -177,7 +190,7 @@ Options SanitizeOptions(const std::string& dbname,
     }
   }
   if (result.block_cache == NULL) {
-    result.block_cache = NewLRUCache(8 << 20);
+    result.block_cache = NewClockCache(8 << 20, result.block_size, 0.1, true);
   }
   return result;
 }
@@ -185,13 +198,14 @@ Options SanitizeOptions(const std::string& dbname,
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
-      internal_filter_policy_(raw_options.filter_policy),
+      internal_filter_policy_(raw_options.filter_policy, raw_options.prefix_extractor),
       options_(SanitizeOptions(dbname, &internal_comparator_,
                                &internal_filter_policy_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
       table_cache_(),
+      vlog_(new ValueLog(dbname, &options_)),
       db_lock_(NULL),
       mutex_(),
       shutting_down_(NULL),
@@ -212,6 +226,7 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       bg_fg_cv_(&mutex_),
       bg_compaction_cv_(&mutex_),
       bg_memtable_cv_(&mutex_),
+      bg_value_log_cv_(&mutex_),
       bg_log_cv_(&mutex_),
       bg_log_occupied_(false),
       manual_compaction_(NULL),
@@ -236,6 +251,10 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
 	  env_->StartThread(&DBImpl::CompactLevelWrapper, this);
   }
   num_bg_threads_ = num_bg_compaction_threads_ + 1;
+  if (options_.value_log_threshold > 0) {
+    env_->StartThread(&DBImpl::ValueLogGCWrapper, this);
+    num_bg_threads_ += 1;
+  }
 
   // Reserve ten files or so for other uses and give the rest to TableCache.
   int max_open_files = options_.max_open_files;
@@ -270,6 +289,7 @@ DBImpl::~DBImpl() {
   shutting_down_.Release_Store(this);  // Any non-NULL value is ok
   bg_compaction_cv_.SignalAll();
   bg_memtable_cv_.SignalAll();
+  bg_value_log_cv_.SignalAll();
   while (num_bg_threads_ > 0) {
     bg_fg_cv_.Wait();
   }
@@ -285,6 +305,7 @@ DBImpl::~DBImpl() {
   log_.reset();
   logfile_.reset();
   delete table_cache_;
+  delete vlog_;
 
   if (owns_info_log_) {
     delete options_.info_log;
@@ -372,6 +393,9 @@ void DBImpl::DeleteObsoleteFiles() {
   // Make a set of all of the live files
   std::set<uint64_t> live = pending_outputs_;
   versions_->AddLiveFiles(&live);
+  SequenceNumber oldest_snapshot = snapshots_.empty() ?
+      versions_->LastSequence() : snapshots_.oldest()->number_;
+  oldest_snapshot = std::min(oldest_snapshot, manual_garbage_cutoff_);
 
   std::vector<std::string> filenames;
   env_->GetChildren(dbname_, &filenames); // Ignoring errors on purpose
@@ -398,6 +422,9 @@ void DBImpl::DeleteObsoleteFiles() {
           // be recorded in pending_outputs_, which is inserted into "live"
           keep = (live.find(number) != live.end());
           break;
+        case kValueLogFile:
+          keep = !vlog_->Deletable(number, oldest_snapshot);
+          break;
         case kCurrentFile:
         case kDBLockFile:
         case kInfoLogFile:
@@ -414,6 +441,8 @@ void DBImpl::DeleteObsoleteFiles() {
           // Remove all the in memory maps used.
           versions_->RemoveFileLevelBloomFilterInfo(number);
           versions_->RemoveFileMetaDataFromTableCache(number);
+        } else if (type == kValueLogFile) {
+          vlog_->RemoveFile(number);
         }
         Log(options_.info_log, "Delete type=%d #%lld\n",
             int(type),
@@ -482,6 +511,16 @@ Status DBImpl::Recover(VersionEdit* edit) {
         expected.erase(number);
         if (type == kLogFile && ((number >= min_log) || (number == prev_log)))
           logs.push_back(number);
+        if (type == kValueLogFile) {
+          // Value log files are not named in the descriptor
+          uint64_t size;
+          s = env_->GetFileSize(ValueLogFileName(dbname_, number), &size);
+          if (!s.ok()) {
+            return s;
+          }
+          vlog_->AddExistingFile(number, size);
+          versions_->MarkFileNumberUsed(number);
+        }
       }
     }
     if (!expected.empty()) {
@@ -654,6 +693,110 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
   return status;
 }
 
+namespace {
+
+// Passes the newest value of each key in a memtable that every snapshot
+// sees through a CompactionFilter as a flush writes it out.  A removed
+// value becomes a deletion, because older values of its key may be in
+// the tables.  Only iterates forward from SeekToFirst().
+class FlushFilterIterator : public Iterator {
+ public:
+  FlushFilterIterator(const CompactionFilter* filter, const Comparator* ucmp,
+                      Iterator* iter, SequenceNumber smallest_snapshot,
+                      SequenceNumber garbage_cutoff)
+    : filter_(filter),
+      ucmp_(ucmp),
+      iter_(iter),
+      smallest_snapshot_(smallest_snapshot),
+      garbage_cutoff_(garbage_cutoff),
+      prev_user_key_(),
+      has_prev_(false),
+      changed_(false),
+      key_(),
+      value_(),
+      status_() {
+  }
+  virtual ~FlushFilterIterator() { delete iter_; }
+
+  virtual bool Valid() const { return iter_->Valid(); }
+  virtual void SeekToFirst() {
+    has_prev_ = false;
+    iter_->SeekToFirst();
+    Update();
+  }
+  virtual void Next() {
+    iter_->Next();
+    Update();
+  }
+  virtual void SeekToLast() { Unsupported(); }
+  virtual void Seek(const Slice& target) { Unsupported(); }
+  virtual void Prev() { Unsupported(); }
+  virtual Slice key() const { return changed_ ? Slice(key_) : iter_->key(); }
+  virtual Slice value() const {
+    return changed_ ? Slice(value_) : iter_->value();
+  }
+  virtual const Status& status() const {
+    return status_.ok() ? iter_->status() : status_;
+  }
+
+ private:
+  void Unsupported() {
+    assert(false);
+    status_ = Status::NotSupported("flush iterators only move forward");
+  }
+
+  void Update() {
+    changed_ = false;
+    ParsedInternalKey ikey;
+    if (!iter_->Valid() || !ParseInternalKey(iter_->key(), &ikey)) {
+      return;
+    }
+    const bool newest = !has_prev_ ||
+                        ucmp_->Compare(ikey.user_key, prev_user_key_) != 0;
+    prev_user_key_.assign(ikey.user_key.data(), ikey.user_key.size());
+    has_prev_ = true;
+    if (!newest || ikey.type != kTypeValue ||
+        ikey.sequence > smallest_snapshot_ ||
+        ikey.sequence >= garbage_cutoff_) {
+      return;
+    }
+    switch (filter_->Filter(0, ikey.user_key, iter_->value(), &value_)) {
+      case CompactionFilter::kKeep:
+        break;
+      case CompactionFilter::kRemove:
+        key_.clear();
+        AppendInternalKey(&key_, ParsedInternalKey(ikey.user_key,
+                                                   ikey.sequence,
+                                                   kTypeDeletion));
+        value_.clear();
+        changed_ = true;
+        break;
+      case CompactionFilter::kChangeValue:
+        key_.assign(iter_->key().data(), iter_->key().size());
+        changed_ = true;
+        break;
+    }
+  }
+
+  const CompactionFilter* const filter_;
+  const Comparator* const ucmp_;
+  Iterator* const iter_;
+  const SequenceNumber smallest_snapshot_;
+  const SequenceNumber garbage_cutoff_;
+  std::string prev_user_key_;
+  bool has_prev_;
+  bool changed_;        // Do key_ and value_ replace the current entry?
+  std::string key_;
+  std::string value_;
+  Status status_;
+
+  // No copying allowed
+  FlushFilterIterator(const FlushFilterIterator&);
+  void operator=(const FlushFilterIterator&);
+};
+
+}  // namespace
+
 Status DBImpl::WriteLevel0TableGuards(MemTable* mem, VersionEdit* edit,
                                 Version* base, std::vector<uint64_t> &numbers,
 								FileLevelFilterBuilder* file_level_filter_builder,
@@ -664,6 +807,13 @@ Status DBImpl::WriteLevel0TableGuards(MemTable* mem, VersionEdit* edit,
   std::vector<FileMetaData> meta_list;
 
   Iterator* iter = mem->NewIterator();
+  if (options_.compaction_filter != NULL) {
+    const SequenceNumber smallest_snapshot = snapshots_.empty() ?
+        versions_->LastSequence() : snapshots_.oldest()->number_;
+    iter = new FlushFilterIterator(options_.compaction_filter,
+                                   user_comparator(), iter, smallest_snapshot,
+                                   manual_garbage_cutoff_);
+  }
   std::vector<GuardMetaData*> guards_;
   if (base != NULL) {
   	guards_ = base->GetGuardsAtLevel(0);
@@ -705,12 +855,21 @@ Status DBImpl::WriteLevel0TableGuards(MemTable* mem, VersionEdit* edit,
 			const Slice max_user_key = meta.largest.user_key();
 			// Note: We are always putting the new files to level 0
 			edit->AddFile(level, meta.number, meta.file_size,
-						  meta.smallest, meta.largest);
+						  meta.smallest, meta.largest,
+						  meta.smallest_seq, meta.largest_seq, 0,
+						  meta.num_entries, meta.num_deletions);
 			numbers.push_back(meta.number);
 			total_file_size += meta.file_size;
 		}
   }
 
+  // The tombstones now hide entries in the version's files
+  std::vector<RangeTombstone> tombstones;
+  mem->GetRangeTombstones(&tombstones);
+  for (size_t i = 0; i < tombstones.size(); i++) {
+    edit->AddRangeTombstone(tombstones[i]);
+  }
+
   // Adding the remaining reserved but unused file numbers so that they can be removed from the pending_outputs set
   for (unsigned i = meta_list.size(); i <= num_level0_guards; i++) {
 	  numbers.push_back(reserved_file_numbers[i]);
@@ -771,6 +930,14 @@ void DBImpl::CompactMemTableThread() {
       s = Status::IOError("Deleting DB during memtable compaction");
     }
 
+    // The new tables may point into the value log, and the write-ahead
+    // log that holds those writes goes away with the edit below
+    if (s.ok()) {
+      mutex_.Unlock();
+      s = vlog_->Sync();
+      mutex_.Lock();
+    }
+
     // Replace immutable memtable with the generated Table
     if (s.ok()) {
       edit.SetPrevLogNumber(0);
@@ -798,7 +965,9 @@ void DBImpl::CompactMemTableThread() {
       bg_compaction_cv_.SignalAll();
       DeleteObsoleteFiles();
       record_timer(CMT_DELETE_OBSOLETE_FILES);
-    } else {
+      s = DropObsoleteRangeTombstones();
+    }
+    if (!s.ok()) {
       RecordBackgroundError(s);
     }
 
@@ -971,7 +1140,7 @@ void DBImpl::CompactLevelThread() {
       break;
     }
 
-    assert(manual_compaction_ == NULL || num_bg_threads_ == 2);
+    assert(manual_compaction_ == NULL || num_bg_compaction_threads_ == 1);
 
     start_timer_simple(TOTAL_BACKGROUND_COMPACTION);
     start_timer(TOTAL_BACKGROUND_COMPACTION);
@@ -982,6 +1151,7 @@ void DBImpl::CompactLevelThread() {
 
     bg_fg_cv_.SignalAll(); // before the backoff In case a waiter
                            // can proceed despite the error
+    bg_value_log_cv_.Signal();  // The compaction may have found garbage
 
     if (s.ok()) {
       // Success
@@ -1005,6 +1175,201 @@ void DBImpl::CompactLevelThread() {
   bg_fg_cv_.SignalAll();
 }
 
+void DBImpl::ValueLogGCThread() {
+  MutexLock l(&mutex_);
+
+  while (!shutting_down_.Acquire_Load() && !allow_background_activity_) {
+    bg_value_log_cv_.Wait();
+  }
+  while (!shutting_down_.Acquire_Load()) {
+    uint64_t number;
+    if (!vlog_->PickFileForCollection(options_.value_log_gc_ratio, &number)) {
+      bg_value_log_cv_.Wait();
+      continue;
+    }
+    Status s = CollectValueLogFile(number);
+    if (!s.ok() && !shutting_down_.Acquire_Load()) {
+      // Back off like the compaction thread does
+      Log(options_.info_log, "Waiting after value log GC error: %s",
+          s.ToString().c_str());
+      mutex_.Unlock();
+      env_->SleepForMicroseconds(1000000);
+      mutex_.Lock();
+    }
+  }
+  Log(options_.info_log, "cleaning up ValueLogGCThread");
+  num_bg_threads_ -= 1;
+  bg_fg_cv_.SignalAll();
+}
+
+// Copy the live values of value log file "number" to the current value log
+// file, and delete the file once no reader can need it any more.
+Status DBImpl::CollectValueLogFile(uint64_t number) {
+  mutex_.AssertHeld();
+  mutex_.Unlock();
+  Log(options_.info_log, "Collecting value log #%llu",
+      static_cast<unsigned long long>(number));
+
+  // Relocations are written in batches of about this many bytes of values
+  static const size_t kBatchBytes = 4 << 20;
+  ValueLogReader* reader = NULL;
+  Status s = vlog_->NewReader(number, &reader);
+  bool more = s.ok();
+  while (more && s.ok() && !shutting_down_.Acquire_Load()) {
+    std::vector<std::string> keys;
+    std::vector<ValuePointer> old;
+    std::vector<std::string> moved;
+    size_t bytes = 0;
+    Slice key;
+    Slice value;
+    ValuePointer ptr;
+    std::vector<std::string> operands;
+    while (bytes < kBatchBytes &&
+           (more = reader->ReadRecord(&key, &value, &ptr))) {
+      operands.clear();
+      if (!ValuePointerIsLive(key, ptr, &operands)) {
+        continue;
+      }
+      ValuePointer copy;
+      s = MaybeNewValueLogFile();
+      if (s.ok()) {
+        s = vlog_->Add(key, value, &copy);
+      }
+      if (!s.ok()) {
+        break;
+      }
+      keys.push_back(key.ToString());
+      old.push_back(ptr);
+      moved.push_back(std::string());
+      copy.EncodeTo(&moved.back());
+      bytes += value.size();
+    }
+    if (s.ok()) {
+      s = reader->status();
+    }
+    if (s.ok() && !keys.empty()) {
+      s = WriteRelocatedValues(keys, old, moved);
+    }
+  }
+  delete reader;
+
+  mutex_.Lock();
+  vlog_->FinishCollection(number, s.ok() && !more, versions_->LastSequence());
+  DeleteObsoleteFiles();
+  return s;
+}
+
+Status DBImpl::WriteRelocatedValues(const std::vector<std::string>& keys,
+                                    const std::vector<ValuePointer>& old,
+                                    const std::vector<std::string>& moved) {
+  WriteBatch candidates;
+  for (size_t i = 0; i < keys.size(); i++) {
+    WriteBatchInternal::PutValuePointer(&candidates, keys[i], moved[i]);
+  }
+
+  Writer w(&writers_mutex_);
+  Status s = SequenceWriteBegin(&w, &candidates);
+  if (s.ok()) {
+    // Once every earlier writer is done, a key that still points at the old
+    // copy cannot be overwritten by anything ordered before us.
+    MutexLock l(&writers_mutex_);
+    while (w.prev_) {
+      w.wake_me_when_head_ = true;
+      w.cv_.Wait();
+    }
+    w.wake_me_when_head_ = false;
+  }
+
+  WriteBatch live;
+  std::vector<std::string> operands;
+  for (size_t i = 0; s.ok() && i < keys.size(); i++) {
+    operands.clear();
+    if (!ValuePointerIsLive(keys[i], old[i], &operands)) {
+      continue;
+    }
+    if (operands.empty()) {
+      WriteBatchInternal::PutValuePointer(&live, keys[i], moved[i]);
+      continue;
+    }
+    // The copy would hide the operands above the old value, so write the
+    // value they make instead and drop the copy
+    std::string base;
+    std::string merged;
+    s = ResolveValuePointer(ReadOptions(), moved[i], &base);
+    if (s.ok()) {
+      Slice base_slice(base);
+      s = ApplyMergeOperands(keys[i], &base_slice, operands, &merged);
+    }
+    if (s.ok() && merged.size() >= options_.value_log_threshold) {
+      ValuePointer ptr;
+      s = MaybeNewValueLogFile();
+      if (s.ok()) {
+        s = vlog_->Add(keys[i], merged, &ptr);
+      }
+      if (s.ok()) {
+        std::string pointer;
+        ptr.EncodeTo(&pointer);
+        WriteBatchInternal::PutValuePointer(&live, keys[i], pointer);
+      }
+    } else if (s.ok()) {
+      live.Put(keys[i], merged);
+    }
+    ValuePointer copy;
+    if (copy.DecodeFrom(moved[i])) {
+      vlog_->AddGarbage(copy);
+    }
+  }
+
+  WriteBatch* updates_with_guards = NULL;
+  if (s.ok() && WriteBatchInternal::Count(&live) > 0) {
+    WriteBatchInternal::SetSequence(&live, w.start_sequence_);
+    updates_with_guards = new WriteBatch(live);
+    s = WriteBatchInternal::SetGuards(&live, updates_with_guards);
+    // The old file goes away once this is done, so the copies and the
+    // pointers to them must be durable first
+    if (s.ok()) {
+      s = vlog_->Sync();
+    }
+    if (s.ok()) {
+      s = w.log_->AddRecord(WriteBatchInternal::Contents(updates_with_guards));
+    }
+    if (s.ok()) {
+      s = w.logfile_->Sync();
+    }
+  }
+  SequenceWriteEnd(&w, updates_with_guards, s);
+  delete updates_with_guards;
+  return s;
+}
+
+bool DBImpl::ValuePointerIsLive(const Slice& key, const ValuePointer& ptr,
+                                std::vector<std::string>* operands) {
+  ReadOptions options;
+  options.fill_cache = false;
+  PinnableSlice pointer;
+  ValueType type;
+  ValuePointer current;
+  return GetImpl(options, key, &pointer, false, &type, operands).ok() &&
+         type == kTypeValuePointer &&
+         current.DecodeFrom(pointer) &&
+         current.file == ptr.file &&
+         current.offset == ptr.offset;
+}
+
+Status DBImpl::TEST_CollectValueLog() {
+  MutexLock l(&mutex_);
+  uint64_t number;
+  if (!vlog_->PickFileForCollection(0, &number)) {
+    return Status::OK();
+  }
+  return CollectValueLogFile(number);
+}
+
+size_t DBImpl::TEST_NumRangeTombstones() {
+  MutexLock l(&mutex_);
+  return versions_->current()->range_tombstones().size();
+}
+
 void DBImpl::RecordBackgroundError(const Status& s) {
   mutex_.AssertHeld();
   if (bg_error_.ok()) {
@@ -1097,7 +1462,9 @@ Status DBImpl::BackgroundCompactionGuards(FileLevelFilterBuilder* file_level_fil
 
   if (c) {
     levels_locked_[c->level() + 0] = false;
-    levels_locked_[c->level() + 1] = false;
+    if (c->level() + 1 < config::kNumLevels) {
+      levels_locked_[c->level() + 1] = false;
+    }
     delete c;
   }
 
@@ -1210,7 +1577,10 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 #ifdef FILE_LEVEL_FILTER
   // Populate file level filter information to in-memory map
   if (options_.filter_policy != NULL) {
-	  std::string* filter_string = file_level_filter_builder->GenerateFilter();
+	  const int output_level = compact->compaction->level() +
+			  (compact->compaction->is_horizontal_compaction ? 0 : 1);
+	  std::string* filter_string = file_level_filter_builder->GenerateFilter(
+			  versions_->FileLevelFilterPolicy(output_level));
 	  assert(filter_string != NULL);
 	  file_level_filters->push_back(filter_string);
 	  file_level_filter_builder->Clear();
@@ -1250,15 +1620,125 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact, const int leve
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
+  compact->compaction->AddMovedInputs(compact->compaction->edit());
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
     compact->compaction->edit()->AddFile(
         level_to_add_new_files,
-        out.number, out.file_size, out.smallest, out.largest);
+        out.number, out.file_size, out.smallest, out.largest,
+        out.smallest_seq, out.largest_seq, compact->tombstones_applied,
+        out.num_entries, out.num_deletions);
   }
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_, &bg_log_cv_, &bg_log_occupied_, file_numbers, file_level_filters, 0);
 }
 
+Status DBImpl::DropObsoleteRangeTombstones() {
+  mutex_.AssertHeld();
+  Version* current = versions_->current();
+  const std::vector<RangeTombstone>& tombstones = current->range_tombstones();
+  // Writes racing with the DeleteRange() may have reached a newer memtable
+  SequenceNumber oldest_in_memory = mem_->SmallestSequence();
+  if (imm_ != NULL) {
+    oldest_in_memory = std::min(oldest_in_memory, imm_->SmallestSequence());
+  }
+  VersionEdit edit;
+  int dropped = 0;
+  for (size_t i = 0; i < tombstones.size(); i++) {
+    if (tombstones[i].sequence < oldest_in_memory &&
+        current->RangeTombstoneIsObsolete(tombstones[i])) {
+      edit.DeleteRangeTombstone(tombstones[i].sequence);
+      dropped++;
+    }
+  }
+  if (dropped == 0) {
+    return Status::OK();
+  }
+  Log(options_.info_log, "Dropping %d obsolete range tombstones", dropped);
+  return versions_->LogAndApply(&edit, &mutex_, &bg_log_cv_, &bg_log_occupied_,
+                                std::vector<uint64_t>(),
+                                std::vector<std::string*>(), 0);
+}
+
+Status DBImpl::FoldMergeOperands(CompactionState* compact, Iterator* input,
+                                 std::string* key, std::string* value,
+                                 SequenceNumber* last_sequence_for_key) {
+  ParsedInternalKey ikey;
+  bool ok = ParseInternalKey(input->key(), &ikey);
+  assert(ok && ikey.type == kTypeMerge);
+  const std::string user_key = ikey.user_key.ToString();
+  const SequenceNumber sequence = ikey.sequence;
+  const RangeTombstoneList* tombstones =
+      compact->compaction->range_tombstone_list();
+  const SequenceNumber deleted_before =
+      tombstones != NULL
+          ? tombstones->NewestCovering(user_key, compact->smallest_snapshot)
+          : 0;
+  std::vector<std::string> operands;
+  operands.push_back(input->value().ToString());
+  bool has_base = false;
+  bool complete = false;  // Is nothing older left to combine with?
+  std::string base;
+  for (input->Next(); input->Valid(); input->Next()) {
+    ok = ParseInternalKey(input->key(), &ikey);
+    if (!ok || user_comparator()->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    if (ikey.sequence < deleted_before) {
+      // A range tombstone hides it and everything older
+      complete = true;
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      operands.push_back(input->value().ToString());
+      continue;
+    }
+    if (ikey.type == kTypeValue) {
+      base = input->value().ToString();
+      has_base = true;
+      complete = true;
+      input->Next();
+    } else if (ikey.type == kTypeDeletion) {
+      complete = true;
+      input->Next();
+    }
+    // A value in the value log stays below the combined operand
+    break;
+  }
+  if (!input->status().ok()) {
+    return input->status();
+  }
+  if (!complete && (!input->Valid() || !ok ||
+                    user_comparator()->Compare(ikey.user_key, user_key) != 0) &&
+      compact->compaction->IsBaseLevelForKey(user_key)) {
+    // No level below holds the key
+    complete = true;
+  }
+
+  std::string merged;
+  Status s;
+  if (complete) {
+    Slice base_slice(base);
+    s = ApplyMergeOperands(user_key, has_base ? &base_slice : NULL,
+                           operands, &merged);
+    // The value hides the older entries for the key
+    *last_sequence_for_key = sequence;
+  } else {
+    // The oldest operand takes the place of the value below it
+    std::string oldest;
+    oldest.swap(operands.back());
+    operands.pop_back();
+    Slice oldest_slice(oldest);
+    s = ApplyMergeOperands(user_key, &oldest_slice, operands, &merged);
+  }
+  if (s.ok()) {
+    key->clear();
+    AppendInternalKey(key, ParsedInternalKey(user_key, sequence,
+                                             complete ? kTypeValue : kTypeMerge));
+    value->swap(merged);
+  }
+  return s;
+}
+
 Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
 		std::vector<GuardMetaData*> complete_guards_used_in_bg_compaction,
 		FileLevelFilterBuilder* file_level_filter_builder) {
@@ -1279,6 +1759,11 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
       compact->compaction->level(),
       compact->compaction->num_input_files(1),
       compact->compaction->level() + 1);
+  if (compact->compaction->num_moved_inputs() > 0) {
+    Log(options_.info_log, "Moving %lu files to level-%d without rewriting them",
+        compact->compaction->num_moved_inputs(),
+        compact->compaction->level() + 1);
+  }
 
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == NULL);
@@ -1288,6 +1773,23 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
   } else {
     compact->smallest_snapshot = snapshots_.oldest()->number_;
   }
+  // Tombstones still in a memtable are not in the compaction's version
+  compact->tombstones_applied =
+      std::min(compact->smallest_snapshot, manual_garbage_cutoff_) + 1;
+  compact->tombstones_applied =
+      std::min(compact->tombstones_applied, mem_->SmallestSequence());
+  if (imm_ != NULL) {
+    compact->tombstones_applied =
+        std::min(compact->tombstones_applied, imm_->SmallestSequence());
+  }
+  const int skipped = compact->compaction->SkipCoveredInputs(
+      compact->smallest_snapshot, manual_garbage_cutoff_);
+  if (skipped > 0) {
+    Log(options_.info_log, "Dropping %d files hidden by range tombstones",
+        skipped);
+  }
+  const RangeTombstoneList* tombstones =
+      compact->compaction->range_tombstone_list();
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
   // In case some other level needs to be compacted and some thread is waiting.
@@ -1319,11 +1821,18 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
   InternalKey prev;
   bool first_entry = true;
   int cnt = 0;
+  std::string folded_key;
+  std::string folded_value;
+  std::string filtered_key;
+  std::string filtered_value;
+  const int output_level = compact->compaction->is_horizontal_compaction ?
+      compaction_level : compaction_level + 1;
   for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
 	Slice key = input->key();
 	cnt++;
     // Handle key/value, add to state, etc.
     bool drop = false;
+    bool newest_for_key = false;
     if (!ParseInternalKey(key, &ikey)) {
       // Do not hide error keys
       current_key_backing.clear();
@@ -1351,6 +1860,7 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
         assert(x);
         has_current_key = true;
         last_sequence_for_key = kMaxSequenceNumber;
+        newest_for_key = true;
       }
 
       // Just remember that last_sequence_for_key is decreasing over time, and
@@ -1370,6 +1880,11 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (tombstones != NULL &&
+                 ikey.sequence < tombstones->NewestCovering(
+                     ikey.user_key, compact->smallest_snapshot)) {
+        // Hidden by a range tombstone that every snapshot sees
+        drop = true;
       }
 
       // If we're going to drop this key, and there was no previous version of
@@ -1381,7 +1896,60 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
         drop = false;
       }
 
-      last_sequence_for_key = ikey.sequence;
+      // A merge operand hides nothing; it needs the entries below it
+      if (ikey.type != kTypeMerge) {
+        last_sequence_for_key = ikey.sequence;
+      }
+
+      ValuePointer ptr;
+      if (drop && ikey.type == kTypeValuePointer &&
+          ptr.DecodeFrom(input->value())) {
+        vlog_->AddGarbage(ptr);
+      }
+    }
+
+    Slice value = input->value();
+    if (!drop && newest_for_key && ikey.type == kTypeValue &&
+        options_.compaction_filter != NULL &&
+        ikey.sequence <= compact->smallest_snapshot &&
+        ikey.sequence < manual_garbage_cutoff_) {
+      switch (options_.compaction_filter->Filter(output_level, ikey.user_key,
+                                                 value, &filtered_value)) {
+        case CompactionFilter::kKeep:
+          break;
+        case CompactionFilter::kRemove:
+          if (compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+            drop = true;
+          } else {
+            // Older values of the key may be in deeper levels
+            filtered_key.clear();
+            AppendInternalKey(&filtered_key,
+                              ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                                kTypeDeletion));
+            key = filtered_key;
+            value = Slice();
+          }
+          break;
+        case CompactionFilter::kChangeValue:
+          value = filtered_value;
+          break;
+      }
+    }
+    bool folded = false;
+    if (!drop && has_current_key && ikey.type == kTypeMerge &&
+        ikey.sequence <= compact->smallest_snapshot &&
+        ikey.sequence < manual_garbage_cutoff_ &&
+        options_.merge_operator != NULL) {
+      // Every reader that sees an older entry for the key sees this
+      // operand too, so the two can be combined
+      status = FoldMergeOperands(compact, input, &folded_key, &folded_value,
+                                 &last_sequence_for_key);
+      if (!status.ok()) {
+        break;
+      }
+      key = folded_key;
+      value = folded_value;
+      folded = true;
     }
 
     if (!drop) {
@@ -1426,11 +1994,19 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
           break;
         }
       }
+      CompactionState::Output* out = compact->current_output();
       if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
+        out->smallest.DecodeFrom(key);
+      }
+      out->largest.DecodeFrom(key);
+      const SequenceNumber seq = ExtractSequence(key);
+      out->smallest_seq = std::min(out->smallest_seq, seq);
+      out->largest_seq = std::max(out->largest_seq, seq);
+      out->num_entries++;
+      if (ExtractValueType(key) == kTypeDeletion) {
+        out->num_deletions++;
       }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
+      compact->builder->Add(key, value);
 
 #ifdef FILE_LEVEL_FILTER
       file_level_filter_builder->AddKey(key);
@@ -1449,7 +2025,9 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
       }
     }
 
-    input->Next();
+    if (!folded) {
+      input->Next();
+    }
   }
 
   if (status.ok() && shutting_down_.Acquire_Load()) {
@@ -1509,6 +2087,9 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
   if (status.ok()) {
 	  status = InstallCompactionResults(compact, level_written_to, file_numbers, file_level_filters);
   }
+  if (status.ok()) {
+    status = DropObsoleteRangeTombstones();
+  }
   record_timer(BGC_INSTALL_COMPACTION_RESULTS);
 
   if (!status.ok()) {
@@ -1526,6 +2107,7 @@ struct IterState {
   Version* version;
   MemTable* mem;
   MemTable* imm;
+  std::vector<RangeTombstoneList*> tombstones;  // The memtables' lists
 };
 
 static void CleanupIteratorState(void* arg1, void* /*arg2*/) {
@@ -1533,6 +2115,9 @@ static void CleanupIteratorState(void* arg1, void* /*arg2*/) {
   state->mu->Lock();
   state->mem->Unref();
   if (state->imm != NULL) state->imm->Unref();
+  for (size_t i = 0; i < state->tombstones.size(); i++) {
+    state->tombstones[i]->Unref();
+  }
   state->version->Unref();
   state->mu->Unlock();
   delete state;
@@ -1541,7 +2126,8 @@ static void CleanupIteratorState(void* arg1, void* /*arg2*/) {
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options, uint64_t number,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed, bool external_sync) {
+                                      uint32_t* seed, bool external_sync,
+                                      std::vector<const RangeTombstoneList*>* range_tombstones) {
   IterState* cleanup = new IterState;
   if (!external_sync) {
     mutex_.Lock();
@@ -1558,6 +2144,21 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options, uint64_t numbe
     imm_->Ref();
   }
   versions_->current()->AddSomeIteratorsGuards(options, number, &list);
+  if (range_tombstones != NULL) {
+    range_tombstones->clear();
+    if (versions_->current()->range_tombstone_list() != NULL) {
+      range_tombstones->push_back(versions_->current()->range_tombstone_list());
+    }
+    MemTable* const mems[2] = { mem_, imm_ };
+    for (int i = 0; i < 2; i++) {
+      RangeTombstoneList* t = mems[i] != NULL ? mems[i]->RangeTombstones() : NULL;
+      if (t != NULL) {
+        t->Ref();
+        cleanup->tombstones.push_back(t);
+        range_tombstones->push_back(t);
+      }
+    }
+  }
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size(), versions_);
   versions_->current()->Ref();
@@ -1586,9 +2187,41 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+// Cleanup for a value pinned in a memtable
+static void UnrefPinnedMemTable(void* arg1, void* arg2) {
+  port::Mutex* mu = reinterpret_cast<port::Mutex*>(arg1);
+  MemTable* mem = reinterpret_cast<MemTable*>(arg2);
+  mu->Lock();
+  mem->Unref();
+  mu->Unlock();
+}
+
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
+  PinnableSlice pinnable(value);
+  Status s = GetImpl(options, key, &pinnable, false, NULL, NULL);
+  if (s.ok() && pinnable.IsPinned()) {
+    value->assign(pinnable.data(), pinnable.size());
+  }
+  return s;
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+                   const Slice& key,
+                   PinnableSlice* value) {
+  return GetImpl(options, key, value, true, NULL, NULL);
+}
+
+// If "pin_memtable" is false, values found in a memtable are copied
+// rather than pinned, which would cost another trip through mutex_.
+Status DBImpl::GetImpl(const ReadOptions& options,
+                       const Slice& key,
+                       PinnableSlice* value,
+                       bool pin_memtable,
+                       ValueType* type,
+                       std::vector<std::string>* operands) {
+  value->Reset();
   Status s;
   start_timer_simple(GET_OVERALL_TIME);
   start_timer(GET_OVERALL_TIME);
@@ -1596,6 +2229,8 @@ Status DBImpl::Get(const ReadOptions& options,
   MutexLock l(&mutex_);
   record_timer(GET_TIME_TO_GET_MUTEX);
 
+  // Keep the value log files that "snapshot" can see
+  const uint64_t vlog_pin = vlog_->Pin();
   SequenceNumber snapshot;
   if (options.snapshot != NULL) {
     snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
@@ -1612,34 +2247,114 @@ Status DBImpl::Get(const ReadOptions& options,
   }
   current->Ref();
 
+  // The range tombstones are searched once the lock is released; the
+  // version's list lives as long as "current"
+  RangeTombstoneList* tombstones[3] = {
+    mem->RangeTombstones(),
+    imm != NULL ? imm->RangeTombstones() : NULL,
+    const_cast<RangeTombstoneList*>(current->range_tombstone_list())
+  };
+  for (int i = 0; i < 2; i++) {
+    if (tombstones[i] != NULL) {
+      tombstones[i]->Ref();
+    }
+  }
+
   bool have_stat_update = false;
   Version::GetStats stats;
+  MemTable* found_mem = NULL;
 
   // Unlock while reading from files and memtables
   {
     mutex_.Unlock();
+    // Entries older than the newest range tombstone over "key" are deleted
+    SequenceNumber deleted_before = 0;
+    for (int i = 0; i < 3; i++) {
+      if (tombstones[i] != NULL) {
+        deleted_before = std::max(deleted_before,
+                                  tombstones[i]->NewestCovering(key, snapshot));
+      }
+    }
     // First look in the memtable, then in the immutable memtable (if any).
     start_timer(GET_TIME_TO_CHECK_MEM_IMM);
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
-      // Done
+    Slice mem_value;
+    ValueType found_type = kTypeValue;
+    std::vector<std::string> merge_operands;
+    if (mem->Get(lkey, deleted_before, &mem_value, &found_type, &s,
+                 &merge_operands)) {
+      found_mem = mem;
+    } else if (imm != NULL && imm->Get(lkey, deleted_before, &mem_value,
+                                       &found_type, &s, &merge_operands)) {
+      found_mem = imm;
     } else {
       record_timer(GET_TIME_TO_CHECK_MEM_IMM);
 
       start_timer(GET_TIME_TO_CHECK_VERSION);
-      s = current->Get(options, lkey, value, &stats);
+      s = current->Get(options, lkey, deleted_before, value, &found_type,
+                       &merge_operands, &stats);
       total_files_read += current->num_files_read;
       record_timer(GET_TIME_TO_CHECK_VERSION);
 
       have_stat_update = true;
     }
+    if (type != NULL) {
+      if (s.ok()) {
+        *type = found_type;
+      }
+      operands->swap(merge_operands);
+    } else if (!merge_operands.empty() && (s.ok() || s.IsNotFound())) {
+      // Fold the operands into the value below them, if there is one
+      const bool has_base = s.ok();
+      std::string base;
+      s = Status::OK();
+      if (has_base) {
+        Slice raw = (found_mem != NULL) ? mem_value : Slice(*value);
+        if (found_type == kTypeValuePointer) {
+          s = ResolveValuePointer(options, raw, &base);
+        } else {
+          base.assign(raw.data(), raw.size());
+        }
+      }
+      std::string merged;
+      if (s.ok()) {
+        Slice base_slice(base);
+        s = ApplyMergeOperands(key, has_base ? &base_slice : NULL,
+                               merge_operands, &merged);
+      }
+      value->Reset();
+      found_mem = NULL;
+      if (s.ok()) {
+        value->PinSelf(merged);
+      }
+    } else if (s.ok() && found_type == kTypeValuePointer) {
+      std::string pointer = (found_mem != NULL) ? mem_value.ToString()
+                                                : value->ToString();
+      std::string resolved;
+      value->Reset();
+      found_mem = NULL;
+      s = ResolveValuePointer(options, pointer, &resolved);
+      if (s.ok()) {
+        value->PinSelf(resolved);
+      }
+    }
+    if (found_mem != NULL && s.ok()) {
+      if (pin_memtable) {
+        // Referenced below; the cleanup drops that reference
+        value->PinSlice(mem_value, &UnrefPinnedMemTable, &mutex_, found_mem);
+      } else {
+        value->PinSelf(mem_value);
+        found_mem = NULL;
+      }
+    }
 
     start_timer(GET_TIME_TO_LOCK_MUTEX);
     mutex_.Lock();
     record_timer(GET_TIME_TO_LOCK_MUTEX);
   }
+  if (value->IsPinned() && found_mem != NULL) {
+    found_mem->Ref();
+  }
 
   start_timer(GET_TIME_TO_FINISH_UNREF);
   if (have_stat_update && current->UpdateStats(stats)) {
@@ -1648,17 +2363,60 @@ Status DBImpl::Get(const ReadOptions& options,
   //Disable compaction on continous read(Get) requests. COmpaction is triggered
   //only for contiguous seeks. 
   //++straight_reads_;
+  for (int i = 0; i < 2; i++) {
+    if (tombstones[i] != NULL) {
+      tombstones[i]->Unref();
+    }
+  }
   mem->Unref();
   if (imm != NULL) {
 	 imm->Unref();
   }
   current->Unref();
+  vlog_->Unpin(vlog_pin);
   record_timer(GET_TIME_TO_FINISH_UNREF);
   record_timer(GET_OVERALL_TIME);
   record_timer_simple(GET_OVERALL_TIME);
   return s;
 }
 
+Status DBImpl::ApplyMergeOperands(const Slice& user_key, const Slice* base,
+                                  const std::vector<std::string>& operands,
+                                  std::string* value) {
+  const MergeOperator* merge_operator = options_.merge_operator;
+  if (merge_operator == NULL) {
+    return Status::NotSupported("no merge operator for ", user_key);
+  }
+  std::string existing;
+  bool has_existing = (base != NULL);
+  if (has_existing) {
+    existing.assign(base->data(), base->size());
+  }
+  for (size_t i = operands.size(); i > 0; i--) {
+    std::string merged;
+    Slice existing_slice(existing);
+    if (!merge_operator->Merge(user_key,
+                               has_existing ? &existing_slice : NULL,
+                               operands[i - 1], &merged)) {
+      return Status::Corruption("merge operator failed for ", user_key);
+    }
+    existing.swap(merged);
+    has_existing = true;
+  }
+  value->swap(existing);
+  return Status::OK();
+}
+
+Status DBImpl::ResolveValuePointer(const ReadOptions& options,
+                                   const Slice& pointer,
+                                   std::string* value) {
+  ValuePointer ptr;
+  if (!ptr.DecodeFrom(pointer)) {
+    return Status::Corruption("bad value pointer");
+  }
+  return vlog_->Get(options, ptr, value);
+}
+
 Status DBImpl::GetCurrentVersionState(std::string* value) {
 	if (versions_ == NULL) {
 		printf("versions_ is NULL !!\n");
@@ -1669,16 +2427,147 @@ Status DBImpl::GetCurrentVersionState(std::string* value) {
 	return Status::OK();
 }
 
+Status DBImpl::SetOptions(const Options& options) {
+  if (options.level0_sentinel_compaction_trigger < 1 ||
+      options.level0_guard_compaction_trigger < 1) {
+    return Status::InvalidArgument("compaction triggers must be at least 1");
+  }
+  MutexLock l(&mutex_);
+  versions_->SetGuardCompactionTriggers(options);
+  Log(options_.info_log, "Level-0 compaction triggers set to %d (sentinel), "
+      "%d (guards)", options.level0_sentinel_compaction_trigger,
+      options.level0_guard_compaction_trigger);
+  // The new thresholds may call for a compaction right away
+  bg_compaction_cv_.Signal();
+  return Status::OK();
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
+  return NewIteratorImpl(options, NULL, false);
+}
+
+namespace {
+
+void UnpinValueLog(void* arg1, void* arg2) {
+  reinterpret_cast<ValueLog*>(arg1)->Unpin(
+      static_cast<uint64_t>(reinterpret_cast<uintptr_t>(arg2)));
+}
+
+}  // namespace
+
+Iterator* DBImpl::NewIteratorImpl(const ReadOptions& options,
+                                  const SequenceNumber* sequence,
+                                  bool external_sync) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, 0, &latest_snapshot, &seed, false);
-  return NewDBIterator(
-      this, user_comparator(), iter,
-      (options.snapshot != NULL
-       ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
-       : latest_snapshot),
-      seed);
+  const SliceTransform* prefix_extractor =
+      options.prefix_same_as_start ? options_.prefix_extractor : NULL;
+  // Bounded and prefix scans hand the internal iterators a limit that the
+  // DB iterator moves with each seek
+  ScanLimit* scan_limit = NULL;
+  ReadOptions internal_options = options;
+  if (options.iterate_upper_bound != NULL || prefix_extractor != NULL) {
+    scan_limit = new ScanLimit;
+    internal_options.iterate_upper_bound = &scan_limit->limit;
+  }
+  // Keep the value log files that the iterator can see
+  const uint64_t vlog_pin = vlog_->Pin();
+  std::vector<const RangeTombstoneList*> range_tombstones;
+  Iterator* iter = NewInternalIterator(internal_options, 0, &latest_snapshot,
+                                       &seed, external_sync, &range_tombstones);
+  SequenceNumber snapshot = latest_snapshot;
+  if (options.snapshot != NULL) {
+    snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
+  } else if (sequence != NULL) {
+    snapshot = *sequence;
+  }
+  Iterator* db_iter = NewDBIterator(
+      this, user_comparator(), iter, snapshot,
+      seed, options.iterate_lower_bound, options.iterate_upper_bound,
+      prefix_extractor, scan_limit, &range_tombstones,
+      options.tombstones_skipped);
+  db_iter->RegisterCleanup(&UnpinValueLog, vlog_,
+                           reinterpret_cast<void*>(
+                               static_cast<uintptr_t>(vlog_pin)));
+  return db_iter;
+}
+
+namespace {
+
+// The bounds of one shard of a parallel scan, owned by its iterator.
+// An empty bound leaves that end of the shard open.
+struct ShardBounds {
+  std::string lower;
+  std::string upper;
+  Slice lower_slice;
+  Slice upper_slice;
+
+  ShardBounds(const Slice& l, const Slice& u)
+      : lower(l.data(), l.size()),
+        upper(u.data(), u.size()),
+        lower_slice(lower),
+        upper_slice(upper) {
+  }
+
+  void Apply(ReadOptions* options) const {
+    options->iterate_lower_bound = lower.empty() ? NULL : &lower_slice;
+    options->iterate_upper_bound = upper.empty() ? NULL : &upper_slice;
+    // Shards may run on different threads, so they cannot share one counter
+    options->tombstones_skipped = NULL;
+  }
+};
+
+static void DeleteShardBounds(void* arg1, void* /*arg2*/) {
+  delete reinterpret_cast<ShardBounds*>(arg1);
+}
+
+}  // namespace
+
+Status DBImpl::NewParallelScan(const ReadOptions& options,
+                               const Range& range, int n,
+                               std::vector<Iterator*>* iterators) {
+  if (n < 1) {
+    return Status::InvalidArgument("parallel scan needs at least one shard");
+  }
+  const Comparator* ucmp = user_comparator();
+  MutexLock l(&mutex_);
+
+  // Guard keys strictly inside the range, from the deepest level that
+  // has any.  Each guard there holds about the same number of keys.
+  std::vector<std::string> guard_keys;
+  for (int level = config::kNumLevels - 1; level >= 0 && guard_keys.empty(); level--) {
+    std::vector<GuardMetaData*> guards = versions_->GetGuardsAtLevel(level);
+    for (size_t i = 0; i < guards.size(); i++) {
+      Slice key = guards[i]->guard_key.user_key();
+      if ((range.start.empty() || ucmp->Compare(key, range.start) > 0) &&
+          (range.limit.empty() || ucmp->Compare(key, range.limit) < 0)) {
+        guard_keys.push_back(key.ToString());
+      }
+    }
+  }
+
+  // The guard keys split the range into guard_keys.size() + 1 segments;
+  // give each shard an even share of them
+  std::vector<std::string> splits;
+  const size_t segments = guard_keys.size() + 1;
+  const size_t shards = std::min<size_t>(n, segments);
+  for (size_t i = 1; i < shards; i++) {
+    splits.push_back(guard_keys[i * segments / shards - 1]);
+  }
+
+  // One sequence number for all shards, read under the same lock as the
+  // version and memtables they iterate
+  const SequenceNumber sequence = versions_->LastSequence();
+  for (size_t i = 0; i <= splits.size(); i++) {
+    ShardBounds* bounds = new ShardBounds(i == 0 ? range.start : Slice(splits[i - 1]),
+                                          i == splits.size() ? range.limit : Slice(splits[i]));
+    ReadOptions shard_options = options;
+    bounds->Apply(&shard_options);
+    Iterator* iter = NewIteratorImpl(shard_options, &sequence, true);
+    iter->RegisterCleanup(&DeleteShardBounds, bounds, NULL);
+    iterators->push_back(iter);
+  }
+  return Status::OK();
 }
 
 void DBImpl::GetReplayTimestamp(std::string* timestamp) {
@@ -1793,11 +2682,13 @@ Status DBImpl::GetReplayIterator(const std::string& timestamp,
   SequenceNumber latest_snapshot;
   uint32_t seed;
   MutexLock l(&mutex_);
+  const uint64_t vlog_pin = vlog_->Pin();
   Iterator* internal_iter = NewInternalIterator(options, file, &latest_snapshot, &seed, true);
   internal_iter->SeekToFirst();
   ReplayIteratorImpl* iterimpl;
   iterimpl = new ReplayIteratorImpl(
-      this, &mutex_, user_comparator(), internal_iter, mem_, SequenceNumber(seqno));
+      this, &mutex_, user_comparator(), internal_iter, mem_,
+      SequenceNumber(seqno), vlog_pin);
   *iter = iterimpl;
   replay_iters_.push_back(iterimpl);
   return Status::OK();
@@ -1809,6 +2700,7 @@ void DBImpl::ReleaseReplayIterator(ReplayIterator* _iter) {
   for (std::list<ReplayIteratorImpl*>::iterator it = replay_iters_.begin();
       it != replay_iters_.end(); ++it) {
     if (*it == iter) {
+      vlog_->Unpin(iter->value_log_pin());
       iter->cleanup(); // calls delete
       replay_iters_.erase(it);
       return;
@@ -1862,10 +2754,120 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& value) {
+  if (options_.merge_operator == NULL) {
+    return Status::NotSupported("no merge operator");
+  }
+  return DB::Merge(options, key, value);
+}
+
+namespace {
+
+// Copies a batch, appending the values of at least "threshold" bytes to
+// the value log and putting pointers to them in their place.
+class ValueSeparator : public WriteBatch::Handler {
+ public:
+  ValueSeparator(ValueLog* vlog, size_t threshold, WriteBatch* result)
+    : vlog_(vlog),
+      threshold_(threshold),
+      result_(result),
+      separated_(false),
+      status_() {
+  }
+  bool separated() const { return separated_; }
+  Status status() const { return status_; }
+
+  virtual void Put(const Slice& key, const Slice& value) {
+    if (value.size() < threshold_ || !status_.ok()) {
+      result_->Put(key, value);
+      return;
+    }
+    ValuePointer ptr;
+    status_ = vlog_->Add(key, value, &ptr);
+    if (!status_.ok()) {
+      return;
+    }
+    std::string pointer;
+    ptr.EncodeTo(&pointer);
+    WriteBatchInternal::PutValuePointer(result_, key, pointer);
+    separated_ = true;
+  }
+  virtual void Delete(const Slice& key) {
+    result_->Delete(key);
+  }
+  virtual void HandleGuard(const Slice& key, unsigned level) {
+    result_->PutGuard(key, level);
+  }
+  virtual void PutValuePointer(const Slice& key, const Slice& pointer) {
+    WriteBatchInternal::PutValuePointer(result_, key, pointer);
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    // Operands stay in the tree, where compactions combine them
+    result_->Merge(key, value);
+  }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    result_->DeleteRange(begin, end);
+  }
+
+ private:
+  ValueLog* const vlog_;
+  const size_t threshold_;
+  WriteBatch* const result_;
+  bool separated_;
+  Status status_;
+
+  ValueSeparator(const ValueSeparator&);
+  ValueSeparator& operator = (const ValueSeparator&);
+};
+
+}  // namespace
+
+Status DBImpl::MaybeNewValueLogFile() {
+  if (!vlog_->NeedsNewFile()) {
+    return Status::OK();
+  }
+  MutexLock l(&mutex_);
+  Status s;
+  if (vlog_->NeedsNewFile()) {
+    uint64_t number = versions_->NewFileNumber();
+    s = vlog_->NewFile(number);
+  }
+  return s;
+}
+
+Status DBImpl::SeparateValues(const WriteBatch* updates, bool sync,
+                              WriteBatch* result) {
+  Status s = MaybeNewValueLogFile();
+  if (!s.ok()) {
+    return s;
+  }
+  ValueSeparator separator(vlog_, options_.value_log_threshold, result);
+  s = updates->Iterate(&separator);
+  if (s.ok()) {
+    s = separator.status();
+  }
+  // The log record written next refers to these values
+  if (s.ok() && sync && separator.separated()) {
+    s = vlog_->Sync();
+  }
+  return s;
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   Writer w(&writers_mutex_);
   Status s;
 
+  // Move the large values out before the write is sequenced
+  WriteBatch separated;
+  if (updates != NULL && options_.value_log_threshold > 0) {
+    s = SeparateValues(updates, options.sync, &separated);
+    if (!s.ok()) {
+      return s;
+    }
+    updates = &separated;
+  }
+
   start_timer_simple(WRITE_OVERALL_TIME);
   start_timer(WRITE_OVERALL_TIME);
   start_timer(WRITE_SEQUENCE_WRITE_BEGIN_TOTAL);
@@ -2259,6 +3261,50 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
+  } else if (in == "block-cache-tiers") {
+    // Hit rates of the high priority (index and filter) and low priority
+    // (data) tiers of the block cache
+    char buf[200];
+    value->append("Tier        Hits     Misses  HitRate\n"
+                  "-------------------------------------\n");
+    const Cache::Priority tiers[] = { Cache::kHighPriority, Cache::kLowPriority };
+    for (int t = 0; t < 2; t++) {
+      uint64_t hits, misses;
+      if (!options_.block_cache->GetHitCounts(tiers[t], &hits, &misses)) {
+        value->clear();
+        return false;
+      }
+      const uint64_t lookups = hits + misses;
+      snprintf(buf, sizeof(buf), "%-4s %10llu %10llu %7.2f%%\n",
+               t == 0 ? "high" : "low",
+               static_cast<unsigned long long>(hits),
+               static_cast<unsigned long long>(misses),
+               lookups > 0 ? 100.0 * hits / lookups : 0.0);
+      value->append(buf);
+    }
+    return true;
+  } else if (in == "compressed-block-cache") {
+    // Blocks added to the compressed cache after being read from a table,
+    // and lookups after block cache misses that it served (and promoted
+    // into the block cache) or missed
+    Cache* cache = options_.compressed_block_cache;
+    uint64_t inserts, hits, misses;
+    if (cache == NULL || !cache->GetInsertCount(&inserts) ||
+        !cache->GetHitCounts(Cache::kLowPriority, &hits, &misses)) {
+      return false;
+    }
+    char buf[200];
+    const uint64_t lookups = hits + misses;
+    snprintf(buf, sizeof(buf),
+             "   Inserts Promotions     Misses  HitRate\n"
+             "-----------------------------------------\n"
+             "%10llu %10llu %10llu %7.2f%%\n",
+             static_cast<unsigned long long>(inserts),
+             static_cast<unsigned long long>(hits),
+             static_cast<unsigned long long>(misses),
+             lookups > 0 ? 100.0 * hits / lookups : 0.0);
+    value->append(buf);
+    return true;
   }
 
   return false;
@@ -2372,6 +3418,7 @@ Status DBImpl::LiveBackup(const Slice& _name) {
         case kDescriptorFile:
         case kCurrentFile:
         case kInfoLogFile:
+        case kValueLogFile:
           s = env_->CopyFile(src, target);
           break;
         case kTableFile:
@@ -2442,6 +3489,49 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin,
+                       const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::Get(const ReadOptions& options, const Slice& key,
+               PinnableSlice* value) {
+  value->Reset();
+  std::string result;
+  Status s = Get(options, key, &result);
+  if (s.ok()) {
+    value->PinSelf(result);
+  }
+  return s;
+}
+
+Status DB::SetOptions(const Options& options) {
+  return Status::NotSupported("SetOptions");
+}
+
+Status DB::NewParallelScan(const ReadOptions& options, const Range& range,
+                           int n, std::vector<Iterator*>* iterators) {
+  if (n < 1) {
+    return Status::InvalidArgument("parallel scan needs at least one shard");
+  }
+  ShardBounds* bounds = new ShardBounds(range.start, range.limit);
+  ReadOptions shard_options = options;
+  bounds->Apply(&shard_options);
+  Iterator* iter = NewIterator(shard_options);
+  iter->RegisterCleanup(&DeleteShardBounds, bounds, NULL);
+  iterators->push_back(iter);
+  return Status::OK();
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
@@ -2486,6 +3576,7 @@ Status DB::Open(const Options& options, const std::string& dbname,
   impl->allow_background_activity_ = true;
   impl->bg_compaction_cv_.SignalAll();
   impl->bg_memtable_cv_.SignalAll();
+  impl->bg_value_log_cv_.SignalAll();
   impl->mutex_.Unlock();
 
   if (s.ok()) {
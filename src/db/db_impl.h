@@ -19,6 +19,7 @@
 #include "db/log_writer.h"
 #include "db/replay_iterator.h"
 #include "db/snapshot.h"
+#include "db/value_log.h"
 #include "pebblesdb/db.h"
 #include "pebblesdb/env.h"
 #include "port/port.h"
@@ -47,12 +48,21 @@ class DBImpl : public DB {
   // Implementations of the DB interface
   virtual Status Put(const WriteOptions&, const Slice& key, const Slice& value);
   virtual Status Delete(const WriteOptions&, const Slice& key);
+  virtual Status Merge(const WriteOptions&, const Slice& key,
+                       const Slice& value);
   virtual Status Write(const WriteOptions& options, WriteBatch* updates);
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key,
+                     PinnableSlice* value);
   virtual Status GetCurrentVersionState(std::string* value);
+  virtual Status SetOptions(const Options& options);
   virtual Iterator* NewIterator(const ReadOptions&);
+  virtual Status NewParallelScan(const ReadOptions& options,
+                                 const Range& range, int n,
+                                 std::vector<Iterator*>* iterators);
   virtual void GetReplayTimestamp(std::string* timestamp);
   virtual void AllowGarbageCollectBeforeTimestamp(const std::string& timestamp);
   virtual bool ValidateTimestamp(const std::string& timestamp);
@@ -104,6 +114,23 @@ class DBImpl : public DB {
   // REQURES: mutex_ not held
   SequenceNumber LastSequence();
 
+  // Read the value that the encoded ValuePointer "pointer" refers to.
+  Status ResolveValuePointer(const ReadOptions& options, const Slice& pointer,
+                             std::string* value);
+
+  // Rewrite the value log file with the most garbage, if any holds garbage.
+  Status TEST_CollectValueLog();
+
+  // Return the number of range tombstones in the current version.
+  size_t TEST_NumRangeTombstones();
+
+  // Apply the merge "operands" of "user_key", newest first, to "base",
+  // the value below them (NULL if there is none), and store the result
+  // in *value.
+  Status ApplyMergeOperands(const Slice& user_key, const Slice* base,
+                            const std::vector<std::string>& operands,
+                            std::string* value);
+
  private:
   friend class DB;
   struct CompactionState;
@@ -111,7 +138,22 @@ class DBImpl : public DB {
 
   Iterator* NewInternalIterator(const ReadOptions&, uint64_t number,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed, bool external_sync);
+                                uint32_t* seed, bool external_sync,
+                                std::vector<const RangeTombstoneList*>* range_tombstones = NULL);
+
+  // If "type" is non-NULL, pointers into the value log are returned as
+  // they are, with their type in *type, instead of being resolved, and
+  // the merge operands above them are stored in *operands, newest first,
+  // instead of being applied.
+  Status GetImpl(const ReadOptions& options, const Slice& key,
+                 PinnableSlice* value, bool pin_memtable, ValueType* type,
+                 std::vector<std::string>* operands);
+
+  // Like NewIterator(), but reads as of "*sequence" instead of the latest
+  // state if "sequence" is non-NULL and options.snapshot is NULL.
+  Iterator* NewIteratorImpl(const ReadOptions& options,
+                            const SequenceNumber* sequence,
+                            bool external_sync);
 
   Status NewDB();
 
@@ -124,6 +166,9 @@ class DBImpl : public DB {
 
   // Delete any unneeded files and stale in-memory entries.
   void DeleteObsoleteFiles();
+
+  // Forget the range tombstones that no longer cover anything.
+  Status DropObsoleteRangeTombstones() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   
   // A background thread to compact the in-memory write buffer to disk.
   // Switches to a new log-file/memtable and writes a new descriptor iff
@@ -152,6 +197,30 @@ class DBImpl : public DB {
   // REQUIRES: writers_mutex_ not held
   void WaitOutWriters();
 
+  // Start a new value log file if Add() needs one.
+  // REQUIRES: mutex_ not held
+  Status MaybeNewValueLogFile();
+  // Copy "updates" into *result, moving the large values to the value log.
+  Status SeparateValues(const WriteBatch* updates, bool sync,
+                        WriteBatch* result);
+
+  // A background thread to rewrite value log files holding much garbage.
+  static void ValueLogGCWrapper(void* db)
+  { reinterpret_cast<DBImpl*>(db)->ValueLogGCThread(); }
+  void ValueLogGCThread();
+  Status CollectValueLogFile(uint64_t number) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Point keys[i] at the copy moved[i] of the value at old[i], leaving out
+  // the keys that no longer refer to old[i] once earlier writes are done.
+  // Keys with merge operands above old[i] get the merged value instead.
+  // REQUIRES: mutex_ not held
+  Status WriteRelocatedValues(const std::vector<std::string>& keys,
+                              const std::vector<ValuePointer>& old,
+                              const std::vector<std::string>& moved);
+  // Is "ptr" the newest value of "key", save for the merge operands it
+  // stores in *operands?
+  bool ValuePointerIsLive(const Slice& key, const ValuePointer& ptr,
+                          std::vector<std::string>* operands);
+
   static void CompactLevelWrapper(void* db)
   { reinterpret_cast<DBImpl*>(db)->CompactLevelThread(); }
   void CompactLevelThread();
@@ -167,6 +236,13 @@ class DBImpl : public DB {
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWorkForGuardsInALevel(CompactionState* compact)
   	  EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // The input is at a merge operand that every snapshot sees.  Combine it
+  // with the older entries for its key that it can absorb, leaving the
+  // input at the first entry it did not, and store the result in *key and
+  // *value.
+  Status FoldMergeOperands(CompactionState* compact, Iterator* input,
+                           std::string* key, std::string* value,
+                           SequenceNumber* last_sequence_for_key);
   Status DoCompactionWorkGuards(CompactionState* compact,
 		  std::vector<GuardMetaData*> complete_guards_used_in_bg_compaction,
 		  FileLevelFilterBuilder* file_level_filter_builder)
@@ -189,6 +265,9 @@ class DBImpl : public DB {
   // table_cache_ provides its own synchronization
   TableCache* table_cache_;
 
+  // vlog_ provides its own synchronization
+  ValueLog* vlog_;
+
   // Lock over the persistent DB state.  Non-NULL iff successfully acquired.
   FileLock* db_lock_;
 
@@ -223,6 +302,8 @@ class DBImpl : public DB {
   port::CondVar bg_compaction_cv_;
   // Communicate with memtable->L0 background thread
   port::CondVar bg_memtable_cv_;
+  // Communicate with value log garbage collection background thread
+  port::CondVar bg_value_log_cv_;
   // Mutual exlusion protecting the LogAndApply func
   port::CondVar bg_log_cv_;
   bool bg_log_occupied_;
@@ -6,6 +6,8 @@
 
 #include "db/db_iter.h"
 
+#include <algorithm>
+
 #include "db/filename.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
@@ -51,30 +53,53 @@ class DBIter: public Iterator {
   };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, const Slice* lower_bound, const Slice* upper_bound,
+         const SliceTransform* prefix_extractor, ScanLimit* scan_limit,
+         std::vector<const RangeTombstoneList*>* range_tombstones,
+         uint64_t* tombstones_skipped)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        lower_bound_(lower_bound),
+        upper_bound_(upper_bound),
+        prefix_extractor_(prefix_extractor),
+        scan_limit_(scan_limit),
+        prefix_(),
+        prefix_active_(false),
         status_(),
         saved_key_(),
         saved_value_(),
+        resolved_value_(),
+        value_resolved_(false),
+        past_current_(false),
+        operands_(),
         direction_(kForward),
         valid_(false),
         rnd_(seed),
         bytes_counter_(RandomPeriod()),
-        tombstones_counter_(0) {
+        tombstones_counter_(0),
+        tombstones_skipped_(tombstones_skipped),
+        range_tombstones_() {
+    if (range_tombstones != NULL) {
+      range_tombstones_.swap(*range_tombstones);
+    }
   }
   virtual ~DBIter() {
     delete iter_;
+    delete scan_limit_;
   }
   virtual bool Valid() const { return valid_; }
   virtual Slice key() const {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !past_current_) ?
+        ExtractUserKey(iter_->key()) : saved_key_;
   }
   virtual Slice value() const {
     assert(valid_);
+    if (value_resolved_) {
+      return resolved_value_;
+    }
     return (direction_ == kForward) ? iter_->value() : saved_value_;
   }
   virtual const Status& status() const {
@@ -95,6 +120,14 @@ class DBIter: public Iterator {
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
+  bool ResolveValue(ValueType type, const Slice& raw_value);
+  bool MergeValue(ValueType base_type, const Slice& raw_base);
+  bool MergeForward();
+  void SetScanRange(const Slice* target);
+  bool PastScanEnd(const Slice& user_key) const;
+  bool BeforeScanStart(const Slice& user_key) const;
+  bool OutsidePrefix(const Slice& user_key) const;
+  void SeekToLowerBound();
 
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
@@ -118,16 +151,30 @@ class DBIter: public Iterator {
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  const Slice* const lower_bound_;  // Inclusive; NULL if unbounded
+  const Slice* const upper_bound_;  // Exclusive; NULL if unbounded
+  const SliceTransform* const prefix_extractor_;  // NULL unless prefix scans
+  ScanLimit* const scan_limit_;     // Shared with iter_; may be NULL
+  std::string prefix_;              // Prefix of the last Seek() target
+  bool prefix_active_;              // Confine the scan to prefix_?
 
   Status status_;
   std::string saved_key_;     // == current key when direction_==kReverse
   std::string saved_value_;   // == current raw value when direction_==kReverse
+  std::string resolved_value_;  // == current value when value_resolved_
+  bool value_resolved_;       // Was the value read or merged from elsewhere?
+  // True if, moving forward, iter_ went past the entries the current one
+  // was merged from; saved_key_ then holds the current key.
+  bool past_current_;
+  std::vector<std::string> operands_;  // Merge operands, newest first
   Direction direction_;
   bool valid_;
 
   Random rnd_;
   ssize_t bytes_counter_;
   ssize_t tombstones_counter_;
+  uint64_t* const tombstones_skipped_;  // NULL if not counted
+  std::vector<const RangeTombstoneList*> range_tombstones_;
 
   // No copying allowed
   DBIter(const DBIter&);
@@ -146,7 +193,22 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
     status_ = Status::Corruption("corrupted internal key in DBIter");
     return false;
   } else {
+    // An entry under a range tombstone reads as a deletion
+    if (!range_tombstones_.empty() && ikey->sequence <= sequence_) {
+      SequenceNumber deleted_before = 0;
+      for (size_t i = 0; i < range_tombstones_.size(); i++) {
+        deleted_before = std::max(deleted_before,
+                                  range_tombstones_[i]->NewestCovering(
+                                      ikey->user_key, sequence_));
+      }
+      if (ikey->sequence < deleted_before) {
+        ikey->type = kTypeDeletion;
+      }
+    }
     if (ikey->type == kTypeDeletion) {
+        if (tombstones_skipped_ != NULL) {
+          ++(*tombstones_skipped_);
+        }
         ++tombstones_counter_;
         if (tombstones_counter_ > 64) {
             db_->RecordReadSample(k);
@@ -157,6 +219,130 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
   }
 }
 
+// Read the value of the current entry from the value log if "raw_value"
+// is a pointer into it.  Returns false on error.
+bool DBIter::ResolveValue(ValueType type, const Slice& raw_value) {
+  value_resolved_ = (type == kTypeValuePointer);
+  if (value_resolved_) {
+    Status s = db_->ResolveValuePointer(ReadOptions(), raw_value,
+                                        &resolved_value_);
+    if (!s.ok()) {
+      status_ = s;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Apply operands_ to the value below them, the raw value "raw_base" of
+// type "base_type" (kTypeDeletion if there is none), and make the result
+// the current value.  Returns false on error.
+bool DBIter::MergeValue(ValueType base_type, const Slice& raw_base) {
+  Slice base = raw_base;
+  std::string resolved;
+  Status s;
+  if (base_type == kTypeValuePointer) {
+    s = db_->ResolveValuePointer(ReadOptions(), raw_base, &resolved);
+    base = resolved;
+  }
+  if (s.ok()) {
+    s = db_->ApplyMergeOperands(saved_key_,
+                                (base_type == kTypeDeletion) ? NULL : &base,
+                                operands_, &resolved_value_);
+  }
+  if (!s.ok()) {
+    status_ = s;
+    return false;
+  }
+  value_resolved_ = true;
+  return true;
+}
+
+// iter_ is at a merge operand visible at sequence_.  Merge it with the
+// entries for its key below it, leaving iter_ after the last one used.
+bool DBIter::MergeForward() {
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  operands_.clear();
+  operands_.push_back(iter_->value().ToString());
+  past_current_ = true;
+  ValueType base_type = kTypeDeletion;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey)) {
+      continue;
+    }
+    if (user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      operands_.push_back(iter_->value().ToString());
+      continue;
+    }
+    if (ikey.type == kTypeValue || ikey.type == kTypeValuePointer) {
+      base_type = ikey.type;
+      Slice raw_base = iter_->value();
+      saved_value_.assign(raw_base.data(), raw_base.size());
+    }
+    break;
+  }
+  return MergeValue(base_type, saved_value_);
+}
+
+// Record the range that the scan starting at "target" (NULL for
+// SeekToFirst() and SeekToLast()) may return, and narrow *scan_limit_ to
+// it so that iter_ can skip the files that hold nothing in it.
+void DBIter::SetScanRange(const Slice* target) {
+  prefix_active_ = prefix_extractor_ != NULL && target != NULL &&
+                   prefix_extractor_->InDomain(*target);
+  if (prefix_active_) {
+    Slice prefix = prefix_extractor_->Transform(*target);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
+  if (scan_limit_ == NULL) {
+    return;
+  }
+  scan_limit_->key.clear();
+  if (upper_bound_ != NULL) {
+    scan_limit_->key.assign(upper_bound_->data(), upper_bound_->size());
+  }
+  std::string successor;
+  // Keys with one prefix end at its successor only in bytewise order
+  if (prefix_active_ && user_comparator_ == BytewiseComparator() &&
+      PrefixSuccessor(prefix_, &successor) &&
+      (scan_limit_->key.empty() ||
+       user_comparator_->Compare(successor, scan_limit_->key) < 0)) {
+    scan_limit_->key.swap(successor);
+  }
+  scan_limit_->limit = scan_limit_->key;
+}
+
+inline bool DBIter::OutsidePrefix(const Slice& user_key) const {
+  return prefix_active_ &&
+         (!prefix_extractor_->InDomain(user_key) ||
+          prefix_extractor_->Transform(user_key) != Slice(prefix_));
+}
+
+inline bool DBIter::PastScanEnd(const Slice& user_key) const {
+  return (upper_bound_ != NULL &&
+          user_comparator_->Compare(user_key, *upper_bound_) >= 0) ||
+         OutsidePrefix(user_key);
+}
+
+inline bool DBIter::BeforeScanStart(const Slice& user_key) const {
+  return (lower_bound_ != NULL &&
+          user_comparator_->Compare(user_key, *lower_bound_) < 0) ||
+         OutsidePrefix(user_key);
+}
+
+// Position iter_ at the first entry visible at sequence_ whose user key
+// is at or after *lower_bound_.
+void DBIter::SeekToLowerBound() {
+  std::string start;
+  AppendInternalKey(
+      &start, ParsedInternalKey(*lower_bound_, sequence_, kValueTypeForSeek));
+  iter_->Seek(start);
+}
+
 void DBIter::Next() {
   assert(valid_);
 
@@ -166,7 +352,11 @@ void DBIter::Next() {
     // so advance into the range of entries for this->key() and then
     // use the normal skipping code below.
     if (!iter_->Valid()) {
-      iter_->SeekToFirst();
+      if (lower_bound_ != NULL) {
+        SeekToLowerBound();
+      } else {
+        iter_->SeekToFirst();
+      }
     } else {
       iter_->Next();
     }
@@ -176,6 +366,14 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (past_current_) {
+    // saved_key_ holds the current key and iter_ is past the entries used
+    if (!iter_->Valid()) {
+      valid_ = false;
+      past_current_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -188,9 +386,14 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  past_current_ = false;
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      if (PastScanEnd(ikey.user_key)) {
+        // Reached the end of the requested range
+        break;
+      }
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
@@ -199,15 +402,25 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           skipping = true;
           break;
         case kTypeValue:
+        case kTypeValuePointer:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
           } else {
-            valid_ = true;
+            valid_ = ResolveValue(ikey.type, iter_->value());
             saved_key_.clear();
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+          } else {
+            valid_ = MergeForward();
+            return;
+          }
+          break;
         default:
           break;
       }
@@ -224,8 +437,16 @@ void DBIter::Prev() {
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    if (past_current_) {
+      // saved_key_ holds the current key; iter_ is somewhere after it
+      past_current_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
       iter_->Prev();
       if (!iter_->Valid()) {
@@ -247,12 +468,19 @@ void DBIter::Prev() {
 
 void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
+  past_current_ = false;
 
   ValueType value_type = kTypeDeletion;
+  ValueType base_type = kTypeDeletion;  // Of the value below operands_
+  operands_.clear();
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
       if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+        if (BeforeScanStart(ikey.user_key)) {
+          // Reached the start of the requested range
+          break;
+        }
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
@@ -262,7 +490,15 @@ void DBIter::FindPrevUserEntry() {
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
+          operands_.clear();
+          base_type = kTypeDeletion;
+        } else if (value_type == kTypeMerge) {
+          // Collected oldest first; reversed below
+          SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+          operands_.push_back(iter_->value().ToString());
         } else {
+          operands_.clear();
+          base_type = value_type;
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
             std::string empty;
@@ -282,14 +518,23 @@ void DBIter::FindPrevUserEntry() {
     saved_key_.clear();
     ClearSavedValue();
     direction_ = kForward;
+  } else if (value_type == kTypeMerge) {
+    std::reverse(operands_.begin(), operands_.end());
+    valid_ = MergeValue(base_type, saved_value_);
   } else {
-    valid_ = true;
+    valid_ = ResolveValue(value_type, saved_value_);
   }
 }
 
-void DBIter::Seek(const Slice& target) {
+void DBIter::Seek(const Slice& user_target) {
   direction_ = kForward;
   ClearSavedValue();
+  Slice target = user_target;
+  if (lower_bound_ != NULL &&
+      user_comparator_->Compare(target, *lower_bound_) < 0) {
+    target = *lower_bound_;
+  }
+  SetScanRange(&target);
   saved_key_.clear();
   AppendInternalKey(
       &saved_key_, ParsedInternalKey(target, sequence_, kValueTypeForSeek));
@@ -304,7 +549,12 @@ void DBIter::Seek(const Slice& target) {
 void DBIter::SeekToFirst() {
   direction_ = kForward;
   ClearSavedValue();
-  iter_->SeekToFirst();
+  SetScanRange(NULL);
+  if (lower_bound_ != NULL) {
+    SeekToLowerBound();
+  } else {
+    iter_->SeekToFirst();
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -315,7 +565,21 @@ void DBIter::SeekToFirst() {
 void DBIter::SeekToLast() {
   direction_ = kReverse;
   ClearSavedValue();
-  iter_->SeekToLast();
+  SetScanRange(NULL);
+  if (upper_bound_ != NULL) {
+    // Position just before the first entry at or past the bound
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_,
+        ParsedInternalKey(*upper_bound_, kMaxSequenceNumber, kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  } else {
+    iter_->SeekToLast();
+  }
   FindPrevUserEntry();
 }
 
@@ -326,8 +590,16 @@ Iterator* NewDBIterator(
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
-    uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+    uint32_t seed,
+    const Slice* lower_bound,
+    const Slice* upper_bound,
+    const SliceTransform* prefix_extractor,
+    ScanLimit* scan_limit,
+    std::vector<const RangeTombstoneList*>* range_tombstones,
+    uint64_t* tombstones_skipped) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    lower_bound, upper_bound, prefix_extractor, scan_limit,
+                    range_tombstones, tombstones_skipped);
 }
 
 }  // namespace leveldb
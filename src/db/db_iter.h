@@ -13,15 +13,40 @@ namespace leveldb {
 
 class DBImpl;
 
+// The exclusive end of the range a DB iterator is currently scanning.
+// The internal iterators beneath it see "limit" as their
+// ReadOptions::iterate_upper_bound and skip files with nothing before it;
+// an empty limit leaves them unbounded.
+struct ScanLimit {
+  std::string key;
+  Slice limit;
+};
+
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  If "lower_bound" is non-NULL, user keys
+// before *lower_bound are never returned; if "upper_bound" is non-NULL,
+// user keys at or after *upper_bound are never returned.  If
+// "prefix_extractor" is
+// non-NULL, a Seek() to a key in its domain only returns keys with the
+// same prefix.  If "scan_limit" is non-NULL the iterator keeps it up to
+// date with both restrictions and takes ownership of it.  Entries hidden
+// by the range tombstones in "*range_tombstones", if non-NULL, are skipped;
+// the iterator takes the contents of the vector, and the lists must live
+// as long as "*internal_iter".  Every deletion the
+// iterator steps over is added to "*tombstones_skipped" if it is non-NULL.
 extern Iterator* NewDBIterator(
     DBImpl* db,
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
-    uint32_t seed);
+    uint32_t seed,
+    const Slice* lower_bound = NULL,
+    const Slice* upper_bound = NULL,
+    const SliceTransform* prefix_extractor = NULL,
+    ScanLimit* scan_limit = NULL,
+    std::vector<const RangeTombstoneList*>* range_tombstones = NULL,
+    uint64_t* tombstones_skipped = NULL);
 
 }  // namespace leveldb
 
@@ -4,6 +4,8 @@
 
 #define __STDC_LIMIT_MACROS
 
+#include <algorithm>
+#include <set>
 #include "pebblesdb/db.h"
 #include "pebblesdb/filter_policy.h"
 #include "db/db_impl.h"
@@ -11,8 +13,13 @@
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "pebblesdb/cache.h"
+#include "pebblesdb/compaction_filter.h"
 #include "pebblesdb/env.h"
+#include "pebblesdb/merge_operator.h"
+#include "pebblesdb/persistent_cache.h"
+#include "pebblesdb/slice_transform.h"
 #include "pebblesdb/table.h"
+#include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -68,6 +75,33 @@ class SpecialEnv : public EnvWrapper {
   void WaitForThread(unsigned long int th, void** return_status) {
   }
 
+  struct DelayedThread {
+    SpecialEnv* env;
+    void (*function)(void*);
+    void* arg;
+  };
+
+  static void DelayedThreadBody(void* arg) {
+    DelayedThread* t = reinterpret_cast<DelayedThread*>(arg);
+    while (t->env->delay_threads_.Acquire_Load() != NULL) {
+      DelayMilliseconds(10);
+    }
+    (*t->function)(t->arg);
+    delete t;
+  }
+
+  void StartThread(void (*f)(void*), void* a) {
+    if (delay_threads_.Acquire_Load() == NULL) {
+      target()->StartThread(f, a);
+      return;
+    }
+    DelayedThread* t = new DelayedThread;
+    t->env = this;
+    t->function = f;
+    t->arg = a;
+    target()->StartThread(&DelayedThreadBody, t);
+  }
+
   pthread_t GetThreadId() {
 	  return 0;
   }
@@ -90,11 +124,16 @@ class SpecialEnv : public EnvWrapper {
   // Force write to manifest files to fail while this pointer is non-NULL
   port::AtomicPointer manifest_write_error_;
 
+  // Threads started while this pointer is non-NULL do not run until it is
+  // cleared.  Holds back a DB's background compactions.
+  port::AtomicPointer delay_threads_;
+
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
   explicit SpecialEnv(Env* base) : EnvWrapper(base) {
     delay_data_sync_.Release_Store(NULL);
+    delay_threads_.Release_Store(NULL);
     data_sync_error_.Release_Store(NULL);
     no_space_.Release_Store(NULL);
     non_writable_.Release_Store(NULL);
@@ -213,6 +252,9 @@ class SpecialEnv : public EnvWrapper {
         counter_->Increment();
         return target_->Read(offset, n, result, scratch);
       }
+      virtual void Prefetch(uint64_t offset, size_t n) const {
+        target_->Prefetch(offset, n);
+      }
     };
 
     Status s = target()->NewRandomAccessFile(f, r);
@@ -430,6 +472,15 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeValuePointer:
+              result += "PTR";
+              break;
+            case kTypeMerge:
+              result += "MERGE(" + iter->value().ToString() + ")";
+              break;
+            case kTypeRangeDeletion:
+              result += "DELRANGE";
+              break;
           }
         }
         iter->Next();
@@ -573,6 +624,19 @@ class DBTest {
     return result;
   }
 
+  // Wait until background compactions stop reshaping the levels
+  void WaitForStableFiles() {
+    std::string layout = FilesPerLevel();
+    for (int i = 0; i < 50; i++) {
+      DelayMilliseconds(200);
+      std::string next = FilesPerLevel();
+      if (next == layout) {
+        break;
+      }
+      layout = next;
+    }
+  }
+
   int CountFiles() {
     std::vector<std::string> files;
     env_->GetChildren(dbname_, &files);
@@ -649,6 +713,20 @@ class DBTest {
     return false;
   }
 
+  std::set<uint64_t> TableFileNumbers() {
+    std::vector<std::string> filenames;
+    std::set<uint64_t> numbers;
+    env_->GetChildren(dbname_, &filenames);
+    uint64_t number;
+    FileType type;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type) && type == kTableFile) {
+        numbers.insert(number);
+      }
+    }
+    return numbers;
+  }
+
   // Returns number of files renamed.
   int RenameSSTToLDB() {
     std::vector<std::string> filenames;
@@ -1074,9 +1152,12 @@ TEST(DBTest, RecoverWithLargeLog) {
   }
 
   // Make sure that if we re-open with a small write buffer size that
-  // we flush table files in the middle of a large log file.
+  // we flush table files in the middle of a large log file.  Background
+  // compactions are held so that they cannot move the tables down first.
   Options options = CurrentOptions();
   options.write_buffer_size = 100000;
+  options.env = env_;
+  env_->delay_threads_.Release_Store(env_);
   Reopen(&options);
   ASSERT_EQ(NumTableFilesAtLevel(0), 3);
   ASSERT_EQ(std::string(200000, '1'), Get("big1"));
@@ -1084,6 +1165,7 @@ TEST(DBTest, RecoverWithLargeLog) {
   ASSERT_EQ(std::string(10, '3'), Get("small3"));
   ASSERT_EQ(std::string(10, '4'), Get("small4"));
   ASSERT_GT(NumTableFilesAtLevel(0), 1);
+  env_->delay_threads_.Release_Store(NULL);
 }
 
 TEST(DBTest, CompactionsGenerateMultipleFiles) {
@@ -1805,6 +1887,1358 @@ TEST(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST(DBTest, LevelFilterPolicies) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  const FilterPolicy* fuse = NewBinaryFuseFilterPolicy(8);
+  options.level_filter_policies.assign(config::kNumLevels, fuse);
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  env_->delay_data_sync_.Release_Store(env_);
+
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads_1 = db_->total_files_read;
+  fprintf(stderr, "%d present => %d reads\n", N, reads_1);
+  ASSERT_GE(reads_1, N);
+  ASSERT_LE(reads_1, N + 3*N/100);
+
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  int reads_2 = db_->total_files_read - reads_1;
+  fprintf(stderr, "%d missing => %d reads\n", N, reads_2);
+  ASSERT_LE(reads_2, 3*N/100);
+
+  // Filters are rebuilt from the tables on open and must agree
+  Reopen(&options);
+  for (int i = 0; i < N; i += 10) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+
+  env_->delay_data_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete fuse;
+}
+
+namespace {
+// Keeps every key, so both point and range queries are exact.  Stands in
+// for SuRF, which answers the same questions approximately.
+class ExactRangeFilterPolicy : public FilterPolicy {
+ public:
+  virtual const char* Name() const { return "test.ExactRangeFilter"; }
+  virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const {
+    for (int i = 0; i < n; i++) {
+      PutLengthPrefixedSlice(dst, keys[i]);
+    }
+  }
+  virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const {
+    return RangeMayMatch(key, key.ToString() + '\0', filter);
+  }
+  virtual bool RangeMayMatch(const Slice& start, const Slice& limit,
+                             const Slice& filter) const {
+    Slice input = filter;
+    Slice k;
+    while (GetLengthPrefixedSlice(&input, &k)) {
+      if (k.compare(start) >= 0 && k.compare(limit) < 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+}  // namespace
+
+TEST(DBTest, RangeFilterSkipsFiles) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = new ExactRangeFilterPolicy;
+  Reopen(&options);
+
+  // Only even keys exist, so [Key(odd), Key(odd + 1)) is always empty
+  const int N = 2000;
+  for (int i = 0; i < N; i += 2) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.Release_Store(env_);
+  WaitForStableFiles();
+
+  // Open every table before counting reads
+  ReadOptions ropts;
+  Iterator* iter = db_->NewIterator(ropts);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(count, N / 2);
+  delete iter;
+
+  env_->random_read_counter_.Reset();
+  for (int i = 1; i < N; i += 20) {
+    iter = db_->NewIterator(ropts);
+    iter->Seek(Key(i));
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(Key(i + 1), iter->key().ToString());
+    delete iter;
+  }
+  const int unbounded_reads = env_->random_read_counter_.Read();
+
+  // With an upper bound the filters prove each range empty and no data
+  // block is read
+  std::string upper;
+  Slice upper_slice;
+  ropts.iterate_upper_bound = &upper_slice;
+  env_->random_read_counter_.Reset();
+  for (int i = 1; i < N; i += 20) {
+    upper = Key(i + 1);
+    upper_slice = upper;
+    iter = db_->NewIterator(ropts);
+    iter->Seek(Key(i));
+    ASSERT_TRUE(!iter->Valid());
+    delete iter;
+  }
+  const int bounded_reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d seeks => %d reads unbounded, %d reads bounded\n",
+          N / 20, unbounded_reads, bounded_reads);
+  ASSERT_GE(unbounded_reads, N / 20);
+  ASSERT_EQ(bounded_reads, 0);
+
+  // Ranges that are not empty still return their keys, in both directions
+  upper = Key(N / 2);
+  upper_slice = upper;
+  iter = db_->NewIterator(ropts);
+  count = 0;
+  for (iter->Seek(Key(N / 4)); iter->Valid(); iter->Next()) {
+    ASSERT_LT(iter->key().ToString(), upper);
+    count++;
+  }
+  ASSERT_EQ(count, N / 8);
+  count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(count, N / 4);
+  iter->SeekToLast();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(N / 2 - 2), iter->key().ToString());
+  iter->Prev();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(N / 2 - 4), iter->key().ToString());
+  delete iter;
+
+  env_->delay_data_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+static std::string PrefixKey(int prefix, int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "p%04d/%04d", prefix, i);
+  return std::string(buf);
+}
+
+TEST(DBTest, PrefixSameAsStart) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewFixedPrefixTransform(5);
+  Reopen(&options);
+
+  // Only even prefixes exist
+  const int kPrefixes = 200;
+  const int kKeysPerPrefix = 10;
+  for (int p = 0; p < kPrefixes; p += 2) {
+    for (int i = 0; i < kKeysPerPrefix; i++) {
+      ASSERT_OK(Put(PrefixKey(p, i), PrefixKey(p, i)));
+    }
+  }
+  Compact("a", "z");
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.Release_Store(env_);
+  WaitForStableFiles();
+
+  // Open every table before counting reads
+  ReadOptions ropts;
+  Iterator* iter = db_->NewIterator(ropts);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(count, kPrefixes / 2 * kKeysPerPrefix);
+  delete iter;
+
+  env_->random_read_counter_.Reset();
+  for (int p = 1; p + 1 < kPrefixes; p += 2) {
+    iter = db_->NewIterator(ropts);
+    iter->Seek(PrefixKey(p, 0).substr(0, 5));
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(PrefixKey(p + 1, 0), iter->key().ToString());
+    delete iter;
+  }
+  const int total_order_reads = env_->random_read_counter_.Read();
+
+  // Prefixes missing from every file are answered by the filters alone
+  ropts.prefix_same_as_start = true;
+  env_->random_read_counter_.Reset();
+  for (int p = 1; p + 1 < kPrefixes; p += 2) {
+    iter = db_->NewIterator(ropts);
+    iter->Seek(PrefixKey(p, 0).substr(0, 5));
+    ASSERT_TRUE(!iter->Valid());
+    delete iter;
+  }
+  const int prefix_reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d seeks => %d reads in total order, %d reads by prefix\n",
+          kPrefixes / 2 - 1, total_order_reads, prefix_reads);
+  ASSERT_GE(total_order_reads, kPrefixes / 2 - 1);
+  ASSERT_LE(prefix_reads, kPrefixes / 20);
+
+  // A scan stops at the end of its prefix, in both directions
+  iter = db_->NewIterator(ropts);
+  count = 0;
+  for (iter->Seek(PrefixKey(10, 0).substr(0, 5)); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(PrefixKey(10, count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(count, kKeysPerPrefix);
+  iter->Seek(PrefixKey(10, 3));
+  ASSERT_EQ(PrefixKey(10, 3), iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ(PrefixKey(10, 2), iter->key().ToString());
+  iter->Next();
+  ASSERT_EQ(PrefixKey(10, 3), iter->key().ToString());
+  iter->Seek(PrefixKey(10, 0));
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  iter->Seek(PrefixKey(10, kKeysPerPrefix - 1));
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+
+  // Whole-database positioning ignores the prefix
+  iter->SeekToFirst();
+  ASSERT_EQ(PrefixKey(0, 0), iter->key().ToString());
+  count = 0;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    count++;
+  }
+  ASSERT_EQ(count, kPrefixes / 2 * kKeysPerPrefix);
+  delete iter;
+
+  env_->delay_data_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
+TEST(DBTest, PrefixSameAsStartWithoutFilters) {
+  Options options = CurrentOptions();
+  options.filter_policy = NULL;
+  options.prefix_extractor = NewFixedPrefixTransform(5);
+  Reopen(&options);
+
+  for (int p = 0; p < 4; p++) {
+    for (int i = 0; i < 3; i++) {
+      ASSERT_OK(Put(PrefixKey(p, i), PrefixKey(p, i)));
+    }
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put(PrefixKey(1, 3), PrefixKey(1, 3)));
+
+  // Without filters no file is skipped, but the scan still ends with
+  // its prefix
+  ReadOptions ropts;
+  ropts.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(ropts);
+  int count = 0;
+  for (iter->Seek(PrefixKey(1, 0).substr(0, 5)); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(PrefixKey(1, count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(count, 4);
+  iter->Seek(PrefixKey(2, 0));
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+
+  Close();
+  delete options.prefix_extractor;
+}
+
+TEST(DBTest, IterateBounds) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  Reopen(&options);
+
+  const int kNumKeys = 2000;
+  const std::string value(200, 'v');
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_OK(Put(Key(i), value));
+  }
+  Compact("a", "z");
+  dbfull()->TEST_CompactMemTable();
+  // Entries in the memtable on both sides of the bounds
+  ASSERT_OK(Put(Key(999), "mem"));
+  ASSERT_OK(Put(Key(1500), "mem"));
+  ASSERT_OK(Delete(Key(1005)));
+
+  env_->delay_data_sync_.Release_Store(env_);
+  WaitForStableFiles();
+
+  const std::string lower_key = Key(1000);
+  const std::string upper_key = Key(1020);
+  Slice lower(lower_key);
+  Slice upper(upper_key);
+  ReadOptions ropts;
+  ropts.iterate_lower_bound = &lower;
+  ropts.iterate_upper_bound = &upper;
+  Iterator* iter = db_->NewIterator(ropts);
+
+  std::vector<std::string> forward;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    forward.push_back(iter->key().ToString());
+  }
+  ASSERT_EQ(forward.size(), 19u);
+  ASSERT_EQ(forward.front(), Key(1000));
+  ASSERT_EQ(forward.back(), Key(1019));
+  int pos = forward.size();
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    ASSERT_GT(pos, 0);
+    ASSERT_EQ(forward[--pos], iter->key().ToString());
+  }
+  ASSERT_EQ(pos, 0);
+
+  // Seeks outside the bounds and direction changes at their edges
+  iter->Seek(Key(10));
+  ASSERT_EQ(Key(1000), iter->key().ToString());
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  iter->Seek(Key(1019));
+  ASSERT_EQ(Key(1019), iter->key().ToString());
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  iter->Seek(Key(1010));
+  iter->Prev();
+  ASSERT_EQ(Key(1009), iter->key().ToString());
+  iter->Next();
+  ASSERT_EQ(Key(1010), iter->key().ToString());
+  iter->SeekToLast();
+  ASSERT_EQ(Key(1019), iter->key().ToString());
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  iter->Seek(Key(1500));
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+
+  // An unbounded scan over the same keys has to read past them to stop
+  ReadOptions unbounded;
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(unbounded);
+  int count = 0;
+  for (iter->Seek(lower_key); iter->Valid() && iter->key().compare(upper) < 0;
+       iter->Next()) {
+    count++;
+  }
+  delete iter;
+  const int unbounded_reads = env_->random_read_counter_.Read();
+  ASSERT_EQ(count, 19);
+
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(ropts);
+  count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  const int forward_reads = env_->random_read_counter_.Read();
+  ASSERT_EQ(count, 19);
+  env_->random_read_counter_.Reset();
+  count = 0;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    count++;
+  }
+  const int reverse_reads = env_->random_read_counter_.Read();
+  ASSERT_EQ(count, 19);
+  delete iter;
+  fprintf(stderr, "%d reads unbounded, %d forward and %d reverse when bounded\n",
+          unbounded_reads, forward_reads, reverse_reads);
+  ASSERT_LE(forward_reads, unbounded_reads);
+  ASSERT_LE(reverse_reads, unbounded_reads + 1);
+
+  env_->delay_data_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+}
+
+TEST(DBTest, CacheIndexAndFilterBlocks) {
+  env_->count_random_reads_ = true;
+  const int N = 4000;
+  const int kGets = 20;
+  const std::string value(100, 'v');
+  int get_reads[2];
+  for (int tiered = 0; tiered < 2; tiered++) {
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.block_cache = NewLRUCache(256 << 10, tiered ? 0.5 : 0);
+    options.cache_index_and_filter_blocks = true;
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    for (int i = 0; i < N; i++) {
+      ASSERT_OK(Put(Key(i), value));
+    }
+    Compact("a", "z");
+    dbfull()->TEST_CompactMemTable();
+
+    // Prevent auto compactions triggered by seeks
+    env_->delay_data_sync_.Release_Store(env_);
+    WaitForStableFiles();
+
+    // Each Get follows a full scan that floods the cache with data blocks
+    get_reads[tiered] = 0;
+    for (int g = 0; g < kGets; g++) {
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      int count = 0;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        count++;
+      }
+      ASSERT_EQ(count, N);
+      delete iter;
+
+      env_->random_read_counter_.Reset();
+      ASSERT_EQ(value, Get(Key(g * 50)));
+      get_reads[tiered] += env_->random_read_counter_.Read();
+    }
+
+    std::string tiers;
+    ASSERT_TRUE(db_->GetProperty("leveldb.block-cache-tiers", &tiers));
+    ASSERT_TRUE(tiers.find("high") != std::string::npos);
+
+    env_->delay_data_sync_.Release_Store(NULL);
+    Close();
+    delete options.block_cache;
+    delete options.filter_policy;
+  }
+  fprintf(stderr, "%d gets => %d reads untiered, %d reads tiered\n",
+          kGets, get_reads[0], get_reads[1]);
+
+  // Index blocks kept in the high priority tier survive the scans, so each
+  // Get only reads its data block
+  ASSERT_LT(get_reads[1], get_reads[0]);
+  ASSERT_LE(get_reads[1], kGets);
+}
+
+TEST(DBTest, RowCache) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent block cache hits
+  options.row_cache = NewLRUCache(1 << 20);
+  Reopen(&options);
+
+  const int N = 200;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.Release_Store(env_);
+  WaitForStableFiles();
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  ASSERT_GE(env_->random_read_counter_.Read(), N);
+
+  // Every row is now cached
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  ASSERT_EQ(env_->random_read_counter_.Read(), 0);
+
+  // Newer versions land in newer tables and shadow the cached rows
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put(Key(0), "new"));
+  ASSERT_OK(Delete(Key(1)));
+  dbfull()->TEST_CompactMemTable();
+  for (int pass = 0; pass < 2; pass++) {
+    ASSERT_EQ("new", Get(Key(0)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(1)));
+    ASSERT_EQ(Key(0), Get(Key(0), snapshot));
+    ASSERT_EQ(Key(1), Get(Key(1), snapshot));
+  }
+  db_->ReleaseSnapshot(snapshot);
+
+  env_->delay_data_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete options.row_cache;
+}
+
+TEST(DBTest, CompressedBlockCache) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Every block cache lookup misses
+  options.compressed_block_cache = NewLRUCache(1 << 20);
+  Reopen(&options);
+
+  const int N = 1000;
+  const std::string value(100, 'x');
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), value));
+  }
+  Compact("a", "z");
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.Release_Store(env_);
+  WaitForStableFiles();
+
+  // The second pass is served by the compressed cache
+  for (int pass = 0; pass < 2; pass++) {
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i += 10) {
+      ASSERT_EQ(value, Get(Key(i)));
+    }
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_EQ(value, iter->value().ToString());
+      count++;
+    }
+    ASSERT_EQ(count, N);
+    delete iter;
+    if (pass == 0) {
+      ASSERT_GE(env_->random_read_counter_.Read(), 1);
+    } else {
+      ASSERT_EQ(env_->random_read_counter_.Read(), 0);
+    }
+  }
+
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("leveldb.compressed-block-cache", &stats));
+  uint64_t inserts, hits, misses;
+  ASSERT_TRUE(options.compressed_block_cache->GetInsertCount(&inserts));
+  ASSERT_TRUE(options.compressed_block_cache->GetHitCounts(
+      Cache::kLowPriority, &hits, &misses));
+  ASSERT_GT(inserts, 0u);
+  ASSERT_GE(hits, static_cast<uint64_t>(N / 10));
+
+  env_->delay_data_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete options.compressed_block_cache;
+}
+
+static void DestroyPersistentCache(const std::string& dir) {
+  std::vector<std::string> children;
+  Env::Default()->GetChildren(dir, &children);
+  for (size_t i = 0; i < children.size(); i++) {
+    Env::Default()->DeleteFile(dir + "/" + children[i]);
+  }
+  Env::Default()->DeleteDir(dir);
+}
+
+TEST(DBTest, PersistentCache) {
+  env_->count_random_reads_ = true;
+  const std::string cache_dir = dbname_ + "_pcache";
+  DestroyPersistentCache(cache_dir);  // Left over by an earlier run
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Every block cache lookup misses
+  ASSERT_OK(NewPersistentCache(Env::Default(), cache_dir, 8 << 20,
+                               &options.persistent_cache));
+  Reopen(&options);
+
+  const int N = 1000;
+  const std::string value(100, 'x');
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), value));
+  }
+  Compact("a", "z");
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.Release_Store(env_);
+  WaitForStableFiles();
+
+  // After the first pass, data blocks come from the persistent cache,
+  // and keep doing so once the cache has been closed and reopened
+  int reads[3];
+  for (int pass = 0; pass < 3; pass++) {
+    if (pass == 2) {
+      delete options.persistent_cache;
+      ASSERT_OK(NewPersistentCache(Env::Default(), cache_dir, 8 << 20,
+                                   &options.persistent_cache));
+      Reopen(&options);
+    }
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i += 10) {
+      ASSERT_EQ(value, Get(Key(i)));
+    }
+    reads[pass] = env_->random_read_counter_.Read();
+  }
+  ASSERT_GE(reads[0], 10);
+  ASSERT_EQ(reads[1], 0);
+  ASSERT_LT(reads[2], reads[0] / 2);  // Only table opens go to the tables
+
+  env_->delay_data_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete options.persistent_cache;
+  DestroyPersistentCache(cache_dir);
+}
+
+TEST(DBTest, PrefetchNextGuard) {
+  Options options = CurrentOptions();
+  Reopen(&options);
+  const int N = 2000;
+  const std::string value(200, 'v');
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), value));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 2) {
+    ASSERT_OK(Put(Key(i), "mem"));
+  }
+
+  // Scans see the same data with prefetching, in either direction
+  ReadOptions ropts;
+  ropts.prefetch_next_guard = true;
+  Iterator* iter = db_->NewIterator(ropts);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(count), iter->key().ToString());
+    ASSERT_EQ(count % 2 == 0 ? "mem" : value, iter->value().ToString());
+    count++;
+  }
+  ASSERT_EQ(N, count);
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    count--;
+    ASSERT_EQ(Key(count), iter->key().ToString());
+  }
+  ASSERT_EQ(0, count);
+  for (iter->Seek(Key(N / 2)), count = N / 2; iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(N, count);
+  delete iter;
+}
+
+// Return the keys of all shards, in order, and check that none is empty
+static std::string ScanShards(const std::vector<Iterator*>& iters,
+                              std::vector<std::string>* keys) {
+  std::string first_keys;
+  for (size_t i = 0; i < iters.size(); i++) {
+    iters[i]->SeekToFirst();
+    if (!iters[i]->Valid()) {
+      return "empty shard";
+    }
+    if (i > 0) {
+      first_keys.append(first_keys.empty() ? "" : ",");
+      first_keys.append(iters[i]->key().ToString());
+    }
+    for (; iters[i]->Valid(); iters[i]->Next()) {
+      keys->push_back(iters[i]->key().ToString());
+    }
+  }
+  return first_keys;
+}
+
+static void DeleteShards(std::vector<Iterator*>* iters) {
+  for (size_t i = 0; i < iters->size(); i++) {
+    delete (*iters)[i];
+  }
+  iters->clear();
+}
+
+TEST(DBTest, ParallelScan) {
+  // Keys whose hash makes them guards of level 1 and below
+  static const char* kGuardKeys[] = {
+    "key29401562", "key40606358", "key56275378"
+  };
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Background compactions add guards
+  Reopen(&options);
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < 100000000; i += 40000) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "key%08d", i);
+    keys.push_back(buf);
+  }
+  keys.insert(keys.end(), kGuardKeys, kGuardKeys + 3);
+  std::sort(keys.begin(), keys.end());
+  const std::string value(1000, 'v');
+  for (int round = 0; round < 2; round++) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      ASSERT_OK(Put(keys[i], value));
+    }
+  }
+  env_->delay_data_sync_.Release_Store(env_);
+  WaitForStableFiles();
+  int deepest = config::kNumLevels - 1;
+  while (deepest > 0 && NumGuardsAtLevel(deepest) == 0) {
+    deepest--;
+  }
+  ASSERT_EQ(3, NumGuardsAtLevel(deepest));
+
+  // Shards start at guard keys
+  std::vector<Iterator*> iters;
+  std::vector<std::string> scanned;
+  ASSERT_OK(db_->NewParallelScan(ReadOptions(), Range(), 8, &iters));
+  ASSERT_EQ(4u, iters.size());
+  ASSERT_EQ("key29401562,key40606358,key56275378", ScanShards(iters, &scanned));
+  ASSERT_TRUE(keys == scanned);
+  DeleteShards(&iters);
+
+  scanned.clear();
+  ASSERT_OK(db_->NewParallelScan(ReadOptions(), Range(), 2, &iters));
+  ASSERT_EQ(2u, iters.size());
+  ASSERT_EQ("key40606358", ScanShards(iters, &scanned));
+  ASSERT_TRUE(keys == scanned);
+  DeleteShards(&iters);
+
+  // A bounded range only splits at the guards inside it
+  scanned.clear();
+  ASSERT_OK(db_->NewParallelScan(ReadOptions(),
+                                 Range("key30000000", "key60000000"), 8,
+                                 &iters));
+  ASSERT_EQ(3u, iters.size());
+  ASSERT_EQ("key40606358,key56275378", ScanShards(iters, &scanned));
+  std::vector<std::string> expected;
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (keys[i] >= "key30000000" && keys[i] < "key60000000") {
+      expected.push_back(keys[i]);
+    }
+  }
+  ASSERT_TRUE(expected == scanned);
+  DeleteShards(&iters);
+
+  // All shards read the state at the time of the call
+  ASSERT_OK(db_->NewParallelScan(ReadOptions(), Range(), 4, &iters));
+  ASSERT_OK(Put("key00000001", "new"));
+  ASSERT_OK(Delete(keys.back()));
+  scanned.clear();
+  ScanShards(iters, &scanned);
+  ASSERT_TRUE(keys == scanned);
+  DeleteShards(&iters);
+
+  // Shards do not count tombstones into a shared counter
+  uint64_t skipped = 0;
+  ReadOptions ro;
+  ro.tombstones_skipped = &skipped;
+  ASSERT_OK(db_->NewParallelScan(ro, Range(), 4, &iters));
+  scanned.clear();
+  ScanShards(iters, &scanned);
+  ASSERT_EQ(keys.size(), scanned.size());  // One key added, one deleted
+  ASSERT_EQ(0u, skipped);
+  DeleteShards(&iters);
+
+  ASSERT_TRUE(!db_->NewParallelScan(ReadOptions(), Range(), 0, &iters).ok());
+  ASSERT_TRUE(iters.empty());
+  env_->delay_data_sync_.Release_Store(NULL);
+}
+
+TEST(DBTest, IteratorOpensTablesLazily) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  Reopen(&options);
+  // Each table shares its last key with the next one, so compaction
+  // rewrites the tables rather than moving them down intact
+  for (int f = 0; f < 16; f++) {
+    for (int i = 0; i <= 100 && f * 100 + i < 1600; i++) {
+      ASSERT_OK(Put(Key(f * 100 + i), std::string(100, 'v')));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  WaitForStableFiles();
+
+  // Reopen with an empty table cache
+  env_->count_random_reads_ = true;
+  Reopen(&options);
+  const int num_files = TotalTableFiles();
+  ASSERT_GT(num_files, 1);
+
+  // Opening a table reads at least its footer and index block, so a
+  // short scan that opened every table would need 2 * num_files reads
+  env_->random_read_counter_.Reset();
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(Key(i), iter->key().ToString());
+    ASSERT_EQ(std::string(100, 'v'), iter->value().ToString());
+    iter->Next();
+  }
+  const int scan_reads = env_->random_read_counter_.Read();
+  ASSERT_LT(scan_reads, 2 * num_files) << scan_reads << " reads";
+
+  // A seek opens only the tables around its target
+  env_->random_read_counter_.Reset();
+  iter->Seek(Key(1250));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(1250), iter->key().ToString());
+  ASSERT_EQ(std::string(100, 'v'), iter->value().ToString());
+  const int seek_reads = env_->random_read_counter_.Read();
+  ASSERT_LT(seek_reads, 2 * num_files) << seek_reads << " reads";
+
+  // Every key is still found in both directions
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(1600, count);
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    count--;
+    ASSERT_EQ(Key(count), iter->key().ToString());
+  }
+  ASSERT_EQ(0, count);
+  delete iter;
+  env_->count_random_reads_ = false;
+}
+
+TEST(DBTest, PinnedGet) {
+  // Blocks from the default cache, blocks owned by the pin, cached rows
+  for (int config = 0; config < 3; config++) {
+    Options options = CurrentOptions();
+    options.block_cache = (config == 1) ? NewLRUCache(0) : NULL;
+    options.row_cache = (config == 2) ? NewLRUCache(1 << 20) : NULL;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    Random rnd(301);
+    const int N = 100;
+    for (int i = 0; i < N; i++) {
+      ASSERT_OK(Put(Key(i), RandomString(&rnd, 4096) + Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put("mem", "memtable value"));
+
+    std::vector<std::string> expected(N);
+    PinnableSlice pinned[N];
+    for (int i = 0; i < N; i++) {
+      expected[i] = Get(Key(i));
+      ASSERT_OK(db_->Get(ReadOptions(), Key(i), &pinned[i]));
+      ASSERT_TRUE(pinned[i].IsPinned());
+      ASSERT_EQ(expected[i], pinned[i].ToString());
+    }
+    if (config == 2) {
+      // Served from the row cache this time
+      pinned[0].Reset();
+      ASSERT_OK(db_->Get(ReadOptions(), Key(0), &pinned[0]));
+      ASSERT_EQ(expected[0], pinned[0].ToString());
+    }
+    PinnableSlice mem_value;
+    ASSERT_OK(db_->Get(ReadOptions(), "mem", &mem_value));
+    ASSERT_TRUE(mem_value.IsPinned());
+    PinnableSlice missing;
+    ASSERT_TRUE(db_->Get(ReadOptions(), "missing", &missing).IsNotFound());
+    ASSERT_TRUE(!missing.IsPinned());
+
+    // Pinned values outlive overwrites, memtable flushes and compactions
+    for (int i = 0; i < N; i++) {
+      ASSERT_OK(Put(Key(i), "overwritten"));
+    }
+    ASSERT_OK(Delete("mem"));
+    dbfull()->TEST_CompactMemTable();
+    Compact("", "~");
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(expected[i], pinned[i].ToString());
+      pinned[i].Reset();
+    }
+    ASSERT_EQ("memtable value", mem_value.ToString());
+    mem_value.Reset();
+
+    // Reusing a slice releases what it pinned
+    ASSERT_OK(db_->Get(ReadOptions(), Key(0), &pinned[0]));
+    ASSERT_EQ("overwritten", pinned[0].ToString());
+    ASSERT_OK(db_->Get(ReadOptions(), Key(1), &pinned[0]));
+    ASSERT_EQ("overwritten", pinned[0].ToString());
+    pinned[0].Reset();
+
+    Close();
+    delete options.block_cache;
+    delete options.row_cache;
+  }
+}
+
+namespace {
+int CountValueLogFiles(Env* env, const std::string& dbname) {
+  std::vector<std::string> files;
+  env->GetChildren(dbname, &files);
+  int count = 0;
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (ParseFileName(files[i], &number, &type) && type == kValueLogFile) {
+      count++;
+    }
+  }
+  return count;
+}
+}  // namespace
+
+TEST(DBTest, ValueLog) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.value_log_threshold = 1000;
+  options.value_log_file_size = 64 << 10;
+  DestroyAndReopen(&options);
+
+  Random rnd(301);
+  const int N = 200;
+  std::vector<std::string> expected(N);
+  for (int i = 0; i < N; i++) {
+    // Every third value is small enough to stay in the tree
+    expected[i] = RandomString(&rnd, (i % 3 == 0) ? 100 : 2000);
+    ASSERT_OK(Put(Key(i), expected[i]));
+  }
+  ASSERT_GT(CountValueLogFiles(env_, dbname_), 1);
+  ASSERT_EQ(expected[1], Get(Key(1)));
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(expected[i], Get(Key(i)));
+  }
+
+  // Iterators read the values through the pointers in either direction
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int i = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+    ASSERT_EQ(Key(i), iter->key().ToString());
+    ASSERT_EQ(expected[i], iter->value().ToString());
+  }
+  ASSERT_EQ(N, i);
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    i--;
+    ASSERT_EQ(Key(i), iter->key().ToString());
+    ASSERT_EQ(expected[i], iter->value().ToString());
+  }
+  ASSERT_EQ(0, i);
+  ASSERT_OK(iter->status());
+  delete iter;
+
+  // Overwrite everything, so the first files hold nothing but garbage
+  // once compactions drop the old pointers
+  const Snapshot* snapshot = db_->GetSnapshot();
+  std::vector<std::string> old = expected;
+  for (int i = 0; i < N; i++) {
+    expected[i] = RandomString(&rnd, 2000);
+    ASSERT_OK(Put(Key(i), expected[i]));
+  }
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(old[i], Get(Key(i), snapshot));
+  }
+  db_->ReleaseSnapshot(snapshot);
+  Reopen(&options);
+  ASSERT_EQ(expected[2], Get(Key(2)));
+  const int before = CountValueLogFiles(env_, dbname_);
+  dbfull()->TEST_CompactMemTable();
+  Compact("", "~");
+  for (int round = 0; round < 2 * before; round++) {
+    ASSERT_OK(dbfull()->TEST_CollectValueLog());
+  }
+  ASSERT_LT(CountValueLogFiles(env_, dbname_), before);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(expected[i], Get(Key(i)));
+  }
+
+  // Values moved by the collection are found after a restart
+  Reopen(&options);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(expected[i], Get(Key(i)));
+  }
+}
+
+namespace {
+// Appends each operand to the existing value, separated by commas, so
+// tests can see the order in which operands were applied.
+class AppendOperator : public MergeOperator {
+ public:
+  virtual const char* Name() const { return "test.Append"; }
+  virtual bool Merge(const Slice& key, const Slice* existing_value,
+                     const Slice& value, std::string* new_value) const {
+    new_value->clear();
+    if (existing_value != NULL) {
+      new_value->assign(existing_value->data(), existing_value->size());
+      new_value->push_back(',');
+    }
+    new_value->append(value.data(), value.size());
+    return true;
+  }
+};
+}  // namespace
+
+TEST(DBTest, MergeOperator) {
+  AppendOperator append;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.merge_operator = &append;
+  options.value_log_threshold = 1000;
+  DestroyAndReopen(&options);
+
+  const WriteOptions wo;
+  ASSERT_OK(db_->Merge(wo, "a", "1"));
+  ASSERT_OK(db_->Merge(wo, "a", "2"));
+  ASSERT_OK(Put("b", "x"));
+  ASSERT_OK(db_->Merge(wo, "b", "y"));
+  ASSERT_OK(Put("c", "gone"));
+  ASSERT_OK(Delete("c"));
+  ASSERT_OK(db_->Merge(wo, "c", "z"));
+  const std::string big(2000, 'v');
+  ASSERT_OK(Put("d", big));
+  ASSERT_OK(db_->Merge(wo, "d", "w"));
+  ASSERT_EQ("1,2", Get("a"));
+  ASSERT_EQ("x,y", Get("b"));
+  ASSERT_EQ("z", Get("c"));
+  ASSERT_EQ(big + ",w", Get("d"));
+
+  // Operands written after a snapshot are invisible to it
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->Merge(wo, "a", "3"));
+  ASSERT_EQ("1,2", Get("a", snapshot));
+  ASSERT_EQ("1,2,3", Get("a"));
+
+  // Operands split between the memtable and the tables
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(db_->Merge(wo, "b", "y2"));
+  ASSERT_EQ("1,2,3", Get("a"));
+  ASSERT_EQ("x,y,y2", Get("b"));
+  ASSERT_EQ("1,2", Get("a", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Iterators merge in either direction, including when Prev() follows a
+  // Next() that had to read past the operands
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_EQ(IterStatus(iter), "a->1,2,3");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->x,y,y2");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->z");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->x,y,y2");
+  iter->Next();
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "d->" + big + ",w");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  iter->SeekToLast();
+  ASSERT_EQ(IterStatus(iter), "d->" + big + ",w");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "c->z");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->x,y,y2");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->1,2,3");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  delete iter;
+
+  // Compaction folds the operands and the results survive a restart
+  dbfull()->TEST_CompactMemTable();
+  Compact("", "~");
+  ASSERT_EQ("1,2,3", Get("a"));
+  ASSERT_EQ("x,y,y2", Get("b"));
+  ASSERT_EQ("z", Get("c"));
+  ASSERT_EQ(big + ",w", Get("d"));
+  Reopen(&options);
+  ASSERT_OK(db_->Merge(wo, "a", "4"));
+  ASSERT_EQ("1,2,3,4", Get("a"));
+  ASSERT_EQ(big + ",w", Get("d"));
+
+  // Without an operator, merges are refused
+  options.merge_operator = NULL;
+  Reopen(&options);
+  Status s = db_->Merge(wo, "a", "5");
+  ASSERT_TRUE(!s.ok());
+  ASSERT_TRUE(s.ToString().find("Not implemented") != std::string::npos);
+}
+
+TEST(DBTest, DeleteRange) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  const WriteOptions wo;
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_OK(Put("c", "vc"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("d", "vd"));
+  ASSERT_OK(Put("e", "ve"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+
+  // The range covers keys in both the memtable and the tables, and keeps
+  // its end key
+  ASSERT_OK(db_->DeleteRange(wo, "b", "e"));
+  ASSERT_OK(Put("c", "vc2"));
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("vc2", Get("c"));
+  ASSERT_EQ("NOT_FOUND", Get("d"));
+  ASSERT_EQ("ve", Get("e"));
+  ASSERT_EQ("vb", Get("b", snapshot));
+  ASSERT_EQ("vd", Get("d", snapshot));
+  ASSERT_EQ("(a->va)(c->vc2)(e->ve)", Contents());
+
+  // Iteration skips the covered keys in either direction
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToLast();
+  ASSERT_EQ(IterStatus(iter), "e->ve");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "c->vc2");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Seek("b");
+  ASSERT_EQ(IterStatus(iter), "c->vc2");
+  delete iter;
+
+  // The tombstone survives a flush and a restart
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("vb", Get("b", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+  Reopen(&options);
+  ASSERT_EQ("(a->va)(c->vc2)(e->ve)", Contents());
+  ASSERT_EQ(1U, dbfull()->TEST_NumRangeTombstones());
+
+  // Once compaction removes what it covers, the tombstone goes too.  A
+  // background compaction may have moved the tables down while the
+  // snapshot still needed them.
+  Compact("", "~");
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("(a->va)(c->vc2)(e->ve)", Contents());
+  ASSERT_EQ(0U, dbfull()->TEST_NumRangeTombstones());
+  Reopen(&options);
+  ASSERT_EQ("(a->va)(c->vc2)(e->ve)", Contents());
+  ASSERT_EQ("NOT_FOUND", Get("d"));
+}
+
+TEST(DBTest, TrivialMoveGuards) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  // Tables with disjoint key ranges are moved down by compaction, so the
+  // same table files hold the data afterwards
+  std::string expected;
+  for (int t = 0; t < 2; t++) {
+    for (int i = 0; i < 10; i++) {
+      const std::string key = Key(t * 10 + i);
+      ASSERT_OK(Put(key, "v" + key));
+      expected += "(" + key + "->v" + key + ")";
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  const std::set<uint64_t> tables = TableFileNumbers();
+  ASSERT_EQ(2U, tables.size());
+  for (int i = 0; i < 100 && NumTableFilesAtLevel(0) > 0; i++) {
+    DelayMilliseconds(100);
+  }
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_EQ(2, NumTableFilesAtLevel(1));
+  ASSERT_TRUE(tables == TableFileNumbers());
+  ASSERT_EQ(expected, Contents());
+  ASSERT_EQ("v" + Key(15), Get(Key(15)));
+
+  Reopen(&options);
+  ASSERT_EQ(2, NumTableFilesAtLevel(1));
+  ASSERT_EQ(expected, Contents());
+}
+
+TEST(DBTest, SetOptions) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.level0_sentinel_compaction_trigger = 8;
+  options.max_files_per_guard.push_back(0);
+  options.max_files_per_guard.push_back(8);
+  DestroyAndReopen(&options);
+
+  // Level-0 keeps its tables until it holds eight of them
+  for (int t = 0; t < 3; t++) {
+    ASSERT_OK(Put(Key(t), "v" + Key(t)));
+    dbfull()->TEST_CompactMemTable();
+  }
+  WaitForStableFiles();
+  ASSERT_EQ("3", FilesPerLevel());
+
+  // A trigger below one is rejected without changing anything
+  Options changed = options;
+  changed.level0_sentinel_compaction_trigger = 0;
+  ASSERT_TRUE(!db_->SetOptions(changed).ok());
+  WaitForStableFiles();
+  ASSERT_EQ("3", FilesPerLevel());
+
+  // Lowering the trigger compacts level-0 without another write, and
+  // level-1 keeps up to eight files per guard
+  changed.level0_sentinel_compaction_trigger = 2;
+  ASSERT_OK(db_->SetOptions(changed));
+  for (int i = 0; i < 100 && NumTableFilesAtLevel(0) > 0; i++) {
+    DelayMilliseconds(100);
+  }
+  WaitForStableFiles();
+  ASSERT_EQ("0,3", FilesPerLevel());
+  ASSERT_EQ("v" + Key(1), Get(Key(1)));
+}
+
+TEST(DBTest, TombstoneCompaction) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.level0_sentinel_compaction_trigger = 8;
+  options.tombstone_compaction_ratio = 0;
+  DestroyAndReopen(&options);
+
+  // One table of values and one of deletions for all of them
+  const int kNumKeys = 2000;
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  WaitForStableFiles();
+  ASSERT_EQ("2", FilesPerLevel());
+
+  // A scan reports the deletions it steps over
+  uint64_t skipped = 0;
+  ReadOptions ro;
+  ro.tombstones_skipped = &skipped;
+  Iterator* iter = db_->NewIterator(ro);
+  iter->SeekToFirst();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(static_cast<uint64_t>(kNumKeys), skipped);
+
+  // Half of level-0's entries are deletions, which is enough to compact
+  // it once the ratio is set; the compaction drops every entry
+  Options changed = options;
+  changed.tombstone_compaction_ratio = 0.5;
+  ASSERT_OK(db_->SetOptions(changed));
+  for (int i = 0; i < 100 && TotalTableFiles() > 0; i++) {
+    DelayMilliseconds(100);
+  }
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_EQ("NOT_FOUND", Get(Key(1)));
+}
+
+namespace {
+// Removes the values "drop" and rewrites the values "old" as "new".
+class ValueFilter : public CompactionFilter {
+ public:
+  virtual const char* Name() const { return "test.ValueFilter"; }
+  virtual Decision Filter(int level, const Slice& key, const Slice& value,
+                          std::string* new_value) const {
+    if (value == Slice("drop")) {
+      return kRemove;
+    }
+    if (value == Slice("old")) {
+      new_value->assign("new");
+      return kChangeValue;
+    }
+    return kKeep;
+  }
+};
+}  // namespace
+
+TEST(DBTest, CompactionFilter) {
+  ValueFilter filter;
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.compaction_filter = &filter;
+  DestroyAndReopen(&options);
+
+  // A flush filters the values it writes
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "drop"));
+  ASSERT_OK(Put("c", "old"));
+  ASSERT_EQ("drop", Get("b"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("new", Get("c"));
+
+  // Removing a value does not bring back an older one from the tables
+  ASSERT_OK(Put("d", "vd"));
+  dbfull()->TEST_CompactMemTable();
+  Compact("", "~");
+  ASSERT_OK(Put("d", "drop"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("NOT_FOUND", Get("d"));
+  Compact("", "~");
+  ASSERT_EQ("NOT_FOUND", Get("d"));
+
+  // Values written after a snapshot wait for a compaction after its
+  // release.  A background compaction may have moved the tables down
+  // while the snapshot was held.
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("e", "drop"));
+  ASSERT_OK(Put("f", "old"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("drop", Get("e"));
+  ASSERT_EQ("old", Get("f"));
+  db_->ReleaseSnapshot(snapshot);
+  Compact("", "~");
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("(a->va)(c->new)(f->new)", Contents());
+
+  // The TTL filter removes the values written too long ago
+  const CompactionFilter* ttl = NewTTLCompactionFilter(3600, env_);
+  options.compaction_filter = ttl;
+  DestroyAndReopen(&options);
+  const uint64_t now = env_->NowMicros() / 1000000;
+  std::string fresh("v1");
+  std::string stale("v2");
+  AppendTTLTimestamp(&fresh, now);
+  AppendTTLTimestamp(&stale, now - 7200);
+  ASSERT_OK(Put("fresh", fresh));
+  ASSERT_OK(Put("stale", stale));
+  ASSERT_EQ(stale, Get("stale"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(fresh, Get("fresh"));
+  ASSERT_EQ("NOT_FOUND", Get("stale"));
+  Close();
+  delete ttl;
+}
+
 // Multi-threaded test:
 namespace {
 
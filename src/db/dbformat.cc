@@ -3,6 +3,9 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <stdio.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
 #include "db/dbformat.h"
 #include "port/port.h"
 #include "util/coding.h"
@@ -98,6 +101,19 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
+bool PrefixSuccessor(const Slice& prefix, std::string* result) {
+  result->assign(prefix.data(), prefix.size());
+  while (!result->empty()) {
+    const size_t last = result->size() - 1;
+    if (static_cast<uint8_t>((*result)[last]) != 0xff) {
+      (*result)[last]++;
+      return true;
+    }
+    result->resize(last);
+  }
+  return false;
+}
+
 const char* InternalFilterPolicy::Name() const {
   return user_policy_->Name();
 }
@@ -111,13 +127,131 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
     mkey[i] = ExtractUserKey(keys[i]);
     // TODO(sanjay): Suppress dups?
   }
-  user_policy_->CreateFilter(keys, n, dst);
+  if (prefix_extractor_ == NULL) {
+    user_policy_->CreateFilter(keys, n, dst);
+    return;
+  }
+
+  // Add each distinct prefix just before the first key that starts with
+  // it.  A prefix never sorts after the keys it begins, so policies that
+  // expect ordered input (e.g. SuRF) still get it.
+  std::vector<Slice> with_prefixes;
+  with_prefixes.reserve(2 * n);
+  Slice last_prefix;
+  bool have_prefix = false;
+  for (int i = 0; i < n; i++) {
+    if (prefix_extractor_->InDomain(keys[i])) {
+      Slice prefix = prefix_extractor_->Transform(keys[i]);
+      if (!have_prefix || prefix != last_prefix) {
+        if (prefix != keys[i]) {
+          with_prefixes.push_back(prefix);
+        }
+        last_prefix = prefix;
+        have_prefix = true;
+      }
+    }
+    with_prefixes.push_back(keys[i]);
+  }
+  user_policy_->CreateFilter(&with_prefixes[0], with_prefixes.size(), dst);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
   return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
 }
 
+bool InternalFilterPolicy::RangeMayMatch(const Slice& start, const Slice& limit,
+                                         const Slice& f) const {
+  return user_policy_->RangeMayMatch(ExtractUserKey(start),
+                                     ExtractUserKey(limit), f);
+}
+
+namespace {
+struct UserKeyLess {
+  explicit UserKeyLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+  const Comparator* ucmp;
+};
+}  // namespace
+
+struct RangeTombstoneList::BeginLess {
+  explicit BeginLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const Slice& key, const Fragment& f) const {
+    return ucmp->Compare(key, f.begin) < 0;
+  }
+  const Comparator* ucmp;
+};
+
+RangeTombstoneList::RangeTombstoneList(
+    const Comparator* ucmp,
+    const std::vector<RangeTombstone>& tombstones)
+    : ucmp_(ucmp),
+      refs_(0),
+      fragments_() {
+  UserKeyLess less(ucmp);
+  std::vector<std::string> bounds;
+  for (size_t i = 0; i < tombstones.size(); i++) {
+    bounds.push_back(tombstones[i].begin);
+    bounds.push_back(tombstones[i].end);
+  }
+  std::sort(bounds.begin(), bounds.end(), less);
+  std::vector<std::string>::iterator last = bounds.begin();
+  for (size_t i = 0; i < bounds.size(); i++) {
+    if (last == bounds.begin() || less(*(last - 1), bounds[i])) {
+      *last++ = bounds[i];
+    }
+  }
+  bounds.erase(last, bounds.end());
+
+  // Every tombstone covers a run of the fragments between adjacent bounds
+  std::vector<Fragment> all(bounds.empty() ? 0 : bounds.size() - 1);
+  for (size_t i = 0; i < all.size(); i++) {
+    all[i].begin = bounds[i];
+    all[i].end = bounds[i + 1];
+  }
+  for (size_t i = 0; i < tombstones.size(); i++) {
+    const RangeTombstone& t = tombstones[i];
+    size_t lo = std::lower_bound(bounds.begin(), bounds.end(),
+                                 t.begin, less) - bounds.begin();
+    size_t hi = std::lower_bound(bounds.begin(), bounds.end(),
+                                 t.end, less) - bounds.begin();
+    for (size_t f = lo; f < hi; f++) {
+      all[f].sequences.push_back(t.sequence);
+    }
+  }
+  for (size_t i = 0; i < all.size(); i++) {
+    if (!all[i].sequences.empty()) {
+      fragments_.push_back(Fragment());
+      fragments_.back().begin.swap(all[i].begin);
+      fragments_.back().end.swap(all[i].end);
+      fragments_.back().sequences.swap(all[i].sequences);
+      std::sort(fragments_.back().sequences.begin(),
+                fragments_.back().sequences.end(),
+                std::greater<SequenceNumber>());
+    }
+  }
+}
+
+SequenceNumber RangeTombstoneList::NewestCovering(
+    const Slice& user_key,
+    SequenceNumber snapshot) const {
+  std::vector<Fragment>::const_iterator f =
+      std::upper_bound(fragments_.begin(), fragments_.end(), user_key,
+                       BeginLess(ucmp_));
+  if (f == fragments_.begin()) {
+    return 0;
+  }
+  --f;
+  if (ucmp_->Compare(user_key, f->end) >= 0) {
+    return 0;
+  }
+  std::vector<SequenceNumber>::const_iterator s =
+      std::lower_bound(f->sequences.begin(), f->sequences.end(), snapshot,
+                       std::greater<SequenceNumber>());
+  return s == f->sequences.end() ? 0 : *s;
+}
+
 LookupKey::LookupKey(const Slice& ukey, SequenceNumber s)
   : start_(),
     kstart_(),
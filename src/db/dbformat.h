@@ -6,11 +6,15 @@
 #define STORAGE_LEVELDB_DB_FORMAT_H_
 
 #include <stdio.h>
+#include <string>
+#include <vector>
 #include "pebblesdb/comparator.h"
 #include "pebblesdb/db.h"
 #include "pebblesdb/filter_policy.h"
 #include "pebblesdb/slice.h"
+#include "pebblesdb/slice_transform.h"
 #include "pebblesdb/table_builder.h"
+#include "util/atomic.h"
 #include "util/coding.h"
 #include "util/logging.h"
 
@@ -24,11 +28,12 @@ static const unsigned kNumLevels = 7;
 // Level-0 compaction is started when we hit this many files.
 static const unsigned kL0_CompactionTrigger = 4;
 
-static const unsigned kL0_SentinelCompactionTrigger = 2;
+// Options::max_files_per_guard for levels it leaves unset.
+static const int kDefaultMaxFilesPerGuard = 2;
 
-static const unsigned kL0_GuardCompactionTrigger = 2;
-
-static const unsigned kMaxFilesPerGuardSentinel = 2;
+// Guards with fewer entries are not compacted for their deletions
+// (see Options::tombstone_compaction_ratio).
+static const uint64_t kMinEntriesForTombstoneCompaction = 1000;
 
 // Soft limit on number of level-0 files.  We could slow down writes at this
 // point, but don't.
@@ -59,7 +64,12 @@ class InternalKey;
 enum ValueType {
   kTypeDeletion = 0x0,
   kTypeValue = 0x1,
-  kTypeGuard = 0x2
+  kTypeGuard = 0x2,
+  kTypeValuePointer = 0x3,  // Value is a ValuePointer into the value log
+  kTypeMerge = 0x4,         // Value is an operand for Options::merge_operator
+  // Only in write batches: a DeleteRange() whose value is the end key.
+  // Range tombstones are kept beside the keys, never among them.
+  kTypeRangeDeletion = 0x5
 };
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
@@ -67,7 +77,7 @@ enum ValueType {
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeMerge;
 
 typedef uint64_t SequenceNumber;
 
@@ -112,6 +122,16 @@ inline Slice ExtractUserKey(const Slice& internal_key) {
   return Slice(internal_key.data(), internal_key.size() - 8);
 }
 
+// Stores in "*result" the smallest key, in bytewise order, that sorts
+// after every key starting with "prefix", and returns true.  Returns false
+// if there is no such key (the prefix is empty or all 0xff bytes).
+extern bool PrefixSuccessor(const Slice& prefix, std::string* result);
+
+inline SequenceNumber ExtractSequence(const Slice& internal_key) {
+  assert(internal_key.size() >= 8);
+  return DecodeFixed64(internal_key.data() + internal_key.size() - 8) >> 8;
+}
+
 inline ValueType ExtractValueType(const Slice& internal_key) {
   assert(internal_key.size() >= 8);
   const size_t n = internal_key.size();
@@ -144,17 +164,25 @@ class InternalKeyComparator : public Comparator {
   { user_comparator_ = rhs.user_comparator_; return *this; }
 };
 
-// Filter policy wrapper that converts from internal keys to user keys
+// Filter policy wrapper that converts from internal keys to user keys.
+// If "prefix_extractor" is non-NULL the filters also cover the prefix of
+// every user key in its domain, so KeyMayMatch() can be asked about a
+// prefix (in internal key form) as well as about a whole key.
 class InternalFilterPolicy : public FilterPolicy {
  private:
   const FilterPolicy* const user_policy_;
+  const SliceTransform* const prefix_extractor_;
   InternalFilterPolicy(const InternalFilterPolicy&);
   InternalFilterPolicy& operator = (const InternalFilterPolicy&);
  public:
-  explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) { }
+  explicit InternalFilterPolicy(const FilterPolicy* p,
+                                const SliceTransform* prefix_extractor = NULL)
+      : user_policy_(p), prefix_extractor_(prefix_extractor) { }
   virtual const char* Name() const;
   virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const;
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const;
+  virtual bool RangeMayMatch(const Slice& start, const Slice& limit,
+                             const Slice& filter) const;
 };
 
 // Modules in this directory should keep internal keys wrapped inside
@@ -205,7 +233,9 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<unsigned char>(kTypeValue));
+  return (c <= static_cast<unsigned char>(kTypeValue) ||
+          c == static_cast<unsigned char>(kTypeValuePointer) ||
+          c == static_cast<unsigned char>(kTypeMerge));
 }
 
 // A helper class useful for DBImpl::Get()
@@ -248,6 +278,62 @@ inline LookupKey::~LookupKey() {
   if (start_ != space_) delete[] start_;
 }
 
+// Hides every entry for a user key in [begin, end) that is older than
+// "sequence" (see DB::DeleteRange()).
+struct RangeTombstone {
+  RangeTombstone() : begin(), end(), sequence() { }
+  RangeTombstone(const Slice& b, const Slice& e, SequenceNumber s)
+      : begin(b.ToString()), end(e.ToString()), sequence(s) { }
+  std::string begin;
+  std::string end;
+  SequenceNumber sequence;
+};
+
+// An immutable view of a set of range tombstones, split into disjoint
+// fragments sorted by begin key so a lookup is a binary search.
+// RangeTombstoneLists are reference counted.
+class RangeTombstoneList {
+ public:
+  // The initial reference count is zero.
+  RangeTombstoneList(const Comparator* ucmp,
+                     const std::vector<RangeTombstone>& tombstones);
+
+  void Ref() { atomic::increment_64_fullbarrier(&refs_, 1); }
+  void Unref() {
+    uint64_t ref = atomic::increment_64_fullbarrier(&refs_, -1);
+    if (ref == 0) {
+      delete this;
+    }
+  }
+
+  bool empty() const { return fragments_.empty(); }
+
+  // Return the sequence number of the newest tombstone that covers
+  // "user_key" and is visible at "snapshot", or 0 if there is none.
+  // Entries for the key older than the result are deleted.
+  SequenceNumber NewestCovering(const Slice& user_key,
+                                SequenceNumber snapshot) const;
+
+ private:
+  ~RangeTombstoneList() { }
+
+  // The tombstones covering [begin, end), newest first
+  struct Fragment {
+    std::string begin;
+    std::string end;
+    std::vector<SequenceNumber> sequences;
+  };
+  struct BeginLess;
+
+  const Comparator* ucmp_;
+  uint64_t refs_;
+  std::vector<Fragment> fragments_;
+
+  // No copying allowed
+  RangeTombstoneList(const RangeTombstoneList&);
+  void operator=(const RangeTombstoneList&);
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_FORMAT_H_
@@ -105,6 +105,30 @@ TEST(FormatTest, InternalKeyShortestSuccessor) {
             ShortSuccessor(IKey("\xff\xff", 100, kTypeValue)));
 }
 
+TEST(FormatTest, RangeTombstoneListNewestCovering) {
+  std::vector<RangeTombstone> tombstones;
+  tombstones.push_back(RangeTombstone("b", "f", 10));
+  tombstones.push_back(RangeTombstone("d", "h", 20));
+  tombstones.push_back(RangeTombstone("c", "e", 5));
+  tombstones.push_back(RangeTombstone("x", "x", 30));  // Empty
+  RangeTombstoneList* list =
+      new RangeTombstoneList(BytewiseComparator(), tombstones);
+  list->Ref();
+  ASSERT_TRUE(!list->empty());
+  ASSERT_EQ(0u, list->NewestCovering("a", 100));
+  ASSERT_EQ(10u, list->NewestCovering("b", 100));
+  ASSERT_EQ(10u, list->NewestCovering("c", 100));
+  ASSERT_EQ(5u, list->NewestCovering("c", 9));
+  ASSERT_EQ(0u, list->NewestCovering("c", 4));
+  ASSERT_EQ(20u, list->NewestCovering("d", 100));
+  ASSERT_EQ(10u, list->NewestCovering("e", 19));
+  ASSERT_EQ(20u, list->NewestCovering("g", 100));
+  ASSERT_EQ(0u, list->NewestCovering("g", 19));
+  ASSERT_EQ(0u, list->NewestCovering("h", 100));
+  ASSERT_EQ(0u, list->NewestCovering("x", 100));
+  list->Unref();
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
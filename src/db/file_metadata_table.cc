@@ -0,0 +1,172 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/file_metadata_table.h"
+
+#include "util/atomic.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+static const int kInitialBits = 6;
+
+FileMetaDataTable::FileMetaDataTable()
+    : array_(NewArray(kInitialBits)),
+      readers_(0),
+      live_(0),
+      used_(0) {
+}
+
+FileMetaDataTable::~FileMetaDataTable() {
+  Array* a = array_;
+  for (uint64_t i = 0; i <= a->mask; i++) {
+    delete a->slots[i].meta;
+  }
+  retired_.push_back(a);
+  FreeRetiredLocked();
+}
+
+FileMetaDataTable::Array* FileMetaDataTable::NewArray(int bits) {
+  Array* a = new Array;
+  a->shift = 64 - bits;
+  a->mask = (1ull << bits) - 1;
+  a->slots = new Slot[a->mask + 1];
+  for (uint64_t i = 0; i <= a->mask; i++) {
+    a->slots[i].number = 0;
+    a->slots[i].meta = NULL;
+  }
+  return a;
+}
+
+FileMetaData* FileMetaDataTable::Lookup(uint64_t number) const {
+  // Announce the lookup before reading array_, so that a writer that
+  // replaced the array and then sees no lookups knows none can use it.
+  atomic::increment_64_fullbarrier(&readers_, 1);
+  const Array* a = atomic::load_ptr_acquire(&array_);
+  FileMetaData* result = NULL;
+  for (uint64_t i = Index(a, number); ; i = (i + 1) & a->mask) {
+    Slot* slot = &a->slots[i];
+    const uint64_t n = atomic::load_64_acquire(&slot->number);
+    if (n == number) {
+      FileMetaData* meta = atomic::load_ptr_acquire(&slot->meta);
+      // A removed entry's slot may have been taken over by another table
+      // after we read its number
+      if (atomic::load_64_acquire(&slot->number) == number) {
+        result = meta;
+      }
+      break;
+    } else if (n == 0) {
+      break;
+    }
+  }
+  atomic::increment_64_fullbarrier(&readers_, -1);
+  return result;
+}
+
+void FileMetaDataTable::Insert(uint64_t number, uint64_t file_size,
+                               const InternalKey& smallest,
+                               const InternalKey& largest) {
+  assert(number != 0);
+  MutexLock l(&mutex_);
+  FreeRetiredLocked();
+  // Keep at least a quarter of the slots unused so probes stay short
+  if ((used_ + 1) * 4 > (array_->mask + 1) * 3) {
+    ResizeLocked();
+  }
+  Array* a = array_;
+  Slot* target = NULL;
+  for (uint64_t i = Index(a, number); ; i = (i + 1) & a->mask) {
+    Slot* slot = &a->slots[i];
+    if (slot->number == number) {
+      if (slot->meta != NULL) {
+        return;
+      }
+      target = slot;
+      break;
+    } else if (slot->number == 0) {
+      if (target == NULL) {
+        target = slot;
+        used_++;
+      }
+      break;
+    } else if (slot->meta == NULL && target == NULL) {
+      target = slot;  // Reuse the first removed entry on the probe path
+    }
+  }
+
+  FileMetaData* meta = new FileMetaData();
+  meta->number = number;
+  meta->file_size = file_size;
+  meta->smallest = smallest;
+  meta->largest = largest;
+  atomic::store_64_release(&target->number, number);
+  atomic::store_ptr_release(&target->meta, meta);
+  live_++;
+}
+
+void FileMetaDataTable::Remove(uint64_t number) {
+  MutexLock l(&mutex_);
+  FreeRetiredLocked();
+  Array* a = array_;
+  for (uint64_t i = Index(a, number); ; i = (i + 1) & a->mask) {
+    Slot* slot = &a->slots[i];
+    if (slot->number == number) {
+      FileMetaData* meta = slot->meta;
+      if (meta != NULL) {
+        atomic::store_ptr_release(&slot->meta, static_cast<FileMetaData*>(NULL));
+        live_--;
+        delete meta;
+      }
+      return;
+    } else if (slot->number == 0) {
+      return;
+    }
+  }
+}
+
+size_t FileMetaDataTable::Size() const {
+  MutexLock l(&mutex_);
+  return live_;
+}
+
+// Copy the live entries into a new array with room for four times as
+// many, which also clears out the removed entries.
+// REQUIRES: mutex_ held
+void FileMetaDataTable::ResizeLocked() {
+  Array* old = array_;
+  int bits = kInitialBits;
+  while ((1ull << bits) < (live_ + 1) * 4) {
+    bits++;
+  }
+  Array* a = NewArray(bits);
+  for (uint64_t i = 0; i <= old->mask; i++) {
+    const Slot& slot = old->slots[i];
+    if (slot.meta == NULL) {
+      continue;
+    }
+    uint64_t j = Index(a, slot.number);
+    while (a->slots[j].number != 0) {
+      j = (j + 1) & a->mask;
+    }
+    a->slots[j].number = slot.number;
+    a->slots[j].meta = slot.meta;
+  }
+  atomic::store_ptr_fullbarrier(&array_, a);
+  retired_.push_back(old);
+  used_ = live_;
+}
+
+// REQUIRES: mutex_ held, or no concurrent lookups
+void FileMetaDataTable::FreeRetiredLocked() {
+  if (retired_.empty() || atomic::load_64_acquire(&readers_) != 0) {
+    return;
+  }
+  for (size_t i = 0; i < retired_.size(); i++) {
+    delete[] retired_[i]->slots;
+    delete retired_[i];
+  }
+  retired_.clear();
+}
+
+}  // namespace leveldb
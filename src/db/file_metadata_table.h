@@ -0,0 +1,84 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// FileMetaDataTable maps table file numbers to their FileMetaData.
+// Lookups take no locks and usually probe a single slot, so the guard
+// iterators can consult it for every file they open.  Writers are
+// serialized by an internal mutex.
+//
+// The table uses open addressing with linear probing.  A removed entry
+// leaves its file number behind with a NULL value, and the slot is reused
+// by a later insert; file numbers are never reused, so a reader that
+// races with such an insert can tell by re-reading the number.  When the
+// table fills up, the live entries are copied into a new table.  The old
+// one is freed by a later writer that finds no lookup in progress.
+
+#ifndef STORAGE_LEVELDB_DB_FILE_METADATA_TABLE_H_
+#define STORAGE_LEVELDB_DB_FILE_METADATA_TABLE_H_
+
+#include <stdint.h>
+#include <vector>
+#include "db/version_edit.h"
+#include "port/port.h"
+
+namespace leveldb {
+
+class FileMetaDataTable {
+ public:
+  FileMetaDataTable();
+  ~FileMetaDataTable();
+
+  // Return the metadata of table "number", or NULL if it is not present.
+  // The result stays valid until Remove(number) is called.
+  // Thread-safe, and never waits for other threads.
+  FileMetaData* Lookup(uint64_t number) const;
+
+  // Add the metadata of table "number" unless it is already present.
+  // REQUIRES: number != 0
+  void Insert(uint64_t number, uint64_t file_size,
+              const InternalKey& smallest, const InternalKey& largest);
+
+  // Remove the metadata of table "number", if present.
+  void Remove(uint64_t number);
+
+  // Number of tables present
+  size_t Size() const;
+
+ private:
+  struct Slot {
+    volatile uint64_t number;      // 0 if the slot was never used
+    FileMetaData* volatile meta;   // NULL if removed
+  };
+
+  struct Array {
+    int shift;                     // 64 - log2(number of slots)
+    uint64_t mask;                 // Number of slots - 1
+    Slot* slots;
+  };
+
+  static Array* NewArray(int bits);
+  static uint64_t Index(const Array* a, uint64_t number) {
+    // Fibonacci hashing spreads consecutive file numbers apart
+    return (number * 0x9e3779b97f4a7c15ull) >> a->shift;
+  }
+  void ResizeLocked();
+  void FreeRetiredLocked();
+
+  Array* volatile array_;
+  mutable volatile uint64_t readers_;  // Lookups in progress
+
+  // mutex_ protects the following state, and serializes changes to array_.
+  mutable port::Mutex mutex_;
+  size_t live_;                    // Slots holding a table
+  size_t used_;                    // Slots ever used in array_
+  std::vector<Array*> retired_;    // Replaced arrays lookups may be using
+
+  // No copying allowed
+  FileMetaDataTable(const FileMetaDataTable&);
+  void operator=(const FileMetaDataTable&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_FILE_METADATA_TABLE_H_
@@ -0,0 +1,167 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/file_metadata_table.h"
+
+#include "pebblesdb/env.h"
+#include "port/port.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static InternalKey Smallest(uint64_t number) {
+  return InternalKey("a" + NumberToString(number), number, kTypeValue);
+}
+
+static InternalKey Largest(uint64_t number) {
+  return InternalKey("z" + NumberToString(number), number, kTypeValue);
+}
+
+class FileMetaDataTableTest {
+ public:
+  FileMetaDataTable table_;
+
+  void Add(uint64_t number) {
+    table_.Insert(number, number * 10, Smallest(number), Largest(number));
+  }
+
+  // Returns the file size recorded for "number", or -1 if not present
+  int64_t Size(uint64_t number) {
+    FileMetaData* f = table_.Lookup(number);
+    if (f == NULL) {
+      return -1;
+    }
+    ASSERT_EQ(number, f->number);
+    ASSERT_EQ(Smallest(number).Encode().ToString(),
+              f->smallest.Encode().ToString());
+    ASSERT_EQ(Largest(number).Encode().ToString(),
+              f->largest.Encode().ToString());
+    return f->file_size;
+  }
+};
+
+TEST(FileMetaDataTableTest, Empty) {
+  ASSERT_EQ(-1, Size(1));
+  ASSERT_EQ(-1, Size(1000));
+  ASSERT_EQ(0u, table_.Size());
+}
+
+TEST(FileMetaDataTableTest, InsertLookupRemove) {
+  Add(5);
+  Add(7);
+  ASSERT_EQ(50, Size(5));
+  ASSERT_EQ(70, Size(7));
+  ASSERT_EQ(-1, Size(6));
+
+  // An existing entry is kept
+  table_.Insert(5, 1, Smallest(5), Largest(5));
+  ASSERT_EQ(50, Size(5));
+  ASSERT_EQ(2u, table_.Size());
+
+  table_.Remove(5);
+  table_.Remove(6);
+  ASSERT_EQ(-1, Size(5));
+  ASSERT_EQ(70, Size(7));
+  ASSERT_EQ(1u, table_.Size());
+}
+
+TEST(FileMetaDataTableTest, Growth) {
+  const uint64_t N = 10000;
+  for (uint64_t i = 1; i <= N; i++) {
+    Add(i);
+  }
+  ASSERT_EQ(N, table_.Size());
+  for (uint64_t i = 1; i <= N; i++) {
+    ASSERT_EQ(static_cast<int64_t>(i * 10), Size(i));
+  }
+  ASSERT_EQ(-1, Size(N + 1));
+}
+
+TEST(FileMetaDataTableTest, Churn) {
+  // Files come and go as compactions replace them
+  const uint64_t kLive = 500;
+  for (uint64_t i = 1; i <= 100000; i++) {
+    Add(i);
+    if (i > kLive) {
+      table_.Remove(i - kLive);
+    }
+  }
+  ASSERT_EQ(kLive, table_.Size());
+  ASSERT_EQ(-1, Size(100000 - kLive));
+  for (uint64_t i = 100000 - kLive + 1; i <= 100000; i++) {
+    ASSERT_EQ(static_cast<int64_t>(i * 10), Size(i));
+  }
+}
+
+namespace {
+
+struct ReaderState {
+  FileMetaDataTable* table;
+  port::AtomicPointer stop;
+  port::Mutex mu;
+  port::CondVar cv;
+  int remaining;
+  bool ok;
+
+  ReaderState() : cv(&mu), remaining(0), ok(true) { }
+};
+
+static void ReaderLoop(void* arg) {
+  ReaderState* state = reinterpret_cast<ReaderState*>(arg);
+  bool ok = true;
+  while (state->stop.Acquire_Load() == NULL) {
+    // Files 1..100 are never removed.  Others come and go, so may or may
+    // not be found, and must not be dereferenced since they may be
+    // deleted at any time.
+    for (uint64_t i = 1; i <= 1000; i++) {
+      FileMetaData* f = state->table->Lookup(i);
+      if (i <= 100) {
+        ok = ok && f != NULL && f->number == i && f->file_size == i * 10;
+      }
+    }
+  }
+  MutexLock l(&state->mu);
+  state->ok = state->ok && ok;
+  state->remaining--;
+  state->cv.SignalAll();
+}
+
+}  // namespace
+
+TEST(FileMetaDataTableTest, ConcurrentReaders) {
+  const int kThreads = 4;
+  ReaderState state;
+  state.table = &table_;
+  state.stop.Release_Store(NULL);
+  state.remaining = kThreads;
+  for (uint64_t i = 1; i <= 100; i++) {
+    Add(i);
+  }
+  for (int i = 0; i < kThreads; i++) {
+    Env::Default()->StartThread(&ReaderLoop, &state);
+  }
+  // Keep about 500 other files live, forcing slot reuse and resizes
+  for (uint64_t i = 101; i <= 200000; i++) {
+    Add(i);
+    if (i > 600) {
+      table_.Remove(i - 500);
+    }
+  }
+  state.stop.Release_Store(&state);
+  {
+    MutexLock l(&state.mu);
+    while (state.remaining > 0) {
+      state.cv.Wait();
+    }
+  }
+  ASSERT_TRUE(state.ok);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -82,6 +82,21 @@ class WriteBatchItemPrinter : public WriteBatch::Handler {
     printf("  del '%s'\n",
            EscapeString(key).c_str());
   }
+  virtual void PutValuePointer(const Slice& key, const Slice& pointer) {
+    printf("  ptr '%s' '%s'\n",
+           EscapeString(key).c_str(),
+           EscapeString(pointer).c_str());
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    printf("  merge '%s' '%s'\n",
+           EscapeString(key).c_str(),
+           EscapeString(value).c_str());
+  }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    printf("  delrange '%s' '%s'\n",
+           EscapeString(begin).c_str(),
+           EscapeString(end).c_str());
+  }
 
   WriteBatchItemPrinter()
     : offset_(),
@@ -167,6 +182,10 @@ bool DumpTable(Env* env, const std::string& fname) {
         type = "del";
       } else if (key.type == kTypeValue) {
         type = "val";
+      } else if (key.type == kTypeValuePointer) {
+        type = "ptr";
+      } else if (key.type == kTypeMerge) {
+        type = "merge";
       } else {
         snprintf(kbuf, sizeof(kbuf), "%d", static_cast<int>(key.type));
         type = kbuf;
@@ -22,19 +22,28 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 }
 
 MemTable::MemTable(const InternalKeyComparator& cmp)
-    : comparator_(cmp),
+    : num_entries(0),
+      comparator_(cmp),
       extractor_(cmp),
       refs_(0),
       arena_(),
       table_(comparator_, extractor_, &arena_),
-	  num_entries(0) {
+      range_tombstones_(),
+      range_tombstone_bytes_(0),
+      range_tombstone_list_(NULL),
+      smallest_sequence_(kMaxSequenceNumber) {
 }
 
 MemTable::~MemTable() {
   assert(refs_ == 0);
+  if (range_tombstone_list_ != NULL) {
+    range_tombstone_list_->Unref();
+  }
 }
 
-size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
+size_t MemTable::ApproximateMemoryUsage() {
+  return arena_.MemoryUsage() + range_tombstone_bytes_;
+}
 
 int MemTable::KeyComparator::operator()(const char* aptr, const char* bptr)
     const {
@@ -121,13 +130,49 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   assert(static_cast<size_t>((p + val_size) - buf) == encoded_len);
   table_.Insert(buf);
   num_entries++;
+  if (s < smallest_sequence_) {
+    smallest_sequence_ = s;
+  }
+}
+
+void MemTable::AddRangeTombstone(SequenceNumber s,
+                                 const Slice& begin,
+                                 const Slice& end) {
+  range_tombstones_.push_back(RangeTombstone(begin, end, s));
+  range_tombstone_bytes_ += sizeof(RangeTombstone) + begin.size() + end.size();
+  if (range_tombstone_list_ != NULL) {
+    range_tombstone_list_->Unref();
+    range_tombstone_list_ = NULL;
+  }
+  if (s < smallest_sequence_) {
+    smallest_sequence_ = s;
+  }
+}
+
+void MemTable::GetRangeTombstones(
+    std::vector<RangeTombstone>* tombstones) const {
+  tombstones->insert(tombstones->end(), range_tombstones_.begin(),
+                     range_tombstones_.end());
+}
+
+RangeTombstoneList* MemTable::RangeTombstones() {
+  if (range_tombstones_.empty()) {
+    return NULL;
+  }
+  if (range_tombstone_list_ == NULL) {
+    range_tombstone_list_ = new RangeTombstoneList(
+        comparator_.comparator.user_comparator(), range_tombstones_);
+    range_tombstone_list_->Ref();
+  }
+  return range_tombstone_list_;
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+bool MemTable::Get(const LookupKey& key, SequenceNumber deleted_before,
+                   Slice* value, ValueType* type, Status* s,
+                   std::vector<std::string>* operands) {
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  for (iter.Seek(memkey.data()); iter.Valid(); iter.Next()) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -142,21 +187,34 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
             Slice(key_ptr, key_length - 8),
-            key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
-          return true;
-        }
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
-        default:
-          break;
+            key.user_key()) != 0) {
+      break;
+    }
+    // Correct user key
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    if ((tag >> 8) < deleted_before) {
+      // Hidden by a range tombstone
+      *s = Status::NotFound(Slice());
+      return true;
+    }
+    switch (static_cast<ValueType>(tag & 0xff)) {
+      case kTypeValue:
+      case kTypeValuePointer: {
+        *value = GetLengthPrefixedSlice(key_ptr + key_length);
+        *type = static_cast<ValueType>(tag & 0xff);
+        return true;
+      }
+      case kTypeDeletion:
+        *s = Status::NotFound(Slice());
+        return true;
+      case kTypeMerge: {
+        // The entries after it are older ones for the same key
+        Slice operand = GetLengthPrefixedSlice(key_ptr + key_length);
+        operands->push_back(operand.ToString());
+        break;
       }
+      default:
+        return false;
     }
   }
   return false;
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
 #include <string>
+#include <vector>
 #include "pebblesdb/db.h"
 #include "db/dbformat.h"
 #include "db/skiplist.h"
@@ -57,11 +58,43 @@ class MemTable {
            const Slice& key,
            const Slice& value);
 
-  // If memtable contains a value for key, store it in *value and return true.
+  // Record that the keys in [begin, end) written before "seq" are deleted.
+  // The tombstone is not among the keys NewIterator() yields.
+  void AddRangeTombstone(SequenceNumber seq,
+                         const Slice& begin,
+                         const Slice& end);
+
+  // Append the range tombstones added so far to *tombstones.
+  //
+  // REQUIRES: external synchronization with AddRangeTombstone().
+  void GetRangeTombstones(std::vector<RangeTombstone>* tombstones) const;
+
+  // Return the range tombstones added so far, or NULL if there are none.
+  // The caller must Ref() the result to use it past the next call to
+  // AddRangeTombstone().
+  //
+  // REQUIRES: external synchronization with AddRangeTombstone().
+  RangeTombstoneList* RangeTombstones();
+
+  // Return the smallest sequence number added so far, or
+  // kMaxSequenceNumber if the memtable is empty.
+  SequenceNumber SmallestSequence() const { return smallest_sequence_; }
+
+  // If memtable contains a value for key, store it in *value, its type
+  // (kTypeValue or kTypeValuePointer) in *type, and return true.
+  // *value refers to the memtable's storage, so is valid while the
+  // memtable is referenced.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  // Merge operands newer than the entry found are appended to *operands,
+  // newest first.
+  // Entries older than "deleted_before" (see
+  // RangeTombstoneList::NewestCovering())
+  // are treated as a deletion.
+  bool Get(const LookupKey& key, SequenceNumber deleted_before,
+           Slice* value, ValueType* type, Status* s,
+           std::vector<std::string>* operands);
 
   int num_entries;
 
@@ -88,6 +121,10 @@ class MemTable {
   uint64_t refs_;
   Arena arena_;
   Table table_;
+  std::vector<RangeTombstone> range_tombstones_;
+  size_t range_tombstone_bytes_;
+  RangeTombstoneList* range_tombstone_list_;  // Built on demand
+  SequenceNumber smallest_sequence_;
 
   // No copying allowed
   MemTable(const MemTable&);
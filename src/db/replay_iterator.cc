@@ -24,6 +24,10 @@ ReplayIterator::ReplayIterator() {
 ReplayIterator::~ReplayIterator() {
 }
 
+bool ReplayIterator::IsMerge() {
+  return false;
+}
+
 ReplayState::ReplayState(Iterator* i, SequenceNumber s, SequenceNumber l)
   : mem_(NULL),
     iter_(i),
@@ -39,14 +43,18 @@ ReplayState::ReplayState(MemTable* m, SequenceNumber s)
 }
 
 ReplayIteratorImpl::ReplayIteratorImpl(DBImpl* db, port::Mutex* mutex, const Comparator* cmp,
-    Iterator* iter, MemTable* m, SequenceNumber s)
+    Iterator* iter, MemTable* m, SequenceNumber s, uint64_t value_log_pin)
   : ReplayIterator(),
     db_(db),
     mutex_(mutex),
     user_comparator_(cmp),
     start_at_(s),
+    value_log_pin_(value_log_pin),
     valid_(),
     status_(),
+    value_in_log_(false),
+    pointer_(),
+    value_(),
     has_current_user_key_(false),
     current_user_key_(),
     current_user_sequence_(),
@@ -83,7 +91,14 @@ void ReplayIteratorImpl::SkipToLast() {
 
 bool ReplayIteratorImpl::HasValue() {
   ParsedInternalKey ikey;
-  return ParseKey(&ikey) && ikey.type == kTypeValue;
+  return ParseKey(&ikey) &&
+         (ikey.type == kTypeValue || ikey.type == kTypeValuePointer ||
+          ikey.type == kTypeMerge);
+}
+
+bool ReplayIteratorImpl::IsMerge() {
+  ParsedInternalKey ikey;
+  return ParseKey(&ikey) && ikey.type == kTypeMerge;
 }
 
 Slice ReplayIteratorImpl::key() const {
@@ -93,7 +108,7 @@ Slice ReplayIteratorImpl::key() const {
 
 Slice ReplayIteratorImpl::value() const {
   assert(valid_);
-  return rs_.iter_->value();
+  return value_in_log_ ? Slice(value_) : rs_.iter_->value();
 }
 
 Status ReplayIteratorImpl::status() const {
@@ -138,6 +153,22 @@ void ReplayIteratorImpl::cleanup() {
   delete this;
 }
 
+// Read the value "pointer" points to, unless it is the one read last.
+bool ReplayIteratorImpl::ResolveValue(const Slice& pointer) {
+  if (value_in_log_ && pointer == Slice(pointer_)) {
+    return true;
+  }
+  value_in_log_ = false;
+  Status s = db_->ResolveValuePointer(ReadOptions(), pointer, &value_);
+  if (!s.ok()) {
+    status_ = s;
+    return false;
+  }
+  pointer_.assign(pointer.data(), pointer.size());
+  value_in_log_ = true;
+  return true;
+}
+
 bool ReplayIteratorImpl::ParseKey(ParsedInternalKey* ikey) {
   return ParseKey(rs_.iter_->key(), ikey);
 }
@@ -170,11 +201,17 @@ void ReplayIteratorImpl::Prime() {
                                      Slice(current_user_key_)) != 0 ||
            ikey.sequence >= current_user_sequence_) &&
           (ikey.sequence >= rs_.seq_start_ &&
-            (ikey.type == kTypeDeletion || ikey.type == kTypeValue))) {
+            (ikey.type == kTypeDeletion || ikey.type == kTypeValue ||
+             ikey.type == kTypeValuePointer || ikey.type == kTypeMerge))) {
         has_current_user_key_ = true;
         current_user_key_.assign(ikey.user_key.data(), ikey.user_key.size());
         current_user_sequence_ = ikey.sequence;
-        valid_ = true;
+        if (ikey.type == kTypeValuePointer) {
+          valid_ = ResolveValue(rs_.iter_->value());
+        } else {
+          value_in_log_ = false;
+          valid_ = true;
+        }
         return;
       }
       rs_.iter_->Next();
@@ -26,14 +26,16 @@ struct ReplayState {
 
 class ReplayIteratorImpl : public ReplayIterator {
  public:
-  // Refs the memtable on its own; caller must hold mutex while creating this
+  // Refs the memtable on its own; caller must hold mutex while creating this.
+  // "value_log_pin" is the value log pin the caller took for this iterator.
   ReplayIteratorImpl(DBImpl* db, port::Mutex* mutex, const Comparator* cmp,
-      Iterator* iter, MemTable* m, SequenceNumber s);
+      Iterator* iter, MemTable* m, SequenceNumber s, uint64_t value_log_pin);
   virtual bool Valid();
   virtual void Next();
   virtual void SkipTo(const Slice& target);
   virtual void SkipToLast();
   virtual bool HasValue();
+  virtual bool IsMerge();
   virtual Slice key() const;
   virtual Slice value() const;
   virtual Status status() const;
@@ -47,20 +49,30 @@ class ReplayIteratorImpl : public ReplayIterator {
   // REQUIRES: caller must hold mutex passed into ctor
   void cleanup(); // calls delete this;
 
+  uint64_t value_log_pin() const { return value_log_pin_; }
+
  private:
   friend class DB;
   virtual ~ReplayIteratorImpl();
   bool ParseKey(ParsedInternalKey* ikey);
   bool ParseKey(const Slice& k, ParsedInternalKey* ikey);
   void Prime();
+  bool ResolveValue(const Slice& pointer);
 
   DBImpl* const db_;
   port::Mutex* mutex_;
   const Comparator* const user_comparator_;
   SequenceNumber const start_at_;
+  uint64_t const value_log_pin_;
   bool valid_;
   Status status_;
 
+  // The value read from the value log for the current entry, if its value
+  // is a pointer into it, and the pointer it was read through
+  bool value_in_log_;
+  std::string pointer_;
+  std::string value_;
+
   bool has_current_user_key_;
   std::string current_user_key_;
   SequenceNumber current_user_sequence_;
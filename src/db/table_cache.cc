@@ -50,12 +50,6 @@ TableCache::TableCache(const std::string& dbname,
 }
 
 TableCache::~TableCache() {
-  for (std::map<uint64_t, FileMetaData*>::iterator it = file_metadata_map.begin(); it != file_metadata_map.end(); ++it) {
-	  FileMetaData* f = (*it).second;
-	  if (f != NULL) {
-		  delete f;
-	  }
-  }
   for (int i = 0; i < NUM_SEEK_THREADS; i++) {
 	  if (static_timers_[i] != NULL) {
 		  delete static_timers_[i];
@@ -87,7 +81,7 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 		}
 		if (s.ok()) {
 			start_timer(GET_TABLE_CACHE_GET_TABLE_OPEN);
-			s = Table::Open(*options_, file, file_size, &table, timer);
+			s = Table::Open(*options_, file, file_size, &table, timer, file_number);
 			record_timer(GET_TABLE_CACHE_GET_TABLE_OPEN);
 		}
 
@@ -110,22 +104,6 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 	return s;
 }
 
-void TableCache::SetFileMetaDataMap(uint64_t file_number, uint64_t file_size, InternalKey smallest, InternalKey largest) {
-//	printf("Setting file meta data map for file %llu\n", file_number);
-	// Disabling this because accessing map with multiple bg compaction threads might lead to race conditions.
-	// Anyways this map is not being used anywhere.
-	return;
-//	  if (file_metadata_map[file_number] == NULL) {
-////		  printf("DEBUG :: Creating new FileMetaData for file %llu to set file metadata map in table_cache\n", file_number);
-//		  FileMetaData* file_meta = new FileMetaData();
-//		  file_meta->number = file_number;
-//		  file_meta->file_size = file_size;
-//		  file_meta->smallest = smallest;
-//		  file_meta->largest = largest;
-//		  file_metadata_map[file_number] = file_meta;
-//	  }
-}
-
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number,
                                   uint64_t file_size,
@@ -141,7 +119,7 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   }
 
   Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-  Iterator* result = table->NewIterator(options);
+  Iterator* result = table->NewIterator(options, true);
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
   if (tableptr != NULL) {
     *tableptr = table;
@@ -155,10 +133,14 @@ Status TableCache::Get(const ReadOptions& options,
                        const Slice& k,
                        void* arg,
                        void (*saver)(void*, const Slice&, const Slice&),
-					   Timer* timer) {
+					   Timer* timer,
+                       Iterator** block_iter) {
 //  printf("Tablecache Get().\n");
   Cache::Handle* handle = NULL;
   Status s;
+  if (block_iter != NULL) {
+    *block_iter = NULL;
+  }
   start_timer(GET_TABLE_CACHE_FIND_TABLE);
   s = FindTable(file_number, file_size, &handle, timer);
 //  printf("After finding table. \n");
@@ -168,9 +150,15 @@ Status TableCache::Get(const ReadOptions& options,
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
 //    printf("Doing an InternalGet for key from Table.\n");
 //    printf("Calling table->InternalGet. \n");
-    s = t->InternalGet(options, k, arg, saver, timer);
+    s = t->InternalGet(options, k, arg, saver, timer, block_iter);
 //    printf("Releasing cache->handle.\n");
-    cache_->Release(handle);
+    if (block_iter != NULL && *block_iter != NULL) {
+      // The block may belong to the table's file, so the table stays open
+      // until the caller is done with the iterator
+      (*block_iter)->RegisterCleanup(&UnrefEntry, cache_, handle);
+    } else {
+      cache_->Release(handle);
+    }
     record_timer(GET_TABLE_CACHE_INTERNAL_GET);
   }
   return s;
@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <unordered_map>
 #include "db/dbformat.h"
+#include "db/file_metadata_table.h"
 #include "pebblesdb/cache.h"
 #include "pebblesdb/table.h"
 #include "port/port.h"
@@ -41,34 +42,35 @@ class TableCache {
 
   // If a seek to internal key "k" in specified file finds an entry,
   // call (*handle_result)(arg, found_key, found_value).
+  //
+  // If "block_iter" is non-NULL, the slices passed to handle_result stay
+  // valid, and the table stays open, until the caller deletes
+  // "*block_iter", which may be NULL if handle_result was not called.
   Status Get(const ReadOptions& options,
              uint64_t file_number,
              uint64_t file_size,
              const Slice& k,
              void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&),
-			 Timer* timer);
+			 Timer* timer,
+             Iterator** block_iter = NULL);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
-  void SetFileMetaDataMap(uint64_t file_number, uint64_t file_size, InternalKey smallest, InternalKey largest);
+  // Record the metadata of a newly written table.  Thread-safe.
+  void SetFileMetaDataMap(uint64_t file_number, uint64_t file_size, InternalKey smallest, InternalKey largest) {
+	  file_metadata_.Insert(file_number, file_size, smallest, largest);
+  }
 
+  // Return the metadata of the specified table, or NULL if it was not
+  // recorded.  Lock-free.
   FileMetaData* GetFileMetaDataForFile(uint64_t file_number) {
-	  if (file_metadata_map.count(file_number) > 0) {
-		  return file_metadata_map[file_number];
-	  }
-	  return NULL;
+	  return file_metadata_.Lookup(file_number);
   }
 
   void RemoveFileMetaDataMapForFile(uint64_t number) {
-	  if (file_metadata_map.count(number) > 0) {
-		  FileMetaData* f = file_metadata_map[number];
-		  if (f != NULL) {
-			  delete f;
-		  }
-		  file_metadata_map.erase(number);
-	  }
+	  file_metadata_.Remove(number);
   }
   Timer* static_timers_[NUM_SEEK_THREADS];
 
@@ -99,7 +101,7 @@ class TableCache {
   const std::string dbname_;
   const Options* options_;
   Cache* cache_;
-  std::map<uint64_t, FileMetaData*> file_metadata_map;
+  FileMetaDataTable file_metadata_;
 //  std::unordered_map<uint64_t, Cache::Handle*> cache_handle_map;
 
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**, Timer* timer);
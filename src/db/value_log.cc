@@ -0,0 +1,331 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/value_log.h"
+
+#include "db/filename.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// Checksum, key length and value length.
+const size_t kHeaderSize = 12;
+
+uint32_t RecordChecksum(const char* header, const Slice& key,
+                        const Slice& value) {
+  uint32_t crc = crc32c::Value(header + 4, kHeaderSize - 4);
+  crc = crc32c::Extend(crc, key.data(), key.size());
+  return crc32c::Extend(crc, value.data(), value.size());
+}
+
+// Split the record in "input" into its key and value.
+Status ParseRecord(const Slice& input, bool verify_checksum,
+                   Slice* key, Slice* value) {
+  if (input.size() < kHeaderSize) {
+    return Status::Corruption("truncated value log record");
+  }
+  const uint32_t key_length = DecodeFixed32(input.data() + 4);
+  const uint32_t value_length = DecodeFixed32(input.data() + 8);
+  if (input.size() != kHeaderSize + static_cast<uint64_t>(key_length) +
+                      value_length) {
+    return Status::Corruption("bad value log record length");
+  }
+  *key = Slice(input.data() + kHeaderSize, key_length);
+  *value = Slice(input.data() + kHeaderSize + key_length, value_length);
+  if (verify_checksum &&
+      crc32c::Unmask(DecodeFixed32(input.data())) !=
+      RecordChecksum(input.data(), *key, *value)) {
+    return Status::Corruption("value log record checksum mismatch");
+  }
+  return Status::OK();
+}
+
+}  // namespace
+
+void ValuePointer::EncodeTo(std::string* dst) const {
+  PutVarint64(dst, file);
+  PutVarint64(dst, offset);
+  PutVarint64(dst, size);
+}
+
+bool ValuePointer::DecodeFrom(const Slice& input) {
+  Slice in = input;
+  return GetVarint64(&in, &file) &&
+         GetVarint64(&in, &offset) &&
+         GetVarint64(&in, &size) &&
+         in.empty();
+}
+
+ValueLogReader::ValueLogReader(SequentialFile* file, uint64_t number)
+    : file_(file),
+      number_(number),
+      offset_(0),
+      backing_(),
+      status_() {
+}
+
+ValueLogReader::~ValueLogReader() {
+  delete file_;
+}
+
+bool ValueLogReader::ReadRecord(Slice* key, Slice* value, ValuePointer* ptr) {
+  if (!status_.ok()) {
+    return false;
+  }
+  char header[kHeaderSize];
+  Slice result;
+  status_ = file_->Read(kHeaderSize, &result, header);
+  if (!status_.ok() || result.size() < kHeaderSize) {
+    return false;
+  }
+  const uint64_t size = kHeaderSize +
+                        static_cast<uint64_t>(DecodeFixed32(header + 4)) +
+                        DecodeFixed32(header + 8);
+  backing_.resize(size);
+  memcpy(&backing_[0], header, kHeaderSize);
+  status_ = file_->Read(size - kHeaderSize, &result, &backing_[kHeaderSize]);
+  if (!status_.ok() || result.size() < size - kHeaderSize) {
+    return false;
+  }
+  if (result.data() != &backing_[kHeaderSize]) {
+    memcpy(&backing_[kHeaderSize], result.data(), result.size());
+  }
+  status_ = ParseRecord(backing_, true, key, value);
+  if (!status_.ok()) {
+    return false;
+  }
+  ptr->file = number_;
+  ptr->offset = offset_;
+  ptr->size = size;
+  offset_ += size;
+  return true;
+}
+
+ValueLog::ValueLog(const std::string& dbname, const Options* options)
+    : env_(options->env),
+      dbname_(dbname),
+      options_(options),
+      mu_(),
+      files_(),
+      logfile_(NULL),
+      logfile_number_(0),
+      epoch_(0),
+      pins_() {
+}
+
+ValueLog::~ValueLog() {
+  if (logfile_ != NULL) {
+    // A reopened DB may flush the values' log records to tables and then
+    // delete the write-ahead log, so leave the values durable
+    logfile_->Sync();
+    logfile_->Close();
+    delete logfile_;
+  }
+  for (std::map<uint64_t, FileState>::iterator it = files_.begin();
+       it != files_.end(); ++it) {
+    delete it->second.file;
+  }
+}
+
+void ValueLog::AddExistingFile(uint64_t number, uint64_t size) {
+  MutexLock l(&mu_);
+  files_[number].size = size;
+}
+
+bool ValueLog::NeedsNewFile() {
+  MutexLock l(&mu_);
+  return logfile_ == NULL ||
+         files_[logfile_number_].size >= options_->value_log_file_size;
+}
+
+Status ValueLog::NewFile(uint64_t number) {
+  WritableFile* file;
+  Status s = env_->NewWritableFile(ValueLogFileName(dbname_, number), &file);
+  if (!s.ok()) {
+    return s;
+  }
+  MutexLock l(&mu_);
+  if (logfile_ != NULL) {
+    s = logfile_->Sync();
+    if (s.ok()) {
+      s = logfile_->Close();
+    }
+    delete logfile_;
+  }
+  logfile_ = file;
+  logfile_number_ = number;
+  files_[number] = FileState();
+  return s;
+}
+
+Status ValueLog::Add(const Slice& key, const Slice& value, ValuePointer* ptr) {
+  char header[kHeaderSize];
+  EncodeFixed32(header + 4, key.size());
+  EncodeFixed32(header + 8, value.size());
+  EncodeFixed32(header, crc32c::Mask(RecordChecksum(header, key, value)));
+
+  MutexLock l(&mu_);
+  assert(logfile_ != NULL);
+  Status s = logfile_->Append(Slice(header, kHeaderSize));
+  if (s.ok()) {
+    s = logfile_->Append(key);
+  }
+  if (s.ok()) {
+    s = logfile_->Append(value);
+  }
+  if (s.ok()) {
+    // Make the record visible to Get()
+    s = logfile_->Flush();
+  }
+  if (!s.ok()) {
+    // The file may end in a partial record; the next Add() starts a new one
+    delete logfile_;
+    logfile_ = NULL;
+    logfile_number_ = 0;
+    return s;
+  }
+  FileState* f = &files_[logfile_number_];
+  ptr->file = logfile_number_;
+  ptr->offset = f->size;
+  ptr->size = kHeaderSize + key.size() + value.size();
+  f->size += ptr->size;
+  return s;
+}
+
+Status ValueLog::Sync() {
+  MutexLock l(&mu_);
+  return logfile_ != NULL ? logfile_->Sync() : Status::OK();
+}
+
+Status ValueLog::Get(const ReadOptions& options, const ValuePointer& ptr,
+                     std::string* value) {
+  RandomAccessFile* file = NULL;
+  Status s;
+  {
+    MutexLock l(&mu_);
+    std::map<uint64_t, FileState>::iterator it = files_.find(ptr.file);
+    if (it == files_.end() || ptr.offset + ptr.size > it->second.size) {
+      return Status::Corruption("value pointer past the end of the value log",
+                                ValueLogFileName(dbname_, ptr.file));
+    }
+    if (it->second.file == NULL) {
+      s = env_->NewRandomAccessFile(ValueLogFileName(dbname_, ptr.file),
+                                    &it->second.file);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    file = it->second.file;
+  }
+
+  std::string scratch;
+  scratch.resize(ptr.size);
+  Slice result;
+  s = file->Read(ptr.offset, ptr.size, &result, &scratch[0]);
+  if (!s.ok()) {
+    return s;
+  }
+  Slice key;
+  Slice contents;
+  s = ParseRecord(result,
+                  options.verify_checksums || options_->paranoid_checks,
+                  &key, &contents);
+  if (s.ok()) {
+    value->assign(contents.data(), contents.size());
+  }
+  return s;
+}
+
+Status ValueLog::NewReader(uint64_t number, ValueLogReader** reader) {
+  *reader = NULL;
+  SequentialFile* file;
+  Status s = env_->NewSequentialFile(ValueLogFileName(dbname_, number), &file);
+  if (s.ok()) {
+    *reader = new ValueLogReader(file, number);
+  }
+  return s;
+}
+
+void ValueLog::AddGarbage(const ValuePointer& ptr) {
+  MutexLock l(&mu_);
+  std::map<uint64_t, FileState>::iterator it = files_.find(ptr.file);
+  if (it != files_.end()) {
+    it->second.garbage += ptr.size;
+  }
+}
+
+bool ValueLog::PickFileForCollection(double ratio, uint64_t* number) {
+  MutexLock l(&mu_);
+  double best = -1;
+  for (std::map<uint64_t, FileState>::iterator it = files_.begin();
+       it != files_.end(); ++it) {
+    const FileState& f = it->second;
+    if (it->first == logfile_number_ || f.collecting || f.obsolete ||
+        f.garbage == 0) {
+      continue;
+    }
+    const double garbage = static_cast<double>(f.garbage) / f.size;
+    if (garbage >= ratio && garbage > best) {
+      best = garbage;
+      *number = it->first;
+    }
+  }
+  if (best < 0) {
+    return false;
+  }
+  files_[*number].collecting = true;
+  return true;
+}
+
+void ValueLog::FinishCollection(uint64_t number, bool obsolete,
+                                SequenceNumber sequence) {
+  MutexLock l(&mu_);
+  FileState* f = &files_[number];
+  f->collecting = false;
+  if (obsolete) {
+    f->obsolete = true;
+    f->obsolete_sequence = sequence;
+    f->obsolete_epoch = ++epoch_;
+  }
+}
+
+uint64_t ValueLog::Pin() {
+  MutexLock l(&mu_);
+  ++pins_[epoch_];
+  return epoch_;
+}
+
+void ValueLog::Unpin(uint64_t pin) {
+  MutexLock l(&mu_);
+  std::map<uint64_t, int>::iterator it = pins_.find(pin);
+  assert(it != pins_.end());
+  if (--it->second == 0) {
+    pins_.erase(it);
+  }
+}
+
+bool ValueLog::Deletable(uint64_t number, SequenceNumber oldest_snapshot) {
+  MutexLock l(&mu_);
+  std::map<uint64_t, FileState>::iterator it = files_.find(number);
+  if (it == files_.end() || !it->second.obsolete) {
+    return false;
+  }
+  return (pins_.empty() || pins_.begin()->first >= it->second.obsolete_epoch) &&
+         oldest_snapshot >= it->second.obsolete_sequence;
+}
+
+void ValueLog::RemoveFile(uint64_t number) {
+  MutexLock l(&mu_);
+  std::map<uint64_t, FileState>::iterator it = files_.find(number);
+  if (it != files_.end()) {
+    delete it->second.file;
+    files_.erase(it);
+  }
+}
+
+}  // namespace leveldb
@@ -0,0 +1,160 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The value log holds the values that are at least
+// Options::value_log_threshold bytes long.  DBImpl::Write() appends them
+// to the newest value log file and stores a ValuePointer to them under a
+// kTypeValuePointer entry in the memtable and the tables, so compactions
+// move a few bytes per value instead of the value itself.
+//
+// A value log file is a sequence of records:
+//    checksum: fixed32   // masked crc32c of the rest of the record
+//    key length: fixed32
+//    value length: fixed32
+//    key: uint8[key length]
+//    value: uint8[value length]
+
+#ifndef STORAGE_LEVELDB_DB_VALUE_LOG_H_
+#define STORAGE_LEVELDB_DB_VALUE_LOG_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include "db/dbformat.h"
+#include "pebblesdb/env.h"
+#include "pebblesdb/options.h"
+#include "port/port.h"
+
+namespace leveldb {
+
+// The location of one record in the value log.
+struct ValuePointer {
+  uint64_t file;    // Number of the value log file
+  uint64_t offset;  // Offset of the record in the file
+  uint64_t size;    // Size of the whole record
+
+  ValuePointer() : file(0), offset(0), size(0) { }
+
+  void EncodeTo(std::string* dst) const;
+  bool DecodeFrom(const Slice& input);
+};
+
+// Reads the records of one value log file from front to back.
+class ValueLogReader {
+ public:
+  // Takes ownership of "file".
+  ValueLogReader(SequentialFile* file, uint64_t number);
+  ~ValueLogReader();
+
+  // Read the next record.  *key and *value stay valid until the next call.
+  // Returns false at the end of the file, or on error (see status()).  A
+  // record cut short by a crash ends the file.
+  bool ReadRecord(Slice* key, Slice* value, ValuePointer* ptr);
+
+  Status status() const { return status_; }
+
+ private:
+  SequentialFile* const file_;
+  const uint64_t number_;
+  uint64_t offset_;
+  std::string backing_;
+  Status status_;
+
+  // No copying allowed
+  ValueLogReader(const ValueLogReader&);
+  void operator=(const ValueLogReader&);
+};
+
+// ValueLog provides its own synchronization.
+class ValueLog {
+ public:
+  ValueLog(const std::string& dbname, const Options* options);
+  ~ValueLog();
+
+  // Register a value log file left behind by an earlier incarnation.
+  void AddExistingFile(uint64_t number, uint64_t size);
+
+  // Does Add() need a new file?  True until the first NewFile() call and
+  // whenever the current file reached Options::value_log_file_size.
+  bool NeedsNewFile();
+
+  // Make the file with the specified number the one Add() appends to.
+  // The previous one is synced and closed.
+  Status NewFile(uint64_t number);
+
+  // Append a record to the current file and store its location in *ptr.
+  // REQUIRES: NeedsNewFile() was false at some point before this call
+  Status Add(const Slice& key, const Slice& value, ValuePointer* ptr);
+
+  // Make every record added so far durable.
+  Status Sync();
+
+  // Read the value of the record at *ptr into *value.
+  Status Get(const ReadOptions& options, const ValuePointer& ptr,
+             std::string* value);
+
+  // Open a reader over the records of file "number".
+  Status NewReader(uint64_t number, ValueLogReader** reader);
+
+  // Note that the record at *ptr no longer holds the value of its key.
+  void AddGarbage(const ValuePointer& ptr);
+
+  // Pick a file other than the current one in which at least "ratio" of
+  // the bytes are garbage, and reserve it for the caller, who must call
+  // FinishCollection() once done.  Returns false if there is none.  With
+  // a ratio of zero any file holding garbage qualifies.
+  bool PickFileForCollection(double ratio, uint64_t* number);
+
+  // Release the reservation of file "number".  If "obsolete", every live
+  // value of the file has been copied by the writes ending at "sequence",
+  // and the file can go once nothing older can read it; see Deletable().
+  void FinishCollection(uint64_t number, bool obsolete,
+                        SequenceNumber sequence);
+
+  // Readers that may follow pointers to obsolete files hold a pin from
+  // before they chose their sequence number until they are done.
+  uint64_t Pin();
+  void Unpin(uint64_t pin);
+
+  // Is file "number" obsolete, with no pin older than that and no
+  // snapshot older than the writes that made it so?
+  bool Deletable(uint64_t number, SequenceNumber oldest_snapshot);
+
+  // Forget a file that was deleted.
+  void RemoveFile(uint64_t number);
+
+ private:
+  struct FileState {
+    uint64_t size;
+    uint64_t garbage;
+    RandomAccessFile* file;  // Cached reader; NULL until the first Get()
+    bool collecting;
+    bool obsolete;
+    SequenceNumber obsolete_sequence;
+    uint64_t obsolete_epoch;
+
+    FileState()
+      : size(0), garbage(0), file(NULL), collecting(false),
+        obsolete(false), obsolete_sequence(0), obsolete_epoch(0) { }
+  };
+
+  Env* const env_;
+  const std::string dbname_;
+  const Options* const options_;
+
+  port::Mutex mu_;
+  std::map<uint64_t, FileState> files_;
+  WritableFile* logfile_;    // The file Add() appends to
+  uint64_t logfile_number_;  // 0 if there is none yet
+  uint64_t epoch_;
+  std::map<uint64_t, int> pins_;  // Readers holding each epoch
+
+  // No copying allowed
+  ValueLog(const ValueLog&);
+  void operator=(const ValueLog&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_VALUE_LOG_H_
@@ -27,7 +27,11 @@ enum Tag {
   kNewSentinelFile      = 13,
   kDeletedSentinelFile  = 14,
   kNewCompleteGuard     = 15,
-  kNewSentinelFileNo	= 16
+  kNewSentinelFileNo	= 16,
+  kNewFileWithSequences = 17,
+  kRangeTombstone       = 18,
+  kDeletedRangeTombstone = 19,
+  kNewFileWithStats     = 20
 };
 
 void VersionEdit::Clear() {
@@ -49,6 +53,8 @@ void VersionEdit::Clear() {
     sentinel_files_[i].clear();
   }
   deleted_sentinel_files_.clear();
+  new_range_tombstones_.clear();
+  deleted_range_tombstones_.clear();
 }
 
 void VersionEdit::EncodeTo(std::string* dst) const {
@@ -89,12 +95,33 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    PutVarint32(dst, kNewFileWithStats);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    PutVarint64(dst, f.smallest_seq);
+    PutVarint64(dst, f.largest_seq);
+    PutVarint64(dst, f.tombstones_applied);
+    PutVarint64(dst, f.num_entries);
+    PutVarint64(dst, f.num_deletions);
+  }
+
+  for (size_t i = 0; i < new_range_tombstones_.size(); i++) {
+    const RangeTombstone& t = new_range_tombstones_[i];
+    PutVarint32(dst, kRangeTombstone);
+    PutLengthPrefixedSlice(dst, t.begin);
+    PutLengthPrefixedSlice(dst, t.end);
+    PutVarint64(dst, t.sequence);
+  }
+
+  for (std::set<SequenceNumber>::const_iterator iter =
+           deleted_range_tombstones_.begin();
+       iter != deleted_range_tombstones_.end();
+       ++iter) {
+    PutVarint32(dst, kDeletedRangeTombstone);
+    PutVarint64(dst, *iter);
   }
 
   // Encode deleted guards
@@ -171,6 +198,8 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
   Slice str;
   InternalKey key;
   GuardMetaData g;
+  RangeTombstone t;
+  Slice end;
   
   while (msg == NULL && GetVarint32(&input, &tag)) {
     switch (tag) {
@@ -262,6 +291,46 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
 	msg = "new-file entry";
       }
 	    break;
+
+    case kNewFileWithSequences:
+    case kNewFileWithStats:
+      if (GetLevel(&input, &level) &&
+          GetVarint64(&input, &f.number) &&
+          GetVarint64(&input, &f.file_size) &&
+          GetInternalKey(&input, &f.smallest) &&
+          GetInternalKey(&input, &f.largest) &&
+          GetVarint64(&input, &f.smallest_seq) &&
+          GetVarint64(&input, &f.largest_seq) &&
+          GetVarint64(&input, &f.tombstones_applied) &&
+          (tag == kNewFileWithSequences ||
+           (GetVarint64(&input, &f.num_entries) &&
+            GetVarint64(&input, &f.num_deletions)))) {
+        new_files_.push_back(std::make_pair(level, f));
+        f = FileMetaData();
+      } else {
+        msg = "new-file entry";
+      }
+      break;
+
+    case kRangeTombstone:
+      if (GetLengthPrefixedSlice(&input, &str) &&
+          GetLengthPrefixedSlice(&input, &end) &&
+          GetVarint64(&input, &t.sequence)) {
+        t.begin = str.ToString();
+        t.end = end.ToString();
+        new_range_tombstones_.push_back(t);
+      } else {
+        msg = "range tombstone";
+      }
+      break;
+
+    case kDeletedRangeTombstone:
+      if (GetVarint64(&input, &number)) {
+        deleted_range_tombstones_.insert(number);
+      } else {
+        msg = "deleted range tombstone";
+      }
+      break;
 	    
     case kNewSentinelFile:
       if (GetLevel(&input, &level) &&
@@ -389,6 +458,36 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    r.append(" @ ");
+    AppendNumberTo(&r, f.smallest_seq);
+    r.append(" .. ");
+    AppendNumberTo(&r, f.largest_seq);
+    if (f.tombstones_applied > 0) {
+      r.append(" clean below ");
+      AppendNumberTo(&r, f.tombstones_applied);
+    }
+    if (f.num_entries > 0) {
+      r.append(" deletions ");
+      AppendNumberTo(&r, f.num_deletions);
+      r.append("/");
+      AppendNumberTo(&r, f.num_entries);
+    }
+  }
+  for (size_t i = 0; i < new_range_tombstones_.size(); i++) {
+    const RangeTombstone& t = new_range_tombstones_[i];
+    r.append("\n  AddRangeTombstone: '");
+    r.append(EscapeString(t.begin));
+    r.append("' .. '");
+    r.append(EscapeString(t.end));
+    r.append("' @ ");
+    AppendNumberTo(&r, t.sequence);
+  }
+  for (std::set<SequenceNumber>::const_iterator iter =
+           deleted_range_tombstones_.begin();
+       iter != deleted_range_tombstones_.end();
+       ++iter) {
+    r.append("\n  DeleteRangeTombstone: ");
+    AppendNumberTo(&r, *iter);
   }
   // Add guards to the debug string
   for (DeletedGuardSet::const_iterator iter = deleted_guards_.begin();
@@ -24,8 +24,20 @@ struct FileMetaData {
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
   GuardMetaData* guard;       // The guard that the file belongs to.
+  // Range of the sequence numbers in the table.  Files from before these
+  // were recorded claim every sequence number.
+  SequenceNumber smallest_seq;
+  SequenceNumber largest_seq;
+  // Range tombstones older than this cover none of the table's entries
+  SequenceNumber tombstones_applied;
+  // Number of entries in the table, and how many of them are deletions.
+  // Both are zero for files from before these were recorded.
+  uint64_t num_entries;
+  uint64_t num_deletions;
   
-FileMetaData() : refs(0), allowed_seeks(1 << 30), number(0), file_size(0), smallest(), largest(), guard() { }
+FileMetaData() : refs(0), allowed_seeks(1 << 30), number(0), file_size(0), smallest(), largest(), guard(),
+                 smallest_seq(0), largest_seq(kMaxSequenceNumber), tombstones_applied(0),
+                 num_entries(0), num_deletions(0) { }
 };
 
 /* 
@@ -97,15 +109,31 @@ class VersionEdit {
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
   // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
+  // REQUIRES: the sequence numbers in the file are within
+  //           [smallest_seq, largest_seq]
+  // REQUIRES: no range tombstone older than "tombstones_applied" covers an
+  //           entry in the file
+  // REQUIRES: the file holds "num_entries" entries, "num_deletions" of
+  //           them deletions (or both are zero if unknown)
   void AddFile(int level, uint64_t file,
                uint64_t file_size,
                const InternalKey& smallest,
-               const InternalKey& largest) {
+               const InternalKey& largest,
+               SequenceNumber smallest_seq = 0,
+               SequenceNumber largest_seq = kMaxSequenceNumber,
+               SequenceNumber tombstones_applied = 0,
+               uint64_t num_entries = 0,
+               uint64_t num_deletions = 0) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.smallest_seq = smallest_seq;
+    f.largest_seq = largest_seq;
+    f.tombstones_applied = tombstones_applied;
+    f.num_entries = num_entries;
+    f.num_deletions = num_deletions;
     new_files_.push_back(std::make_pair(level, f));
   }
 
@@ -191,6 +219,16 @@ class VersionEdit {
   void DeleteSentinelFile(int level, uint64_t file) {
     deleted_sentinel_files_.insert(std::make_pair(level, file));
   }
+
+  // Add a range tombstone moved out of a memtable.
+  void AddRangeTombstone(const RangeTombstone& t) {
+    new_range_tombstones_.push_back(t);
+  }
+
+  // Drop the range tombstone with the given sequence number.
+  void DeleteRangeTombstone(SequenceNumber sequence) {
+    deleted_range_tombstones_.insert(sequence);
+  }
   
   void UpdateGuards(uint64_t* guard_array) {
     for (int i = 0; i < config::kNumLevels; i++) {
@@ -248,6 +286,9 @@ class VersionEdit {
   std::vector<GuardMetaData> new_guards_[config::kNumLevels];
   std::vector<GuardMetaData> new_complete_guards_[config::kNumLevels];
   DeletedGuardSet deleted_guards_;
+
+  std::vector<RangeTombstone> new_range_tombstones_;
+  std::set<SequenceNumber> deleted_range_tombstones_;
 };
 
 }  // namespace leveldb
@@ -27,8 +27,12 @@ TEST(VersionEditTest, EncodeDecode) {
     TestEncodeDecode(edit);
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
-                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion),
+                 kBig + 500 + i, kBig + 600 + i, kBig + 550 + i,
+                 kBig + 650 + i, kBig + 640 + i);
     edit.DeleteFile(4, kBig + 700 + i);
+    edit.AddRangeTombstone(RangeTombstone("bar", "baz", kBig + 800 + i));
+    edit.DeleteRangeTombstone(kBig + 850 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
   }
 
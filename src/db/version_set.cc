@@ -7,6 +7,7 @@
 #include "db/version_set.h"
 
 #include <algorithm>
+#include <deque>
 #include <stdio.h>
 #include <cmath>
 #include "db/dbformat.h"
@@ -15,12 +16,14 @@
 #include "db/log_writer.h"
 #include "db/memtable.h"
 #include "db/table_cache.h"
+#include "pebblesdb/cache.h"
 #include "pebblesdb/env.h"
 #include "pebblesdb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 #include "util/timer.h"
 #include "db/murmurhash3.h"
 #include <inttypes.h>
@@ -113,18 +116,6 @@ static uint64_t MaxFileSizeForLevel(unsigned level) {
   return bytes[level];
 }
 
-static int MaxFilesPerGuardForLevel(unsigned level) {
-  assert(level < leveldb::config::kNumLevels);
-  static const int num_files[] = {-1,
-                                 -1,
-                                 -1,
-                                 -1,
-                                 -1,
-                                 -1,
-                                 -1};
-  return num_files[level];
-}
-
 static uint64_t MaxCompactionBytesForLevel(unsigned level) {
   return MaxFileSizeForLevel(level) * 16;
 }
@@ -147,6 +138,10 @@ Version::~Version() {
   prev_->next_ = next_;
   next_->prev_ = prev_;
 
+  if (range_tombstone_list_ != NULL) {
+    range_tombstone_list_->Unref();
+  }
+
   // Drop references to files
   for (unsigned level = 0; level < config::kNumLevels; level++) {
     for (size_t i = 0; i < files_[level].size(); i++) {
@@ -420,7 +415,10 @@ class Version::LevelGuardNumIterator : public Iterator {
                        const std::vector<GuardMetaData*>* glist,
 					   const std::vector<FileMetaData*>* sentinel_list,
 					   const std::vector<FileMetaData*>* file_list,
-                       uint64_t num, Timer* timer)
+                       uint64_t num, Timer* timer,
+                       const Slice* lower_bound = NULL,
+                       const Slice* upper_bound = NULL,
+                       const std::set<uint64_t>* skipped_files = NULL)
       : icmp_(icmp),
         glist_(glist),
 		sentinel_list_(sentinel_list),
@@ -428,7 +426,10 @@ class Version::LevelGuardNumIterator : public Iterator {
         index_(glist->size()), // Marks as invalid
         number_(num),
         status_(Status::OK()),
-		timer(timer) {
+		timer(timer),
+		lower_bound_(lower_bound),
+		upper_bound_(upper_bound),
+		skipped_files_(skipped_files) {
   }
 
   ~LevelGuardNumIterator() { }
@@ -460,6 +461,17 @@ class Version::LevelGuardNumIterator : public Iterator {
 
   virtual void SeekToLast() {
     index_ = glist_->size() - 1;
+    if (HasBound(upper_bound_)) {
+      // Start from the last guard that begins before the upper bound
+      std::string upper;
+      AppendInternalKey(&upper, ParsedInternalKey(*upper_bound_, kMaxSequenceNumber, kValueTypeForSeek));
+      if (glist_->size() > 0) {
+        index_ = FindGuard(icmp_, *glist_, upper);
+      }
+      while (index_ >= 0 && GuardKeyCompare(index_, *upper_bound_) >= 0) {
+        index_--;
+      }
+    }
     BumpReverse();
   }
 
@@ -506,7 +518,7 @@ class Version::LevelGuardNumIterator : public Iterator {
     uint64_t num_files = 0;
     if (index_ == -1) {
     	for (int i = 0; i < sentinel_list_->size(); i++) {
-    		if (sentinel_list_->at(i)->number > number_) {
+    		if (Include(sentinel_list_->at(i)->number)) {
     			files.push_back(sentinel_list_->at(i)->number);
     			file_sizes.push_back(sentinel_list_->at(i)->file_size);
     			num_files++;
@@ -514,7 +526,7 @@ class Version::LevelGuardNumIterator : public Iterator {
     	}
     } else {
     	for (int i = 0; i < glist_->at(index_)->number_segments; i++) {
-    		if (glist_->at(index_)->files[i] > number_) {
+    		if (Include(glist_->at(index_)->files[i])) {
     			files.push_back(glist_->at(index_)->files[i]);
     			file_sizes.push_back(glist_->at(index_)->file_metas[i]->file_size);
     			num_files++;
@@ -538,12 +550,45 @@ class Version::LevelGuardNumIterator : public Iterator {
   LevelGuardNumIterator(const LevelGuardNumIterator&);
   LevelGuardNumIterator& operator = (const LevelGuardNumIterator&);
 
+  static bool HasBound(const Slice* bound) {
+    return bound != NULL && !bound->empty();
+  }
+
+  // Files numbered at most number_, or in *skipped_files_, are left out
+  bool Include(uint64_t file_number) const {
+    return file_number > number_ &&
+           (skipped_files_ == NULL || skipped_files_->count(file_number) == 0);
+  }
+
+  int GuardKeyCompare(int index, const Slice& user_key) const {
+    return icmp_.user_comparator()->Compare((*glist_)[index]->guard_key.user_key(), user_key);
+  }
+
+  // Guard i holds keys in [guard_key(i), guard_key(i+1)) and the sentinel
+  // holds keys below guard_key(0).  A guard lying entirely outside the
+  // iterate bounds ends the iteration, so no table under it is opened.
   void Bump() {
+    BumpForward();
+    if (index_ >= 0 && index_ < (int) glist_->size() &&
+        HasBound(upper_bound_) && GuardKeyCompare(index_, *upper_bound_) >= 0) {
+      index_ = glist_->size();  // Marks as invalid
+    }
+  }
+
+  void BumpReverse() {
+    BumpBackward();
+    if (index_ >= -1 && index_ + 1 < (int) glist_->size() &&
+        HasBound(lower_bound_) && GuardKeyCompare(index_ + 1, *lower_bound_) <= 0) {
+      index_ = glist_->size();  // Marks as invalid
+    }
+  }
+
+  void BumpForward() {
 	// Handle sentinel files --> Go to guard 0 if either sentinel has no files or all sentinel files are invalid (> number)
 	if (index_ == -1) {
 		bool valid = false;
 		for (int i = 0; i < sentinel_list_->size(); i++) {
-	      if ((*sentinel_list_)[i]->number > number_) {
+	      if (Include((*sentinel_list_)[i]->number)) {
 	    	  valid = true;
 	    	  break;
 	      }
@@ -557,7 +602,7 @@ class Version::LevelGuardNumIterator : public Iterator {
     while (index_ < glist_->size()) {
       bool valid = false;
       for (int i = 0; glist_->at(index_) != NULL && i < glist_->at(index_)->number_segments; i++) {
-    	  if (glist_->at(index_)->files[i] > number_) {
+    	  if (Include(glist_->at(index_)->files[i])) {
     		  valid = true;
     		  break;
     	  }
@@ -569,18 +614,18 @@ class Version::LevelGuardNumIterator : public Iterator {
     }
   }
 
-  void BumpReverse() {
+  void BumpBackward() {
 	// Handle sentinel files --> Go to guard 0 if either sentinel has no files or all sentinel files are invalid (> number)
 	while (index_ >= -1) {
 		if (index_ == -1) {
 			for (int i = 0; i < sentinel_list_->size(); i++) {
-		      if ((*sentinel_list_)[i]->number > number_) {
+		      if (Include((*sentinel_list_)[i]->number)) {
 		    	  return;
 		      }
 			}
 		} else {
 			  for (int i = 0; glist_->at(index_) != NULL && i < glist_->at(index_)->number_segments; i++) {
-				  if (glist_->at(index_)->files[i] > number_) {
+				  if (Include(glist_->at(index_)->files[i])) {
 					  return;
 				  }
 			  }
@@ -597,6 +642,11 @@ class Version::LevelGuardNumIterator : public Iterator {
   uint64_t number_;
   Status status_;
   Timer* timer;
+  // Iterate bounds as user keys; NULL or empty if unbounded.  Read on
+  // every positioning call since the DBIter may move them between seeks.
+  const Slice* const lower_bound_;
+  const Slice* const upper_bound_;
+  const std::set<uint64_t>* const skipped_files_;
 
   // Backing store for value().  Holds the file number and size.
   mutable char value_buf_[16384];
@@ -709,7 +759,187 @@ static Iterator* GetGuardIteratorParallel(void* arg1, const void* arg2, void* ar
 }
 #endif
 
-static Iterator* GetGuardIteratorSeq(void* arg1, const void* arg2, void* arg3, unsigned level, const ReadOptions& options, const Slice& file_values) {
+namespace {
+
+// Iterates over one table of a guard, but opens the table only once the
+// merge needs more than its first or last key.  Both are known from the
+// file metadata, so a scan that stops before a table's range begins, or
+// seeks past its end, never opens it.
+class LazyTableIterator : public Iterator {
+ public:
+  LazyTableIterator(TableCache* table_cache, const InternalKeyComparator* icmp,
+                    const ReadOptions& options, uint64_t file_number,
+                    uint64_t file_size, const FileMetaData* meta)
+      : table_cache_(table_cache),
+        icmp_(icmp),
+        options_(options),
+        file_number_(file_number),
+        file_size_(file_size),
+        meta_(meta),
+        iter_(NULL),
+        position_(kInvalid) {
+    assert(meta_ != NULL);
+  }
+
+  virtual ~LazyTableIterator() {
+    delete iter_;
+  }
+
+  virtual bool Valid() const {
+    switch (position_) {
+      case kAtSmallest:
+      case kAtLargest:
+        return true;
+      case kOpened:
+        return iter_->Valid();
+      default:
+        return false;
+    }
+  }
+
+  virtual void Seek(const Slice& target) {
+    if (icmp_->Compare(target, meta_->largest.Encode()) > 0) {
+      position_ = kInvalid;
+    } else if (icmp_->Compare(target, meta_->smallest.Encode()) <= 0 &&
+               WithinBounds(meta_->smallest)) {
+      position_ = kAtSmallest;
+    } else {
+      Open();
+      iter_->Seek(target);
+    }
+  }
+
+  virtual void SeekToFirst() {
+    if (WithinBounds(meta_->smallest)) {
+      position_ = kAtSmallest;
+    } else {
+      Open();
+      iter_->SeekToFirst();
+    }
+  }
+
+  virtual void SeekToLast() {
+    if (WithinBounds(meta_->largest)) {
+      position_ = kAtLargest;
+    } else {
+      Open();
+      iter_->SeekToLast();
+    }
+  }
+
+  virtual void Next() {
+    assert(Valid());
+    if (Materialize()) {
+      iter_->Next();
+    }
+  }
+
+  virtual void Prev() {
+    assert(Valid());
+    if (Materialize()) {
+      iter_->Prev();
+    }
+  }
+
+  virtual Slice key() const {
+    assert(Valid());
+    switch (position_) {
+      case kAtSmallest:
+        return meta_->smallest.Encode();
+      case kAtLargest:
+        return meta_->largest.Encode();
+      default:
+        return iter_->key();
+    }
+  }
+
+  virtual Slice value() const {
+    assert(Valid());
+    if (!Materialize()) {
+      return Slice();
+    }
+    return iter_->value();
+  }
+
+  virtual const Status& status() const {
+    if (!status_.ok() || iter_ == NULL) {
+      return status_;
+    }
+    return iter_->status();
+  }
+
+ private:
+  enum Position {
+    kInvalid,
+    kAtSmallest,   // At the table's first key; not opened yet
+    kAtLargest,    // At the table's last key; not opened yet
+    kOpened
+  };
+
+  // The table iterator skips blocks outside the iterate bounds, so only
+  // a key within them is sure to be where the table iterator lands.
+  bool WithinBounds(const InternalKey& key) const {
+    const Comparator* ucmp = icmp_->user_comparator();
+    const Slice* lower = options_.iterate_lower_bound;
+    const Slice* upper = options_.iterate_upper_bound;
+    return (lower == NULL || lower->empty() ||
+            ucmp->Compare(key.user_key(), *lower) >= 0) &&
+           (upper == NULL || upper->empty() ||
+            ucmp->Compare(key.user_key(), *upper) < 0);
+  }
+
+  void Open() const {
+    if (iter_ == NULL) {
+      iter_ = table_cache_->NewIterator(options_, file_number_, file_size_);
+    }
+    position_ = kOpened;
+  }
+
+  // Position the table iterator where the placeholder is.  Returns false,
+  // leaving the iterator invalid, if the table does not have the key its
+  // metadata promised there, e.g. because its first block is unreadable.
+  bool Materialize() const {
+    if (position_ == kAtSmallest) {
+      Open();
+      iter_->SeekToFirst();
+    } else if (position_ == kAtLargest) {
+      Open();
+      iter_->SeekToLast();
+    } else {
+      return true;
+    }
+    if (!iter_->Valid()) {
+      status_ = iter_->status();
+      if (status_.ok()) {
+        status_ = Status::Corruption("table ends before its recorded key range");
+      }
+      return false;
+    }
+    return true;
+  }
+
+  TableCache* const table_cache_;
+  const InternalKeyComparator* const icmp_;
+  const ReadOptions options_;
+  const uint64_t file_number_;
+  const uint64_t file_size_;
+  const FileMetaData* const meta_;
+  // Opened by the const value() as well
+  mutable Iterator* iter_;
+  mutable Position position_;
+  mutable Status status_;
+
+  // No copying allowed
+  LazyTableIterator(const LazyTableIterator&);
+  void operator=(const LazyTableIterator&);
+};
+
+}  // namespace
+
+// Compaction inputs read every table in full, so they open tables eagerly
+// rather than through LazyTableIterator.
+static Iterator* GetGuardIteratorSeq(void* arg1, const void* arg2, void* arg3, unsigned level, const ReadOptions& options, const Slice& file_values,
+                                     bool open_lazily) {
   TableCache* table_cache = reinterpret_cast<TableCache*> (arg1);
   const InternalKeyComparator* icmp = reinterpret_cast<const InternalKeyComparator*> (arg2);
   VersionSet* vset = reinterpret_cast<VersionSet*> (arg3);
@@ -720,24 +950,31 @@ static Iterator* GetGuardIteratorSeq(void* arg1, const void* arg2, void* arg3, u
 
   assert(num_files == DecodeFixed64(file_values.data()));
   vvstart_timer(SEEK_TITERATOR_SEQUENTIAL_TOTAL);
+  std::vector<uint64_t> file_numbers(num_files);
   for (int i = 0; i < num_files; i++) {
 	  int file_num_pos = i * 16 + 8;
 	  int file_size_pos = file_num_pos + 8;
 	  uint64_t file_number = DecodeFixed64(file_values.data() + file_num_pos);
 	  uint64_t file_size = DecodeFixed64(file_values.data() + file_size_pos);
+	  file_numbers[i] = file_number;
 	  file_meta_list[i] = table_cache->GetFileMetaDataForFile(file_number);
-	  list[i] = table_cache->NewIterator(options, file_number, file_size);
+	  if (open_lazily && file_meta_list[i] != NULL) {
+		  list[i] = new LazyTableIterator(table_cache, icmp, options, file_number, file_size, file_meta_list[i]);
+	  } else {
+		  list[i] = table_cache->NewIterator(options, file_number, file_size);
+	  }
   }
   vvrecord_timer2(SEEK_TITERATOR_SEQUENTIAL_TOTAL, num_files);
-  Iterator* iterator = NewMergingIteratorForFiles(icmp, list, file_meta_list, num_files, icmp, vset, level);
+  Iterator* iterator = NewMergingIteratorForFiles(icmp, list, file_meta_list, num_files, icmp, vset, level,
+		  &file_numbers[0], options.iterate_upper_bound);
   delete[] list;
   return iterator;
 }
 
 
-static Iterator* GetGuardIterator(void* arg1, const void* arg2, void* arg3, unsigned level,
-                                 const ReadOptions& options,
-                                 const Slice& file_values) {
+static Iterator* NewGuardIterator(void* arg1, const void* arg2, void* arg3, unsigned level,
+                                  const ReadOptions& options,
+                                  const Slice& file_values, bool open_lazily) {
   TableCache* table_cache = reinterpret_cast<TableCache*> (arg1);
   const InternalKeyComparator* icmp = reinterpret_cast<const InternalKeyComparator*> (arg2);
   VersionSet* vset = reinterpret_cast<VersionSet*> (arg3);
@@ -750,18 +987,129 @@ static Iterator* GetGuardIterator(void* arg1, const void* arg2, void* arg3, unsi
   if (num_files > 1 && level == config::kNumLevels-1) {
 	  return GetGuardIteratorParallel(arg1, arg2, arg3, level, options, file_values);
   } else {
-	  return GetGuardIteratorSeq(arg1, arg2, arg3, level, options, file_values);
+	  return GetGuardIteratorSeq(arg1, arg2, arg3, level, options, file_values, open_lazily);
   }
 #else
-  return GetGuardIteratorSeq(arg1, arg2, arg3, level, options, file_values);
+  return GetGuardIteratorSeq(arg1, arg2, arg3, level, options, file_values, open_lazily);
 #endif
 }
 
+static Iterator* GetGuardIterator(void* arg1, const void* arg2, void* arg3, unsigned level,
+                                 const ReadOptions& options,
+                                 const Slice& file_values) {
+  return NewGuardIterator(arg1, arg2, arg3, level, options, file_values, true);
+}
+
+static Iterator* GetCompactionGuardIterator(void* arg1, const void* arg2, void* arg3, unsigned level,
+                                            const ReadOptions& options,
+                                            const Slice& file_values) {
+  return NewGuardIterator(arg1, arg2, arg3, level, options, file_values, false);
+}
+
+// Open the tables of a guard and read their first blocks, so that an
+// iterator entering the guard finds them in the table and block caches.
+// Errors are left for the iterator to find.
+namespace {
+// An Env whose Schedule() runs the scheduled work on a thread of its own,
+// started on first use.  Guard prefetches then neither wait behind nor
+// delay other work on the background thread of the base Env.  They still
+// run one at a time, so a slow prefetch delays the next one.
+class PrefetchEnv : public EnvWrapper {
+ public:
+  explicit PrefetchEnv(Env* base)
+      : EnvWrapper(base),
+        mu_(),
+        cv_(&mu_),
+        queue_(),
+        started_(false),
+        running_(false),
+        shutting_down_(false) {
+  }
+
+  virtual ~PrefetchEnv() {
+    MutexLock l(&mu_);
+    shutting_down_ = true;
+    cv_.SignalAll();
+    while (running_) {
+      cv_.Wait();
+    }
+  }
+
+  virtual void Schedule(void (*function)(void*), void* arg) {
+    MutexLock l(&mu_);
+    if (!started_) {
+      started_ = true;
+      running_ = true;
+      target()->StartThread(&PrefetchEnv::ThreadBody, this);
+    }
+    queue_.push_back(std::make_pair(function, arg));
+    cv_.SignalAll();
+  }
+
+ private:
+  typedef std::pair<void (*)(void*), void*> Work;
+
+  static void ThreadBody(void* arg) {
+    reinterpret_cast<PrefetchEnv*>(arg)->Run();
+  }
+
+  void Run() {
+    MutexLock l(&mu_);
+    while (true) {
+      while (queue_.empty() && !shutting_down_) {
+        cv_.Wait();
+      }
+      if (queue_.empty()) {
+        break;
+      }
+      Work work = queue_.front();
+      queue_.pop_front();
+      mu_.Unlock();
+      (*work.first)(work.second);
+      mu_.Lock();
+    }
+    running_ = false;
+    cv_.SignalAll();
+  }
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  std::deque<Work> queue_;  // Protected by mu_
+  bool started_;            // Protected by mu_
+  bool running_;            // Protected by mu_
+  bool shutting_down_;      // Protected by mu_
+};
+}  // namespace
+
+static void PrefetchGuard(void* arg1, const void* /*arg2*/, void* /*arg3*/, unsigned /*level*/,
+                          const ReadOptions& options, const Slice& file_values) {
+  TableCache* table_cache = reinterpret_cast<TableCache*> (arg1);
+  ReadOptions prefetch_options = options;
+  prefetch_options.iterate_lower_bound = NULL;
+  prefetch_options.iterate_upper_bound = NULL;
+  prefetch_options.readahead_size = 0;
+  const uint64_t num_files = DecodeFixed64(file_values.data());
+  for (uint64_t i = 0; i < num_files; i++) {
+	  uint64_t file_number = DecodeFixed64(file_values.data() + i * 16 + 8);
+	  uint64_t file_size = DecodeFixed64(file_values.data() + i * 16 + 16);
+	  Iterator* iter = table_cache->NewIterator(prefetch_options, file_number, file_size);
+	  iter->SeekToFirst();
+	  delete iter;
+  }
+}
+
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             unsigned level, uint64_t num) const {
+  Iterator* lookahead = NULL;
+  if (options.prefetch_next_guard) {
+    lookahead = new LevelGuardNumIterator(vset_->icmp_, &guards_[level], &sentinel_files_[level], &files_[level], num, vset_->timer,
+                                          options.iterate_lower_bound, options.iterate_upper_bound);
+  }
 	return NewTwoLevelIteratorGuards(
-      new LevelGuardNumIterator(vset_->icmp_, &guards_[level], &sentinel_files_[level], &files_[level], num, vset_->timer),
-      &GetGuardIterator, vset_->table_cache_, &vset_->icmp_, vset_, level, options);
+      new LevelGuardNumIterator(vset_->icmp_, &guards_[level], &sentinel_files_[level], &files_[level], num, vset_->timer,
+                                options.iterate_lower_bound, options.iterate_upper_bound),
+      &GetGuardIterator, vset_->table_cache_, &vset_->icmp_, vset_, level, options, &vset_->icmp_,
+      lookahead, &PrefetchGuard, vset_->prefetch_env_);
 }
 
 void Version::AddIterators(const ReadOptions& options,
@@ -850,9 +1198,61 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
   }
 }
 
+// Options::row_cache maps RowCacheKey() to a row: the tag (sequence and
+// type) of the newest entry for the user key in the table, followed by
+// the value if the entry is not a deletion.
+static void RowCacheKey(uint64_t cache_id, uint64_t file_number,
+                        const Slice& user_key, std::string* key) {
+  PutFixed64(key, cache_id);
+  PutFixed64(key, file_number);
+  key->append(user_key.data(), user_key.size());
+}
+
+static void DeleteCachedRow(const Slice& key, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+static void ReleaseCachedRow(void* arg1, void* arg2) {
+  Cache* cache = reinterpret_cast<Cache*>(arg1);
+  cache->Release(reinterpret_cast<Cache::Handle*>(arg2));
+}
+
+static void DeleteBlockIterator(void* arg1, void* /*arg2*/) {
+  delete reinterpret_cast<Iterator*>(arg1);
+}
+
+Status Version::GetBelowOperand(const ReadOptions& options, FileMetaData* f,
+                                Saver* saver,
+                                std::vector<std::string>* operands,
+                                std::string* lookup_key,
+                                Iterator** block_iter) {
+  Status s;
+  while (s.ok() && saver->state == kMerge) {
+    operands->push_back(saver->value.ToString());
+    if (block_iter != NULL) {
+      delete *block_iter;
+      *block_iter = NULL;
+    }
+    // The older entries for the key sort after the operand
+    assert(saver->sequence > 0);
+    lookup_key->clear();
+    AppendInternalKey(lookup_key, ParsedInternalKey(saver->user_key,
+                                                    saver->sequence - 1,
+                                                    kValueTypeForSeek));
+    saver->state = kNotFound;
+    s = vset_->table_cache_->Get(options, f->number, f->file_size,
+                                 *lookup_key, saver, SaveValue,
+                                 vset_->timer, block_iter);
+  }
+  return s;
+}
+
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
-                    std::string* value,
+                    SequenceNumber deleted_before,
+                    PinnableSlice* value,
+                    ValueType* type,
+                    std::vector<std::string>* operands,
                     GetStats* stats) {
 #ifdef READ_PARALLEL
   pthread_t current_thread = vset_->env_->GetThreadId();
@@ -861,6 +1261,12 @@ Status Version::Get(const ReadOptions& options,
   Slice user_key = k.user_key();
   const Comparator* ucmp = vset_->icmp_.user_comparator();
   Status s;
+  Cache* row_cache = vset_->options_->row_cache;
+  SequenceNumber snapshot = DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8;
+  std::string row_key;
+  // Once a merge operand is found, older files are searched from below it
+  std::string lookup_key;
+  bool below_operand = false;
 
   stats->seek_file = NULL;
   stats->seek_file_level = -1;
@@ -960,6 +1366,29 @@ Status Version::Get(const ReadOptions& options,
       last_file_read = f;
       last_file_read_level = level;
 
+      if (row_cache != NULL) {
+        row_key.clear();
+        RowCacheKey(vset_->row_cache_id_, f->number, user_key, &row_key);
+        Cache::Handle* h = row_cache->Lookup(row_key);
+        if (h != NULL) {
+          const std::string* row = reinterpret_cast<std::string*>(row_cache->Value(h));
+          const uint64_t tag = DecodeFixed64(row->data());
+          // A row newer than the snapshot hides older entries in the table
+          if ((tag >> 8) <= snapshot) {
+            *type = static_cast<ValueType>(tag & 0xff);
+            if ((tag >> 8) >= deleted_before &&
+                (*type == kTypeValue || *type == kTypeValuePointer)) {
+              value->PinSlice(Slice(row->data() + 8, row->size() - 8),
+                              &ReleaseCachedRow, row_cache, h);
+              return Status::OK();
+            }
+            row_cache->Release(h);
+            return Status::NotFound(Slice());
+          }
+          row_cache->Release(h);
+        }
+      }
+
       bool key_may_match = true;
 
 #ifdef FILE_LEVEL_FILTER
@@ -967,7 +1396,7 @@ Status Version::Get(const ReadOptions& options,
       if (filter_string != NULL) {
 		  vstart_timer(GET_FILE_LEVEL_FILTER_CHECK, BEGIN, 1);
 		  Slice filter_slice = Slice(filter_string->data(), filter_string->size());
-		  key_may_match = vset_->options_->filter_policy->KeyMayMatch(ikey, filter_slice);
+		  key_may_match = vset_->FileLevelFilterPolicy(level)->KeyMayMatch(ikey, filter_slice);
 		  vrecord_timer(GET_FILE_LEVEL_FILTER_CHECK, BEGIN, 1);
 		  if (!key_may_match) {
 			  continue;
@@ -979,22 +1408,55 @@ Status Version::Get(const ReadOptions& options,
       saver.state = kNotFound;
       saver.ucmp = ucmp;
       saver.user_key = user_key;
-      saver.value = value;
+      saver.deleted_before = deleted_before;
 
       vstart_timer(GET_TABLE_CACHE_GET, BEGIN, 1);
+      Iterator* block_iter = NULL;
       s = vset_->table_cache_->Get(options, f->number, f->file_size,
-			  ikey, &saver, SaveValue, vset_->timer);
+			  ikey, &saver, SaveValue, vset_->timer, &block_iter);
       vrecord_timer(GET_TABLE_CACHE_GET, BEGIN, 1);
       num_files_read++;
 
+      if (s.ok() && saver.state == kMerge) {
+        s = GetBelowOperand(options, f, &saver, operands, &lookup_key,
+                            &block_iter);
+        ikey = lookup_key;
+        snapshot = DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8;
+        below_operand = true;
+      }
       if (!s.ok()) {
+        delete block_iter;
         return s;
       }
+      if (saver.state == kFound) {
+        // saver.value points into the block, so keep it until the caller
+        // is done with the value
+        value->PinSlice(saver.value, &DeleteBlockIterator, block_iter, NULL);
+      } else {
+        delete block_iter;
+      }
+
+      // Without a snapshot the entry found is the newest one in the table.
+      // A row records the entry itself, not what a tombstone made of it.
+      if (row_cache != NULL && options.snapshot == NULL && options.fill_cache &&
+          !below_operand && saver.sequence >= deleted_before &&
+          (saver.state == kFound || saver.state == kDeleted)) {
+        const ValueType row_type = (saver.state == kFound) ? saver.type : kTypeDeletion;
+        std::string* row = new std::string;
+        PutFixed64(row, (saver.sequence << 8) | row_type);
+        if (saver.state == kFound) {
+          row->append(value->data(), value->size());
+        }
+        row_cache->Release(row_cache->Insert(row_key, row,
+                                             row_key.size() + row->size(),
+                                             &DeleteCachedRow));
+      }
 
       switch (saver.state) {
         case kNotFound:
           break;      // Keep searching in other files
         case kFound:
+          *type = saver.type;
           return Status::OK();
         case kDeleted:
           s = Status::NotFound(Slice());  // Use empty error message for speed
@@ -1008,6 +1470,7 @@ Status Version::Get(const ReadOptions& options,
     }
 #else
     std::vector<Saver*> savers;
+    std::vector<std::string> scratch(num_files);
     std::vector<pthread_t> pthreads;
 
     std::vector<int> read_thread_indices;
@@ -1028,6 +1491,8 @@ Status Version::Get(const ReadOptions& options,
       saver.state = kNotFound;
       saver.ucmp = ucmp;
       saver.user_key = user_key;
+      saver.deleted_before = deleted_before;
+      saver.scratch = &scratch[i];  // The block is gone once the read returns
       savers.push_back(&saver);
 
       vstart_timer(GET_TABLE_CACHE_GET, BEGIN, 1);
@@ -1092,11 +1557,20 @@ Status Version::Get(const ReadOptions& options,
         return s;
       }
       */
+      if (savers[i]->state == kMerge) {
+        s = GetBelowOperand(options, files[i], savers[i], operands,
+                            &lookup_key, NULL);
+        if (!s.ok()) {
+          return s;
+        }
+        ikey = lookup_key;
+      }
       switch (savers[i]->state) {
         case kNotFound:
           break;      // Keep searching in other files
         case kFound:
-        	value->assign(savers[i]->value);
+        	value->PinSelf(savers[i]->value);
+          *type = savers[i]->type;
           return Status::OK();
         case kDeleted:
           s = Status::NotFound(Slice());  // Use empty error message for speed
@@ -1178,6 +1652,21 @@ void Version::Unref() {
   }
 }
 
+bool Version::RangeTombstoneIsObsolete(const RangeTombstone& t) const {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  for (unsigned level = 0; level < config::kNumLevels; level++) {
+    for (size_t i = 0; i < files_[level].size(); i++) {
+      const FileMetaData* f = files_[level][i];
+      if (f->smallest_seq < t.sequence && f->tombstones_applied <= t.sequence &&
+          ucmp->Compare(f->largest.user_key(), t.begin) >= 0 &&
+          ucmp->Compare(f->smallest.user_key(), t.end) < 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 bool Version::OverlapInLevel(unsigned level,
                              const Slice* smallest_user_key,
                              const Slice* largest_user_key) {
@@ -1534,6 +2023,8 @@ class VersionSet::Builder {
   VersionSet* vset_;
   Version* base_;
   LevelState levels_[config::kNumLevels];
+  std::vector<RangeTombstone> added_tombstones_;
+  std::set<SequenceNumber> deleted_tombstones_;
 
  public:
   // Initialize a builder with the files from *base and other info from *vset
@@ -1681,11 +2172,33 @@ class VersionSet::Builder {
 		levels_[level].added_complete_guards->insert(g);
       }
     }
+
+    // Range tombstones
+    added_tombstones_.insert(added_tombstones_.end(),
+                             edit->new_range_tombstones_.begin(),
+                             edit->new_range_tombstones_.end());
+    deleted_tombstones_.insert(edit->deleted_range_tombstones_.begin(),
+                               edit->deleted_range_tombstones_.end());
  }
   
   // Save the current state in *v.
   void SaveTo(Version* v, int mtc = 0, VersionEdit* edit = NULL) {
 	int a;
+    for (int which = 0; which < 2; which++) {
+      const std::vector<RangeTombstone>& tombstones =
+          (which == 0) ? base_->range_tombstones_ : added_tombstones_;
+      for (size_t i = 0; i < tombstones.size(); i++) {
+        if (deleted_tombstones_.count(tombstones[i].sequence) == 0) {
+          v->range_tombstones_.push_back(tombstones[i]);
+        }
+      }
+    }
+    if (!v->range_tombstones_.empty()) {
+      v->range_tombstone_list_ = new RangeTombstoneList(
+          vset_->icmp_.user_comparator(), v->range_tombstones_);
+      v->range_tombstone_list_->Ref();
+    }
+
     BySmallestKey cmp;
     BySmallestGuard guard_cmp;
     cmp.internal_comparator = &vset_->icmp_;
@@ -2011,6 +2524,7 @@ VersionSet::VersionSet(const std::string& dbname,
                        const InternalKeyComparator* cmp,
 					   Timer* timer)
     : env_(options->env),
+      prefetch_env_(new PrefetchEnv(options->env)),
       dbname_(dbname),
       options_(options),
       table_cache_(table_cache),
@@ -2034,6 +2548,15 @@ VersionSet::VersionSet(const std::string& dbname,
   current_thread_ = GetCurrentThreadId();
 #endif
 
+  // Keeps the rows of DBs that share a row cache apart
+  row_cache_id_ = (options_->row_cache != NULL) ? options_->row_cache->NewId() : 0;
+
+  for (size_t i = 0; i < options_->level_filter_policies.size() && i < config::kNumLevels; i++) {
+	  const FilterPolicy* policy = options_->level_filter_policies[i];
+	  level_filter_policies_.push_back(policy != NULL ? new InternalFilterPolicy(policy, options_->prefix_extractor) : NULL);
+  }
+
+  SetGuardCompactionTriggers(*options_);
   AppendVersion(new Version(this));
   PopulateFileLevelBloomFilter();
 
@@ -2075,6 +2598,7 @@ VersionSet::VersionSet(const std::string& dbname,
 }
 
 VersionSet::~VersionSet() {
+  delete prefetch_env_;
 #ifdef READ_PARALLEL
   stop_read_threads_ = 1;
   for (int i = 0; i < NUM_READ_THREADS; i++) {
@@ -2129,6 +2653,9 @@ VersionSet::~VersionSet() {
 	  }
   }
 #endif
+  for (size_t i = 0; i < level_filter_policies_.size(); i++) {
+	  delete level_filter_policies_[i];
+  }
   current_->Unref();
   assert(dummy_versions_.next_ == &dummy_versions_);  // List must be empty
   delete descriptor_log_;
@@ -2176,7 +2703,8 @@ void VersionSet::PopulateFileLevelBloomFilter() {
 	current->Ref();
 	for (int i = 0; i < config::kNumLevels; i++) {
 		for (int j = 0; j < current->files_[i].size(); j++) {
-			PopulateBloomFilterForFile(current->files_[i][j], &file_level_filter_builder);
+			PopulateBloomFilterForFile(current->files_[i][j], &file_level_filter_builder,
+					FileLevelFilterPolicy(i));
 		}
 	}
 	file_level_filter_builder.Destroy();
@@ -2184,7 +2712,53 @@ void VersionSet::PopulateFileLevelBloomFilter() {
 #endif
 }
 
-void VersionSet::PopulateBloomFilterForFile(FileMetaData* file, FileLevelFilterBuilder* file_level_filter_builder) {
+const FilterPolicy* VersionSet::FileLevelFilterPolicy(unsigned level) const {
+	if (level < level_filter_policies_.size() && level_filter_policies_[level] != NULL &&
+			options_->filter_policy != NULL) {
+		return level_filter_policies_[level];
+	}
+	return options_->filter_policy;
+}
+
+bool VersionSet::FileRangeMayMatch(uint64_t file_number, unsigned level,
+		const Slice& start, const Slice& limit) {
+#ifdef FILE_LEVEL_FILTER
+	const FilterPolicy* policy = FileLevelFilterPolicy(level);
+	if (policy == NULL) {
+		return true;
+	}
+	std::map<uint64_t, std::string*>::const_iterator it = file_level_bloom_filter.find(file_number);
+	if (it == file_level_bloom_filter.end() || it->second == NULL) {
+		return true;
+	}
+	return policy->RangeMayMatch(start, limit, Slice(*it->second));
+#else
+	return true;
+#endif
+}
+
+bool VersionSet::FilePrefixMayMatch(uint64_t file_number, unsigned level,
+		const Slice& prefix) {
+#ifdef FILE_LEVEL_FILTER
+	const FilterPolicy* policy = FileLevelFilterPolicy(level);
+	if (policy == NULL) {
+		return true;
+	}
+	std::map<uint64_t, std::string*>::const_iterator it = file_level_bloom_filter.find(file_number);
+	if (it == file_level_bloom_filter.end() || it->second == NULL) {
+		return true;
+	}
+	// The filters hold prefixes as if they were user keys
+	std::string prefix_key;
+	AppendInternalKey(&prefix_key, ParsedInternalKey(prefix, kMaxSequenceNumber, kValueTypeForSeek));
+	return policy->KeyMayMatch(prefix_key, Slice(*it->second));
+#else
+	return true;
+#endif
+}
+
+void VersionSet::PopulateBloomFilterForFile(FileMetaData* file, FileLevelFilterBuilder* file_level_filter_builder,
+		const FilterPolicy* filter_policy) {
 	uint64_t file_number = file->number;
 	uint64_t file_size = file->file_size;
 	int cnt = 0;
@@ -2204,7 +2778,7 @@ void VersionSet::PopulateBloomFilterForFile(FileMetaData* file, FileLevelFilterB
     	iter->Next();
     }
     if (cnt > 0) {
-		std::string* filter_string = file_level_filter_builder->GenerateFilter();
+		std::string* filter_string = file_level_filter_builder->GenerateFilter(filter_policy);
 		assert (filter_string != NULL);
 
 		AddFileLevelBloomFilterInfo(file_number, filter_string);
@@ -2571,13 +3145,63 @@ uint64_t VersionSet::GetOverlappingRangeBetweenFiles(FileMetaData* f1, FileMetaD
 	return 0;
 }
 
+void VersionSet::SetGuardCompactionTriggers(const Options& options) {
+  level0_sentinel_compaction_trigger_ = options.level0_sentinel_compaction_trigger;
+  level0_guard_compaction_trigger_ = options.level0_guard_compaction_trigger;
+  tombstone_compaction_ratio_ = options.tombstone_compaction_ratio;
+  for (unsigned level = 0; level < config::kNumLevels; level++) {
+    max_files_per_guard_[level] = config::kDefaultMaxFilesPerGuard;
+    if (level < options.max_files_per_guard.size() &&
+        options.max_files_per_guard[level] > 0) {
+      max_files_per_guard_[level] = options.max_files_per_guard[level];
+    }
+  }
+  if (current_ != NULL) {
+    Finalize(current_);
+  }
+}
+
+int VersionSet::MaxFilesPerGuard(unsigned level) const {
+  assert(level < config::kNumLevels);
+  return max_files_per_guard_[level];
+}
+
+double VersionSet::TombstoneScore(const std::vector<FileMetaData*>& files) const {
+  if (tombstone_compaction_ratio_ <= 0) {
+    return 0;
+  }
+  uint64_t entries = 0;
+  uint64_t deletions = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    entries += files[i]->num_entries;
+    deletions += files[i]->num_deletions;
+  }
+  if (entries < config::kMinEntriesForTombstoneCompaction) {
+    return 0;
+  }
+  return deletions / static_cast<double>(entries) / tombstone_compaction_ratio_;
+}
+
+bool VersionSet::CompactsHorizontally(const Version* v, unsigned level) const {
+  if (level == config::kNumLevels-1) {
+    return true;
+  }
+  if (level == config::kNumLevels-2) {
+    int64_t current_level_size = TotalFileSize(v->files_[level]);
+    int64_t next_level_size = TotalFileSize(v->files_[level+1]);
+
+    // If the penultimate level contains very less data compared to last level, do horizontal compaction in that level
+    return current_level_size > 0 && next_level_size / current_level_size > 25.0;
+  }
+  return false;
+}
+
 void VersionSet::Finalize(Version* v) {
   // Compute the ratio of disk usage to its limit
   for (unsigned level = 0; level < config::kNumLevels; ++level) {
-	int max_files_per_segment = config::kMaxFilesPerGuardSentinel;
-	if (MaxFilesPerGuardForLevel(level) > 0) {
-		max_files_per_segment= MaxFilesPerGuardForLevel(level);
-	}
+	const int max_files_per_segment = MaxFilesPerGuard(level);
+	// Compacting deletions in place would leave them where they are
+	const bool score_tombstones = !CompactsHorizontally(v, level);
 
 	v->guard_compaction_scores_[level].clear();
     double score;
@@ -2595,14 +3219,21 @@ void VersionSet::Finalize(Version* v) {
       // overwrites/deletions).
 
       // Compute the compaction scores for sentinels and guards
-	  v->sentinel_compaction_scores_[level] = v->sentinel_files_[level].size() /
-			  static_cast<double>(config::kL0_SentinelCompactionTrigger);
+	  score = v->sentinel_files_[level].size() /
+			  static_cast<double>(level0_sentinel_compaction_trigger_);
+	  if (score_tombstones) {
+		  score = std::max(score, TombstoneScore(v->sentinel_files_[level]));
+	  }
+	  v->sentinel_compaction_scores_[level] = score;
       double max_score_in_level = v->sentinel_compaction_scores_[level];
       for (unsigned i = 0; i < v->guards_[level].size(); i++) {
     	  GuardMetaData* g = v->guards_[level][i];
-    	  std::string guard_user_key = g->guard_key.user_key().ToString();
-    	  v->guard_compaction_scores_[level].push_back(g->files.size() /
-    			  static_cast<double>(config::kL0_GuardCompactionTrigger));
+    	  score = g->files.size() /
+    			  static_cast<double>(level0_guard_compaction_trigger_);
+    	  if (score_tombstones) {
+    		  score = std::max(score, TombstoneScore(g->file_metas));
+    	  }
+    	  v->guard_compaction_scores_[level].push_back(score);
     	  max_score_in_level = std::max(max_score_in_level, v->guard_compaction_scores_[level][i]);
       }
       v->compaction_scores_[level] = max_score_in_level;
@@ -2622,6 +3253,9 @@ void VersionSet::Finalize(Version* v) {
       score1 = sentinel_bytes / MaxBytesPerGuardForLevel(level);
       score2 = static_cast<double>(num_sentinel_files) / static_cast<double>(max_files_per_segment+1);
       score = std::max(score1, score2);
+      if (score_tombstones) {
+    	  score = std::max(score, TombstoneScore(v->sentinel_files_[level]));
+      }
       v->sentinel_compaction_scores_[level] = score;
       double max_score_in_level = v->sentinel_compaction_scores_[level];
 
@@ -2632,6 +3266,9 @@ void VersionSet::Finalize(Version* v) {
     	  score1 = guard_file_bytes / MaxBytesPerGuardForLevel(level);
     	  score2 = static_cast<double>(g->files.size()) / static_cast<double>(max_files_per_segment+1);
           score = std::max(score1, score2);
+          if (score_tombstones) {
+        	  score = std::max(score, TombstoneScore(g->file_metas));
+          }
           v->guard_compaction_scores_[level].push_back(score);
     	  max_score_in_level = std::max(max_score_in_level, v->guard_compaction_scores_[level][i]);
       }
@@ -2659,7 +3296,9 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
 	const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                   f->smallest_seq, f->largest_seq, f->tombstones_applied,
+                   f->num_entries, f->num_deletions);
     }
 
     // Save sentinel files
@@ -2687,6 +3326,11 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     }
   }
 
+  // Save range tombstones
+  for (size_t i = 0; i < current_->range_tombstones_.size(); i++) {
+    edit.AddRangeTombstone(current_->range_tombstones_[i]);
+  }
+
   std::string record;
   edit.EncodeTo(&record);
   return log->AddRecord(record);
@@ -2908,6 +3552,7 @@ Iterator* VersionSet::MakeInputIteratorForGuardsInALevel(Compaction* c) {
   ReadOptions options;
   options.verify_checksums = options_->paranoid_checks;
   options.fill_cache = false;
+  options.readahead_size = options_->compaction_readahead_size;
 
   const int space = 2;
   Iterator** list = new Iterator*[space];
@@ -2919,8 +3564,9 @@ Iterator* VersionSet::MakeInputIteratorForGuardsInALevel(Compaction* c) {
 		const std::vector<FileMetaData*>* sentinel_files = &c->sentinel_inputs_[which];
 		const std::vector<GuardMetaData*>* guards = &c->guard_inputs_[which];
 
-    	Iterator* guard_iterator = new Version::LevelGuardNumIterator(icmp_, guards, sentinel_files, files, 0, timer);
-    	list[num++] = NewTwoLevelIteratorGuards(guard_iterator, &GetGuardIterator, table_cache_, &icmp_, this, which + c->level(), options);
+    	Iterator* guard_iterator = new Version::LevelGuardNumIterator(icmp_, guards, sentinel_files, files, 0, timer,
+    	                                                              NULL, NULL, &c->skipped_inputs_);
+    	list[num++] = NewTwoLevelIteratorGuards(guard_iterator, &GetCompactionGuardIterator, table_cache_, &icmp_, this, which + c->level(), options);
     }
   }
   assert(num <= space);
@@ -3132,19 +3778,7 @@ Compaction* VersionSet::PickCompactionForGuards(Version* v, unsigned level, std:
 	  /*
 	   * If horizontal_compaction is true, only smaller files in the last level are compacted (to reduce write amplification)
 	   */
-	  bool horizontal_compaction = false;
-	  if (level == config::kNumLevels-1) {
-		  horizontal_compaction = true;
-	  } else if (level == config::kNumLevels-2) {
-		  int64_t current_level_size = TotalFileSize(current_->files_[level]);
-		  int64_t current_level_size_in_mb = current_level_size / (1024 * 1024);
-		  int64_t next_level_size = TotalFileSize(current_->files_[level+1]);
-
-		  // If the penultimate level contains very less data compared to last level, do horizontal compaction in that level
-		  if (current_level_size > 0 && next_level_size / current_level_size > 25.0) {
-			  horizontal_compaction = true;
-		  }
-	  }
+	  bool horizontal_compaction = CompactsHorizontally(v, level);
 	  int num_input_levels_for_compaction = 2;
 	  if (horizontal_compaction) {
 		  num_input_levels_for_compaction = 1;
@@ -3231,15 +3865,12 @@ Compaction* VersionSet::PickCompactionForGuards(Version* v, unsigned level, std:
 			  add_all_sentinel_files = false;
 		  }
 
-		  int max_files_per_guard = MaxFilesPerGuardForLevel(current_level);
-		  if (max_files_per_guard <= 0) {
-			  max_files_per_guard = config::kMaxFilesPerGuardSentinel;
-		  }
+		  const int max_files_per_guard = MaxFilesPerGuard(current_level);
 		  if (add_sentinel_files) {
 			  // TODO Not taking care of NewestFirst property, this might possibly return old values for updates - not taking care of that now.
 			  if (horizontal_compaction) {
 				  uint64_t total_size = TotalFileSize(v->sentinel_files_[current_level]);
-				  uint64_t avg_file_size = total_size / static_cast<double> (config::kMaxFilesPerGuardSentinel);
+				  uint64_t avg_file_size = total_size / static_cast<double> (max_files_per_guard);
 
 				  for (unsigned i = 0; i < v->sentinel_files_[current_level].size(); i++) {
 					  FileMetaData* f = v->sentinel_files_[current_level][i];
@@ -3321,7 +3952,7 @@ Compaction* VersionSet::PickCompactionForGuards(Version* v, unsigned level, std:
 			  if (horizontal_compaction) {
 				  GuardMetaData* g = guards_to_add_to_compaction[i];
 				  uint64_t total_bytes = TotalFileSize(g->file_metas);
-				  uint64_t avg_file_size = total_bytes / static_cast<double> (config::kMaxFilesPerGuardSentinel);
+				  uint64_t avg_file_size = total_bytes / static_cast<double> (max_files_per_guard);
 
 				  // WATCH OUT. You are creating a new object, make sure to delete it after processing.
 				  GuardMetaData* new_g = new GuardMetaData;
@@ -3365,9 +3996,66 @@ Compaction* VersionSet::PickCompactionForGuards(Version* v, unsigned level, std:
 		  }
 		  guards_to_add_to_compaction.clear();
 	  }
+	  if (!horizontal_compaction) {
+		  PickTrivialMoves(c, complete_guards_copy[1]);
+	  }
 	  return c;
 }
 
+static bool UserKeyRangesOverlap(const Comparator* ucmp,
+                                 const FileMetaData* a,
+                                 const FileMetaData* b) {
+  return ucmp->Compare(a->smallest.user_key(), b->largest.user_key()) <= 0 &&
+         ucmp->Compare(b->smallest.user_key(), a->largest.user_key()) <= 0;
+}
+
+void VersionSet::PickTrivialMoves(Compaction* c,
+                                  const std::vector<GuardMetaData*>& child_guards) {
+  const unsigned level = c->level();
+  assert(level + 1 < config::kNumLevels);
+  // File-level filters are kept by file number, so a moved file keeps the
+  // filter it was built with
+  if (FileLevelFilterPolicy(level) != FileLevelFilterPolicy(level + 1)) {
+    return;
+  }
+  const Comparator* ucmp = icmp_.user_comparator();
+  const Version* v = c->input_version_;
+  for (size_t i = 0; i < c->inputs_[0].size(); i++) {
+    FileMetaData* f = c->inputs_[0][i];
+    // Rewriting a file into the last level is what drops its deletions
+    if (level + 1 == config::kNumLevels-1 && f->num_deletions > 0) {
+      continue;
+    }
+    // Find the child guard (or the sentinel) holding the smallest key and
+    // check that the largest key is below the next guard
+    size_t next = 0;
+    while (next < child_guards.size() &&
+           ucmp->Compare(child_guards[next]->guard_key.user_key(),
+                         f->smallest.user_key()) <= 0) {
+      ++next;
+    }
+    if (next < child_guards.size() &&
+        ucmp->Compare(f->largest.user_key(),
+                      child_guards[next]->guard_key.user_key()) >= 0) {
+      continue;
+    }
+    bool overlaps = false;
+    for (int which = 0; which < 2 && !overlaps; which++) {
+      const std::vector<FileMetaData*>& files = v->files_[level + which];
+      for (size_t j = 0; j < files.size(); j++) {
+        if (files[j] != f && UserKeyRangesOverlap(ucmp, files[j], f)) {
+          overlaps = true;
+          break;
+        }
+      }
+    }
+    if (!overlaps) {
+      c->moved_inputs_.push_back(f);
+      c->skipped_inputs_.insert(f->number);
+    }
+  }
+}
+
 // Below commented functions are used by HyperLevelDB
 /*
  * Compaction* VersionSet::PickCompaction(Version* v, unsigned level) {
@@ -3554,7 +4242,8 @@ Compaction::Compaction(unsigned l)
       max_output_file_size_(MaxFileSizeForLevel(l)),
       input_version_(NULL),
       edit_(),
-      boundaries_() {
+      boundaries_(),
+      skipped_inputs_() {
   for (unsigned i = 0; i < config::kNumLevels; i++) {
     level_ptrs_[i] = 0;
   }
@@ -3614,6 +4303,43 @@ void Compaction::AddInputDeletions(VersionEdit* ed) {
   }
 }
 
+void Compaction::AddMovedInputs(VersionEdit* ed) {
+  for (size_t i = 0; i < moved_inputs_.size(); i++) {
+    const FileMetaData* f = moved_inputs_[i];
+    ed->AddFile(level_ + 1, f->number, f->file_size, f->smallest, f->largest,
+                f->smallest_seq, f->largest_seq, f->tombstones_applied,
+                f->num_entries, f->num_deletions);
+  }
+}
+
+int Compaction::SkipCoveredInputs(SequenceNumber smallest_snapshot,
+                                  SequenceNumber garbage_cutoff) {
+  const std::vector<RangeTombstone>& tombstones = range_tombstones();
+  const Comparator* ucmp = input_version_->vset_->icmp_.user_comparator();
+  int skipped = 0;
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      const FileMetaData* f = inputs_[which][i];
+      if (f->largest_seq >= garbage_cutoff ||
+          skipped_inputs_.count(f->number) > 0) {
+        continue;
+      }
+      for (size_t j = 0; j < tombstones.size(); j++) {
+        const RangeTombstone& t = tombstones[j];
+        if (t.sequence <= smallest_snapshot &&
+            f->largest_seq < t.sequence &&
+            ucmp->Compare(f->smallest.user_key(), t.begin) >= 0 &&
+            ucmp->Compare(f->largest.user_key(), t.end) < 0) {
+          skipped_inputs_.insert(f->number);
+          skipped++;
+          break;
+        }
+      }
+    }
+  }
+  return skipped;
+}
+
 std::string Compaction::DebugString() {
 	  std::string r;
 	  r.append("Compaction level --> ");
@@ -21,6 +21,7 @@
 #include <vector>
 #include "db/dbformat.h"
 #include "db/version_edit.h"
+#include "pebblesdb/pinnable_slice.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
 #include "util/timer.h"
@@ -64,14 +65,23 @@ enum SaverState {
   kNotFound,
   kFound,
   kDeleted,
-  kCorrupt
+  kCorrupt,
+  kMerge
 };
 struct Saver {
-  Saver() : state(), ucmp(), user_key(), value() {}
+  Saver() : state(), type(), ucmp(), user_key(), value(), scratch(), sequence(),
+            deleted_before() {}
   SaverState state;
+  ValueType type;  // Of the value found, if any
   const Comparator* ucmp;
   Slice user_key;
-  std::string *value;
+  // The value found.  Refers to the block it was read from, unless
+  // scratch is non-NULL, in which case it is copied into *scratch.
+  Slice value;
+  std::string* scratch;
+  SequenceNumber sequence;  // Of the entry found, if any
+  // Entries older than this are hidden by a range tombstone
+  SequenceNumber deleted_before;
  private:
   Saver(const Saver&);
   Saver& operator = (const Saver&);
@@ -83,9 +93,25 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+      if (parsed_key.sequence < s->deleted_before) {
+        s->state = kDeleted;
+      } else if (parsed_key.type == kTypeValue ||
+          parsed_key.type == kTypeValuePointer) {
+        s->state = kFound;
+      } else if (parsed_key.type == kTypeMerge) {
+        s->state = kMerge;
+      } else {
+        s->state = kDeleted;
+      }
+      s->type = parsed_key.type;
+      s->sequence = parsed_key.sequence;
+      if (s->state == kFound || s->state == kMerge) {
+        if (s->scratch != NULL) {
+          s->scratch->assign(v.data(), v.size());
+          s->value = Slice(*s->scratch);
+        } else {
+          s->value = v;
+        }
       }
     }
   }
@@ -151,16 +177,38 @@ class Version {
   // This function is with taking guards into account
   void AddSomeIteratorsGuards(const ReadOptions&, uint64_t num, std::vector<Iterator*>* iters);
 
-  // Lookup the value for key.  If found, store it in *val and
-  // return OK.  Else return a non-OK status.  Fills *stats.
+  // Lookup the value for key.  If found, store it in *val, pinning the
+  // block or cached row it was found in, store its type (kTypeValue or
+  // kTypeValuePointer) in *type, and return OK.  Else return a non-OK
+  // status.  Merge operands newer than the entry found are appended to
+  // *operands, newest first.  Entries older than "deleted_before" (see
+  // RangeTombstoneList::NewestCovering()) are treated as a deletion.
+  // Fills *stats.
   // REQUIRES: lock is not held
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
   };
-  Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
+  Status Get(const ReadOptions&, const LookupKey& key,
+             SequenceNumber deleted_before, PinnableSlice* val,
+             ValueType* type, std::vector<std::string>* operands,
              GetStats* stats);
 
+  // The range tombstones flushed from memtables that may still hide
+  // entries in the files of this version.
+  const std::vector<RangeTombstone>& range_tombstones() const {
+    return range_tombstones_;
+  }
+
+  // The same tombstones prepared for lookups, or NULL if there are none.
+  // Valid while this version is live.
+  const RangeTombstoneList* range_tombstone_list() const {
+    return range_tombstone_list_;
+  }
+
+  // Return true if no file of this version can hold an entry "t" hides.
+  bool RangeTombstoneIsObsolete(const RangeTombstone& t) const;
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -396,6 +444,16 @@ class Version {
 
   Iterator* NewConcatenatingIterator(const ReadOptions&, unsigned level, uint64_t num) const;
 
+  // *saver holds a merge operand found in "f".  Append it to *operands
+  // and look further down "f" until an entry that is not an operand,
+  // which is left in *saver (kNotFound if there is none).  *lookup_key
+  // is set to the key that lookups below the last operand start at.
+  // *block_iter, if non-NULL, is replaced by the one the entry left in
+  // *saver refers to.
+  Status GetBelowOperand(const ReadOptions& options, FileMetaData* f,
+                         Saver* saver, std::vector<std::string>* operands,
+                         std::string* lookup_key, Iterator** block_iter);
+
   // Call func(arg, level, f) for every file that overlaps user_key in
   // order from newest to oldest.  If an invocation of func returns
   // false, makes no more calls.
@@ -420,6 +478,9 @@ class Version {
   std::vector<FileMetaData*> sentinel_files_[config::kNumLevels];
   // List of sentinel file numbers alone - persisted to disk
   std::vector<uint64_t> sentinel_file_nos_[config::kNumLevels];
+  // Range tombstones, oldest first
+  std::vector<RangeTombstone> range_tombstones_;
+  RangeTombstoneList* range_tombstone_list_;
   // Refers to the number of complete guards persisted in any version
   int num_complete_guards_[config::kNumLevels];
   
@@ -439,6 +500,7 @@ class Version {
 
   explicit Version(VersionSet* vset)
       : vset_(vset), next_(this), prev_(this), refs_(0),
+        range_tombstone_list_(NULL),
         file_to_compact_(NULL),
         file_to_compact_level_(-1) {
     for (unsigned i = 0; i < config::kNumLevels; ++i) {
@@ -751,6 +813,11 @@ class VersionSet {
   // in a level and assign them to proper guards
   Compaction* PickCompactionForGuards(Version* v, unsigned level, std::vector<GuardMetaData*>* complete_guards_used_in_bg_compaction, bool force_compact);
 
+  // Mark the inputs of "c" that can move to the next level without being
+  // rewritten: those that fall within one of "child_guards" and overlap no
+  // other file in either level.
+  void PickTrivialMoves(Compaction* c, const std::vector<GuardMetaData*>& child_guards);
+
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns NULL if there is nothing in that
   // level that overlaps the specified range.  Caller should delete
@@ -770,6 +837,13 @@ class VersionSet {
 
   Iterator* MakeInputIteratorForGuardsInALevel(Compaction* c);
 
+  // Score compactions with the level0_sentinel_compaction_trigger,
+  // level0_guard_compaction_trigger, max_files_per_guard and
+  // tombstone_compaction_ratio of "options" from now on, starting with
+  // the current version.
+  // REQUIRES: mutex is held
+  void SetGuardCompactionTriggers(const Options& options);
+
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction(bool* levels, bool seek_driven) const {
 	bool force_compact;
@@ -795,6 +869,29 @@ class VersionSet {
 
   Timer* timer;
 
+  // Returns the policy used for the in-memory file-level filters of files
+  // in "level": the override from Options::level_filter_policies if one
+  // is set, options_->filter_policy otherwise.
+  const FilterPolicy* FileLevelFilterPolicy(unsigned level) const;
+
+  // Returns false if the file-level filter of "file_number" (in "level")
+  // proves that the file holds no user key in [start, limit).  Both
+  // bounds are internal keys; only their user keys are compared.
+  bool FileRangeMayMatch(uint64_t file_number, unsigned level,
+                         const Slice& start, const Slice& limit);
+
+  // Returns false if the file-level filter of "file_number" (in "level")
+  // proves that the file holds no user key starting with "prefix".
+  // REQUIRES: prefix was produced by options_->prefix_extractor
+  bool FilePrefixMayMatch(uint64_t file_number, unsigned level,
+                          const Slice& prefix);
+
+  // The prefix extractor whose prefixes the file-level filters hold, or
+  // NULL if there is none (or there are no filters to consult).
+  const SliceTransform* FilterPrefixExtractor() const {
+    return options_->filter_policy != NULL ? options_->prefix_extractor : NULL;
+  }
+
   void AddFileLevelBloomFilterInfo(uint64_t file_number, std::string* filter_string);
   void RemoveFileLevelBloomFilterInfo(uint64_t file_number);
   void InitializeFileLevelBloomFilter();
@@ -821,6 +918,17 @@ class VersionSet {
 
   void Finalize(Version* v);
 
+  // Number of files the sentinel or a guard of "level" may hold before it
+  // is compacted.
+  int MaxFilesPerGuard(unsigned level) const;
+
+  // Compaction score earned by the deletions in "files": at least 1 once
+  // they reach tombstone_compaction_ratio_ of the entries.
+  double TombstoneScore(const std::vector<FileMetaData*>& files) const;
+
+  // Does a compaction of "level" in "v" write back into "level"?
+  bool CompactsHorizontally(const Version* v, unsigned level) const;
+
   void GetRange(const std::vector<FileMetaData*>& inputs,
                 InternalKey* smallest,
                 InternalKey* largest);
@@ -845,9 +953,11 @@ class VersionSet {
 
   void AppendVersion(Version* v);
   void PopulateFileLevelBloomFilter();
-  void PopulateBloomFilterForFile(FileMetaData* file, FileLevelFilterBuilder* file_level_filter_builder);
+  void PopulateBloomFilterForFile(FileMetaData* file, FileLevelFilterBuilder* file_level_filter_builder,
+		  const FilterPolicy* filter_policy);
 
   Env* const env_;
+  Env* const prefetch_env_;  // Runs guard prefetches on a thread of its own
   const std::string dbname_;
   const Options* const options_;
   TableCache* const table_cache_;
@@ -941,6 +1051,20 @@ class VersionSet {
 
   std::map<uint64_t, std::string*> file_level_bloom_filter;
 
+  // InternalFilterPolicy wrappers for Options::level_filter_policies;
+  // NULL entries fall back to options_->filter_policy.
+  std::vector<InternalFilterPolicy*> level_filter_policies_;
+
+  // Guard compaction thresholds from Options, which SetGuardCompactionTriggers()
+  // may change later.  Protected by the DB mutex.
+  int level0_sentinel_compaction_trigger_;
+  int level0_guard_compaction_trigger_;
+  int max_files_per_guard_[config::kNumLevels];
+  double tombstone_compaction_ratio_;
+
+  // Prefix of this DB's keys in options_->row_cache
+  uint64_t row_cache_id_;
+
   // Opened lazily
   ConcurrentWritableFile* descriptor_file_;
   log::Writer* descriptor_log_;
@@ -994,6 +1118,28 @@ class Compaction {
 
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
+
+  // Number of "level" inputs that are moved to "level+1" unchanged.
+  size_t num_moved_inputs() const { return moved_inputs_.size(); }
+
+  // Add the files moved to "level+1" as new files to *edit.  Must be
+  // called after AddInputDeletions(), which deletes them from "level".
+  void AddMovedInputs(VersionEdit* edit);
+
+  // The range tombstones of the version being compacted.
+  const std::vector<RangeTombstone>& range_tombstones() const {
+    return input_version_->range_tombstones();
+  }
+  const RangeTombstoneList* range_tombstone_list() const {
+    return input_version_->range_tombstone_list();
+  }
+
+  // Leave out of the input iterator every input file whose entries are
+  // all hidden by a range tombstone visible at "smallest_snapshot" and
+  // older than "garbage_cutoff".  The files are still deleted by
+  // AddInputDeletions().  Returns the number of files left out.
+  int SkipCoveredInputs(SequenceNumber smallest_snapshot,
+                        SequenceNumber garbage_cutoff);
   
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
@@ -1028,6 +1174,12 @@ class Compaction {
   std::vector<GuardMetaData*> guard_inputs_[2];
   std::vector<FileMetaData*> sentinel_inputs_[2]; // inputs_ = guard_inputs_ + sentinel_inputs_
   std::vector<std::pair<uint64_t, leveldb::Slice> > boundaries_;
+  // Input files the input iterator leaves out (see SkipCoveredInputs()
+  // and moved_inputs_)
+  std::set<uint64_t> skipped_inputs_;
+  // Inputs from "level_" that fit in one guard of "level_+1" and overlap
+  // no other input, so they are moved there without being rewritten
+  std::vector<FileMetaData*> moved_inputs_;
 
   // State for implementing IsBaseLevelForKey
 
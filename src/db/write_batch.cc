@@ -9,7 +9,10 @@
 // record :=
 //    kTypeValue varstring varstring         |
 //    kTypeDeletion varstring
-//    kTypeGuard varstring varint32 
+//    kTypeGuard varstring varint32 |
+//    kTypeValuePointer varstring varstring |
+//    kTypeMerge varstring varstring |
+//    kTypeRangeDeletion varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -42,6 +45,17 @@ WriteBatch::~WriteBatch() { }
 
 WriteBatch::Handler::~Handler() { }
 
+void WriteBatch::Handler::PutValuePointer(const Slice& key,
+                                          const Slice& pointer) {
+  Put(key, pointer);
+}
+
+void WriteBatch::Handler::Merge(const Slice& key, const Slice& value) {
+}
+
+void WriteBatch::Handler::DeleteRange(const Slice& begin, const Slice& end) {
+}
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(kHeader);
@@ -81,6 +95,30 @@ Status WriteBatch::Iterate(Handler* handler) const {
           return Status::Corruption("bad WriteBatch Delete");
         }
         break;
+      case kTypeValuePointer:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->PutValuePointer(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch value pointer");
+        }
+        break;
+      case kTypeMerge:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->Merge(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Merge");
+        }
+        break;
+      case kTypeRangeDeletion:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->DeleteRange(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
     case kTypeGuard:
 	if (GetLengthPrefixedSlice(&input, &key) &&
 	    GetVarint32(&input, &level)) {
@@ -123,6 +161,14 @@ void WriteBatch::Put(const Slice& key, const Slice& value) {
   PutLengthPrefixedSlice(&rep_, value);
 }
 
+void WriteBatchInternal::PutValuePointer(WriteBatch* b, const Slice& key,
+                                         const Slice& pointer) {
+  SetCount(b, Count(b) + 1);
+  b->rep_.push_back(static_cast<char>(kTypeValuePointer));
+  PutLengthPrefixedSlice(&b->rep_, key);
+  PutLengthPrefixedSlice(&b->rep_, pointer);
+}
+
 void WriteBatch::PutGuard(const Slice& key, int level) {
   WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
   rep_.push_back(static_cast<char>(kTypeGuard));
@@ -136,6 +182,20 @@ void WriteBatch::Delete(const Slice& key) {
   PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::Merge(const Slice& key, const Slice& value) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeMerge));
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+void WriteBatch::DeleteRange(const Slice& begin, const Slice& end) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&rep_, begin);
+  PutLengthPrefixedSlice(&rep_, end);
+}
+
 /* 
 vijayc: Changing memtable inserter so that it inserts guards into a
 version in addition to adding keys to the memtable.
@@ -164,6 +224,18 @@ class MemTableInserter : public WriteBatch::Handler {
     mem_->Add(sequence_, kTypeDeletion, key, Slice());
     sequence_++;
   }
+  virtual void PutValuePointer(const Slice& key, const Slice& pointer) {
+    mem_->Add(sequence_, kTypeValuePointer, key, pointer);
+    sequence_++;
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    mem_->Add(sequence_, kTypeMerge, key, value);
+    sequence_++;
+  }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    mem_->AddRangeTombstone(sequence_, begin, end);
+    sequence_++;
+  }
   virtual void HandleGuard(const Slice& key, unsigned level) {
     /* Return harmlessly if no version to insert into. */
     if (!version_) return;
@@ -233,6 +305,18 @@ WriteBatch contents.
     sequence_++;
   }
 
+  virtual void PutValuePointer(const Slice& key, const Slice& pointer) {
+    Put(key, pointer);
+  }
+
+  virtual void Merge(const Slice& key, const Slice& value) {
+    Put(key, value);
+  }
+
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    sequence_++;
+  }
+
   virtual void HandleGuard(const Slice& key, unsigned level) {
     /* vijayc: emptyHandleGuard. */
     assert(0);
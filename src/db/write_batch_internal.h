@@ -38,6 +38,11 @@ class WriteBatchInternal {
     return batch->rep_.size();
   }
 
+  // Store the mapping "key->pointer", where "pointer" is the encoding of
+  // a ValuePointer into the value log.
+  static void PutValuePointer(WriteBatch* batch, const Slice& key,
+                              const Slice& pointer);
+
   static void SetContents(WriteBatch* batch, const Slice& contents);
 
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
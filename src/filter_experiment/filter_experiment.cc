@@ -10,6 +10,7 @@
 #include <thread>
 #include <atomic>
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <random>
@@ -38,6 +39,24 @@ void setValueBuffer(char* value_buf, int size,
     }
 }
 
+const leveldb::FilterPolicy* newFilterPolicy(int filter_type) {
+    if (filter_type == 0)
+	    return leveldb::NewBloomFilterPolicy(14);
+    else if (filter_type == 1)
+	    return leveldb::NewSuRFPolicy(0, 0, true, 16);
+    else if (filter_type == 2)
+	    return leveldb::NewSuRFPolicy(1, 4, true, 16);
+    else if (filter_type == 3)
+	    return leveldb::NewSuRFPolicy(2, 4, true, 16);
+    else if (filter_type == 4)
+	    return leveldb::NewBlockedBloomFilterPolicy(14);
+    else if (filter_type == 5)
+	    return leveldb::NewBinaryFuseFilterPolicy(8);
+    else if (filter_type == 6)
+	    return leveldb::NewBinaryFuseFilterPolicy(16);
+    return nullptr;
+}
+
 void init(const std::string& key_path, const std::string& db_path, leveldb::DB** db, leveldb::Options* options,
 	  uint64_t key_count, uint64_t value_size, int filter_type) {
 
@@ -46,14 +65,7 @@ void init(const std::string& key_path, const std::string& db_path, leveldb::DB**
     
     char value_buf[value_size];
 
-    if (filter_type == 0)
-	    options->filter_policy = leveldb::NewBloomFilterPolicy(14);
-    else if (filter_type == 1)
-	    options->filter_policy = leveldb::NewSuRFPolicy(0, 0, true, 16);
-    else if (filter_type == 2)
-	    options->filter_policy = leveldb::NewSuRFPolicy(1, 4, true, 16);
-    else if (filter_type == 3)
-	    options->filter_policy = leveldb::NewSuRFPolicy(2, 4, true, 16);
+    options->filter_policy = newFilterPolicy(filter_type);
 
     if (options->filter_policy == nullptr)
 	    std::cout << "Filter DISABLED\n";
@@ -453,6 +465,86 @@ void benchClosedRangeQuery(leveldb::DB* db, leveldb::Options* options, uint64_t
 }
 
 
+// Probe a single in-memory filter directly, without going through the DB,
+// so that the cost of the filter itself is not hidden behind table reads.
+// Nearly all probe keys are absent, which is the case filters exist for.
+void benchFilterProbe(int filter_type, uint64_t key_count, uint64_t query_count) {
+    const leveldb::FilterPolicy* policy = newFilterPolicy(filter_type);
+    if (policy == nullptr) {
+	    std::cout << "Filter DISABLED\n";
+	    return;
+    }
+    std::cout << "Using " << policy->Name() << "\n";
+
+    std::mt19937_64 e(2017);
+    std::uniform_int_distribution<unsigned long long> dist(0, ULLONG_MAX);
+
+    std::vector<uint64_t> keys(key_count);
+    std::vector<leveldb::Slice> key_slices(key_count);
+    for (uint64_t i = 0; i < key_count; i++) {
+        keys[i] = htobe64(dist(e));
+        key_slices[i] = leveldb::Slice(reinterpret_cast<const char*>(&keys[i]), sizeof(uint64_t));
+    }
+    std::sort(keys.begin(), keys.end(), [](uint64_t a, uint64_t b) { return be64toh(a) < be64toh(b); });
+
+    std::string filter;
+    policy->CreateFilter(&key_slices[0], key_count, &filter);
+    std::cout << "bits per key: " << (filter.size() * 8.0 / key_count) << "\n";
+
+    std::vector<uint64_t> probes(query_count);
+    std::vector<leveldb::Slice> probe_slices(query_count);
+    for (uint64_t i = 0; i < query_count; i++) {
+        probes[i] = htobe64(dist(e));
+        probe_slices[i] = leveldb::Slice(reinterpret_cast<const char*>(&probes[i]), sizeof(uint64_t));
+    }
+
+    struct timespec ts_start;
+    struct timespec ts_end;
+    uint64_t elapsed;
+    uint64_t positives = 0;
+
+    printf("single-key probes\n");
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+    for (uint64_t i = 0; i < query_count; i++) {
+        if (policy->KeyMayMatch(probe_slices[i], filter))
+            positives++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts_end);
+    elapsed = (static_cast<uint64_t>(ts_end.tv_sec) * 1000000000UL +
+	static_cast<uint64_t>(ts_end.tv_nsec)) -
+	(static_cast<uint64_t>(ts_start.tv_sec) * 1000000000UL +
+	static_cast<uint64_t>(ts_start.tv_nsec));
+    std::cout << "false positive rate: " << (static_cast<double>(positives) / query_count) << "\n";
+    std::cout << "elapsed:    " << (static_cast<double>(elapsed) / 1000000000.) << "\n";
+    std::cout << "throughput: " << (static_cast<double>(query_count) / (static_cast<double>(elapsed) / 1000000000.)) << "\n";
+
+    const int kBatch = 64;
+    bool results[kBatch];
+    positives = 0;
+
+    printf("batched probes (%d keys)\n", kBatch);
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+    for (uint64_t i = 0; i < query_count; i += kBatch) {
+        int n = (query_count - i < kBatch) ? static_cast<int>(query_count - i) : kBatch;
+        policy->KeysMayMatch(&probe_slices[i], n, filter, results);
+        for (int j = 0; j < n; j++) {
+            if (results[j])
+                positives++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts_end);
+    elapsed = (static_cast<uint64_t>(ts_end.tv_sec) * 1000000000UL +
+	static_cast<uint64_t>(ts_end.tv_nsec)) -
+	(static_cast<uint64_t>(ts_start.tv_sec) * 1000000000UL +
+	static_cast<uint64_t>(ts_start.tv_nsec));
+    std::cout << "false positive rate: " << (static_cast<double>(positives) / query_count) << "\n";
+    std::cout << "elapsed:    " << (static_cast<double>(elapsed) / 1000000000.) << "\n";
+    std::cout << "throughput: " << (static_cast<double>(query_count) / (static_cast<double>(elapsed) / 1000000000.)) << "\n";
+
+    delete policy;
+}
+
+
 void printIO() {
     FILE* fp = fopen("/sys/block/sda/sda2/stat", "r");
     if (fp == NULL) {
@@ -504,7 +596,7 @@ uint64_t getMemAvailable() {
 }
 
 int main(int argc, const char* argv[]) {
-    if (argc < 3) {
+    if (argc < 4) {
         std::cout << "Usage:\n";
         std::cout << "arg 1: path to datafiles\n";
         std::cout << "arg 2: filter type\n";
@@ -512,11 +604,16 @@ int main(int argc, const char* argv[]) {
         std::cout << "\t1: SuRF\n";
         std::cout << "\t2: SuRF Hash\n";
 	    std::cout << "\t3: SuRF Real\n";
+        std::cout << "\t4: Blocked Bloom filter\n";
+        std::cout << "\t5: Binary fuse filter (8-bit fingerprints)\n";
+        std::cout << "\t6: Binary fuse filter (16-bit fingerprints)\n";
         std::cout << "arg 3: query type\n";
         std::cout << "\t0: init\n";
         std::cout << "\t1: point query\n";
         std::cout << "\t2: open range query\n";
         std::cout << "\t3: closed range query\n";
+        std::cout << "\t4: in-memory filter probe (no DB)\n";
+        std::cout << "\t5: in-memory filter probe of every filter type (no DB)\n";
         return -1;
     }
 
@@ -544,6 +641,17 @@ int main(int argc, const char* argv[]) {
 
     //=========================================================================
     
+    if (query_type == 4) {
+	    benchFilterProbe(filter_type, kKeyCount / 5, kQueryCount * 20);
+	    return 0;
+    } else if (query_type == 5) {
+	    for (int type = 0; type <= 6; type++) {
+		    benchFilterProbe(type, kKeyCount / 5, kQueryCount * 20);
+		    std::cout << "\n";
+	    }
+	    return 0;
+    }
+
     leveldb::DB* db;
     leveldb::Options options;
     
@@ -59,6 +59,7 @@ typedef struct leveldb_filterpolicy_t  leveldb_filterpolicy_t;
 typedef struct leveldb_iterator_t      leveldb_iterator_t;
 typedef struct leveldb_logger_t        leveldb_logger_t;
 typedef struct leveldb_options_t       leveldb_options_t;
+typedef struct leveldb_pinnableslice_t leveldb_pinnableslice_t;
 typedef struct leveldb_randomfile_t    leveldb_randomfile_t;
 typedef struct leveldb_readoptions_t   leveldb_readoptions_t;
 typedef struct leveldb_seqfile_t       leveldb_seqfile_t;
@@ -104,6 +105,21 @@ extern char* leveldb_get(
     size_t* vallen,
     char** errptr);
 
+/* Returns NULL if not found.  Otherwise the value, which is not copied:
+   it stays pinned inside the db until the result is passed to
+   leveldb_pinnableslice_destroy(), which must happen before the db is
+   closed. */
+extern leveldb_pinnableslice_t* leveldb_get_pinned(
+    leveldb_t* db,
+    const leveldb_readoptions_t* options,
+    const char* key, size_t keylen,
+    char** errptr);
+
+extern const char* leveldb_pinnableslice_value(
+    const leveldb_pinnableslice_t* v, size_t* vallen);
+
+extern void leveldb_pinnableslice_destroy(leveldb_pinnableslice_t* v);
+
 extern leveldb_iterator_t* leveldb_create_iterator(
     leveldb_t* db,
     const leveldb_readoptions_t* options);
@@ -197,8 +213,18 @@ extern void leveldb_options_set_info_log(leveldb_options_t*, leveldb_logger_t*);
 extern void leveldb_options_set_write_buffer_size(leveldb_options_t*, size_t);
 extern void leveldb_options_set_max_open_files(leveldb_options_t*, int);
 extern void leveldb_options_set_cache(leveldb_options_t*, leveldb_cache_t*);
+extern void leveldb_options_set_row_cache(leveldb_options_t*, leveldb_cache_t*);
+extern void leveldb_options_set_compressed_cache(leveldb_options_t*,
+                                                 leveldb_cache_t*);
 extern void leveldb_options_set_block_size(leveldb_options_t*, size_t);
 extern void leveldb_options_set_block_restart_interval(leveldb_options_t*, int);
+extern void leveldb_options_set_compaction_readahead_size(leveldb_options_t*,
+                                                         size_t);
+extern void leveldb_options_set_value_log_threshold(leveldb_options_t*,
+                                                    size_t);
+extern void leveldb_options_set_value_log_file_size(leveldb_options_t*,
+                                                    size_t);
+extern void leveldb_options_set_value_log_gc_ratio(leveldb_options_t*, double);
 
 enum {
   leveldb_no_compression = 0,
@@ -250,6 +276,10 @@ extern void leveldb_readoptions_set_fill_cache(
 extern void leveldb_readoptions_set_snapshot(
     leveldb_readoptions_t*,
     const leveldb_snapshot_t*);
+extern void leveldb_readoptions_set_readahead_size(
+    leveldb_readoptions_t*, size_t);
+extern void leveldb_readoptions_set_prefetch_next_guard(
+    leveldb_readoptions_t*, unsigned char);
 
 /* Write options */
 
@@ -10,10 +10,11 @@
 // length strings, may use the length of the string as the charge for
 // the string.
 //
-// A builtin cache implementation with a least-recently-used eviction
-// policy is provided.  Clients may use their own implementations if
-// they want something more sophisticated (like scan-resistance, a
-// custom eviction policy, variable cache sizing, etc.)
+// Builtin cache implementations with least-recently-used and CLOCK
+// eviction policies are provided, optionally scan-resistant.  Clients
+// may use their own implementations if they want something more
+// sophisticated (like a custom eviction policy, variable cache sizing,
+// etc.)
 
 #ifndef STORAGE_LEVELDB_INCLUDE_CACHE_H_
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
@@ -27,7 +28,33 @@ class Cache;
 
 // Create a new cache with a fixed size capacity.  This implementation
 // of Cache uses a least-recently-used eviction policy.
-extern Cache* NewLRUCache(size_t capacity);
+//
+// If "high_pri_pool_ratio" is positive, that share of the capacity is
+// reserved for entries inserted with Cache::kHighPriority and the rest
+// for kLowPriority entries: inserting an entry evicts from the tier that
+// is over its share, so a flood of low priority entries cannot evict high
+// priority ones held within their share, and vice versa.  Unused space of
+// either tier is available to the other.  If zero, all entries share one
+// tier.
+//
+// If "scan_resistant" is true, new low priority entries start out on
+// probation and are evicted before entries that were looked up again
+// since they were inserted; those are promoted to a protected segment of
+// at most 80% of the low priority capacity.  A scan that reads each
+// block once then only cycles through the probationary entries instead
+// of flushing the working set.
+extern Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio = 0,
+                          bool scan_resistant = false);
+
+// Create a new cache with a fixed size capacity that uses the CLOCK
+// eviction policy.  Lookups of cached entries take no locks, so hits
+// scale with the number of reader threads.  The table holds about
+// capacity/estimated_entry_charge entries; if entries are smaller than
+// estimated, the cache evicts once that many are present.
+// "high_pri_pool_ratio" and "scan_resistant" are as for NewLRUCache().
+extern Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge,
+                            double high_pri_pool_ratio = 0,
+                            bool scan_resistant = false);
 
 class Cache {
  public:
@@ -40,6 +67,14 @@ class Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle { };
 
+  // Tier of an entry, for caches that reserve capacity per tier.  High
+  // priority is meant for entries that are costly to lose and are read
+  // on every access to their table, like index and filter blocks.
+  enum Priority {
+    kLowPriority = 0,
+    kHighPriority = 1
+  };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -52,6 +87,14 @@ class Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert() above, but places the entry in the tier of "priority".
+  // The default implementation ignores the priority.
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
+    return Insert(key, value, charge, deleter);
+  }
+
   // If the cache has no mapping for "key", returns NULL.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -59,6 +102,20 @@ class Cache {
   // longer needed.
   virtual Handle* Lookup(const Slice& key) = 0;
 
+  // Like Lookup() above, but a miss is counted against the tier of
+  // "priority" (see GetHitCounts()).
+  virtual Handle* Lookup(const Slice& key, Priority priority) {
+    return Lookup(key);
+  }
+
+  // Like Lookup(key, priority), but a hit does not count as a use of the
+  // entry: it neither delays the entry's eviction nor promotes it out of
+  // probation.  Meant for bulk reads that should leave the cache as they
+  // found it.  The default implementation is Lookup().
+  virtual Handle* Peek(const Slice& key, Priority priority) {
+    return Lookup(key, priority);
+  }
+
   // Release a mapping returned by a previous Lookup().
   // REQUIRES: handle must not have been released yet.
   // REQUIRES: handle must have been returned by a method on *this.
@@ -81,6 +138,21 @@ class Cache {
   // its cache keys.
   virtual uint64_t NewId() = 0;
 
+  // Store in "*hits" the number of lookups that found an entry of the
+  // tier of "priority", and in "*misses" the number of lookups for that
+  // tier that found nothing.  Returns false if the cache does not keep
+  // these counts.
+  virtual bool GetHitCounts(Priority priority,
+                            uint64_t* hits, uint64_t* misses) {
+    return false;
+  }
+
+  // Store in "*inserts" the number of entries inserted into the cache.
+  // Returns false if the cache does not keep this count.
+  virtual bool GetInsertCount(uint64_t* inserts) {
+    return false;
+  }
+
  private:
   void LRU_Remove(Handle* e);
   void LRU_Append(Handle* e);
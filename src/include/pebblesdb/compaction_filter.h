@@ -0,0 +1,59 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A CompactionFilter drops or rewrites entries while memtable flushes and
+// compactions write them out.  Dead data, such as values past their
+// time-to-live, is then reclaimed as part of the normal write path rather
+// than by scanning for it and deleting it.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace leveldb {
+
+class Env;
+class Slice;
+
+class CompactionFilter {
+ public:
+  enum Decision {
+    kKeep,          // Write the entry unchanged
+    kRemove,        // Delete the key
+    kChangeValue    // Write *new_value in place of the value
+  };
+
+  virtual ~CompactionFilter();
+
+  // Return the name of this compaction filter.
+  virtual const char* Name() const = 0;
+
+  // Decide what happens to "value", the newest value of "key", as it is
+  // written to "level".  Only values that every snapshot sees are passed
+  // in; deletions, merge operands and values kept in the value log are
+  // not.  Until a flush or compaction reaches it, a value the filter would
+  // remove stays readable.
+  //
+  // Flushes and compactions may call this concurrently.
+  virtual Decision Filter(int level, const Slice& key, const Slice& value,
+                          std::string* new_value) const = 0;
+};
+
+// Return a filter that removes the values written more than "ttl_seconds"
+// ago, according to "env"'s clock.  Every value must end with the time it
+// was written, as appended by AppendTTLTimestamp(); values too short to
+// hold one are kept.
+extern const CompactionFilter* NewTTLCompactionFilter(uint64_t ttl_seconds,
+                                                      Env* env);
+
+// Append "unix_seconds", the time a value is written, to the value in
+// *value.  The timestamp takes the last 8 bytes of the stored value,
+// which readers must strip themselves.
+extern void AppendTTLTimestamp(std::string* value, uint64_t unix_seconds);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
@@ -7,8 +7,10 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <vector>
 #include "pebblesdb/iterator.h"
 #include "pebblesdb/options.h"
+#include "pebblesdb/pinnable_slice.h"
 #include "pebblesdb/replay_iterator.h"
 
 namespace leveldb {
@@ -69,6 +71,20 @@ class DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Combine "value" with the value of "key" (if any) through
+  // Options::merge_operator, without reading the old value.  Returns
+  // NotSupported if the database has no merge operator.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options,
+                       const Slice& key,
+                       const Slice& value);
+
+  // Remove the database entries (if any) for the keys in ["begin", "end").
+  // Returns OK on success, and a non-OK status on error.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin, const Slice& end);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -84,6 +100,25 @@ class DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) = 0;
 
+  // Like Get() above, but on success "*value" refers to the value where
+  // the DB holds it, such as a cached block or the memtable, instead of
+  // a copy.  That storage stays pinned until "*value" is reset, reused
+  // or destroyed, which must happen before the DB is deleted.
+  //
+  // The default implementation copies the value.
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key, PinnableSlice* value);
+
+  // Change the settings of the open database that Options marks as
+  // changeable with SetOptions(): level0_sentinel_compaction_trigger,
+  // level0_guard_compaction_trigger, max_files_per_guard and
+  // tombstone_compaction_ratio.  The other fields of "options" are
+  // ignored.  Returns InvalidArgument, and changes
+  // nothing, if a trigger is below 1.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status SetOptions(const Options& options);
+
   // Store the debug string of the current version of database in value
   virtual Status GetCurrentVersionState(std::string* value) = 0;
 
@@ -98,6 +133,25 @@ class DB {
   // The returned iterator should be deleted before this db is deleted.
   virtual Iterator* NewIterator(const ReadOptions& options) = 0;
 
+  // Split "range" into at most "n" disjoint shards that together cover
+  // it, and append an iterator over each shard to "*iterators", in key
+  // order.  An empty range.start or range.limit leaves that end of the
+  // range open.  All iterators read the same snapshot (options.snapshot,
+  // or the state of the DB at the time of the call) and may be used
+  // from different threads, so a full export can use every core.  The
+  // iterators behave as if created by NewIterator() with bounds set to
+  // their shard; options.iterate_lower_bound, iterate_upper_bound and
+  // tombstones_skipped are ignored.  Each must be deleted before this db
+  // is deleted.
+  //
+  // Shards are split at guard keys of the deepest level that has guards
+  // inside the range, with about as many guards in each shard, so fewer
+  // than "n" iterators are returned if there are not enough guards.  The
+  // default implementation returns a single iterator.
+  virtual Status NewParallelScan(const ReadOptions& options,
+                                 const Range& range, int n,
+                                 std::vector<Iterator*>* iterators);
+
   // Return a handle to the current DB state.  Iterators created with
   // this handle will all observe a stable snapshot of the current DB
   // state.  The caller must call ReleaseSnapshot(result) when the
@@ -122,6 +176,13 @@ class DB {
   //     about the internal operation of the DB.
   //  "leveldb.sstables" - returns a multi-line string that describes all
   //     of the sstables that make up the db contents.
+  //  "leveldb.block-cache-tiers" - returns a multi-line string with the
+  //     hits, misses and hit rate of the high priority (index and filter
+  //     blocks) and low priority (data blocks) tiers of the block cache.
+  //  "leveldb.compressed-block-cache" - returns a multi-line string with
+  //     the number of blocks added to Options::compressed_block_cache and
+  //     the number of block cache misses it served (promoting the block
+  //     into the block cache) or missed.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
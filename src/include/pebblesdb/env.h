@@ -268,6 +268,16 @@ public:
     Read(uint64_t offset, size_t n, Slice *result,
          char *scratch) const = 0;
 
+    // Hint that bytes [offset, offset+n) of the file will be read soon,
+    // so that the implementation may start fetching them in the
+    // background.  Only a hint: it may be ignored, and reads issued
+    // afterwards return the same data either way.  The default
+    // implementation does nothing.
+    //
+    // Safe for concurrent use by multiple threads.
+    virtual void
+    Prefetch(uint64_t offset, size_t n) const;
+
 private:
     // No copying allowed
     RandomAccessFile(const RandomAccessFile &);
@@ -47,6 +47,23 @@ class FilterPolicy {
   // This method may return true or false if the key was not on the
   // list, but it should aim to return false with a high probability.
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const = 0;
+
+  // Batched form of KeyMayMatch(): sets results[i] to the value that
+  // KeyMayMatch(keys[i], filter) would return, for i in [0,n-1].  The
+  // default implementation probes one key at a time; policies that can
+  // overlap the memory accesses of several probes should override it.
+  virtual void KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                            bool* results) const;
+
+  // "filter" contains the data appended by a preceding call to
+  // CreateFilter() on this class.  This method must return true if any
+  // key passed to CreateFilter() lies in the range [start, limit) of the
+  // user supplied comparator.  The default implementation cannot answer
+  // range questions and always returns true; range filters such as
+  // NewSuRFPolicy() override it so that iterators can skip files that
+  // hold nothing between a seek target and ReadOptions::iterate_upper_bound.
+  virtual bool RangeMayMatch(const Slice& start, const Slice& limit,
+                             const Slice& filter) const;
 };
 
 // Return a new filter policy that uses a bloom filter with approximately
@@ -65,6 +82,26 @@ class FilterPolicy {
 // trailing spaces in keys.
 extern const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a cache-line-blocked bloom filter:
+// all probes for a key fall into a single 64-byte block, so a negative
+// lookup costs one cache miss instead of up to k.  The false positive
+// rate is slightly higher than NewBloomFilterPolicy() at the same
+// bits_per_key.  When compiled with AVX2 support (e.g. -mavx2 or
+// -march=native) the probes are vectorized.
+//
+// The same comparator caveats as NewBloomFilterPolicy() apply.
+extern const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key);
+
+// Return a new filter policy that uses a binary fuse filter (a compact
+// static relative of the xor filter) with 8- or 16-bit fingerprints.
+// An 8-bit filter costs about 9 bits per key for a ~0.4% false positive
+// rate, and a 16-bit filter about 18 bits per key for ~0.0015%; a bloom
+// filter needs roughly 30% more memory for either rate.  Building is
+// slower than for a bloom filter, so this policy suits levels that are
+// rarely rewritten (see Options::level_filter_policies).
+//
+// The same comparator caveats as NewBloomFilterPolicy() apply.
+extern const FilterPolicy* NewBinaryFuseFilterPolicy(int fingerprint_bits);
 
 // suffix_type: 0 (no suffix), 1 (hash), 2(real)
 extern const FilterPolicy* NewSuRFPolicy(int suffix_type = 0,
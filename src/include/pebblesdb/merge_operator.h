@@ -0,0 +1,42 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator turns a read-modify-write of a key, such as bumping a
+// counter or appending to a list, into a blind write.  DB::Merge() and
+// WriteBatch::Merge() store an operand for the key; reads combine the
+// operands with the value below them when they meet them, and
+// compactions combine runs of operands into a single entry.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+
+namespace leveldb {
+
+class Slice;
+
+class MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // Return the name of this merge operator.
+  virtual const char* Name() const = 0;
+
+  // Combine "value" with "existing_value", the value of "key" before it
+  // (NULL if the key has none), and store the result in *new_value.
+  //
+  // Compactions may combine two operands before the value below them is
+  // known, passing the older operand as "existing_value", so values and
+  // operands must share one representation and the operation must be
+  // associative.  Return false if the inputs are malformed; the read or
+  // compaction that asked for the merge then fails with a corruption
+  // error.
+  virtual bool Merge(const Slice& key, const Slice* existing_value,
+                     const Slice& value, std::string* new_value) const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
@@ -6,14 +6,21 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
+#include <vector>
 
 namespace leveldb {
 
 class Cache;
+class PersistentCache;
+class CompactionFilter;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
+class Slice;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -93,10 +100,53 @@ struct Options {
   // a block is the unit of reading from disk).
 
   // If non-NULL, use the specified cache for blocks.
-  // If NULL, leveldb will automatically create and use an 8MB internal cache.
+  // If NULL, leveldb will automatically create and use an 8MB internal
+  // cache (see NewClockCache()) that reserves a tenth of its capacity for
+  // index and filter blocks and is scan-resistant.
   // Default: NULL
   Cache* block_cache;
 
+  // If true, the index and filter blocks of a table are kept in
+  // block_cache as Cache::kHighPriority entries, instead of being held in
+  // memory for as long as the table is open.  Their memory is then
+  // bounded by the cache, and a cache with a high priority pool (see
+  // NewLRUCache()) keeps them resident while scans churn through data
+  // blocks, which are inserted with Cache::kLowPriority.
+  //
+  // Builds with file-level filters (FILE_LEVEL_FILTER, the default) answer
+  // Get() from the filters kept by the version set, so Get() only reads
+  // the index block through the cache and a table's own filter block is
+  // never loaded.
+  // Default: false
+  bool cache_index_and_filter_blocks;
+
+  // If non-NULL, data blocks read from a table are also kept in this
+  // cache, compressed with Snappy (or uncompressed if that does not save
+  // at least an eighth), and it is checked after block_cache misses and
+  // before reading the table.  A hit is decompressed and promoted into
+  // block_cache.  With the cache sized in compressed bytes, the same
+  // memory holds several times as many blocks as block_cache, at the cost
+  // of decompressing on each hit.
+  // Default: NULL
+  Cache* compressed_block_cache;
+
+  // If non-NULL, data blocks read from a table are also stored in this
+  // cache (see NewPersistentCache()), uncompressed, and it is checked
+  // after block_cache and compressed_block_cache miss and before reading
+  // the table.  Its contents survive restarts, so a reopened DB reads
+  // the blocks it used before from the cache's (fast, local) storage.
+  // Default: NULL
+  PersistentCache* persistent_cache;
+
+  // If non-NULL, use the specified cache for rows found by Get().  Entries
+  // are keyed by user key and the number of the table the row was found
+  // in, so they never go stale: a newer version of the row lives in a
+  // newer table.  A hit skips the filter probe and the table read for
+  // that table.  The cache is separate from block_cache and is charged
+  // with the size of each key and value.
+  // Default: NULL
+  Cache* row_cache;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -112,6 +162,47 @@ struct Options {
   // Default: 16
   int block_restart_interval;
 
+  // Largest readahead window used by compaction inputs.  Compactions read
+  // their input tables front to back, so each table is prefetched in
+  // windows that start small and double up to this size (see
+  // ReadOptions::readahead_size).  0 disables readahead for compactions.
+  //
+  // Default: 2MB
+  size_t compaction_readahead_size;
+
+  // Level-0 is compacted once its sentinel (the files before its first
+  // guard) holds this many files.  Lower values mean fewer files for
+  // reads to check; higher values mean less compaction work.  This
+  // parameter can be changed with DB::SetOptions().
+  //
+  // Default: 2
+  int level0_sentinel_compaction_trigger;
+
+  // Level-0 is compacted once any of its guards holds this many files.
+  // This parameter can be changed with DB::SetOptions().
+  //
+  // Default: 2
+  int level0_guard_compaction_trigger;
+
+  // max_files_per_guard[i] is the number of files the sentinel or a guard
+  // of level i may hold before it is compacted into level i+1.  Levels
+  // past the end of the vector, and entries below 1, use 2.  Level-0 uses
+  // the triggers above to decide when to compact.  This parameter can be
+  // changed with DB::SetOptions().
+  //
+  // Default: empty
+  std::vector<int> max_files_per_guard;
+
+  // A guard or sentinel whose tables hold at least this fraction of
+  // deletions is compacted even if it is within its file and size limits,
+  // so that scans stop stepping over the deletions and compaction gets to
+  // drop them.  Guards with fewer than 1000 entries are left alone, as is
+  // the last level.  0 disables this.  This parameter can be changed with
+  // DB::SetOptions().
+  //
+  // Default: 0.5
+  double tombstone_compaction_ratio;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -135,6 +226,64 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // Per-level overrides for the in-memory file-level filters.  If
+  // level_filter_policies[i] is non-NULL it is used instead of
+  // filter_policy for files in level i; levels past the end of the
+  // vector use filter_policy.  Only takes effect when filter_policy is
+  // non-NULL.  A compact static filter such as NewBinaryFuseFilterPolicy()
+  // is a good fit for the last level, which holds most of the data.
+  //
+  // Default: empty
+  std::vector<const FilterPolicy*> level_filter_policies;
+
+  // If non-NULL, the prefix of every key in the domain of this transform
+  // is added to the filters next to the key itself, and iterators opened
+  // with ReadOptions::prefix_same_as_start skip files whose filters rule
+  // out the prefix of the seek target.  Prefixes are only added, and files
+  // only skipped, when filter_policy is non-NULL and the comparator is the
+  // default bytewise one; prefix scans stay within their prefix either
+  // way.  See NewFixedPrefixTransform().
+  //
+  // Default: NULL
+  const SliceTransform* prefix_extractor;
+
+  // If non-NULL, DB::Merge() and WriteBatch::Merge() store operands that
+  // this operator combines with the value of their key on reads and in
+  // compactions.  Every DB open that may meet such operands must supply
+  // an operator that combines them the same way.
+  //
+  // Default: NULL
+  const MergeOperator* merge_operator;
+
+  // If non-NULL, memtable flushes and compactions pass the newest value
+  // of each key through this filter, which may remove it or change it.
+  // See NewTTLCompactionFilter().
+  //
+  // Default: NULL
+  const CompactionFilter* compaction_filter;
+
+  // Values at least this many bytes long are appended to a value log
+  // instead of being stored in the tables, which keep a small pointer to
+  // them.  Compactions then move the pointers rather than the values.
+  // Reads follow the pointers transparently.  0 keeps every value in the
+  // tables.
+  //
+  // Default: 0
+  size_t value_log_threshold;
+
+  // The value log starts a new file once the current one holds this many
+  // bytes.
+  //
+  // Default: 64MB
+  size_t value_log_file_size;
+
+  // A background thread rewrites a value log file, moving its live values
+  // to the newest file, once at least this fraction of its bytes belongs
+  // to values that compactions have found to be overwritten or deleted.
+  //
+  // Default: 0.5
+  double value_log_gc_ratio;
+
   // Is the database used with the Replay mechanism?  If yes, the lower bound on
   // values to compact is (somewhat) left up to the application; if no, then
   // LevelDB functions as usual, and uses snapshots to determine the lower
@@ -158,7 +307,9 @@ struct ReadOptions {
   bool verify_checksums;
 
   // Should the data read for this iteration be cached in memory?
-  // Callers may wish to set this field to false for bulk scans.
+  // Callers may wish to set this field to false for bulk scans.  If
+  // false, blocks found in the cache are read without counting as a use
+  // (see Cache::Peek()), so the scan does not reorder the cache either.
   // Default: true
   bool fill_cache;
 
@@ -169,10 +320,68 @@ struct ReadOptions {
   // Default: NULL
   const Snapshot* snapshot;
 
+  // If "iterate_lower_bound" is non-NULL, iterators created with these
+  // options only return keys greater than or equal to
+  // *iterate_lower_bound; seeks before it land on the bound.  Guards and
+  // table blocks lying entirely below the bound are never read.  The
+  // slice must remain valid for the lifetime of the iterator.
+  // Default: NULL
+  const Slice* iterate_lower_bound;
+
+  // If "iterate_upper_bound" is non-NULL, iterators created with these
+  // options only return keys strictly less than *iterate_upper_bound.
+  // Knowing where a scan ends lets a Seek() skip every file whose filter
+  // proves that it holds no key between the seek target and the bound
+  // (see FilterPolicy::RangeMayMatch), and guards and table blocks lying
+  // entirely at or past the bound are never read.  The slice must remain
+  // valid for the lifetime of the iterator.
+  // Default: NULL
+  const Slice* iterate_upper_bound;
+
+  // If true and Options::prefix_extractor is set, an iterator positioned
+  // with Seek(target) only returns keys with the same prefix as "target"
+  // and becomes invalid at the first key with another prefix.  Files and
+  // guards that cannot hold the prefix are not read.  Has no effect on
+  // SeekToFirst() and SeekToLast(), or if "target" is outside the
+  // extractor's domain.
+  // Default: false
+  bool prefix_same_as_start;
+
+  // Largest readahead window used by iterators created with these
+  // options.  Once an iterator has read a few blocks of a table in file
+  // order, it asks the file (see RandomAccessFile::Prefetch) to fetch
+  // the bytes that follow, in windows that start small and double up to
+  // this size.  Reads that jump around never trigger readahead.  0
+  // disables readahead.
+  // Default: 256KB
+  size_t readahead_size;
+
+  // If non-NULL, iterators created with these options add the number of
+  // deletions they step over, including entries hidden by DeleteRange(),
+  // to *tombstones_skipped as they move.  Iterators used from different
+  // threads must not share a counter.  Ignored by DB::NewParallelScan(),
+  // whose shards do not count tombstones.
+  // Default: NULL
+  uint64_t* tombstones_skipped;
+
+  // If true, iterators created with these options open the tables of
+  // the next guard of each level, and read their first blocks, on a
+  // background thread of the DB while they are still reading the current
+  // guard.  All iterators of a DB share that thread.  Long scans then no longer stall at guard boundaries.
+  // Short scans and point-like seeks may read guards they never reach.
+  // Default: false
+  bool prefetch_next_guard;
+
   ReadOptions()
       : verify_checksums(false),
         fill_cache(true),
-        snapshot(NULL) {
+        snapshot(NULL),
+        iterate_lower_bound(NULL),
+        iterate_upper_bound(NULL),
+        prefix_same_as_start(false),
+        readahead_size(256 << 10),
+        tombstones_skipped(NULL),
+        prefetch_next_guard(false) {
   }
 };
 
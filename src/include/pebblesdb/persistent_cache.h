@@ -0,0 +1,57 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PersistentCache keeps copies of table blocks on storage that is
+// faster than the storage holding the tables themselves, such as a local
+// SSD in front of a network-attached volume.  Unlike a Cache, its
+// contents survive restarts, so a freshly started process finds the
+// blocks it read before instead of going back to the slow volume.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+#define STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
+
+#include <stdint.h>
+#include <string>
+#include "pebblesdb/status.h"
+
+namespace leveldb {
+
+class Env;
+class Slice;
+
+class PersistentCache {
+ public:
+  PersistentCache() { }
+
+  // Closes the cache, leaving its contents in place for the next open.
+  virtual ~PersistentCache();
+
+  // Store a copy of "data" under "key", unless the cache already holds
+  // "key".  Failures are not reported: the entry is simply not cached.
+  virtual void Insert(const Slice& key, const Slice& data) = 0;
+
+  // If the cache holds intact data for "key", store it in "*data" and
+  // return true.  Otherwise return false.
+  virtual bool Lookup(const Slice& key, std::string* data) = 0;
+
+ private:
+  // No copying allowed
+  PersistentCache(const PersistentCache&);
+  void operator=(const PersistentCache&);
+};
+
+// Open the persistent cache stored in directory "dir" of "env", creating
+// it if it does not exist, and store it in "*result".  Entries are
+// appended to log files in "dir"; once they take up more than "capacity"
+// bytes, the oldest log file and its entries are dropped.  Entries
+// written before a crash are recovered up to the first incomplete one.
+//
+// The cache keys tables by file number, so a cache directory must only
+// be used with one DB, and must be removed along with that DB.
+extern Status NewPersistentCache(Env* env, const std::string& dir,
+                                 uint64_t capacity, PersistentCache** result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERSISTENT_CACHE_H_
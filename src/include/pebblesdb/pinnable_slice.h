@@ -0,0 +1,85 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PinnableSlice is a Slice that may keep the storage it refers to
+// alive.  DB::Get() uses it to return a value in place, pointing into a
+// cached block or a memtable entry, instead of copying it into a string.
+// The storage stays pinned until the PinnableSlice is Reset(), reused
+// for another Get(), or destroyed.
+//
+// Pinned storage belongs to the DB, so a PinnableSlice must be released
+// before the DB (and its caches) are deleted.  As with Slice, concurrent
+// non-const calls need external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+#define STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+
+#include <string>
+#include "pebblesdb/slice.h"
+
+namespace leveldb {
+
+class PinnableSlice : public Slice {
+ public:
+  typedef void (*CleanupFunction)(void* arg1, void* arg2);
+
+  // Create an empty slice that copies unpinnable data into a buffer of
+  // its own.
+  PinnableSlice()
+      : buf_(&self_space_), cleanup_(NULL), arg1_(NULL), arg2_(NULL) { }
+
+  // Create an empty slice that copies unpinnable data into "*buf".
+  // "*buf" must outlive the slice.
+  explicit PinnableSlice(std::string* buf)
+      : buf_(buf), cleanup_(NULL), arg1_(NULL), arg2_(NULL) { }
+
+  ~PinnableSlice() { Reset(); }
+
+  // Refer to "s", whose storage stays valid until (*function)(arg1, arg2)
+  // is called when this slice is reset or destroyed.
+  void PinSlice(const Slice& s, CleanupFunction function,
+                void* arg1, void* arg2) {
+    assert(cleanup_ == NULL);
+    Slice::operator=(s);
+    cleanup_ = function;
+    arg1_ = arg1;
+    arg2_ = arg2;
+  }
+
+  // Refer to a copy of "s" held in the buffer.
+  void PinSelf(const Slice& s) {
+    assert(cleanup_ == NULL);
+    buf_->assign(s.data(), s.size());
+    Slice::operator=(*buf_);
+  }
+
+  // Return true iff the slice refers to pinned storage rather than to
+  // the buffer.
+  bool IsPinned() const { return cleanup_ != NULL; }
+
+  // Release the pinned storage, if any, and make the slice empty.
+  void Reset() {
+    if (cleanup_ != NULL) {
+      CleanupFunction function = cleanup_;
+      cleanup_ = NULL;
+      (*function)(arg1_, arg2_);
+    }
+    clear();
+  }
+
+ private:
+  std::string self_space_;
+  std::string* buf_;
+  CleanupFunction cleanup_;  // NULL unless pinned
+  void* arg1_;
+  void* arg2_;
+
+  // No copying allowed
+  PinnableSlice(const PinnableSlice&);
+  void operator=(const PinnableSlice&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
@@ -35,6 +35,11 @@ class ReplayIterator {
   // returns false, it means the current entry is a deleted entry.
   virtual bool HasValue() = 0;
 
+  // Return true if the current entry is a merge operand (see
+  // DB::Merge()), in which case value() is the operand rather than the
+  // value of the key.  HasValue() is true for merge operands.
+  virtual bool IsMerge();
+
   // Return the key for the current entry.  The underlying storage for
   // the returned slice is valid only until the next modification of
   // the iterator.
@@ -0,0 +1,48 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps a key to a shorter key, typically a prefix.  A
+// database configured with Options::prefix_extractor adds the prefix of
+// every key to its filters, so that a scan confined to one prefix (see
+// ReadOptions::prefix_same_as_start) can skip the files and guards that
+// hold no key with that prefix.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <stddef.h>
+
+namespace leveldb {
+
+class Slice;
+
+class SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transformation.
+  virtual const char* Name() const = 0;
+
+  // Return the prefix of "key".  The result must refer to a subrange of
+  // the bytes of "key", and every key in the domain that begins with the
+  // result must map to it as well.
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Return true iff Transform() can be applied to "key".  Keys outside
+  // the domain are never added to filters as prefixes and never confine
+  // a scan.
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a transform that maps every key of at least "prefix_len" bytes
+// to its first "prefix_len" bytes.  Shorter keys are outside the domain.
+//
+// All keys that share a prefix must be adjacent in the comparator's
+// order, which holds for the default bytewise comparator.
+extern const SliceTransform* NewFixedPrefixTransform(size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
@@ -36,11 +36,15 @@ class Table {
   // for the duration of the returned table's lifetime.
   //
   // *file must remain live while this Table is in use.
+  //
+  // "file_number" identifies the table in Options::persistent_cache
+  // across restarts; if zero, the table does not use that cache.
   static Status Open(const Options& options,
                      RandomAccessFile* file,
                      uint64_t file_size,
                      Table** table,
-					 Timer* timer);
+					 Timer* timer,
+                     uint64_t file_number = 0);
 
   ~Table();
 
@@ -70,17 +74,34 @@ class Table {
   Rep* rep_;
 
   explicit Table(Rep* rep) : rep_(rep) { }
+
+  // Like NewIterator().  TableCache passes true for the tables of a DB,
+  // whose keys are internal keys, so the user key bounds in ReadOptions
+  // are converted to match.
+  Iterator* NewIterator(const ReadOptions&, bool bounds_are_internal) const;
+
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // Like BlockReader, for iterators that prefetch sequential reads
+  struct Readahead;
+  static Iterator* ReadaheadBlockReader(void*, const ReadOptions&,
+                                        const Slice&);
+
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
   // that key is not present.
+  //
+  // If "block_iter" is non-NULL and such a call was made, sets
+  // "*block_iter" to the iterator over the block holding the entry, so
+  // the slices passed to handle_result stay valid until the caller
+  // deletes it.  Otherwise sets "*block_iter" to NULL.
   friend class TableCache;
   Status InternalGet(
       const ReadOptions&, const Slice& key,
       void* arg,
       void (*handle_result)(void* arg, const Slice& k, const Slice& v),
-	  Timer* timer);
+	  Timer* timer,
+      Iterator** block_iter = NULL);
 
 
   void ReadMeta(const Footer& footer);
@@ -39,6 +39,13 @@ class WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Combine "value" with the value of "key" through
+  // Options::merge_operator.
+  void Merge(const Slice& key, const Slice& value);
+
+  // Erase every mapping for a key in ["begin", "end").
+  void DeleteRange(const Slice& begin, const Slice& end);
+
   // Store a Guard in the WriteBatch
   void PutGuard(const Slice& key, int level);
   
@@ -54,6 +61,17 @@ class WriteBatch {
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
     virtual void HandleGuard(const Slice& key, unsigned level) = 0;
+    // Called for a value that the database moved to its value log, with
+    // the encoded location of the value.  Only batches read back from the
+    // database's own logs contain these.  The default calls Put() with the
+    // encoded location as the value.
+    virtual void PutValuePointer(const Slice& key, const Slice& pointer);
+    // Called for an operand stored with WriteBatch::Merge().  The default
+    // ignores it.
+    virtual void Merge(const Slice& key, const Slice& value);
+    // Called for a range stored with WriteBatch::DeleteRange().  The
+    // default ignores it.
+    virtual void DeleteRange(const Slice& begin, const Slice& end);
   };
   Status Iterate(Handler* handler) const;
 
@@ -41,9 +41,13 @@ void FileLevelFilterBuilder::AddKey(const Slice& key) {
 }
 
 std::string* FileLevelFilterBuilder::GenerateFilter() {
+	return GenerateFilter(policy_);
+}
+
+std::string* FileLevelFilterBuilder::GenerateFilter(const FilterPolicy* policy) {
 	std::string* result = new std::string;
 	const size_t num_keys = key_offsets_.size();
-	if (num_keys == 0 || policy_ == NULL) {
+	if (num_keys == 0 || policy == NULL) {
 	  delete result;
 	  Clear();
 	  return NULL;
@@ -59,7 +63,7 @@ std::string* FileLevelFilterBuilder::GenerateFilter() {
 	}
 
 	// Generate filter for current set of keys and append to result_.
-	policy_->CreateFilter(&tmp_keys_[0], num_keys, result);
+	policy->CreateFilter(&tmp_keys_[0], num_keys, result);
 
 	Clear();
 	return result;
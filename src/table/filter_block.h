@@ -30,6 +30,9 @@ class FileLevelFilterBuilder {
   void Clear();
   void Destroy();
   std::string* GenerateFilter();
+  // Same as GenerateFilter(), but builds the filter with "policy" instead
+  // of the policy given at construction.
+  std::string* GenerateFilter(const FilterPolicy* policy);
 
  private:
 
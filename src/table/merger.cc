@@ -30,38 +30,34 @@
 namespace leveldb {
 
 namespace {
-class MergingIterator;
-
-struct HeapComparator {
-  HeapComparator(MergingIterator* mi) : mi_(mi) {}
-  HeapComparator(const HeapComparator& other) : mi_(other.mi_) {}
-
-  MergingIterator* mi_;
-
-  bool operator () (unsigned lhs, unsigned rhs) const;
-
-  private:
-    HeapComparator& operator = (const HeapComparator&);
-};
 
+// Merges its children with a loser tree: tree_[1,n-1] are the internal
+// nodes of a tournament whose leaves are the children (leaf i is node
+// n+i, the parent of node j is j/2), and each internal node holds the
+// child that lost the match played there.  tree_[0] holds the overall
+// winner.  Advancing the winner replays only the matches on its path
+// to the root, so Next() and Prev() cost about log2(n) comparisons.
 class MergingIterator : public Iterator {
  private:
   void ReinitializeComparisons();
-  void PopCurrentComparison();
-  void PushCurrentComparison();
+  void Replay(unsigned child);
+  bool Beats(unsigned a, unsigned b) const;
+  void SwitchToForward();
+  void SwitchToReverse();
  public:
   MergingIterator(const Comparator* comparator, Iterator** children,
 		  FileMetaData** file_meta_list, int n,
 		  const InternalKeyComparator* icmp,
 		  bool is_merging_iterator_for_files,
-		  VersionSet* vset, unsigned l)
+		  VersionSet* vset, unsigned l,
+		  const uint64_t* file_numbers = NULL,
+		  const Slice* upper_bound = NULL)
       : comparator_(comparator),
 		icmp_(icmp),
         children_(new IteratorWrapper[n]),
 		file_meta_list(file_meta_list),
         comparisons_(new uint64_t[n]),
-        heap_(new unsigned[n]),
-        heap_sz_(0),
+        tree_(new unsigned[n]),
         n_(n),
         comparisons_intialized_(false),
         current_(NULL),
@@ -69,10 +65,16 @@ class MergingIterator : public Iterator {
         direction_(kForward),
 		is_merging_iterator_for_files_(is_merging_iterator_for_files),
 		vset_(vset),
-		level(l){
+		level(l),
+		file_numbers_(),
+		upper_bound_(NULL) {
     for (int i = 0; i < n; i++) {
       children_[i].Set(children[i]);
     }
+    if (upper_bound != NULL && file_numbers != NULL && vset_ != NULL) {
+    	file_numbers_.assign(file_numbers, file_numbers + n);
+    	upper_bound_ = upper_bound;
+    }
     ReinitializeComparisons();
 //    for (int i = 0; i < n; i++) {
 //    	thread_status_[i] = IDLE;
@@ -86,7 +88,7 @@ class MergingIterator : public Iterator {
   virtual ~MergingIterator() {
     delete[] children_;
     delete[] comparisons_;
-    delete[] heap_;
+    delete[] tree_;
     if (file_meta_list != NULL) {
     	delete[] file_meta_list;
     }
@@ -97,12 +99,25 @@ class MergingIterator : public Iterator {
   }
 
   virtual void SeekToFirst() {
+    const bool filter_files = HasUpperBound();
+    std::string first_key, limit_key;
+    if (filter_files) {
+      // Covers every key of the file that sorts before the bound
+      AppendInternalKey(&first_key,
+          ParsedInternalKey(Slice(), kMaxSequenceNumber, kValueTypeForSeek));
+      AppendInternalKey(&limit_key,
+          ParsedInternalKey(*upper_bound_, kMaxSequenceNumber, kValueTypeForSeek));
+    }
     for (int i = 0; i < n_; i++) {
+      if (filter_files &&
+          !vset_->FileRangeMayMatch(file_numbers_[i], level, first_key, limit_key)) {
+        children_[i].MakeInvalid();
+        continue;
+      }
       children_[i].SeekToFirst();
     }
     direction_ = kForward;
     ReinitializeComparisons();
-    FindSmallest();
   }
 
   virtual void SeekToLast() {
@@ -111,7 +126,6 @@ class MergingIterator : public Iterator {
     }
     direction_ = kReverse;
     ReinitializeComparisons();
-    FindLargest();
   }
 
 #ifdef SEEK_PARALLEL
@@ -215,7 +229,39 @@ class MergingIterator : public Iterator {
 #endif
 
 	uint64_t start, end;
+	// A target at or past the bound is a positioning request (e.g. for a
+	// reverse scan from the bound), not a range lookup
+	const bool filter_files = HasUpperBound() &&
+			icmp_->user_comparator()->Compare(ExtractUserKey(target), *upper_bound_) < 0;
+	std::string limit_key;
+	Slice prefix;
+	bool filter_prefix = false;
+	if (filter_files) {
+		const Comparator* ucmp = icmp_->user_comparator();
+		const Slice user_target = ExtractUserKey(target);
+		AppendInternalKey(&limit_key,
+				ParsedInternalKey(*upper_bound_, kMaxSequenceNumber, kValueTypeForSeek));
+		// When every key in [target, bound) shares the target's prefix, a
+		// file without that prefix has nothing to return either
+		const SliceTransform* prefix_extractor = vset_->FilterPrefixExtractor();
+		if (prefix_extractor != NULL && ucmp == BytewiseComparator() &&
+				prefix_extractor->InDomain(user_target)) {
+			prefix = prefix_extractor->Transform(user_target);
+			std::string successor;
+			filter_prefix = !PrefixSuccessor(prefix, &successor) ||
+					ucmp->Compare(*upper_bound_, successor) <= 0;
+		}
+	}
 	for (int i = 0; i < n_; i++) {
+		if (filter_files &&
+				((filter_prefix &&
+				  !vset_->FilePrefixMayMatch(file_numbers_[i], level, prefix)) ||
+				 !vset_->FileRangeMayMatch(file_numbers_[i], level, target, limit_key))) {
+			// Nothing in this file can be returned before the scan ends,
+			// so do not read any of its blocks
+			children_[i].MakeInvalid();
+			continue;
+		}
 //		start = Env::Default()->NowMicros();
 		children_[i].Seek(target);
 //		end = Env::Default()->NowMicros();
@@ -254,7 +300,6 @@ class MergingIterator : public Iterator {
 	}
 #endif
     ReinitializeComparisons();
-    FindSmallest();
 #ifdef TIMER_LOG_SEEK
 	if (is_merging_iterator_for_files_) {
 		vrecord_timer(SEEK_REINIT_FILE_LEVEL);
@@ -291,7 +336,6 @@ class MergingIterator : public Iterator {
 	}
     direction_ = kForward;
     ReinitializeComparisons();
-    FindSmallest();
   }
 */
 
@@ -308,59 +352,33 @@ class MergingIterator : public Iterator {
     // Ensure that all children are positioned after key().
     // If we are moving in the forward direction, it is already
     // true for all of the non-current_ children since current_ is
-    // the smallest child and key() == current_->key().  Otherwise,
-    // we explicitly position the non-current_ children.
+    // the smallest child and key() == current_->key().
     if (direction_ != kForward) {
-      for (int i = 0; i < n_; i++) {
-        IteratorWrapper* child = &children_[i];
-        if (child != current_) {
-          child->Seek(key());
-          if (child->Valid() &&
-              comparator_->Compare(key(), child->key()) == 0) {
-            child->Next();
-          }
-        }
-      }
-      direction_ = kForward;
-      ReinitializeComparisons();
+      SwitchToForward();
     }
 
+    const unsigned winner = current_ - children_;
 #ifdef TIMER_LOG_SEEK
     if (is_merging_iterator_for_files_) {
-    	vstart_timer(SEEK_NEXT_POP_FILE_LEVEL);
-    	PopCurrentComparison();
-    	vrecord_timer(SEEK_NEXT_POP_FILE_LEVEL);
-
     	vstart_timer(SEEK_NEXT_CURRENT_NEXT_FILE_LEVEL);
         current_->Next();
         vrecord_timer(SEEK_NEXT_CURRENT_NEXT_FILE_LEVEL);
 
         vstart_timer(SEEK_NEXT_PUSH_FILE_LEVEL);
-        PushCurrentComparison();
+        Replay(winner);
         vrecord_timer(SEEK_NEXT_PUSH_FILE_LEVEL);
-
-        FindSmallest();
-
     } else {
-    	vstart_timer(SEEK_NEXT_POP);
-    	PopCurrentComparison();
-    	vrecord_timer(SEEK_NEXT_POP);
-
     	vstart_timer(SEEK_NEXT_CURRENT_NEXT);
         current_->Next();
         vrecord_timer(SEEK_NEXT_CURRENT_NEXT);
 
         vstart_timer(SEEK_NEXT_PUSH);
-        PushCurrentComparison();
+        Replay(winner);
         vrecord_timer(SEEK_NEXT_PUSH);
-
-        FindSmallest();
     }
 #else
-    PopCurrentComparison();
     current_->Next();
-    PushCurrentComparison();
-    FindSmallest();
+    Replay(winner);
 #endif
 
 #ifdef TIMER_LOG_SEEK
@@ -378,30 +396,14 @@ class MergingIterator : public Iterator {
     // Ensure that all children are positioned before key().
     // If we are moving in the reverse direction, it is already
     // true for all of the non-current_ children since current_ is
-    // the largest child and key() == current_->key().  Otherwise,
-    // we explicitly position the non-current_ children.
+    // the largest child and key() == current_->key().
     if (direction_ != kReverse) {
-      for (int i = 0; i < n_; i++) {
-        IteratorWrapper* child = &children_[i];
-        if (child != current_) {
-          child->Seek(key());
-          if (child->Valid()) {
-            // Child is at first entry >= key().  Step back one to be < key()
-            child->Prev();
-          } else {
-            // Child has no entries >= key().  Position at last entry.
-            child->SeekToLast();
-          }
-        }
-      }
-      direction_ = kReverse;
-      ReinitializeComparisons();
+      SwitchToReverse();
     }
 
-    PopCurrentComparison();
+    const unsigned winner = current_ - children_;
     current_->Prev();
-    PushCurrentComparison();
-    FindLargest();
+    Replay(winner);
   }
 
   virtual Slice key() const {
@@ -427,16 +429,17 @@ class MergingIterator : public Iterator {
  private:
   MergingIterator(const MergingIterator&);
   MergingIterator& operator = (const MergingIterator&);
-  friend class HeapComparator;
-  void FindSmallest();
-  void FindLargest();
+
+  // An empty bound leaves the scan unbounded
+  bool HasUpperBound() const {
+    return upper_bound_ != NULL && !upper_bound_->empty();
+  }
 
   const Comparator* comparator_;
   IteratorWrapper* children_;
   FileMetaData** file_meta_list;
-  uint64_t* comparisons_;
-  unsigned* heap_;
-  size_t heap_sz_;
+  uint64_t* comparisons_;  // KeyNum() of each valid child's key
+  unsigned* tree_;
   int n_;
   bool comparisons_intialized_;
   IteratorWrapper* current_;
@@ -446,6 +449,10 @@ class MergingIterator : public Iterator {
   VersionSet* vset_;
   unsigned level;
   pthread_t current_thread;
+  // Set only when seeks are bounded: the file number of each child and
+  // ReadOptions::iterate_upper_bound, which is re-read on every seek
+  std::vector<uint64_t> file_numbers_;
+  const Slice* upper_bound_;
 
   // Which direction is the iterator moving?
   enum Direction {
@@ -455,64 +462,126 @@ class MergingIterator : public Iterator {
   Direction direction_;
 };
 
-bool HeapComparator::operator ()(unsigned lhs, unsigned rhs) const {
-  if (mi_->direction_ == MergingIterator::kForward) {
-    std::swap(lhs, rhs);
+// Return true if child "a" is yielded before child "b" in the current
+// direction.  Exhausted children lose every match.
+bool MergingIterator::Beats(unsigned a, unsigned b) const {
+  if (!children_[a].Valid()) {
+    return false;
+  } else if (!children_[b].Valid()) {
+    return true;
+  }
+  int r;
+  if (comparisons_[a] != comparisons_[b]) {
+    r = comparisons_[a] < comparisons_[b] ? -1 : +1;
+  } else {
+    r = comparator_->Compare(children_[a].key(), children_[b].key());
+  }
+  if (r == 0) {
+    return a < b;
   }
-  return mi_->comparisons_[lhs] < mi_->comparisons_[rhs] ||
-         (mi_->comparisons_[lhs] == mi_->comparisons_[rhs] &&
-          mi_->comparator_->Compare(mi_->children_[lhs].key(), mi_->children_[rhs].key()) < 0);
+  return direction_ == kForward ? r < 0 : r > 0;
 }
 
 void MergingIterator::ReinitializeComparisons() {
-  heap_sz_ = 0;
-  for (int i = 0; i < n_; ++i) {
+  // Play every match once.  The first child to reach a node waits there
+  // until the winner of the other subtree arrives.
+  const unsigned n = n_;
+  const unsigned kEmpty = n;
+  for (unsigned node = 1; node < n; ++node) {
+    tree_[node] = kEmpty;
+  }
+  tree_[0] = 0;
+  for (unsigned i = 0; i < n; ++i) {
     if (children_[i].Valid()) {
       comparisons_[i] = comparator_->KeyNum(children_[i].key());
-      heap_[heap_sz_] = i;
-      ++heap_sz_;
+    }
+    unsigned candidate = i;
+    unsigned node = (n + i) / 2;
+    for (; node > 0; node /= 2) {
+      if (tree_[node] == kEmpty) {
+        tree_[node] = candidate;
+        break;
+      }
+      if (Beats(tree_[node], candidate)) {
+        std::swap(tree_[node], candidate);
+      }
+    }
+    if (node == 0) {
+      tree_[0] = candidate;
     }
   }
-  HeapComparator hc(this);
-  std::make_heap(heap_, heap_ + heap_sz_, hc);
-}
-
-void MergingIterator::PopCurrentComparison() {
-  unsigned idx = current_ - children_;
-  assert(heap_[0] == idx);
-  HeapComparator hc(this);
-  std::pop_heap(heap_, heap_ + heap_sz_, hc);
-  --heap_sz_;
+  current_ = children_[tree_[0]].Valid() ? &children_[tree_[0]] : NULL;
 }
 
-void MergingIterator::PushCurrentComparison() {
-  unsigned idx = current_ - children_;
-  assert(&children_[idx] == current_);
-  if (current_->Valid()) {
-    comparisons_[idx] = comparator_->KeyNum(current_->key());
-    heap_[heap_sz_] = idx;
-    ++heap_sz_;
-    HeapComparator hc(this);
-    std::push_heap(heap_, heap_ + heap_sz_, hc);
+void MergingIterator::Replay(unsigned child) {
+  if (children_[child].Valid()) {
+    comparisons_[child] = comparator_->KeyNum(children_[child].key());
   }
+  const unsigned n = n_;
+  unsigned candidate = child;
+  for (unsigned node = (n + child) / 2; node > 0; node /= 2) {
+    if (Beats(tree_[node], candidate)) {
+      std::swap(tree_[node], candidate);
+    }
+  }
+  tree_[0] = candidate;
+  current_ = children_[candidate].Valid() ? &children_[candidate] : NULL;
 }
 
-void MergingIterator::FindSmallest() {
-  assert(direction_ == kForward);
-  if (heap_sz_ > 0) {
-    current_ = &children_[heap_[0]];
-  } else {
-    current_ = NULL;
+// Moving forward, every other child sits at its last entry before key(),
+// so one step forward normally reaches its first entry after key(), and
+// only a child that steps onto the wrong side (e.g. because a memtable
+// gained an entry in between) is repositioned with a full Seek().
+void MergingIterator::SwitchToForward() {
+  const Slice target = key();
+  for (int i = 0; i < n_; i++) {
+    IteratorWrapper* child = &children_[i];
+    if (child == current_) {
+      continue;
+    }
+    if (child->Valid()) {
+      child->Next();
+      if (child->Valid() && comparator_->Compare(child->key(), target) < 0) {
+        child->Seek(target);
+      }
+    } else {
+      child->Seek(target);
+    }
+    if (child->Valid() && comparator_->Compare(target, child->key()) == 0) {
+      child->Next();
+    }
   }
+  direction_ = kForward;
+  ReinitializeComparisons();
 }
 
-void MergingIterator::FindLargest() {
-  assert(direction_ == kReverse);
-  if (heap_sz_ > 0) {
-    current_ = &children_[heap_[0]];
-  } else {
-    current_ = NULL;
+// The mirror image of SwitchToForward().  Children that are exhausted
+// may also have been skipped by a bounded seek, so they always Seek().
+void MergingIterator::SwitchToReverse() {
+  const Slice target = key();
+  for (int i = 0; i < n_; i++) {
+    IteratorWrapper* child = &children_[i];
+    if (child == current_) {
+      continue;
+    }
+    if (child->Valid()) {
+      child->Prev();
+      if (!child->Valid() ||
+          comparator_->Compare(child->key(), target) < 0) {
+        continue;
+      }
+    }
+    child->Seek(target);
+    if (child->Valid()) {
+      // Child is at first entry >= key().  Step back one to be < key()
+      child->Prev();
+    } else {
+      // Child has no entries >= key().  Position at last entry.
+      child->SeekToLast();
+    }
   }
+  direction_ = kReverse;
+  ReinitializeComparisons();
 }
 }  // namespace
 
@@ -541,14 +610,16 @@ Iterator* NewMergingIterator(const Comparator* cmp, Iterator** list, int n, Vers
 Iterator* NewMergingIteratorForFiles(const Comparator* cmp, Iterator** list,
 		FileMetaData** file_meta_list, int n,
 		const InternalKeyComparator* icmp,
-		VersionSet* vset, unsigned level) {
+		VersionSet* vset, unsigned level,
+		const uint64_t* file_numbers, const Slice* upper_bound) {
   assert(n >= 0);
-  if (n == 0) {
-    return NewEmptyIterator();
-  } else if (n == 1) {
-    return list[0];
+  if (n == 0 || (n == 1 && (upper_bound == NULL || file_numbers == NULL))) {
+    delete[] file_meta_list;
+    return (n == 0) ? NewEmptyIterator() : list[0];
   } else {
-    return new MergingIterator(cmp, list, file_meta_list, n, icmp, true, vset, level);
+    // With an upper bound even a single file goes through MergingIterator
+    // so that seeks can consult its range filter
+    return new MergingIterator(cmp, list, file_meta_list, n, icmp, true, vset, level, file_numbers, upper_bound);
   }
 }
 
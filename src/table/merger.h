@@ -27,8 +27,17 @@ extern Iterator* NewMergingIterator(
 extern Iterator* NewMergingIterator(
     const Comparator* comparator, Iterator** children, int n, VersionSet* vset);
 
+// Like NewMergingIterator(), for the files of one guard in "level";
+// takes ownership of the file_meta_list array as well.  If "upper_bound"
+// (a user key) is non-NULL and not empty, Seek() and SeekToFirst() leave
+// unpositioned every file whose file-level filter proves that it holds no
+// key between the target and the bound, or, when all of that range shares
+// the target's prefix (Options::prefix_extractor), no key with that
+// prefix; file_numbers[0,n-1] name the files of list.  The bound is
+// re-read on every seek, so its owner may move it between seeks.
 extern Iterator* NewMergingIteratorForFiles(
-		const Comparator* cmp, Iterator** list, FileMetaData** file_meta_list, int n, const InternalKeyComparator* icmp, VersionSet* vset, unsigned level);
+		const Comparator* cmp, Iterator** list, FileMetaData** file_meta_list, int n, const InternalKeyComparator* icmp, VersionSet* vset, unsigned level,
+		const uint64_t* file_numbers = NULL, const Slice* upper_bound = NULL);
 
 }  // namespace leveldb
 
@@ -4,12 +4,16 @@
 
 #include "pebblesdb/table.h"
 
+#include <algorithm>
+
 #include "db/version_set.h"
 #include "pebblesdb/cache.h"
 #include "pebblesdb/comparator.h"
 #include "pebblesdb/env.h"
 #include "pebblesdb/filter_policy.h"
 #include "pebblesdb/options.h"
+#include "pebblesdb/persistent_cache.h"
+#include "port/port.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -41,9 +45,15 @@ struct Table::Rep {
       status(),
       file(NULL),
       cache_id(),
+      compressed_cache_id(),
+      file_number(0),
+      file_size(0),
       filter(),
       filter_data(),
       metaindex_handle(),
+      index_handle(),
+      filter_handle(),
+      has_filter_handle(false),
       index_block() {
   }
   ~Rep() {
@@ -56,22 +66,40 @@ struct Table::Rep {
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
+  uint64_t compressed_cache_id;
+  uint64_t file_number;  // 0 if unknown; keys blocks in the persistent cache
+  uint64_t file_size;
   FilterBlockReader* filter;
   const char* filter_data;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
+  // With Options::cache_index_and_filter_blocks, index_block and filter
+  // are NULL and the blocks are read through the block cache instead
+  BlockHandle index_handle;
+  BlockHandle filter_handle;
+  bool has_filter_handle;
   Block* index_block;
 
+  Iterator* NewIndexIterator();
+  FilterBlockReader* GetFilter(Cache::Handle** handle);
+  Status ReadDataBlock(const ReadOptions& read_options,
+                       const BlockHandle& handle, BlockContents* contents);
+  Status ReadPersistedBlock(const ReadOptions& read_options,
+                            const BlockHandle& handle, BlockContents* contents);
+
  private:
   Rep(const Rep&);
   Rep& operator = (const Rep&);
 };
 
+static void DeleteCachedBlock(const Slice& key, void* value);
+
 Status Table::Open(const Options& options,
                    RandomAccessFile* file,
                    uint64_t size,
                    Table** table,
-				   Timer* timer) {
+				   Timer* timer,
+                   uint64_t file_number) {
   *table = NULL;
   if (size < Footer::kEncodedLength) {
     return Status::InvalidArgument("file is too short to be an sstable");
@@ -108,8 +136,24 @@ Status Table::Open(const Options& options,
     rep->options = options;
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
+    rep->index_handle = footer.index_handle();
     rep->index_block = index_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+    rep->compressed_cache_id = (options.compressed_block_cache ?
+                                options.compressed_block_cache->NewId() : 0);
+    rep->file_number = file_number;
+    rep->file_size = size;
+    if (options.cache_index_and_filter_blocks && options.block_cache != NULL &&
+        contents.cachable) {
+      // Leave the index block to the block cache
+      rep->index_block = NULL;
+      char cache_key_buffer[16];
+      EncodeFixed64(cache_key_buffer, rep->cache_id);
+      EncodeFixed64(cache_key_buffer+8, rep->index_handle.offset());
+      options.block_cache->Release(options.block_cache->Insert(
+          Slice(cache_key_buffer, sizeof(cache_key_buffer)), index_block,
+          index_block->size(), &DeleteCachedBlock, Cache::kHighPriority));
+    }
     rep->filter_data = NULL;
     rep->filter = NULL;
     *table = new Table(rep);
@@ -156,6 +200,13 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
     return;
   }
 
+  if (rep_->index_block == NULL) {
+    // Read on first use through the block cache
+    rep_->filter_handle = filter_handle;
+    rep_->has_filter_handle = true;
+    return;
+  }
+
   // We might want to unify with ReadBlock() if we start
   // requiring checksum verification in Table::Open.
   ReadOptions opt;
@@ -188,6 +239,198 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
+// A filter block held by the block cache
+struct CachedFilter {
+  FilterBlockReader* reader;
+  const char* data;  // NULL unless heap allocated
+
+  ~CachedFilter() {
+    delete reader;
+    delete [] data;
+  }
+};
+
+static void DeleteCachedFilter(const Slice& /*key*/, void* value) {
+  delete reinterpret_cast<CachedFilter*>(value);
+}
+
+Iterator* Table::Rep::NewIndexIterator() {
+  if (index_block != NULL) {
+    return index_block->NewIterator(options.comparator);
+  }
+  Cache* block_cache = options.block_cache;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, cache_id);
+  EncodeFixed64(cache_key_buffer+8, index_handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  Cache::Handle* cache_handle = block_cache->Lookup(key, Cache::kHighPriority);
+  Block* block = NULL;
+  if (cache_handle != NULL) {
+    block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+  } else {
+    BlockContents contents;
+    Status s = ReadBlock(file, ReadOptions(), index_handle, &contents);
+    if (!s.ok()) {
+      return NewErrorIterator(s);
+    }
+    block = new Block(contents);
+    cache_handle = block_cache->Insert(key, block, block->size(),
+                                       &DeleteCachedBlock, Cache::kHighPriority);
+  }
+  Iterator* iter = block->NewIterator(options.comparator);
+  iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  return iter;
+}
+
+// Return the filter of the table, or NULL if it has none or it cannot be
+// read.  If "*handle" is set to non-NULL, the caller must release it from
+// the block cache when done with the filter.
+FilterBlockReader* Table::Rep::GetFilter(Cache::Handle** handle) {
+  *handle = NULL;
+  if (filter != NULL || !has_filter_handle) {
+    return filter;
+  }
+  Cache* block_cache = options.block_cache;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, cache_id);
+  EncodeFixed64(cache_key_buffer+8, filter_handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  *handle = block_cache->Lookup(key, Cache::kHighPriority);
+  if (*handle == NULL) {
+    BlockContents block;
+    if (!ReadBlock(file, ReadOptions(), filter_handle, &block).ok()) {
+      return NULL;
+    }
+    CachedFilter* cached = new CachedFilter;
+    cached->reader = new FilterBlockReader(options.filter_policy, block.data);
+    cached->data = block.heap_allocated ? block.data.data() : NULL;
+    *handle = block_cache->Insert(key, cached, block.data.size(),
+                                  &DeleteCachedFilter, Cache::kHighPriority);
+  }
+  return reinterpret_cast<CachedFilter*>(block_cache->Value(*handle))->reader;
+}
+
+// Entries of Options::compressed_block_cache are strings holding a
+// CompressionType byte followed by the block, compressed with that type.
+static void DeleteCompressedBlock(const Slice& key, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+static void CompressBlock(const Slice& raw, std::string* stored) {
+  std::string compressed;
+  if (port::Snappy_Compress(raw.data(), raw.size(), &compressed) &&
+      compressed.size() < raw.size() - (raw.size() / 8u)) {
+    stored->push_back(static_cast<char>(kSnappyCompression));
+    stored->append(compressed);
+  } else {
+    // Snappy not supported, or compressed less than 12.5%, so just
+    // store uncompressed form
+    stored->push_back(static_cast<char>(kNoCompression));
+    stored->append(raw.data(), raw.size());
+  }
+}
+
+static Status UncompressBlock(const std::string& stored,
+                              BlockContents* result) {
+  const char* data = stored.data() + 1;
+  const size_t n = stored.size() - 1;
+  char* buf;
+  size_t length;
+  switch (stored[0]) {
+    case kNoCompression:
+      buf = new char[n];
+      memcpy(buf, data, n);
+      length = n;
+      break;
+    case kSnappyCompression:
+      if (!port::Snappy_GetUncompressedLength(data, n, &length)) {
+        return Status::Corruption("corrupted compressed block contents");
+      }
+      buf = new char[length];
+      if (!port::Snappy_Uncompress(data, n, buf)) {
+        delete[] buf;
+        return Status::Corruption("corrupted compressed block contents");
+      }
+      break;
+    default:
+      return Status::Corruption("bad block type");
+  }
+  result->data = Slice(buf, length);
+  result->heap_allocated = true;
+  result->cachable = true;
+  return Status::OK();
+}
+
+// Read a data block from options.persistent_cache if it holds the block
+// and from the file otherwise, adding it to the persistent cache.
+Status Table::Rep::ReadPersistedBlock(const ReadOptions& read_options,
+                                      const BlockHandle& handle,
+                                      BlockContents* contents) {
+  PersistentCache* persistent_cache = options.persistent_cache;
+  if (persistent_cache == NULL || file_number == 0) {
+    return ReadBlock(file, read_options, handle, contents);
+  }
+  // The file size guards against a table number reused by another DB
+  char cache_key_buffer[24];
+  EncodeFixed64(cache_key_buffer, file_number);
+  EncodeFixed64(cache_key_buffer+8, file_size);
+  EncodeFixed64(cache_key_buffer+16, handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  std::string data;
+  if (persistent_cache->Lookup(key, &data)) {
+    char* buf = new char[data.size()];
+    memcpy(buf, data.data(), data.size());
+    contents->data = Slice(buf, data.size());
+    contents->heap_allocated = true;
+    contents->cachable = true;
+    return Status::OK();
+  }
+
+  Status s = ReadBlock(file, read_options, handle, contents);
+  if (s.ok() && read_options.fill_cache) {
+    persistent_cache->Insert(key, contents->data);
+  }
+  return s;
+}
+
+// Read a data block, from options.compressed_block_cache if it holds the
+// block and through ReadPersistedBlock() otherwise.  Blocks read that way
+// are added to the compressed cache if they may be cached at all.
+Status Table::Rep::ReadDataBlock(const ReadOptions& read_options,
+                                 const BlockHandle& handle,
+                                 BlockContents* contents) {
+  Cache* compressed_cache = options.compressed_block_cache;
+  if (compressed_cache == NULL) {
+    return ReadPersistedBlock(read_options, handle, contents);
+  }
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, compressed_cache_id);
+  EncodeFixed64(cache_key_buffer+8, handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  Cache::Handle* cache_handle;
+  if (read_options.fill_cache) {
+    cache_handle = compressed_cache->Lookup(key, Cache::kLowPriority);
+  } else {
+    cache_handle = compressed_cache->Peek(key, Cache::kLowPriority);
+  }
+  if (cache_handle != NULL) {
+    Status s = UncompressBlock(
+        *reinterpret_cast<std::string*>(compressed_cache->Value(cache_handle)),
+        contents);
+    compressed_cache->Release(cache_handle);
+    return s;
+  }
+
+  Status s = ReadPersistedBlock(read_options, handle, contents);
+  if (s.ok() && contents->cachable && read_options.fill_cache) {
+    std::string* stored = new std::string;
+    CompressBlock(contents->data, stored);
+    compressed_cache->Release(compressed_cache->Insert(
+        key, stored, stored->size(), &DeleteCompressedBlock));
+  }
+  return s;
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg,
@@ -217,25 +460,30 @@ Iterator* Table::BlockReader(void* arg,
       EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
       EncodeFixed64(cache_key_buffer+8, handle.offset());
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-      cache_handle = block_cache->Lookup(key);
+      if (options.fill_cache) {
+        cache_handle = block_cache->Lookup(key, Cache::kLowPriority);
+      } else {
+        cache_handle = block_cache->Peek(key, Cache::kLowPriority);
+      }
       if (cache_handle != NULL) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
     	sstart_timer(SEEK_BLOCK_READER_READ_BLOCK);
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = table->rep_->ReadDataBlock(options, handle, &contents);
         srecord_timer(SEEK_BLOCK_READER_READ_BLOCK);
 
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
             cache_handle = block_cache->Insert(
-                key, block, block->size(), &DeleteCachedBlock);
+                key, block, block->size(), &DeleteCachedBlock,
+                Cache::kLowPriority);
           }
         }
       }
     } else {
       sstart_timer(SEEK_BLOCK_READER_READ_BLOCK);
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = table->rep_->ReadDataBlock(options, handle, &contents);
    	  srecord_timer(SEEK_BLOCK_READER_READ_BLOCK);
 
    	  if (s.ok()) {
@@ -260,25 +508,112 @@ Iterator* Table::BlockReader(void* arg,
   return iter;
 }
 
+// Number of blocks an iterator must read in file order before it starts
+// prefetching, and the size of its first readahead window
+static const int kReadaheadTrigger = 2;
+static const size_t kInitialReadaheadSize = 8 << 10;
+
+// Readahead state of a single table iterator.  Each run of blocks read
+// in file order prefetches the bytes past the last block read, in
+// windows that double up to ReadOptions::readahead_size.  Jumping
+// elsewhere in the file starts over.
+struct Table::Readahead {
+  Table* table;
+  size_t max_size;
+  size_t size;                // Size of the next window
+  int sequential;             // Blocks read in file order so far
+  uint64_t next_offset;       // Offset just past the last block read
+  uint64_t prefetched_until;  // Offset just past the last window
+
+  Readahead(Table* t, size_t max)
+      : table(t),
+        max_size(max),
+        size(std::min(kInitialReadaheadSize, max)),
+        sequential(0),
+        next_offset(0),
+        prefetched_until(0) {
+  }
+
+  void Reset() {
+    size = std::min(kInitialReadaheadSize, max_size);
+    sequential = 0;
+    prefetched_until = 0;
+  }
+
+  void Note(const BlockHandle& handle) {
+    if (handle.offset() != next_offset) {
+      Reset();
+    }
+    sequential++;
+    next_offset = handle.offset() + handle.size() + kBlockTrailerSize;
+    // Only data blocks are worth prefetching
+    const uint64_t limit = table->rep_->metaindex_handle.offset();
+    if (sequential < kReadaheadTrigger ||
+        next_offset < prefetched_until ||
+        next_offset >= limit) {
+      return;
+    }
+    const size_t n = std::min<uint64_t>(size, limit - next_offset);
+    table->rep_->file->Prefetch(next_offset, n);
+    prefetched_until = next_offset + n;
+    size = std::min(size * 2, max_size);
+  }
+
+  static void Delete(void* arg, void* /*ignored*/) {
+    delete reinterpret_cast<Readahead*>(arg);
+  }
+};
+
+Iterator* Table::ReadaheadBlockReader(void* arg,
+                                      const ReadOptions& options,
+                                      const Slice& index_value) {
+  Readahead* readahead = reinterpret_cast<Readahead*>(arg);
+  BlockHandle handle;
+  Slice input = index_value;
+  if (handle.DecodeFrom(&input).ok()) {
+    readahead->Note(handle);
+  }
+  return BlockReader(readahead->table, options, index_value);
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  return NewIterator(options, false);
+}
+
+Iterator* Table::NewIterator(const ReadOptions& options,
+                             bool bounds_are_internal) const {
+  if (options.readahead_size == 0) {
+    return NewTwoLevelIterator(
+        rep_->NewIndexIterator(),
+        &Table::BlockReader, const_cast<Table*>(this), options,
+        rep_->options.comparator, bounds_are_internal);
+  }
+  Readahead* readahead = new Readahead(const_cast<Table*>(this),
+                                       options.readahead_size);
+  Iterator* iter = NewTwoLevelIterator(
+      rep_->NewIndexIterator(),
+      &Table::ReadaheadBlockReader, readahead, options,
+      rep_->options.comparator, bounds_are_internal);
+  iter->RegisterCleanup(&Readahead::Delete, readahead, NULL);
+  return iter;
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void* arg,
                           void (*saver)(void*, const Slice&, const Slice&),
-						  Timer* timer) {
+						  Timer* timer,
+                          Iterator** pinned_block_iter) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  if (pinned_block_iter != NULL) {
+    *pinned_block_iter = NULL;
+  }
+  Iterator* iiter = rep_->NewIndexIterator();
   start_timer(GET_TABLE_CACHE_INDEX_ITER_SEEK);
   iiter->Seek(k);
   record_timer(GET_TABLE_CACHE_INDEX_ITER_SEEK);
 
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
     start_timer(GET_TABLE_CACHE_FILTER_CHECK);
     bool file_level_filter_enabled = false;
@@ -286,9 +621,18 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
 #ifdef FILE_LEVEL_FILTER
     file_level_filter_enabled = true;
 #endif
-    if (file_level_filter_enabled == false && filter != NULL &&
+    FilterBlockReader* filter = NULL;
+    Cache::Handle* filter_cache_handle = NULL;
+    if (file_level_filter_enabled == false) {
+      filter = rep_->GetFilter(&filter_cache_handle);
+    }
+    const bool filtered = filter != NULL &&
         handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
+        !filter->KeyMayMatch(handle.offset(), k);
+    if (filter_cache_handle != NULL) {
+      rep_->options.block_cache->Release(filter_cache_handle);
+    }
+    if (filtered) {
     	record_timer(GET_TABLE_CACHE_FILTER_CHECK);
       // Not found
     } else {
@@ -297,11 +641,18 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
       start_timer(GET_TABLE_CACHE_READ_DATA_BLOCK);
       Iterator* block_iter = BlockReader(this, options, iiter->value());
       block_iter->Seek(k);
+      bool saved = false;
       if (block_iter->Valid()) {
         (*saver)(arg, block_iter->key(), block_iter->value());
+        saved = true;
       }
       s = block_iter->status();
-      delete block_iter;
+      if (saved && pinned_block_iter != NULL) {
+        // The caller keeps the block alive for as long as it needs
+        *pinned_block_iter = block_iter;
+      } else {
+        delete block_iter;
+      }
       record_timer(GET_TABLE_CACHE_READ_DATA_BLOCK);
     }
   }
@@ -314,8 +665,7 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
 
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = rep_->NewIndexIterator();
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
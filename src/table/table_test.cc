@@ -6,6 +6,7 @@
 
 #include "pebblesdb/table.h"
 
+#include <algorithm>
 #include <map>
 #include <string>
 #include "db/dbformat.h"
@@ -18,6 +19,7 @@
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "table/merger.h"
 #include "util/random.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
@@ -141,8 +143,18 @@ class StringSource: public RandomAccessFile {
     return Status::OK();
   }
 
+  virtual void Prefetch(uint64_t offset, size_t n) const {
+    prefetches_.push_back(std::make_pair(offset, n));
+  }
+
+  // The (offset, size) of each Prefetch() call so far
+  std::vector<std::pair<uint64_t, size_t> >* prefetches() const {
+    return &prefetches_;
+  }
+
  private:
   std::string contents_;
+  mutable std::vector<std::pair<uint64_t, size_t> > prefetches_;
 };
 
 typedef std::map<std::string, std::string, STLLessThan> KVMap;
@@ -265,10 +277,16 @@ class TableConstructor: public Constructor {
     return table_->NewIterator(ReadOptions());
   }
 
+  Iterator* NewIterator(const ReadOptions& options) const {
+    return table_->NewIterator(options);
+  }
+
   uint64_t ApproximateOffsetOf(const Slice& key) const {
     return table_->ApproximateOffsetOf(key);
   }
 
+  StringSource* source() const { return source_; }
+
  private:
   void Reset() {
     delete table_;
@@ -407,10 +425,60 @@ class DBConstructor: public Constructor {
   DB* db_;
 };
 
+// Scatters the data over block children read through a MergingIterator
+class MergerConstructor: public Constructor {
+ public:
+  explicit MergerConstructor(const Comparator* cmp)
+      : Constructor(cmp),
+        comparator_(cmp) { }
+  ~MergerConstructor() {
+    Reset();
+  }
+  virtual Status FinishImpl(const Options& options, const KVMap& data) {
+    Reset();
+    // The fan-in grows with the data, up to 64 children
+    const int fan_in = std::min<int>(64, 1 + data.size() / 8);
+    std::vector<KVMap> parts(fan_in, KVMap(STLLessThan(comparator_)));
+    Random rnd(data.size() + 1);
+    for (KVMap::const_iterator it = data.begin();
+         it != data.end();
+         ++it) {
+      parts[rnd.Uniform(fan_in)].insert(*it);
+    }
+    for (int i = 0; i < fan_in; i++) {
+      children_.push_back(new BlockConstructor(comparator_));
+      Status s = children_.back()->FinishImpl(options, parts[i]);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+  virtual Iterator* NewIterator() const {
+    std::vector<Iterator*> list;
+    for (size_t i = 0; i < children_.size(); i++) {
+      list.push_back(children_[i]->NewIterator());
+    }
+    return NewMergingIterator(comparator_, &list[0], list.size(), NULL);
+  }
+
+ private:
+  void Reset() {
+    for (size_t i = 0; i < children_.size(); i++) {
+      delete children_[i];
+    }
+    children_.clear();
+  }
+
+  const Comparator* comparator_;
+  std::vector<BlockConstructor*> children_;
+};
+
 enum TestType {
   TABLE_TEST,
   BLOCK_TEST,
   MEMTABLE_TEST,
+  MERGER_TEST,
   DB_TEST
 };
 
@@ -439,6 +507,10 @@ static const TestArgs kTestArgList[] = {
   { MEMTABLE_TEST, false, 16 },
   { MEMTABLE_TEST, true, 16 },
 
+  { MERGER_TEST, false, 16 },
+  { MERGER_TEST, false, 1 },
+  { MERGER_TEST, true, 16 },
+
   // Do not bother with restart interval variations for DB
   { DB_TEST, false, 16 },
   { DB_TEST, true, 16 },
@@ -471,6 +543,9 @@ class Harness {
       case MEMTABLE_TEST:
         constructor_ = new MemTableConstructor(options_.comparator);
         break;
+      case MERGER_TEST:
+        constructor_ = new MergerConstructor(options_.comparator);
+        break;
       case DB_TEST:
         constructor_ = new DBConstructor(options_.comparator);
         break;
@@ -872,6 +947,201 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"),    4000,   6000));
 }
 
+TEST(TableTest, Readahead) {
+  TableConstructor c(BytewiseComparator());
+  Random rnd(301);
+  std::string tmp;
+  for (int i = 0; i < 200; i++) {
+    char key[10];
+    snprintf(key, sizeof(key), "k%05d", i);
+    c.Add(key, test::RandomString(&rnd, 1000, &tmp));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  c.Finish(options, &keys, &kvmap);
+  std::vector<std::pair<uint64_t, size_t> >* prefetches = c.source()->prefetches();
+
+  // Readahead disabled
+  ReadOptions read_options;
+  read_options.readahead_size = 0;
+  Iterator* iter = c.NewIterator(read_options);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(200, count);
+  delete iter;
+  ASSERT_EQ(0u, prefetches->size());
+
+  // A forward scan prefetches ever larger windows ahead of its reads
+  read_options.readahead_size = 64 << 10;
+  iter = c.NewIterator(read_options);
+  count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(200, count);
+  delete iter;
+  ASSERT_GT(prefetches->size(), 2u);
+  const uint64_t end = c.ApproximateOffsetOf("xyz");
+  ASSERT_GT((*prefetches)[0].first, 0u);
+  ASSERT_EQ(8u << 10, (*prefetches)[0].second);
+  for (size_t i = 1; i < prefetches->size(); i++) {
+    const std::pair<uint64_t, size_t>& prev = (*prefetches)[i - 1];
+    const std::pair<uint64_t, size_t>& cur = (*prefetches)[i];
+    ASSERT_GE(cur.first, prev.first + prev.second);
+    ASSERT_LE(cur.first + cur.second, end);
+    if (cur.first + cur.second < end) {
+      ASSERT_EQ(std::min<size_t>(prev.second * 2, 64 << 10), cur.second);
+    }
+  }
+
+  // Backward scans and scattered seeks are not sequential
+  prefetches->clear();
+  iter = c.NewIterator(read_options);
+  count = 0;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    count++;
+  }
+  ASSERT_EQ(200, count);
+  for (int i = 199; i >= 0; i -= 7) {
+    char key[10];
+    snprintf(key, sizeof(key), "k%05d", i);
+    iter->Seek(key);
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(std::string(key), iter->key().ToString());
+  }
+  delete iter;
+  ASSERT_EQ(0u, prefetches->size());
+}
+
+TEST(TableTest, IterateBounds) {
+  // One key per block, each block's index key equal to its key
+  TableConstructor c(BytewiseComparator());
+  Random rnd(301);
+  std::string tmp;
+  for (int i = 0; i < 200; i++) {
+    char key[10];
+    snprintf(key, sizeof(key), "k%05d", i);
+    c.Add(key, test::RandomString(&rnd, 2000, &tmp));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  c.Finish(options, &keys, &kvmap);
+
+  // The bounds are user keys, like the table's keys.  Blocks entirely
+  // outside them are not read; the blocks holding the bounds are.
+  Slice lower("k00050");
+  Slice upper("k00100");
+  ReadOptions read_options;
+  read_options.iterate_lower_bound = &lower;
+  read_options.iterate_upper_bound = &upper;
+  Iterator* iter = c.NewIterator(read_options);
+  std::string last;
+  for (iter->Seek("k00050"); iter->Valid(); iter->Next()) {
+    last = iter->key().ToString();
+  }
+  ASSERT_EQ("k00100", last);
+  for (iter->Seek("k00060"); iter->Valid(); iter->Prev()) {
+    last = iter->key().ToString();
+  }
+  ASSERT_EQ("k00050", last);
+  ASSERT_TRUE(iter->status().ok());
+  delete iter;
+}
+
+namespace {
+
+// Counts the comparisons made through it
+class CountingComparator : public Comparator {
+ public:
+  CountingComparator() : count_(0) { }
+  virtual const char* Name() const { return "leveldb.CountingComparator"; }
+  virtual int Compare(const Slice& a, const Slice& b) const {
+    ++count_;
+    return BytewiseComparator()->Compare(a, b);
+  }
+  virtual void FindShortestSeparator(std::string* start,
+                                     const Slice& limit) const {
+    BytewiseComparator()->FindShortestSeparator(start, limit);
+  }
+  virtual void FindShortSuccessor(std::string* key) const {
+    BytewiseComparator()->FindShortSuccessor(key);
+  }
+
+  mutable uint64_t count_;
+};
+
+}  // namespace
+
+class MergerTest { };
+
+TEST(MergerTest, Benchmark) {
+  // A guard at a deep level can hold dozens of overlapping files
+  const int kEntries = 200000;
+  const int kFanIns[] = { 2, 4, 8, 16, 32, 64 };
+  Env* env = Env::Default();
+  CountingComparator cmp;
+  Options options;
+  options.comparator = &cmp;
+  for (size_t f = 0; f < sizeof(kFanIns) / sizeof(kFanIns[0]); f++) {
+    const int fan_in = kFanIns[f];
+    std::vector<KVMap> parts(fan_in, KVMap(STLLessThan(&cmp)));
+    Random rnd(301);
+    for (int i = 0; i < kEntries; i++) {
+      char key[20];
+      snprintf(key, sizeof(key), "%016d", i);
+      parts[rnd.Uniform(fan_in)][key] = "v";
+    }
+    std::vector<BlockConstructor*> blocks;
+    std::vector<Iterator*> list;
+    for (int i = 0; i < fan_in; i++) {
+      blocks.push_back(new BlockConstructor(&cmp));
+      ASSERT_OK(blocks.back()->FinishImpl(options, parts[i]));
+      list.push_back(blocks.back()->NewIterator());
+    }
+    Iterator* iter = NewMergingIterator(&cmp, &list[0], fan_in, NULL);
+
+    // Each Next() replays the matches on one leaf-to-root path
+    int depth = 0;
+    while ((1 << depth) < fan_in) {
+      depth++;
+    }
+    for (int reverse = 0; reverse < 2; reverse++) {
+      cmp.count_ = 0;
+      const uint64_t start = env->NowMicros();
+      int count = 0;
+      if (reverse) {
+        for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+          count++;
+        }
+      } else {
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+          count++;
+        }
+      }
+      const uint64_t micros = std::max<uint64_t>(env->NowMicros() - start, 1);
+      ASSERT_EQ(kEntries, count);
+      ASSERT_LE(cmp.count_, static_cast<uint64_t>(fan_in - 1) +
+                            static_cast<uint64_t>(kEntries) * depth);
+      fprintf(stderr, "merge fan-in %2d %s: %6.1f ns/entry, %5.2f compares/entry\n",
+              fan_in, reverse ? "backward" : "forward ",
+              micros * 1000.0 / kEntries,
+              static_cast<double>(cmp.count_) / kEntries);
+    }
+    delete iter;
+    for (int i = 0; i < fan_in; i++) {
+      delete blocks[i];
+    }
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
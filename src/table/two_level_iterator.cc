@@ -3,11 +3,14 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "table/two_level_iterator.h"
+#include "pebblesdb/env.h"
 #include "pebblesdb/table.h"
 #include "db/dbformat.h"
+#include "port/port.h"
 #include "table/block.h"
 #include "table/format.h"
 #include "table/iterator_wrapper.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -17,13 +20,34 @@ typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
 
 typedef Iterator* (*BlockFunctionGuards)(void*, const void*, void*, unsigned, const ReadOptions&, const Slice&);
 
+typedef void (*PrefetchFunctionGuards)(void*, const void*, void*, unsigned, const ReadOptions&, const Slice&);
+
+// Set "*key" to the key that sorts before every entry for the user key
+// "*bound", or clear it if there is no bound (NULL or empty).  Tables
+// inside a DB hold internal keys; tables opened on their own hold user
+// keys.
+static void SetBoundKey(bool bounds_are_internal, const Slice* bound,
+                        std::string* key) {
+  key->clear();
+  if (bound == NULL || bound->empty()) {
+    return;
+  }
+  if (bounds_are_internal) {
+    AppendInternalKey(key, ParsedInternalKey(*bound, kMaxSequenceNumber, kValueTypeForSeek));
+  } else {
+    key->assign(bound->data(), bound->size());
+  }
+}
+
 class TwoLevelIterator: public Iterator {
  public:
   TwoLevelIterator(
     Iterator* index_iter,
     BlockFunction block_function,
     void* arg,
-    const ReadOptions& options);
+    const ReadOptions& options,
+    const Comparator* comparator,
+    bool bounds_are_internal);
 
   virtual ~TwoLevelIterator();
 
@@ -64,36 +88,59 @@ class TwoLevelIterator: public Iterator {
   void SkipEmptyDataBlocksBackward();
   void SetDataIterator(Iterator* data_iter);
   void InitDataBlock();
+  void UpdateBounds();
 
   BlockFunction block_function_;
   void* arg_;
   const ReadOptions options_;
+  const Comparator* const comparator_;  // NULL if bounds are ignored
+  const bool bounds_are_internal_;
   Status status_;
   IteratorWrapper index_iter_;
   IteratorWrapper data_iter_; // May be NULL
   // If data_iter_ is non-NULL, then "data_block_handle_" holds the
   // "index_value" passed to block_function_ to create the data_iter_.
   std::string data_block_handle_;
+  // The ReadOptions bounds in the table's key format; empty if unbounded
+  std::string lower_key_;
+  std::string upper_key_;
 };
 
 TwoLevelIterator::TwoLevelIterator(
     Iterator* index_iter,
     BlockFunction block_function,
     void* arg,
-    const ReadOptions& options)
+    const ReadOptions& options,
+    const Comparator* comparator,
+    bool bounds_are_internal)
     : block_function_(block_function),
       arg_(arg),
       options_(options),
+      comparator_(comparator),
+      bounds_are_internal_(bounds_are_internal),
       status_(),
       index_iter_(index_iter),
       data_iter_(NULL),
-      data_block_handle_() {
+      data_block_handle_(),
+      lower_key_(),
+      upper_key_() {
 }
 
 TwoLevelIterator::~TwoLevelIterator() {
 }
 
+// The bounds may move between seeks (see ScanLimit in db/db_iter.h)
+void TwoLevelIterator::UpdateBounds() {
+  if (comparator_ != NULL) {
+    SetBoundKey(bounds_are_internal_, options_.iterate_lower_bound,
+                &lower_key_);
+    SetBoundKey(bounds_are_internal_, options_.iterate_upper_bound,
+                &upper_key_);
+  }
+}
+
 void TwoLevelIterator::Seek(const Slice& target) {
+  UpdateBounds();
 //  uint64_t a, b, c, d, e;
 //  pthread_t tid = Env::Default()->GetThreadId();
 //  a = Env::Default()->NowMicros();
@@ -110,6 +157,7 @@ void TwoLevelIterator::Seek(const Slice& target) {
 }
 
 void TwoLevelIterator::SeekToFirst() {
+  UpdateBounds();
   index_iter_.SeekToFirst();
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.SeekToFirst();
@@ -117,6 +165,24 @@ void TwoLevelIterator::SeekToFirst() {
 }
 
 void TwoLevelIterator::SeekToLast() {
+  UpdateBounds();
+  if (!upper_key_.empty()) {
+    // Position at the last entry before the upper bound
+    index_iter_.Seek(upper_key_);
+    if (index_iter_.Valid()) {
+      InitDataBlock();
+      if (data_iter_.iter() != NULL) {
+        data_iter_.Seek(upper_key_);
+        if (data_iter_.Valid()) {
+          data_iter_.Prev();
+        } else {
+          data_iter_.SeekToLast();
+        }
+      }
+      SkipEmptyDataBlocksBackward();
+      return;
+    }
+  }
   index_iter_.SeekToLast();
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.SeekToLast();
@@ -143,6 +209,13 @@ void TwoLevelIterator::SkipEmptyDataBlocksForward() {
       SetDataIterator(NULL);
       return;
     }
+    if (!upper_key_.empty() &&
+        comparator_->Compare(index_iter_.key(), upper_key_) >= 0) {
+      // Every key of the next block is past the upper bound; do not
+      // read it
+      SetDataIterator(NULL);
+      return;
+    }
     index_iter_.Next();
     InitDataBlock();
     if (data_iter_.iter() != NULL) data_iter_.SeekToFirst();
@@ -157,6 +230,12 @@ void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
       return;
     }
     index_iter_.Prev();
+    if (!lower_key_.empty() && index_iter_.Valid() &&
+        comparator_->Compare(index_iter_.key(), lower_key_) < 0) {
+      // Every key of this block is before the lower bound
+      SetDataIterator(NULL);
+      return;
+    }
     InitDataBlock();
     if (data_iter_.iter() != NULL) data_iter_.SeekToLast();
   }
@@ -199,7 +278,11 @@ class TwoLevelIteratorGuards: public Iterator {
 	const void* arg2,
 	void* arg3,
 	unsigned level,
-    const ReadOptions& options);
+    const ReadOptions& options,
+    const Comparator* comparator,
+    Iterator* lookahead_iter,
+    PrefetchFunctionGuards prefetch_function,
+    Env* env);
 
   virtual ~TwoLevelIteratorGuards();
 
@@ -240,6 +323,12 @@ class TwoLevelIteratorGuards: public Iterator {
   void SkipEmptyDataBlocksBackward();
   void SetDataIterator(Iterator* data_iter);
   void InitDataBlock();
+  void UpdateBounds();
+  void SeekInternal(const Slice& target);
+  void CheckUpperBound();
+  void CheckLowerBound();
+  void AdvanceLookahead();
+  static void Prefetch(void* arg);
 
   BlockFunctionGuards block_function_;
   void* arg1_;
@@ -247,12 +336,33 @@ class TwoLevelIteratorGuards: public Iterator {
   void* arg3_;
   unsigned level;
   const ReadOptions options_;
+  const Comparator* const comparator_;  // NULL if bounds are ignored
   Status status_;
   IteratorWrapper index_iter_;
   IteratorWrapper data_iter_; // May be NULL
   // If data_iter_ is non-NULL, then "data_block_handle_" holds the
   // "index_value" passed to block_function_ to create the data_iter_.
   std::string data_block_handle_;
+  // For bounded scans, the target of the last Seek() while the iterator
+  // has only moved forward since.  Later guards are entered by seeking to
+  // it, which lets their files be skipped by prefix as well as by range.
+  std::string seek_target_;
+  // Internal key forms of the ReadOptions bounds; empty if unbounded.
+  // Keys outside them are never yielded, so merging this iterator in
+  // either direction sees exactly the bounded range.
+  std::string lower_key_;
+  std::string upper_key_;
+  // Set while moving forward with a lookahead.  lookahead_iter_ is then
+  // positioned one guard past index_iter_.
+  IteratorWrapper lookahead_iter_;  // May be NULL
+  bool lookahead_active_;
+  PrefetchFunctionGuards prefetch_function_;
+  Env* const env_;
+  // Index value of the guard being prefetched in the background
+  std::string prefetch_handle_;
+  port::Mutex prefetch_mutex_;
+  port::CondVar prefetch_cv_;
+  bool prefetch_pending_;  // Protected by prefetch_mutex_
 };
 
 TwoLevelIteratorGuards::TwoLevelIteratorGuards(
@@ -262,55 +372,173 @@ TwoLevelIteratorGuards::TwoLevelIteratorGuards(
 	const void* arg2,
 	void* arg3,
 	unsigned l,
-    const ReadOptions& options)
+    const ReadOptions& options,
+    const Comparator* comparator,
+    Iterator* lookahead_iter,
+    PrefetchFunctionGuards prefetch_function,
+    Env* env)
     : block_function_(block_function),
       arg1_(arg1),
 	  arg2_(arg2),
 	  arg3_(arg3),
 	  level(l),
       options_(options),
+      comparator_(comparator),
       status_(),
       index_iter_(index_iter),
       data_iter_(NULL),
-      data_block_handle_() {
+      data_block_handle_(),
+      seek_target_(),
+      lower_key_(),
+      upper_key_(),
+      lookahead_iter_(lookahead_iter),
+      lookahead_active_(false),
+      prefetch_function_(prefetch_function),
+      env_(env),
+      prefetch_handle_(),
+      prefetch_mutex_(),
+      prefetch_cv_(&prefetch_mutex_),
+      prefetch_pending_(false) {
 }
 
 TwoLevelIteratorGuards::~TwoLevelIteratorGuards() {
+  MutexLock l(&prefetch_mutex_);
+  while (prefetch_pending_) {
+    prefetch_cv_.Wait();
+  }
+}
+
+// Move the lookahead to the guard after the one index_iter_ just
+// reached and prefetch it, unless the previous prefetch is still running.
+void TwoLevelIteratorGuards::AdvanceLookahead() {
+  if (!lookahead_active_ || !lookahead_iter_.Valid()) {
+    return;
+  }
+  lookahead_iter_.Next();
+  if (!lookahead_iter_.Valid()) {
+    return;
+  }
+  MutexLock l(&prefetch_mutex_);
+  if (!prefetch_pending_) {
+    Slice handle = lookahead_iter_.value();
+    prefetch_handle_.assign(handle.data(), handle.size());
+    prefetch_pending_ = true;
+    env_->Schedule(&TwoLevelIteratorGuards::Prefetch, this);
+  }
+}
+
+void TwoLevelIteratorGuards::Prefetch(void* arg) {
+  TwoLevelIteratorGuards* iter = reinterpret_cast<TwoLevelIteratorGuards*>(arg);
+  (*iter->prefetch_function_)(iter->arg1_, iter->arg2_, iter->arg3_,
+                              iter->level, iter->options_,
+                              iter->prefetch_handle_);
+  MutexLock l(&iter->prefetch_mutex_);
+  iter->prefetch_pending_ = false;
+  iter->prefetch_cv_.SignalAll();
+}
+
+void TwoLevelIteratorGuards::UpdateBounds() {
+  if (comparator_ != NULL) {
+    // Guards only exist inside a DB
+    SetBoundKey(true, options_.iterate_lower_bound, &lower_key_);
+    SetBoundKey(true, options_.iterate_upper_bound, &upper_key_);
+  }
 }
 
 void TwoLevelIteratorGuards::Seek(const Slice& target) {
+  UpdateBounds();
+  if (!lower_key_.empty() && comparator_->Compare(target, lower_key_) < 0) {
+    SeekInternal(lower_key_);
+  } else {
+    SeekInternal(target);
+  }
+}
+
+void TwoLevelIteratorGuards::SeekInternal(const Slice& target) {
+  if (!upper_key_.empty() && comparator_->Compare(target, upper_key_) >= 0) {
+    // Nothing to return; a merging iterator changing direction falls
+    // back to SeekToLast() without reading the blocks past the bound
+    SetDataIterator(NULL);
+    lookahead_active_ = false;
+    return;
+  }
+  if (options_.iterate_upper_bound != NULL) {
+    seek_target_.assign(target.data(), target.size());
+  }
   index_iter_.Seek(target);
+  if (lookahead_iter_.iter() != NULL) {
+    lookahead_iter_.Seek(target);
+    lookahead_active_ = true;
+    AdvanceLookahead();
+  }
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.Seek(target);
   SkipEmptyDataBlocksForward();
+  CheckUpperBound();
 }
 
 void TwoLevelIteratorGuards::SeekToFirst() {
+  UpdateBounds();
+  if (!lower_key_.empty()) {
+    SeekInternal(lower_key_);
+    return;
+  }
+  seek_target_.clear();
   index_iter_.SeekToFirst();
+  if (lookahead_iter_.iter() != NULL) {
+    lookahead_iter_.SeekToFirst();
+    lookahead_active_ = true;
+    AdvanceLookahead();
+  }
   InitDataBlock();
   if (data_iter_.iter() != NULL) {
 	  data_iter_.SeekToFirst();
   }
   SkipEmptyDataBlocksForward();
+  CheckUpperBound();
 }
 
 void TwoLevelIteratorGuards::SeekToLast() {
+  UpdateBounds();
+  seek_target_.clear();
+  lookahead_active_ = false;
+  // Guards past the upper bound are skipped by the index iterator and the
+  // table iterators position themselves below the bound
   index_iter_.SeekToLast();
   InitDataBlock();
   if (data_iter_.iter() != NULL) data_iter_.SeekToLast();
   SkipEmptyDataBlocksBackward();
+  CheckLowerBound();
 }
 
 void TwoLevelIteratorGuards::Next() {
   assert(Valid());
   data_iter_.Next();
   SkipEmptyDataBlocksForward();
+  CheckUpperBound();
 }
 
 void TwoLevelIteratorGuards::Prev() {
   assert(Valid());
+  seek_target_.clear();
+  lookahead_active_ = false;
   data_iter_.Prev();
   SkipEmptyDataBlocksBackward();
+  CheckLowerBound();
+}
+
+void TwoLevelIteratorGuards::CheckUpperBound() {
+  if (!upper_key_.empty() && data_iter_.Valid() &&
+      comparator_->Compare(data_iter_.key(), upper_key_) >= 0) {
+    SetDataIterator(NULL);
+  }
+}
+
+void TwoLevelIteratorGuards::CheckLowerBound() {
+  if (!lower_key_.empty() && data_iter_.Valid() &&
+      comparator_->Compare(data_iter_.key(), lower_key_) < 0) {
+    SetDataIterator(NULL);
+  }
 }
 
 
@@ -322,8 +550,16 @@ void TwoLevelIteratorGuards::SkipEmptyDataBlocksForward() {
       return;
     }
     index_iter_.Next();
+    AdvanceLookahead();
     InitDataBlock();
-    if (data_iter_.iter() != NULL) data_iter_.SeekToFirst();
+    if (data_iter_.iter() != NULL) {
+      // Every key of this guard is past seek_target_
+      if (!seek_target_.empty()) {
+        data_iter_.Seek(seek_target_);
+      } else {
+        data_iter_.SeekToFirst();
+      }
+    }
   }
 }
 
@@ -368,8 +604,11 @@ Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     BlockFunction block_function,
     void* arg,
-    const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+    const ReadOptions& options,
+    const Comparator* comparator,
+    bool bounds_are_internal) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              comparator, bounds_are_internal);
 }
 
 /*Iterator* NewTwoLevelIteratorGuards(
@@ -388,8 +627,14 @@ Iterator* NewTwoLevelIteratorGuards(
 	const void* arg2,
 	void* arg3,
 	unsigned level,
-    const ReadOptions& options) {
-  return new TwoLevelIteratorGuards(index_iter, block_function, arg1, arg2, arg3, level, options);
+    const ReadOptions& options,
+    const Comparator* comparator,
+    Iterator* lookahead_iter,
+    PrefetchFunctionGuards prefetch_function,
+    Env* env) {
+  assert(lookahead_iter == NULL || (prefetch_function != NULL && env != NULL));
+  return new TwoLevelIteratorGuards(index_iter, block_function, arg1, arg2, arg3, level, options,
+                                    comparator, lookahead_iter, prefetch_function, env);
 }
 
 }  // namespace leveldb
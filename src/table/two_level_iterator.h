@@ -10,6 +10,8 @@
 namespace leveldb {
 
 struct ReadOptions;
+class Comparator;
+class Env;
 
 // Return a new two level iterator.  A two-level iterator contains an
 // index iterator whose values point to a sequence of blocks where
@@ -20,6 +22,12 @@ struct ReadOptions;
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// If "comparator" (the table's comparator) is non-NULL, blocks lying
+// entirely outside options.iterate_lower_bound and
+// options.iterate_upper_bound are never read.  "bounds_are_internal"
+// says whether the table holds internal keys, as tables of a DB do, or
+// the user keys the bounds are given in.
 extern Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(
@@ -27,8 +35,20 @@ extern Iterator* NewTwoLevelIterator(
         const ReadOptions& options,
         const Slice& index_value),
     void* arg,
-    const ReadOptions& options);
+    const ReadOptions& options,
+    const Comparator* comparator = NULL,
+    bool bounds_are_internal = false);
 
+// If "lookahead_iter" is non-NULL, it must be a second index iterator
+// over the same guards as "index_iter", and is owned by the result.
+// While the result moves forward, it keeps "lookahead_iter" one guard
+// ahead of the guard it is reading and passes the index value of that
+// next guard to (*prefetch_function)(arg1, arg2, arg3, level, options,
+// index_value) on a background thread of "env", so that the guard's
+// tables are ready by the time the iteration gets there.  At most one
+// prefetch per iterator is outstanding at a time; the result waits for
+// it before it is deleted.  Bounds are applied as for
+// NewTwoLevelIterator(), with "comparator" the internal key comparator.
 extern Iterator* NewTwoLevelIteratorGuards(
     Iterator* index_iter,
     Iterator* (*block_function)(
@@ -39,7 +59,15 @@ extern Iterator* NewTwoLevelIteratorGuards(
     void* arg1, const void* arg2,
 	void* arg3,
 	unsigned level,
-    const ReadOptions& options);
+    const ReadOptions& options,
+    const Comparator* comparator = NULL,
+    Iterator* lookahead_iter = NULL,
+    void (*prefetch_function)(
+        void* arg1, const void* arg2,
+        void* arg3, unsigned level,
+        const ReadOptions& options,
+        const Slice& index_value) = NULL,
+    Env* env = NULL);
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_TABLE_TWO_LEVEL_ITERATOR_H_
@@ -0,0 +1,207 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/two_level_iterator.h"
+
+#include <string>
+#include <vector>
+#include "pebblesdb/env.h"
+#include "pebblesdb/options.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+namespace {
+
+// An iterator over a sorted vector of key/value pairs
+class VectorIterator : public Iterator {
+ public:
+  explicit VectorIterator(const std::vector<std::pair<std::string, std::string> >* entries)
+      : entries_(entries), pos_(entries->size()) {
+  }
+
+  virtual bool Valid() const { return pos_ < entries_->size(); }
+  virtual void SeekToFirst() { pos_ = 0; }
+  virtual void SeekToLast() {
+    pos_ = entries_->empty() ? 0 : entries_->size() - 1;
+  }
+  virtual void Seek(const Slice& target) {
+    for (pos_ = 0; pos_ < entries_->size(); pos_++) {
+      if (Slice((*entries_)[pos_].first).compare(target) >= 0) {
+        break;
+      }
+    }
+  }
+  virtual void Next() { assert(Valid()); pos_++; }
+  virtual void Prev() {
+    assert(Valid());
+    pos_ = (pos_ == 0) ? entries_->size() : pos_ - 1;
+  }
+  virtual Slice key() const { return (*entries_)[pos_].first; }
+  virtual Slice value() const { return (*entries_)[pos_].second; }
+  virtual const Status& status() const { return status_; }
+
+ private:
+  const std::vector<std::pair<std::string, std::string> >* entries_;
+  size_t pos_;
+  Status status_;
+};
+
+}  // namespace
+
+static const int kNumGuards = 5;
+static const int kKeysPerGuard = 10;
+
+class TwoLevelIteratorGuardsTest {
+ public:
+  // guards_ maps the largest key of each guard to its index.
+  // data_[i] holds the entries of guard i.
+  std::vector<std::pair<std::string, std::string> > guards_;
+  std::vector<std::pair<std::string, std::string> > data_[kNumGuards];
+
+  port::Mutex mu_;
+  std::vector<std::string> prefetched_;  // Protected by mu_
+
+  TwoLevelIteratorGuardsTest() {
+    for (int g = 0; g < kNumGuards; g++) {
+      for (int i = 0; i < kKeysPerGuard; i++) {
+        std::string key(1, 'a' + g);
+        key.push_back('0' + i);
+        data_[g].push_back(std::make_pair(key, "v" + key));
+      }
+      guards_.push_back(std::make_pair(data_[g].back().first,
+                                       std::string(1, '0' + g)));
+    }
+  }
+
+  static Iterator* GuardIterator(void* arg1, const void* /*arg2*/,
+                                 void* /*arg3*/, unsigned /*level*/,
+                                 const ReadOptions& /*options*/,
+                                 const Slice& index_value) {
+    TwoLevelIteratorGuardsTest* t =
+        reinterpret_cast<TwoLevelIteratorGuardsTest*>(arg1);
+    return new VectorIterator(&t->data_[index_value[0] - '0']);
+  }
+
+  static void PrefetchGuard(void* arg1, const void* /*arg2*/,
+                            void* /*arg3*/, unsigned /*level*/,
+                            const ReadOptions& /*options*/,
+                            const Slice& index_value) {
+    TwoLevelIteratorGuardsTest* t =
+        reinterpret_cast<TwoLevelIteratorGuardsTest*>(arg1);
+    MutexLock l(&t->mu_);
+    t->prefetched_.push_back(index_value.ToString());
+  }
+
+  Iterator* NewIterator(bool lookahead) {
+    return NewTwoLevelIteratorGuards(
+        new VectorIterator(&guards_), &GuardIterator, this, NULL, NULL, 0,
+        ReadOptions(), NULL,
+        lookahead ? new VectorIterator(&guards_) : NULL,
+        lookahead ? &PrefetchGuard : NULL,
+        lookahead ? Env::Default() : NULL);
+  }
+
+  // Return the guards prefetched so far, and forget them
+  std::string TakePrefetched() {
+    MutexLock l(&mu_);
+    std::string result;
+    for (size_t i = 0; i < prefetched_.size(); i++) {
+      result += prefetched_[i];
+    }
+    prefetched_.clear();
+    return result;
+  }
+
+  // Check that "s" lists guards in increasing order, each after "first"
+  static bool IncreasingFrom(const std::string& s, char first) {
+    for (size_t i = 0; i < s.size(); i++) {
+      if (s[i] <= first || s[i] >= '0' + kNumGuards) {
+        return false;
+      }
+      first = s[i];
+    }
+    return true;
+  }
+};
+
+TEST(TwoLevelIteratorGuardsTest, NoLookahead) {
+  Iterator* iter = NewIterator(false);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(kNumGuards * kKeysPerGuard, count);
+  delete iter;
+  ASSERT_EQ("", TakePrefetched());
+}
+
+TEST(TwoLevelIteratorGuardsTest, ForwardScan) {
+  Iterator* iter = NewIterator(true);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(data_[count / kKeysPerGuard][count % kKeysPerGuard].first,
+              iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(kNumGuards * kKeysPerGuard, count);
+  delete iter;  // Waits for the last prefetch
+
+  // The second guard is always prefetched; later ones are skipped while
+  // an earlier prefetch is still running
+  std::string prefetched = TakePrefetched();
+  ASSERT_TRUE(!prefetched.empty());
+  ASSERT_EQ('1', prefetched[0]);
+  ASSERT_TRUE(IncreasingFrom(prefetched, '0')) << prefetched;
+}
+
+TEST(TwoLevelIteratorGuardsTest, Seek) {
+  Iterator* iter = NewIterator(true);
+  iter->Seek("c5");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("c5", iter->key().ToString());
+  delete iter;
+  ASSERT_EQ("3", TakePrefetched());
+
+  // Nothing follows the last guard
+  iter = NewIterator(true);
+  iter->Seek("e0");
+  ASSERT_EQ("e0", iter->key().ToString());
+  for (int i = 0; i < kKeysPerGuard; i++) {
+    ASSERT_TRUE(iter->Valid());
+    iter->Next();
+  }
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+  ASSERT_EQ("", TakePrefetched());
+}
+
+TEST(TwoLevelIteratorGuardsTest, BackwardScan) {
+  Iterator* iter = NewIterator(true);
+  int count = kNumGuards * kKeysPerGuard;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    count--;
+    ASSERT_EQ(data_[count / kKeysPerGuard][count % kKeysPerGuard].first,
+              iter->key().ToString());
+  }
+  ASSERT_EQ(0, count);
+  delete iter;
+  ASSERT_EQ("", TakePrefetched());
+
+  // Turning around stops the lookahead until the next seek
+  iter = NewIterator(true);
+  iter->Seek("b0");
+  iter->Prev();
+  ASSERT_EQ("a9", iter->key().ToString());
+  delete iter;
+  ASSERT_EQ("2", TakePrefetched());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
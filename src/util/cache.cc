@@ -6,8 +6,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
+
 #include "pebblesdb/cache.h"
 #include "port/port.h"
+#include "util/atomic.h"
 #include "util/hash.h"
 #include "util/mutexlock.h"
 
@@ -21,7 +24,9 @@ namespace {
 // LRU cache implementation
 
 // An entry is a variable length heap-allocated structure.  Entries
-// are kept in a circular doubly linked list ordered by access time.
+// are kept in a circular doubly linked list ordered by access time,
+// one list per priority tier plus one for low priority entries on
+// probation.
 struct LRUHandle {
   void* value;
   void (*deleter)(const Slice&, void* value);
@@ -32,6 +37,8 @@ struct LRUHandle {
   size_t key_length;
   uint32_t refs;
   uint32_t hash;      // Hash of key(); used for fast sharding and comparisons
+  Cache::Priority priority;  // Tier the entry is charged to
+  bool in_probation;  // Not looked up since it was inserted or demoted
   char key_data[1];   // Beginning of key
 
   Slice key() const {
@@ -140,52 +147,90 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, double high_pri_pool_ratio,
+                   bool scan_resistant) {
+    capacity_ = capacity;
+    high_pri_capacity_ = static_cast<size_t>(capacity * high_pri_pool_ratio);
+    tiered_ = high_pri_pool_ratio > 0;
+    scan_resistant_ = scan_resistant;
+    protected_capacity_ = (capacity - high_pri_capacity_) / 5 * 4;
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash,
                         void* value, size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
-  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash,
+                        Cache::Priority priority, bool promote);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
+  void AddHitCounts(Cache::Priority priority, uint64_t* hits, uint64_t* misses);
+  void AddInsertCount(uint64_t* inserts);
 
  private:
   void LRU_Remove(LRUHandle* e);
   void LRU_Append(LRUHandle* e);
   void Unref(LRUHandle* e);
+  LRUHandle* NextVictim();
+  void Promote(LRUHandle* e);
 
   // Initialized before use.
   size_t capacity_;
+  size_t high_pri_capacity_;
+  bool tiered_;
+  bool scan_resistant_;
+  size_t protected_capacity_;
 
   // mutex_ protects the following state.
   port::Mutex mutex_;
   size_t usage_;
+  size_t high_pri_usage_;
+  size_t protected_usage_;  // Low priority entries not on probation
+  uint64_t hits_[2];    // Indexed by Cache::Priority
+  uint64_t misses_[2];
+  uint64_t inserts_;
 
-  // Dummy head of LRU list.
-  // lru.prev is newest entry, lru.next is oldest entry.
-  LRUHandle lru_;
+  // Dummy heads of the LRU lists of each tier and of the probationary
+  // entries.  lru.prev is newest entry, lru.next is oldest entry.
+  LRUHandle lru_[2];
+  LRUHandle probation_;
 
   HandleTable table_;
 };
 
 LRUCache::LRUCache()
     : capacity_(),
+      high_pri_capacity_(0),
+      tiered_(false),
+      scan_resistant_(false),
+      protected_capacity_(0),
       mutex_(),
       usage_(0),
-      lru_(),
+      high_pri_usage_(0),
+      protected_usage_(0),
+      inserts_(0),
       table_() {
-  // Make empty circular linked list
-  lru_.next = &lru_;
-  lru_.prev = &lru_;
+  // Make empty circular linked lists
+  for (int i = 0; i < 2; i++) {
+    lru_[i].next = &lru_[i];
+    lru_[i].prev = &lru_[i];
+    hits_[i] = 0;
+    misses_[i] = 0;
+  }
+  probation_.next = &probation_;
+  probation_.prev = &probation_;
 }
 
 LRUCache::~LRUCache() {
-  for (LRUHandle* e = lru_.next; e != &lru_; ) {
-    LRUHandle* next = e->next;
-    assert(e->refs == 1);  // Error if caller has an unreleased handle
-    Unref(e);
-    e = next;
+  LRUHandle* lists[3] = { &lru_[0], &lru_[1], &probation_ };
+  for (int i = 0; i < 3; i++) {
+    for (LRUHandle* e = lists[i]->next; e != lists[i]; ) {
+      LRUHandle* next = e->next;
+      assert(e->refs == 1);  // Error if caller has an unreleased handle
+      Unref(e);
+      e = next;
+    }
   }
 }
 
@@ -194,6 +239,9 @@ void LRUCache::Unref(LRUHandle* e) {
   e->refs--;
   if (e->refs <= 0) {
     usage_ -= e->charge;
+    if (e->priority == Cache::kHighPriority) {
+      high_pri_usage_ -= e->charge;
+    }
     (*e->deleter)(e->key(), e->value);
     free(e);
   }
@@ -202,27 +250,88 @@ void LRUCache::Unref(LRUHandle* e) {
 void LRUCache::LRU_Remove(LRUHandle* e) {
   e->next->prev = e->prev;
   e->prev->next = e->next;
+  if (e->priority == Cache::kLowPriority && !e->in_probation) {
+    protected_usage_ -= e->charge;
+  }
 }
 
 void LRUCache::LRU_Append(LRUHandle* e) {
-  // Make "e" newest entry by inserting just before lru_
-  e->next = &lru_;
-  e->prev = lru_.prev;
+  // Make "e" newest entry by inserting just before the head of its list
+  LRUHandle* list = e->in_probation ? &probation_ : &lru_[e->priority];
+  e->next = list;
+  e->prev = list->prev;
   e->prev->next = e;
   e->next->prev = e;
+  if (e->priority == Cache::kLowPriority && !e->in_probation) {
+    protected_usage_ += e->charge;
+  }
 }
 
-Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
+// Move a probationary entry that was looked up again to the protected
+// segment, demoting the oldest protected entries back to probation to
+// keep the segment within its capacity.
+void LRUCache::Promote(LRUHandle* e) {
+  LRU_Remove(e);
+  e->in_probation = false;
+  LRU_Append(e);
+  LRUHandle* protected_list = &lru_[Cache::kLowPriority];
+  while (protected_usage_ > protected_capacity_ &&
+         protected_list->next != e) {
+    LRUHandle* old = protected_list->next;
+    LRU_Remove(old);
+    old->in_probation = true;
+    LRU_Append(old);
+  }
+}
+
+// Return the entry to evict next, or NULL if the cache is empty.  The
+// tier over its share of the capacity loses its oldest entry; within the
+// low priority tier, probationary entries go first.
+LRUHandle* LRUCache::NextVictim() {
+  LRUHandle* high = &lru_[Cache::kHighPriority];
+  LRUHandle* low = &lru_[Cache::kLowPriority];
+  if (high->next != high &&
+      (high_pri_usage_ > high_pri_capacity_ ||
+       (low->next == low && probation_.next == &probation_))) {
+    return high->next;
+  }
+  if (probation_.next != &probation_) {
+    return probation_.next;
+  }
+  return (low->next != low) ? low->next : NULL;
+}
+
+Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash,
+                                Cache::Priority priority, bool promote) {
   MutexLock l(&mutex_);
   LRUHandle* e = table_.Lookup(key, hash);
   if (e != NULL) {
     e->refs++;
-    LRU_Remove(e);
-    LRU_Append(e);
+    if (promote && e->in_probation) {
+      Promote(e);
+    } else if (promote) {
+      LRU_Remove(e);
+      LRU_Append(e);
+    }
+    hits_[priority]++;
+  } else {
+    misses_[priority]++;
   }
   return reinterpret_cast<Cache::Handle*>(e);
 }
 
+void LRUCache::AddHitCounts(Cache::Priority priority,
+                            uint64_t* hits, uint64_t* misses) {
+  MutexLock l(&mutex_);
+  *hits += hits_[priority];
+  *misses += misses_[priority];
+}
+
+void LRUCache::AddInsertCount(uint64_t* inserts) {
+  MutexLock l(&mutex_);
+  *inserts += inserts_;
+}
+
 void LRUCache::Release(Cache::Handle* handle) {
   MutexLock l(&mutex_);
   Unref(reinterpret_cast<LRUHandle*>(handle));
@@ -230,8 +339,10 @@ void LRUCache::Release(Cache::Handle* handle) {
 
 Cache::Handle* LRUCache::Insert(
     const Slice& key, uint32_t hash, void* value, size_t charge,
-    void (*deleter)(const Slice& key, void* value)) {
+    void (*deleter)(const Slice& key, void* value),
+    Cache::Priority priority) {
   MutexLock l(&mutex_);
+  inserts_++;
 
   LRUHandle* e = reinterpret_cast<LRUHandle*>(
       malloc(sizeof(LRUHandle)-1 + key.size()));
@@ -241,9 +352,14 @@ Cache::Handle* LRUCache::Insert(
   e->key_length = key.size();
   e->hash = hash;
   e->refs = 2;  // One from LRUCache, one for the returned handle
+  e->priority = tiered_ ? priority : Cache::kLowPriority;
+  e->in_probation = scan_resistant_ && e->priority == Cache::kLowPriority;
   memcpy(e->key_data, key.data(), key.size());
   LRU_Append(e);
   usage_ += charge;
+  if (e->priority == Cache::kHighPriority) {
+    high_pri_usage_ += charge;
+  }
 
   LRUHandle* old = table_.Insert(e);
   if (old != NULL) {
@@ -251,8 +367,7 @@ Cache::Handle* LRUCache::Insert(
     Unref(old);
   }
 
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    old = lru_.next;
+  while (usage_ > capacity_ && (old = NextVictim()) != NULL) {
     LRU_Remove(old);
     table_.Remove(old->key(), old->hash);
     Unref(old);
@@ -291,23 +406,53 @@ class ShardedLRUCache : public Cache {
   }
 
  public:
-  explicit ShardedLRUCache(size_t capacity)
+  ShardedLRUCache(size_t capacity, double high_pri_pool_ratio,
+                  bool scan_resistant)
       : id_mutex_(),
         last_id_(0) {
     const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
     for (unsigned s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+      shard_[s].SetCapacity(per_shard, high_pri_pool_ratio, scan_resistant);
     }
   }
   virtual ~ShardedLRUCache() { }
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) {
+    return Insert(key, value, charge, deleter, kLowPriority);
+  }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
   }
   virtual Handle* Lookup(const Slice& key) {
+    return Lookup(key, kLowPriority);
+  }
+  virtual Handle* Lookup(const Slice& key, Priority priority) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Lookup(key, hash, priority, true);
+  }
+  virtual Handle* Peek(const Slice& key, Priority priority) {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Lookup(key, hash);
+    return shard_[Shard(hash)].Lookup(key, hash, priority, false);
+  }
+  virtual bool GetHitCounts(Priority priority,
+                            uint64_t* hits, uint64_t* misses) {
+    *hits = 0;
+    *misses = 0;
+    for (unsigned s = 0; s < kNumShards; s++) {
+      shard_[s].AddHitCounts(priority, hits, misses);
+    }
+    return true;
+  }
+  virtual bool GetInsertCount(uint64_t* inserts) {
+    *inserts = 0;
+    for (unsigned s = 0; s < kNumShards; s++) {
+      shard_[s].AddInsertCount(inserts);
+    }
+    return true;
   }
   virtual void Release(Handle* handle) {
     LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
@@ -328,10 +473,556 @@ class ShardedLRUCache : public Cache {
 
 #pragma GCC diagnostic pop
 
+// CLOCK cache implementation
+//
+// Lookup() and Release() of cached entries take no locks.  Each shard is
+// an open-addressing table of fixed-size slots; a slot's "meta" word holds
+// its state together with the count of outstanding references, so a
+// reader pins an entry with a single atomic increment.  An entry is only
+// freed by whoever moves its slot from (visible or invisible, 0 refs) to
+// construction with a compare-and-swap, so a pinned entry can be read
+// without a lock.  Insert(), Erase() and eviction serialize on a per-shard
+// mutex; they follow a disk read, so they are far rarer than hits.
+//
+// Instead of relinking an LRU list on every hit, a hit sets the slot's
+// clock count and eviction sweeps a hand around the table, decrementing
+// counts and evicting the first unreferenced entry whose count is zero.
+//
+// A scan-resistant cache keeps probationary and protected entries like
+// the LRU cache does.  A hit only flags its slot; the hand, which holds
+// the mutex anyway, promotes flagged entries as it passes them.
+
+struct ClockSlot;
+
+struct ClockHandle {
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  ClockSlot* slot;    // NULL if the entry was never added to the table
+  size_t charge;
+  size_t key_length;
+  uint32_t hash;
+  Cache::Priority priority;  // Tier the entry is charged to
+  bool in_probation;  // Not looked up since it was inserted or demoted
+  char key_data[1];   // Beginning of key
+
+  Slice key() const {
+    return Slice(key_data, key_length);
+  }
+};
+
+// Slots are padded to a cache line so that hits on different entries
+// never write to the same line.
+struct ClockSlot {
+  volatile uint64_t meta;
+  // Number of entries whose probe sequence passes over this slot; a
+  // Lookup() stops probing at a slot that no entry was displaced past.
+  volatile uint32_t displacements;
+  volatile uint32_t clock;
+  ClockHandle* volatile handle;  // Valid while the slot is pinned or locked
+  // Lookups that found the current entry; kept here rather than in a
+  // shared counter so that hits touch no other cache line
+  volatile uint32_t hits;
+  // Set by a promoting lookup; the clock hand moves the entry out of
+  // probation when it finds the flag set
+  volatile uint32_t referenced;
+  char padding[64 - 2 * sizeof(uint64_t) - sizeof(ClockHandle*) -
+               2 * sizeof(uint32_t)];
+};
+
+// Slot states, in the top two bits of ClockSlot::meta.  The remaining
+// bits count references held through Lookup()/Insert() handles, plus
+// transient ones taken by readers that are checking the slot.
+static const uint64_t kStateEmpty = 0;
+static const uint64_t kStateConstruction = 1ULL << 62;
+static const uint64_t kStateVisible = 2ULL << 62;
+static const uint64_t kStateInvisible = 3ULL << 62;  // Erased while pinned
+static const uint64_t kStateMask = 3ULL << 62;
+static const uint64_t kRefsMask = ~kStateMask;
+
+// A hit sets the count to kMaxClock; eviction takes kMaxClock+1 passes
+// to evict an entry that is not touched again.  Entries start at 1 so
+// that a block read once goes before one that was hit.
+static const uint32_t kMaxClock = 3;
+static const uint32_t kInitialClock = 1;
+
+// A single shard of sharded cache.
+class ClockCache {
+ public:
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of ClockCache
+  void SetCapacity(size_t capacity, size_t estimated_entry_charge,
+                   double high_pri_pool_ratio, bool scan_resistant);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash,
+                        void* value, size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash,
+                        Cache::Priority priority, bool promote);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void AddHitCounts(Cache::Priority priority, uint64_t* hits, uint64_t* misses);
+  void AddInsertCount(uint64_t* inserts);
+
+ private:
+  ClockCache(const ClockCache&);
+  ClockCache& operator = (const ClockCache&);
+
+  ClockSlot* SlotFor(uint32_t hash, uint32_t probe) const {
+    return &slots_[(hash + probe) & mask_];
+  }
+  // True if "e" is in the protected segment of a scan-resistant cache
+  bool IsProtected(const ClockHandle* e) const {
+    return scan_resistant_ && !e->in_probation &&
+           (!tiered_ || e->priority == Cache::kLowPriority);
+  }
+  ClockSlot* FindLocked(const Slice& key, uint32_t hash);
+  ClockSlot* ClaimSlotLocked(uint32_t hash);
+  bool EvictOneLocked(int tier, bool spare_protected);
+  void HideLocked(ClockSlot* slot);
+  void FreeLocked(ClockSlot* slot);
+  void Unref(ClockSlot* slot);
+
+  // Initialized before use.
+  size_t capacity_;
+  size_t high_pri_capacity_;
+  bool tiered_;
+  bool scan_resistant_;
+  size_t protected_capacity_;
+  ClockSlot* slots_;
+  uint32_t mask_;
+  uint32_t max_occupancy_;
+
+  // Lookups that found nothing, indexed by Cache::Priority
+  volatile uint64_t misses_[2];
+
+  // mutex_ protects the following state and every change of a slot's
+  // handle; references may be taken and dropped without it.
+  port::Mutex mutex_;
+  size_t usage_;
+  size_t high_pri_usage_;
+  size_t protected_usage_;
+  uint32_t occupancy_;
+  uint32_t clock_hand_;
+  uint64_t hits_[2];  // Hits on entries that have left the table
+  uint64_t inserts_;
+};
+
+// Lets ClockCache::EvictOneLocked() evict from either tier
+static const int kAnyTier = -1;
+
+ClockCache::ClockCache()
+    : capacity_(0),
+      high_pri_capacity_(0),
+      tiered_(false),
+      scan_resistant_(false),
+      protected_capacity_(0),
+      slots_(NULL),
+      mask_(0),
+      max_occupancy_(0),
+      mutex_(),
+      usage_(0),
+      high_pri_usage_(0),
+      protected_usage_(0),
+      occupancy_(0),
+      clock_hand_(0),
+      inserts_(0) {
+  for (int i = 0; i < 2; i++) {
+    misses_[i] = 0;
+    hits_[i] = 0;
+  }
+}
+
+ClockCache::~ClockCache() {
+  for (uint32_t i = 0; slots_ != NULL && i <= mask_; i++) {
+    ClockSlot* slot = &slots_[i];
+    if ((slot->meta & kStateMask) == kStateVisible) {
+      assert((slot->meta & kRefsMask) == 0);  // Error if caller has an unreleased handle
+      ClockHandle* e = slot->handle;
+      (*e->deleter)(e->key(), e->value);
+      free(e);
+    }
+  }
+  delete[] slots_;
+}
+
+void ClockCache::SetCapacity(size_t capacity, size_t estimated_entry_charge,
+                             double high_pri_pool_ratio, bool scan_resistant) {
+  capacity_ = capacity;
+  high_pri_capacity_ = static_cast<size_t>(capacity * high_pri_pool_ratio);
+  tiered_ = high_pri_pool_ratio > 0;
+  scan_resistant_ = scan_resistant;
+  protected_capacity_ = (capacity - high_pri_capacity_) / 5 * 4;
+  // Size the table for a 70% load when the cache is full of entries of
+  // the estimated charge.  Smaller entries are evicted for their slot
+  // once the table reaches max_occupancy_.
+  const size_t entries = capacity / std::max<size_t>(estimated_entry_charge, 1);
+  uint32_t length = 16;
+  while (length < entries * 10 / 7 && length < (1u << 28)) {
+    length *= 2;
+  }
+  slots_ = new ClockSlot[length];
+  memset(slots_, 0, sizeof(slots_[0]) * length);
+  mask_ = length - 1;
+  max_occupancy_ = length - length / 8;
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash,
+                                  Cache::Priority priority, bool promote) {
+  for (uint32_t probe = 0; probe <= mask_; probe++) {
+    ClockSlot* slot = SlotFor(hash, probe);
+    if ((atomic::load_64_acquire(&slot->meta) & kStateMask) == kStateVisible) {
+      // Pin the slot, then check that it still holds a matching entry
+      uint64_t meta = atomic::increment_64_fullbarrier(&slot->meta, 1);
+      if ((meta & kStateMask) == kStateVisible) {
+        ClockHandle* e = slot->handle;
+        if (e->hash == hash && key == e->key()) {
+          if (promote && atomic::load_32_nobarrier(&slot->clock) != kMaxClock) {
+            atomic::store_32_nobarrier(&slot->clock, kMaxClock);
+          }
+          if (promote && atomic::load_32_nobarrier(&slot->referenced) == 0) {
+            atomic::store_32_nobarrier(&slot->referenced, 1);
+          }
+          // Concurrent hits on one entry may lose counts; they are only
+          // statistics
+          atomic::store_32_nobarrier(&slot->hits, slot->hits + 1);
+          return reinterpret_cast<Cache::Handle*>(e);
+        }
+      }
+      Unref(slot);
+    }
+    if (atomic::load_32_nobarrier(&slot->displacements) == 0) {
+      break;
+    }
+  }
+  atomic::increment_64_nobarrier(&misses_[priority], 1);
+  return NULL;
+}
+
+void ClockCache::AddHitCounts(Cache::Priority priority,
+                              uint64_t* hits, uint64_t* misses) {
+  MutexLock l(&mutex_);
+  *hits += hits_[priority];
+  for (uint32_t i = 0; i <= mask_; i++) {
+    ClockSlot* slot = &slots_[i];
+    const uint64_t state = atomic::load_64_acquire(&slot->meta) & kStateMask;
+    // Entries in these states are only freed with the mutex held
+    if ((state == kStateVisible || state == kStateInvisible) &&
+        slot->handle->priority == priority) {
+      *hits += atomic::load_32_nobarrier(&slot->hits);
+    }
+  }
+  *misses += atomic::load_64_nobarrier(&misses_[priority]);
+}
+
+void ClockCache::AddInsertCount(uint64_t* inserts) {
+  MutexLock l(&mutex_);
+  *inserts += inserts_;
+}
+
+void ClockCache::Release(Cache::Handle* handle) {
+  ClockHandle* e = reinterpret_cast<ClockHandle*>(handle);
+  if (e->slot == NULL) {
+    (*e->deleter)(e->key(), e->value);
+    free(e);
+  } else {
+    Unref(e->slot);
+  }
+}
+
+void ClockCache::Unref(ClockSlot* slot) {
+  uint64_t meta = atomic::increment_64_fullbarrier(&slot->meta, -1);
+  if (meta == kStateInvisible) {
+    // Last reference to an erased entry; free it unless another thread
+    // gets there first
+    MutexLock l(&mutex_);
+    if (atomic::compare_and_swap_64_acquire(&slot->meta, kStateInvisible,
+                                            kStateConstruction) == kStateInvisible) {
+      FreeLocked(slot);
+    }
+  }
+}
+
+Cache::Handle* ClockCache::Insert(
+    const Slice& key, uint32_t hash, void* value, size_t charge,
+    void (*deleter)(const Slice& key, void* value),
+    Cache::Priority priority) {
+  ClockHandle* e = reinterpret_cast<ClockHandle*>(
+      malloc(sizeof(ClockHandle)-1 + key.size()));
+  e->value = value;
+  e->deleter = deleter;
+  e->slot = NULL;
+  e->charge = charge;
+  e->key_length = key.size();
+  e->hash = hash;
+  e->priority = priority;
+  e->in_probation = scan_resistant_ &&
+                    (!tiered_ || priority == Cache::kLowPriority);
+  memcpy(e->key_data, key.data(), key.size());
+
+  MutexLock l(&mutex_);
+  inserts_++;
+  ClockSlot* old = FindLocked(key, hash);
+  if (old != NULL) {
+    HideLocked(old);
+  }
+
+  while (usage_ + charge > capacity_ || occupancy_ >= max_occupancy_) {
+    // Take from the tier that is over its share of the capacity
+    int tier = kAnyTier;
+    if (tiered_) {
+      tier = (high_pri_usage_ > high_pri_capacity_) ?
+          Cache::kHighPriority : Cache::kLowPriority;
+    }
+    if (!EvictOneLocked(tier, true) && !EvictOneLocked(kAnyTier, true) &&
+        !(scan_resistant_ && EvictOneLocked(kAnyTier, false))) {
+      // Everything is pinned; hand out an entry that is freed on release
+      return reinterpret_cast<Cache::Handle*>(e);
+    }
+  }
+
+  ClockSlot* slot = ClaimSlotLocked(hash);
+  if (slot == NULL) {
+    return reinterpret_cast<Cache::Handle*>(e);
+  }
+  e->slot = slot;
+  slot->handle = e;
+  atomic::store_32_nobarrier(&slot->clock, kInitialClock);
+  atomic::store_32_nobarrier(&slot->hits, 0);
+  atomic::store_32_nobarrier(&slot->referenced, 0);
+  usage_ += charge;
+  if (e->priority == Cache::kHighPriority) {
+    high_pri_usage_ += charge;
+  }
+  occupancy_++;
+  // Publish the entry with one reference for the returned handle,
+  // keeping any transient references taken by readers meanwhile
+  atomic::increment_64_fullbarrier(&slot->meta,
+                                   (kStateVisible - kStateConstruction) + 1);
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  ClockSlot* slot = FindLocked(key, hash);
+  if (slot != NULL) {
+    HideLocked(slot);
+  }
+}
+
+// Return the slot holding a visible entry for "key", or NULL.
+// REQUIRES: mutex_ held
+ClockSlot* ClockCache::FindLocked(const Slice& key, uint32_t hash) {
+  for (uint32_t probe = 0; probe <= mask_; probe++) {
+    ClockSlot* slot = SlotFor(hash, probe);
+    // Visible entries cannot be freed while we hold the mutex
+    if ((atomic::load_64_acquire(&slot->meta) & kStateMask) == kStateVisible &&
+        slot->handle->hash == hash && key == slot->handle->key()) {
+      return slot;
+    }
+    if (slot->displacements == 0) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+// Reserve an empty slot on the probe sequence of "hash" and mark it as
+// under construction, or return NULL if the table is full.
+// REQUIRES: mutex_ held
+ClockSlot* ClockCache::ClaimSlotLocked(uint32_t hash) {
+  for (uint32_t probe = 0; probe <= mask_; probe++) {
+    ClockSlot* slot = SlotFor(hash, probe);
+    if (atomic::compare_and_swap_64_acquire(&slot->meta, kStateEmpty,
+                                            kStateConstruction) == kStateEmpty) {
+      // Record that this entry was displaced past the earlier slots
+      for (uint32_t i = 0; i < probe; i++) {
+        ClockSlot* passed = SlotFor(hash, i);
+        atomic::store_32_release(&passed->displacements, passed->displacements + 1);
+      }
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+// Remove the entry in "slot" from the cache.  It is freed now if it is
+// not pinned, else by the release of its last reference.
+// REQUIRES: mutex_ held
+void ClockCache::HideLocked(ClockSlot* slot) {
+  uint64_t meta = atomic::increment_64_fullbarrier(
+      &slot->meta, kStateInvisible - kStateVisible);
+  if (meta == kStateInvisible &&
+      atomic::compare_and_swap_64_acquire(&slot->meta, kStateInvisible,
+                                          kStateConstruction) == kStateInvisible) {
+    FreeLocked(slot);
+  }
+}
+
+// Advance the clock hand until an unpinned entry of "tier" (a
+// Cache::Priority or kAnyTier) whose count has run out is evicted.
+// Returns false if there is none.
+//
+// In a scan-resistant cache the hand also moves referenced entries out of
+// probation.  If "spare_protected", protected entries are left alone
+// while their segment is within its capacity, and once over it they are
+// aged and demoted to probation rather than evicted.
+// REQUIRES: mutex_ held
+bool ClockCache::EvictOneLocked(int tier, bool spare_protected) {
+  const uint32_t max_steps = (mask_ + 1) * (kMaxClock + 2);
+  for (uint32_t step = 0; step < max_steps; step++) {
+    ClockSlot* slot = &slots_[clock_hand_++ & mask_];
+    if (atomic::load_64_acquire(&slot->meta) != kStateVisible) {
+      continue;  // Empty, pinned or already leaving the cache
+    }
+    ClockHandle* e = slot->handle;
+    if (tier != kAnyTier && e->priority != tier) {
+      continue;
+    }
+    if (atomic::load_32_nobarrier(&slot->referenced)) {
+      atomic::store_32_nobarrier(&slot->referenced, 0);
+      if (e->in_probation) {
+        e->in_probation = false;
+        protected_usage_ += e->charge;
+      }
+    }
+    const bool spare = spare_protected && IsProtected(e);
+    if (spare && protected_usage_ <= protected_capacity_) {
+      continue;
+    }
+    uint32_t clock = atomic::load_32_nobarrier(&slot->clock);
+    if (clock > 0) {
+      atomic::store_32_nobarrier(&slot->clock, clock - 1);
+    } else if (spare) {
+      e->in_probation = true;
+      protected_usage_ -= e->charge;
+    } else if (atomic::compare_and_swap_64_acquire(&slot->meta, kStateVisible,
+                                                   kStateConstruction) == kStateVisible) {
+      FreeLocked(slot);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Free the entry of a slot in the construction state and empty the slot.
+// REQUIRES: mutex_ held
+void ClockCache::FreeLocked(ClockSlot* slot) {
+  ClockHandle* e = slot->handle;
+  const uint32_t index = slot - slots_;
+  for (uint32_t probe = 0; ((e->hash + probe) & mask_) != index; probe++) {
+    ClockSlot* passed = SlotFor(e->hash, probe);
+    atomic::store_32_release(&passed->displacements, passed->displacements - 1);
+  }
+  usage_ -= e->charge;
+  if (e->priority == Cache::kHighPriority) {
+    high_pri_usage_ -= e->charge;
+  }
+  if (IsProtected(e)) {
+    protected_usage_ -= e->charge;
+  }
+  occupancy_--;
+  hits_[e->priority] += atomic::load_32_nobarrier(&slot->hits);
+  slot->handle = NULL;
+  // Readers may hold transient references; they drop them on seeing the
+  // empty state
+  atomic::increment_64_fullbarrier(&slot->meta, kStateEmpty - kStateConstruction);
+  (*e->deleter)(e->key(), e->value);
+  free(e);
+}
+
+class ShardedClockCache : public Cache {
+ private:
+  ClockCache shard_[kNumShards];
+  volatile uint64_t last_id_;
+
+  static inline uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  static uint32_t Shard(uint32_t hash) {
+    return hash >> (32 - kNumShardBits);
+  }
+
+ public:
+  ShardedClockCache(size_t capacity, size_t estimated_entry_charge,
+                    double high_pri_pool_ratio, bool scan_resistant)
+      : last_id_(0) {
+    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+    for (unsigned s = 0; s < kNumShards; s++) {
+      shard_[s].SetCapacity(per_shard, estimated_entry_charge,
+                            high_pri_pool_ratio, scan_resistant);
+    }
+  }
+  virtual ~ShardedClockCache() { }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value)) {
+    return Insert(key, value, charge, deleter, kLowPriority);
+  }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
+  }
+  virtual Handle* Lookup(const Slice& key) {
+    return Lookup(key, kLowPriority);
+  }
+  virtual Handle* Lookup(const Slice& key, Priority priority) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Lookup(key, hash, priority, true);
+  }
+  virtual Handle* Peek(const Slice& key, Priority priority) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Lookup(key, hash, priority, false);
+  }
+  virtual bool GetHitCounts(Priority priority,
+                            uint64_t* hits, uint64_t* misses) {
+    *hits = 0;
+    *misses = 0;
+    for (unsigned s = 0; s < kNumShards; s++) {
+      shard_[s].AddHitCounts(priority, hits, misses);
+    }
+    return true;
+  }
+  virtual bool GetInsertCount(uint64_t* inserts) {
+    *inserts = 0;
+    for (unsigned s = 0; s < kNumShards; s++) {
+      shard_[s].AddInsertCount(inserts);
+    }
+    return true;
+  }
+  virtual void Release(Handle* handle) {
+    ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+    shard_[Shard(h->hash)].Release(handle);
+  }
+  virtual void Erase(const Slice& key) {
+    const uint32_t hash = HashSlice(key);
+    shard_[Shard(hash)].Erase(key, hash);
+  }
+  virtual void* Value(Handle* handle) {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+  virtual uint64_t NewId() {
+    return atomic::increment_64_fullbarrier(&last_id_, 1);
+  }
+};
+
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) {
-  return new ShardedLRUCache(capacity);
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio,
+                   bool scan_resistant) {
+  return new ShardedLRUCache(capacity, high_pri_pool_ratio, scan_resistant);
+}
+
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge,
+                     double high_pri_pool_ratio, bool scan_resistant) {
+  return new ShardedClockCache(capacity, estimated_entry_charge,
+                               high_pri_pool_ratio, scan_resistant);
 }
 
 }  // namespace leveldb
@@ -5,7 +5,10 @@
 #include "pebblesdb/cache.h"
 
 #include <vector>
+#include "port/port.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -64,6 +67,7 @@ class CacheTest {
   }
 };
 CacheTest* CacheTest::current_;
+const int CacheTest::kCacheSize;
 
 TEST(CacheTest, HitAndMiss) {
   ASSERT_EQ(-1, Lookup(100));
@@ -179,6 +183,355 @@ TEST(CacheTest, NewId) {
   ASSERT_NE(a, b);
 }
 
+class ClockCacheTest : public CacheTest {
+ public:
+  ClockCacheTest() {
+    delete cache_;
+    cache_ = NewClockCache(kCacheSize, 1);
+  }
+};
+
+TEST(ClockCacheTest, ClockHitMissAndErase) {
+  ASSERT_EQ(-1, Lookup(100));
+  Insert(100, 101);
+  Insert(200, 201);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(-1,  Lookup(300));
+
+  Insert(100, 102);
+  ASSERT_EQ(102, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(-1,  Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(2, deleted_keys_.size());
+  ASSERT_EQ(102, deleted_values_[1]);
+}
+
+TEST(ClockCacheTest, ClockEntriesArePinned) {
+  Insert(100, 101);
+  Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+
+  Insert(100, 102);
+  Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  cache_->Release(h1);
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+
+  cache_->Release(h2);
+  ASSERT_EQ(2, deleted_keys_.size());
+  ASSERT_EQ(102, deleted_values_[1]);
+}
+
+TEST(ClockCacheTest, ClockEvictionPolicy) {
+  Insert(100, 101);
+  Insert(200, 201);
+
+  // Frequently used entry must be kept around
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    Insert(1000+i, 2000+i);
+    ASSERT_EQ(2000+i, Lookup(1000+i));
+    ASSERT_EQ(101, Lookup(100));
+  }
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+}
+
+TEST(ClockCacheTest, ClockHeavyEntries) {
+  const int kLight = 1;
+  const int kHeavy = 10;
+  int added = 0;
+  int index = 0;
+  while (added < 2*kCacheSize) {
+    const int weight = (index & 1) ? kLight : kHeavy;
+    Insert(index, 1000+index, weight);
+    added += weight;
+    index++;
+  }
+
+  int cached_weight = 0;
+  for (int i = 0; i < index; i++) {
+    const int weight = (i & 1 ? kLight : kHeavy);
+    int r = Lookup(i);
+    if (r >= 0) {
+      cached_weight += weight;
+      ASSERT_EQ(1000+i, r);
+    }
+  }
+  ASSERT_LE(cached_weight, kCacheSize);
+  ASSERT_GE(cached_weight, kCacheSize / 2);
+}
+
+TEST(ClockCacheTest, ClockMoreEntriesThanEstimated) {
+  // Entries far smaller than estimated are evicted for their slots
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 100);
+  for (int i = 0; i < kCacheSize; i++) {
+    Insert(i, 1000+i);
+    ASSERT_EQ(1000+i, Lookup(i));
+  }
+  ASSERT_GT(deleted_keys_.size(), 0u);
+  int cached = 0;
+  for (int i = 0; i < kCacheSize; i++) {
+    if (Lookup(i) >= 0) {
+      cached++;
+    }
+  }
+  ASSERT_EQ(cached + static_cast<int>(deleted_keys_.size()), kCacheSize);
+}
+
+TEST(ClockCacheTest, ClockZeroCapacity) {
+  delete cache_;
+  cache_ = NewClockCache(0, 1);
+  Cache::Handle* h = cache_->Insert(EncodeKey(100), EncodeValue(101), 1,
+                                    &CacheTest::Deleter);
+  ASSERT_EQ(101, DecodeValue(cache_->Value(h)));
+  ASSERT_EQ(-1, Lookup(100));
+  cache_->Release(h);
+  ASSERT_EQ(1, deleted_keys_.size());
+}
+
+TEST(ClockCacheTest, ClockNewId) {
+  uint64_t a = cache_->NewId();
+  uint64_t b = cache_->NewId();
+  ASSERT_NE(a, b);
+}
+
+// Fill "cache" (of capacity CacheTest::kCacheSize, a fifth of it reserved
+// for high priority entries) with a few high priority entries and a flood
+// of low priority ones, and check that the former survive.
+static void CheckPriorityTiers(Cache* cache) {
+  const int kHigh = CacheTest::kCacheSize / 10;
+  for (int i = 0; i < kHigh; i++) {
+    cache->Release(cache->Insert(EncodeKey(i), EncodeValue(i), 1,
+                                 &CacheTest::Deleter, Cache::kHighPriority));
+  }
+  for (int i = kHigh; i < 10 * CacheTest::kCacheSize; i++) {
+    cache->Release(cache->Insert(EncodeKey(i), EncodeValue(i), 1,
+                                 &CacheTest::Deleter, Cache::kLowPriority));
+    Cache::Handle* h = cache->Lookup(EncodeKey(i), Cache::kLowPriority);
+    ASSERT_TRUE(h != NULL);
+    cache->Release(h);
+  }
+  for (int i = 0; i < kHigh; i++) {
+    Cache::Handle* h = cache->Lookup(EncodeKey(i), Cache::kHighPriority);
+    ASSERT_TRUE(h != NULL);
+    ASSERT_EQ(i, DecodeValue(cache->Value(h)));
+    cache->Release(h);
+  }
+  ASSERT_TRUE(cache->Lookup(EncodeKey(kHigh), Cache::kLowPriority) == NULL);
+
+  uint64_t hits, misses;
+  ASSERT_TRUE(cache->GetHitCounts(Cache::kHighPriority, &hits, &misses));
+  ASSERT_EQ(hits, static_cast<uint64_t>(kHigh));
+  ASSERT_EQ(misses, 0u);
+  ASSERT_TRUE(cache->GetHitCounts(Cache::kLowPriority, &hits, &misses));
+  ASSERT_EQ(hits, static_cast<uint64_t>(10 * CacheTest::kCacheSize - kHigh));
+  ASSERT_EQ(misses, 1u);
+
+  // High priority entries beyond their share go first
+  for (int i = 0; i < CacheTest::kCacheSize; i++) {
+    cache->Release(cache->Insert(EncodeKey(100000 + i), EncodeValue(i), 1,
+                                 &CacheTest::Deleter, Cache::kHighPriority));
+  }
+  int high = 0;
+  for (int i = 0; i < CacheTest::kCacheSize; i++) {
+    Cache::Handle* h = cache->Lookup(EncodeKey(100000 + i));
+    if (h != NULL) {
+      high++;
+      cache->Release(h);
+    }
+  }
+  ASSERT_LE(high, CacheTest::kCacheSize / 4);
+}
+
+TEST(CacheTest, PriorityTiers) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.2);
+  CheckPriorityTiers(cache_);
+}
+
+TEST(ClockCacheTest, ClockPriorityTiers) {
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 1, 0.2);
+  CheckPriorityTiers(cache_);
+}
+
+// Check that a scan through "cache" (of capacity CacheTest::kCacheSize and
+// scan-resistant) leaves the entries that were looked up before it alone,
+// and that entries only peeked at are not promoted.
+static void CheckScanResistance(Cache* cache) {
+  const int kWorkingSet = CacheTest::kCacheSize / 2;
+  for (int i = 0; i < kWorkingSet; i++) {
+    cache->Release(cache->Insert(EncodeKey(i), EncodeValue(i), 1,
+                                 &CacheTest::Deleter));
+    cache->Release(cache->Lookup(EncodeKey(i)));
+  }
+  const int kPeeked = 100000;
+  cache->Release(cache->Insert(EncodeKey(kPeeked), EncodeValue(kPeeked), 1,
+                               &CacheTest::Deleter));
+  for (int i = 0; i < 3; i++) {
+    Cache::Handle* h = cache->Peek(EncodeKey(kPeeked), Cache::kLowPriority);
+    ASSERT_TRUE(h != NULL);
+    cache->Release(h);
+  }
+
+  // Every scanned entry is read exactly once
+  for (int i = 0; i < 10 * CacheTest::kCacheSize; i++) {
+    cache->Release(cache->Insert(EncodeKey(1000 + i), EncodeValue(i), 1,
+                                 &CacheTest::Deleter));
+  }
+
+  int found = 0;
+  for (int i = 0; i < kWorkingSet; i++) {
+    Cache::Handle* h = cache->Lookup(EncodeKey(i));
+    if (h != NULL) {
+      ASSERT_EQ(i, DecodeValue(cache->Value(h)));
+      found++;
+      cache->Release(h);
+    }
+  }
+  ASSERT_GE(found, kWorkingSet * 9 / 10);
+  ASSERT_TRUE(cache->Lookup(EncodeKey(kPeeked)) == NULL);
+}
+
+TEST(CacheTest, ScanResistance) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0, true);
+  CheckScanResistance(cache_);
+}
+
+TEST(ClockCacheTest, ClockScanResistance) {
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 1, 0, true);
+  CheckScanResistance(cache_);
+}
+
+// Concurrent lookups of cached entries, as on the read path of a DB whose
+// working set fits in the block cache
+namespace {
+
+static const int kBenchKeys = 4096;
+
+struct LookupState {
+  Cache* cache;
+  int lookups;
+  bool update;  // Also insert and erase entries
+  port::Mutex mu;
+  port::CondVar cv;
+  int remaining;
+  bool ok;
+
+  LookupState() : cv(&mu) { }
+};
+
+struct LookupThread {
+  LookupState* state;
+  int id;
+};
+
+static void NoopDeleter(const Slice& key, void* v) {
+}
+
+static void LookupLoop(void* arg) {
+  LookupThread* t = reinterpret_cast<LookupThread*>(arg);
+  LookupState* state = t->state;
+  Random rnd(301 + t->id);
+  bool ok = true;
+  for (int i = 0; i < state->lookups; i++) {
+    const int k = rnd.Uniform(kBenchKeys);
+    if (state->update && rnd.OneIn(4)) {
+      state->cache->Release(state->cache->Insert(EncodeKey(k), EncodeValue(k),
+                                                 1, &NoopDeleter));
+    } else if (state->update && rnd.OneIn(8)) {
+      state->cache->Erase(EncodeKey(k));
+    }
+    Cache::Handle* h = state->cache->Lookup(EncodeKey(k));
+    if ((h == NULL && !state->update) ||
+        (h != NULL && DecodeValue(state->cache->Value(h)) != k)) {
+      ok = false;
+    }
+    if (h != NULL) {
+      state->cache->Release(h);
+    }
+  }
+  MutexLock l(&state->mu);
+  state->ok = state->ok && ok;
+  state->remaining--;
+  state->cv.SignalAll();
+}
+
+static double RunLookups(Cache* cache, int threads, int lookups_per_thread,
+                         bool update, bool* ok) {
+  LookupState state;
+  state.cache = cache;
+  state.lookups = lookups_per_thread;
+  state.update = update;
+  state.remaining = threads;
+  state.ok = true;
+  std::vector<LookupThread> args(threads);
+  Env* env = Env::Default();
+  const uint64_t start = env->NowMicros();
+  for (int i = 0; i < threads; i++) {
+    args[i].state = &state;
+    args[i].id = i;
+    env->StartThread(&LookupLoop, &args[i]);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.remaining > 0) {
+      state.cv.Wait();
+    }
+  }
+  const uint64_t micros = std::max<uint64_t>(env->NowMicros() - start, 1);
+  *ok = state.ok;
+  return static_cast<double>(threads) * lookups_per_thread / micros;
+}
+
+}  // namespace
+
+TEST(CacheTest, ConcurrentLookups) {
+  const int kLookups = 200000;
+  const int kThreads[] = { 1, 2, 4, 8, 16 };
+  for (int c = 0; c < 2; c++) {
+    Cache* cache = (c == 0) ? NewLRUCache(kBenchKeys * 2)
+                            : NewClockCache(kBenchKeys * 2, 1);
+    for (int k = 0; k < kBenchKeys; k++) {
+      cache->Release(cache->Insert(EncodeKey(k), EncodeValue(k), 1,
+                                   &NoopDeleter));
+    }
+    for (size_t t = 0; t < sizeof(kThreads) / sizeof(kThreads[0]); t++) {
+      bool ok = false;
+      double mops = RunLookups(cache, kThreads[t], kLookups, false, &ok);
+      ASSERT_TRUE(ok);
+      fprintf(stderr, "%-5s cache, %2d threads: %7.2f M lookups/s\n",
+              (c == 0) ? "lru" : "clock", kThreads[t], mops);
+    }
+    delete cache;
+  }
+}
+
+TEST(ClockCacheTest, ClockConcurrentUpdates) {
+  // Lookups racing with inserts, erases and evictions only ever see the
+  // value inserted for their key
+  delete cache_;
+  cache_ = NewClockCache(kBenchKeys / 4, 1);
+  bool ok = false;
+  RunLookups(cache_, 8, 100000, true, &ok);
+  ASSERT_TRUE(ok);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
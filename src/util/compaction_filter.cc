@@ -0,0 +1,54 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "pebblesdb/compaction_filter.h"
+
+#include "pebblesdb/env.h"
+#include "pebblesdb/slice.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+CompactionFilter::~CompactionFilter() { }
+
+namespace {
+
+class TTLCompactionFilter : public CompactionFilter {
+ private:
+  const uint64_t ttl_seconds_;
+  Env* const env_;
+
+ public:
+  TTLCompactionFilter(uint64_t ttl_seconds, Env* env)
+      : ttl_seconds_(ttl_seconds),
+        env_(env) {
+  }
+
+  virtual const char* Name() const {
+    return "leveldb.TTLCompactionFilter";
+  }
+
+  virtual Decision Filter(int level, const Slice& key, const Slice& value,
+                          std::string* new_value) const {
+    if (value.size() < 8) {
+      return kKeep;
+    }
+    const uint64_t written = DecodeFixed64(value.data() + value.size() - 8);
+    const uint64_t now = env_->NowMicros() / 1000000;
+    return (now >= written && now - written > ttl_seconds_) ? kRemove : kKeep;
+  }
+};
+
+}  // namespace
+
+const CompactionFilter* NewTTLCompactionFilter(uint64_t ttl_seconds,
+                                               Env* env) {
+  return new TTLCompactionFilter(ttl_seconds, env);
+}
+
+void AppendTTLTimestamp(std::string* value, uint64_t unix_seconds) {
+  PutFixed64(value, unix_seconds);
+}
+
+}  // namespace leveldb
@@ -15,6 +15,9 @@ SequentialFile::~SequentialFile() {
 RandomAccessFile::~RandomAccessFile() {
 }
 
+void RandomAccessFile::Prefetch(uint64_t /*offset*/, size_t /*n*/) const {
+}
+
 WritableFile::~WritableFile() {
 }
 
@@ -92,6 +92,12 @@ class PosixRandomAccessFile: public RandomAccessFile {
     }
     return s;
   }
+
+  virtual void Prefetch(uint64_t offset, size_t n) const {
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd_, static_cast<off_t>(offset), n, POSIX_FADV_WILLNEED);
+#endif
+  }
 };
 
 // Helper class to limit mmap file usage so that we do not end up
@@ -179,6 +185,20 @@ class PosixMmapReadableFile: public RandomAccessFile {
     }
     return s;
   }
+
+  virtual void Prefetch(uint64_t offset, size_t n) const {
+    if (offset >= length_) {
+      return;
+    }
+    if (n > length_ - offset) {
+      n = length_ - offset;
+    }
+    // madvise() wants a page-aligned start
+    const uint64_t page_size = static_cast<uint64_t>(getpagesize());
+    const uint64_t start = offset - offset % page_size;
+    madvise(reinterpret_cast<char*>(mmapped_region_) + start,
+            n + (offset - start), MADV_WILLNEED);
+  }
 };
 
 class PosixWritableFile : public WritableFile {
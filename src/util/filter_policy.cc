@@ -4,8 +4,22 @@
 
 #include "pebblesdb/filter_policy.h"
 
+#include "pebblesdb/slice.h"
+
 namespace leveldb {
 
 FilterPolicy::~FilterPolicy() { }
 
+void FilterPolicy::KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                                bool* results) const {
+  for (int i = 0; i < n; i++) {
+    results[i] = KeyMayMatch(keys[i], filter);
+  }
+}
+
+bool FilterPolicy::RangeMayMatch(const Slice& start, const Slice& limit,
+                                 const Slice& filter) const {
+  return true;
+}
+
 }  // namespace leveldb
@@ -19,10 +19,26 @@ Options::Options()
       write_buffer_size(4<<20),
       max_open_files(1000),
       block_cache(NULL),
+      cache_index_and_filter_blocks(false),
+      compressed_block_cache(NULL),
+      persistent_cache(NULL),
+      row_cache(NULL),
       block_size(4096),
       block_restart_interval(16),
+      compaction_readahead_size(2 << 20),
+      level0_sentinel_compaction_trigger(2),
+      level0_guard_compaction_trigger(2),
+      max_files_per_guard(),
+      tombstone_compaction_ratio(0.5),
       compression(kNoCompression),
       filter_policy(NULL),
+      level_filter_policies(),
+      prefix_extractor(NULL),
+      merge_operator(NULL),
+      compaction_filter(NULL),
+      value_log_threshold(0),
+      value_log_file_size(64 << 20),
+      value_log_gc_ratio(0.5),
       manual_garbage_collection(false) {
 }
 
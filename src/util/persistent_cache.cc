@@ -0,0 +1,356 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "pebblesdb/persistent_cache.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "pebblesdb/env.h"
+#include "pebblesdb/slice.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+PersistentCache::~PersistentCache() {
+}
+
+namespace {
+
+// The cache is a sequence of numbered log files in one directory, each a
+// sequence of records:
+//    checksum: uint32   // masked crc32c of the key and data
+//    key size: uint32
+//    data size: uint32
+//    key: uint8[key size]
+//    data: uint8[data size]
+// Each open starts a new log file; older ones are only read.  An
+// in-memory index maps every key to the location of its record, and is
+// rebuilt from the record headers when the cache is opened.
+static const size_t kHeaderSize = 12;
+
+struct LogFile {
+  uint64_t number;
+  RandomAccessFile* file;
+  uint64_t size;
+  int refs;       // One for the cache, one per lookup reading the file
+  bool dropped;   // Delete the file once the last reference is gone
+};
+
+class LogPersistentCache : public PersistentCache {
+ public:
+  LogPersistentCache(Env* env, const std::string& dir, uint64_t capacity)
+      : env_(env),
+        dir_(dir),
+        capacity_(capacity),
+        file_size_(std::max<uint64_t>(capacity / 4, 4096)),
+        next_number_(1),
+        writer_(NULL),
+        current_(NULL),
+        usage_(0),
+        failed_(false) {
+  }
+
+  virtual ~LogPersistentCache() {
+    delete writer_;
+    for (size_t i = 0; i < files_.size(); i++) {
+      Unref(files_[i]);
+    }
+  }
+
+  Status Recover();
+
+  virtual void Insert(const Slice& key, const Slice& data);
+  virtual bool Lookup(const Slice& key, std::string* data);
+
+ private:
+  struct Location {
+    LogFile* file;
+    uint64_t offset;
+    uint32_t size;  // Of the whole record
+  };
+  typedef std::map<std::string, Location> Index;
+
+  std::string LogFileName(uint64_t number) const {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "/%06llu.pcache",
+             static_cast<unsigned long long>(number));
+    return dir_ + buf;
+  }
+
+  Status RecoverFile(uint64_t number);
+  Status NewLogFileLocked();
+  void DropOldestLocked();
+  void Unref(LogFile* f);
+
+  Env* const env_;
+  const std::string dir_;
+  const uint64_t capacity_;
+  const uint64_t file_size_;  // Size at which a new log file is started
+
+  // mutex_ protects the following state.
+  port::Mutex mutex_;
+  uint64_t next_number_;
+  WritableFile* writer_;      // Appends to current_; NULL until the first insert
+  LogFile* current_;
+  std::deque<LogFile*> files_;  // Oldest first
+  Index index_;
+  uint64_t usage_;
+  bool failed_;               // Writing failed; stop inserting
+};
+
+Status LogPersistentCache::Recover() {
+  env_->CreateDir(dir_);  // In case it does not exist
+  std::vector<std::string> children;
+  Status s = env_->GetChildren(dir_, &children);
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<uint64_t> numbers;
+  for (size_t i = 0; i < children.size(); i++) {
+    Slice name(children[i]);
+    uint64_t number;
+    if (ConsumeDecimalNumber(&name, &number) && name == ".pcache") {
+      numbers.push_back(number);
+    }
+  }
+  std::sort(numbers.begin(), numbers.end());
+  for (size_t i = 0; i < numbers.size() && s.ok(); i++) {
+    s = RecoverFile(numbers[i]);
+    next_number_ = numbers[i] + 1;
+  }
+  MutexLock l(&mutex_);
+  while (usage_ > capacity_ && !files_.empty()) {
+    DropOldestLocked();
+  }
+  return s;
+}
+
+// Index the records of one log file.  Records that were not completely
+// written are ignored, along with anything after them.
+Status LogPersistentCache::RecoverFile(uint64_t number) {
+  const std::string fname = LogFileName(number);
+  uint64_t size;
+  Status s = env_->GetFileSize(fname, &size);
+  if (s.ok() && size == 0) {
+    return env_->DeleteFile(fname);
+  }
+  RandomAccessFile* file = NULL;
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, &file);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  LogFile* f = new LogFile;
+  f->number = number;
+  f->file = file;
+  f->size = 0;
+  f->refs = 1;
+  f->dropped = false;
+
+  std::string key;
+  char header[kHeaderSize];
+  uint64_t offset = 0;
+  while (offset + kHeaderSize <= size) {
+    Slice input;
+    s = file->Read(offset, kHeaderSize, &input, header);
+    if (!s.ok() || input.size() != kHeaderSize) {
+      break;
+    }
+    const uint32_t key_size = DecodeFixed32(input.data() + 4);
+    const uint32_t data_size = DecodeFixed32(input.data() + 8);
+    const uint64_t record_size = kHeaderSize + key_size + data_size;
+    if (offset + record_size > size) {
+      break;
+    }
+    key.resize(key_size);
+    s = file->Read(offset + kHeaderSize, key_size, &input, &key[0]);
+    if (!s.ok() || input.size() != key_size) {
+      break;
+    }
+    Location loc;
+    loc.file = f;
+    loc.offset = offset;
+    loc.size = record_size;
+    index_[input.ToString()] = loc;
+    offset += record_size;
+  }
+  f->size = offset;
+  usage_ += offset;
+  files_.push_back(f);
+  return Status::OK();
+}
+
+Status LogPersistentCache::NewLogFileLocked() {
+  delete writer_;
+  writer_ = NULL;
+  current_ = NULL;
+  const uint64_t number = next_number_++;
+  const std::string fname = LogFileName(number);
+  WritableFile* writer;
+  Status s = env_->NewWritableFile(fname, &writer);
+  RandomAccessFile* file = NULL;
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, &file);
+    if (!s.ok()) {
+      delete writer;
+    }
+  }
+  if (s.ok()) {
+    LogFile* f = new LogFile;
+    f->number = number;
+    f->file = file;
+    f->size = 0;
+    f->refs = 1;
+    f->dropped = false;
+    files_.push_back(f);
+    writer_ = writer;
+    current_ = f;
+  }
+  return s;
+}
+
+// Drop the oldest log file and every entry stored in it.
+// REQUIRES: mutex_ held
+void LogPersistentCache::DropOldestLocked() {
+  LogFile* f = files_.front();
+  files_.pop_front();
+  for (Index::iterator it = index_.begin(); it != index_.end(); ) {
+    if (it->second.file == f) {
+      index_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  if (f == current_) {
+    delete writer_;
+    writer_ = NULL;
+    current_ = NULL;
+  }
+  usage_ -= f->size;
+  f->dropped = true;
+  Unref(f);
+}
+
+// REQUIRES: mutex_ held
+void LogPersistentCache::Unref(LogFile* f) {
+  assert(f->refs > 0);
+  if (--f->refs == 0) {
+    delete f->file;
+    if (f->dropped) {
+      env_->DeleteFile(LogFileName(f->number));
+    }
+    delete f;
+  }
+}
+
+void LogPersistentCache::Insert(const Slice& key, const Slice& data) {
+  std::string record;
+  record.resize(4);
+  PutFixed32(&record, key.size());
+  PutFixed32(&record, data.size());
+  record.append(key.data(), key.size());
+  record.append(data.data(), data.size());
+  const uint32_t crc = crc32c::Value(record.data() + kHeaderSize,
+                                     record.size() - kHeaderSize);
+  EncodeFixed32(&record[0], crc32c::Mask(crc));
+
+  MutexLock l(&mutex_);
+  if (failed_ || index_.find(key.ToString()) != index_.end()) {
+    return;
+  }
+  if (writer_ == NULL || current_->size >= file_size_) {
+    if (!NewLogFileLocked().ok()) {
+      failed_ = true;
+      return;
+    }
+  }
+  Status s = writer_->Append(record);
+  if (s.ok()) {
+    // Lookups read through a separate file, so the record must reach it
+    s = writer_->Flush();
+  }
+  if (!s.ok()) {
+    failed_ = true;
+    return;
+  }
+  Location loc;
+  loc.file = current_;
+  loc.offset = current_->size;
+  loc.size = record.size();
+  index_[key.ToString()] = loc;
+  current_->size += record.size();
+  usage_ += record.size();
+  while (usage_ > capacity_ && files_.size() > 1) {
+    DropOldestLocked();
+  }
+}
+
+bool LogPersistentCache::Lookup(const Slice& key, std::string* data) {
+  Location loc;
+  {
+    MutexLock l(&mutex_);
+    Index::iterator it = index_.find(key.ToString());
+    if (it == index_.end()) {
+      return false;
+    }
+    loc = it->second;
+    loc.file->refs++;
+  }
+
+  std::string record;
+  record.resize(loc.size);
+  Slice input;
+  Status s = loc.file->file->Read(loc.offset, loc.size, &input, &record[0]);
+  bool ok = s.ok() && input.size() == loc.size;
+  if (ok) {
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(input.data()));
+    const uint32_t key_size = DecodeFixed32(input.data() + 4);
+    ok = crc == crc32c::Value(input.data() + kHeaderSize,
+                              input.size() - kHeaderSize) &&
+         Slice(input.data() + kHeaderSize, key_size) == key;
+    if (ok) {
+      data->assign(input.data() + kHeaderSize + key_size,
+                   input.size() - kHeaderSize - key_size);
+    }
+  }
+
+  MutexLock l(&mutex_);
+  if (!ok) {
+    // Let a later Insert() replace the damaged record
+    Index::iterator it = index_.find(key.ToString());
+    if (it != index_.end() && it->second.file == loc.file &&
+        it->second.offset == loc.offset) {
+      index_.erase(it);
+    }
+  }
+  Unref(loc.file);
+  return ok;
+}
+
+}  // namespace
+
+Status NewPersistentCache(Env* env, const std::string& dir,
+                          uint64_t capacity, PersistentCache** result) {
+  *result = NULL;
+  LogPersistentCache* cache = new LogPersistentCache(env, dir, capacity);
+  Status s = cache->Recover();
+  if (!s.ok()) {
+    delete cache;
+    return s;
+  }
+  *result = cache;
+  return s;
+}
+
+}  // namespace leveldb
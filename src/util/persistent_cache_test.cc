@@ -0,0 +1,173 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "pebblesdb/persistent_cache.h"
+
+#include <vector>
+#include "pebblesdb/env.h"
+#include "util/coding.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  std::string result;
+  PutFixed64(&result, i);
+  return result;
+}
+
+static std::string Value(int i, size_t size) {
+  return std::string(size, static_cast<char>('a' + i % 26));
+}
+
+static bool IsLogFile(const std::string& name) {
+  const std::string suffix = ".pcache";
+  return name.size() > suffix.size() &&
+         name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+class PersistentCacheTest {
+ public:
+  Env* env_;
+  std::string dir_;
+  PersistentCache* cache_;
+
+  PersistentCacheTest() : env_(Env::Default()), cache_(NULL) {
+    dir_ = test::TmpDir() + "/persistent_cache_test";
+    Destroy();
+  }
+
+  ~PersistentCacheTest() {
+    delete cache_;
+    Destroy();
+  }
+
+  void Destroy() {
+    std::vector<std::string> children;
+    env_->GetChildren(dir_, &children);
+    for (size_t i = 0; i < children.size(); i++) {
+      env_->DeleteFile(dir_ + "/" + children[i]);
+    }
+    env_->DeleteDir(dir_);
+  }
+
+  void Open(uint64_t capacity) {
+    delete cache_;
+    cache_ = NULL;
+    ASSERT_OK(NewPersistentCache(env_, dir_, capacity, &cache_));
+  }
+
+  std::string Lookup(int i) {
+    std::string data;
+    if (!cache_->Lookup(Key(i), &data)) {
+      return "NOT_FOUND";
+    }
+    return data;
+  }
+
+  int CountFiles() {
+    std::vector<std::string> children;
+    env_->GetChildren(dir_, &children);
+    int count = 0;
+    for (size_t i = 0; i < children.size(); i++) {
+      if (IsLogFile(children[i])) {
+        count++;
+      }
+    }
+    return count;
+  }
+};
+
+TEST(PersistentCacheTest, InsertAndLookup) {
+  Open(1 << 20);
+  ASSERT_EQ("NOT_FOUND", Lookup(1));
+  cache_->Insert(Key(1), Value(1, 100));
+  cache_->Insert(Key(2), Value(2, 4000));
+  ASSERT_EQ(Value(1, 100), Lookup(1));
+  ASSERT_EQ(Value(2, 4000), Lookup(2));
+  ASSERT_EQ("NOT_FOUND", Lookup(3));
+
+  // An existing entry is kept
+  cache_->Insert(Key(1), Value(5, 100));
+  ASSERT_EQ(Value(1, 100), Lookup(1));
+}
+
+TEST(PersistentCacheTest, SurvivesReopen) {
+  Open(1 << 20);
+  for (int i = 0; i < 100; i++) {
+    cache_->Insert(Key(i), Value(i, 1000));
+  }
+  Open(1 << 20);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(Value(i, 1000), Lookup(i));
+  }
+
+  // Entries added after reopening go to a new log file
+  cache_->Insert(Key(100), Value(100, 1000));
+  Open(1 << 20);
+  ASSERT_EQ(Value(0, 1000), Lookup(0));
+  ASSERT_EQ(Value(100, 1000), Lookup(100));
+  ASSERT_EQ(2, CountFiles());
+}
+
+TEST(PersistentCacheTest, DropsOldestFiles) {
+  const uint64_t kCapacity = 64 << 10;
+  Open(kCapacity);
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    cache_->Insert(Key(i), Value(i, 1000));
+  }
+  // The newest entries stay; the oldest went with their log files
+  ASSERT_EQ(Value(N - 1, 1000), Lookup(N - 1));
+  ASSERT_EQ("NOT_FOUND", Lookup(0));
+  int found = 0;
+  for (int i = 0; i < N; i++) {
+    if (Lookup(i) != "NOT_FOUND") {
+      found++;
+    }
+  }
+  ASSERT_LE(found * 1000u, kCapacity);
+  ASSERT_GE(found * 1000u, kCapacity / 2);
+  ASSERT_LE(CountFiles(), 5);
+
+  // A smaller capacity drops files on reopen
+  Open(kCapacity / 4);
+  ASSERT_EQ("NOT_FOUND", Lookup(N - found));
+  ASSERT_EQ(Value(N - 1, 1000), Lookup(N - 1));
+}
+
+TEST(PersistentCacheTest, IgnoresTornRecords) {
+  Open(1 << 20);
+  cache_->Insert(Key(1), Value(1, 100));
+  cache_->Insert(Key(2), Value(2, 100));
+  delete cache_;
+  cache_ = NULL;
+
+  // Cut the last record short, as a crash in the middle of a write would
+  std::vector<std::string> children;
+  ASSERT_OK(env_->GetChildren(dir_, &children));
+  std::string fname;
+  for (size_t i = 0; i < children.size(); i++) {
+    if (IsLogFile(children[i])) {
+      fname = dir_ + "/" + children[i];
+    }
+  }
+  ASSERT_TRUE(!fname.empty());
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env_, fname, &contents));
+  contents.resize(contents.size() - 10);
+  ASSERT_OK(WriteStringToFile(env_, contents, fname));
+
+  Open(1 << 20);
+  ASSERT_EQ(Value(1, 100), Lookup(1));
+  ASSERT_EQ("NOT_FOUND", Lookup(2));
+  cache_->Insert(Key(2), Value(2, 100));
+  ASSERT_EQ(Value(2, 100), Lookup(2));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
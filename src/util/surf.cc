@@ -64,6 +64,16 @@ class SuRFPolicy : public FilterPolicy {
 			return found;
 		}
 
+		virtual bool RangeMayMatch(const Slice& start, const Slice& limit,
+					const Slice& filter) const override {
+			char* data = const_cast<char*>(filter.data());
+			surf::SuRF* filter_surf = surf::SuRF::deSerialize(data);
+			bool found = filter_surf->lookupRange(std::string(start.data(), start.size()), true,
+						std::string(limit.data(), limit.size()), false);
+			delete filter_surf;
+			return found;
+		}
+
 	private:
 			surf::SuffixType suffix_type_;
 			surf::level_t suffix_len_;